@@ -0,0 +1,117 @@
+#include "MqttMailingService.h"
+#include <Arduino.h>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+/*
+    This example measures the publish path under sustained overload: sensors
+    sampled faster than the link can publish. The link is throttled with QoS
+    1 and an in-flight window of inFlightWindow messages, so the publish rate
+    is bounded by the acknowledgement latency of the broker.
+
+    With conflation (setConflation) a new sample replaces the pending one of
+    its topic: the memory stays bounded by the number of topics and the
+    published values stay fresh. Set useConflation to false to compare with
+    the plain mailbox, which fills up and drops (or holds back) samples while
+    the backlog delays the published values.
+
+    For each run it reports:
+    - the samples sent and the messages published, conflated and dropped
+    - the p50 and p99 age of the published values, from sendMeasurement to
+      the ESP MQTT client (upper bounds of the latency histogram buckets)
+    - the high-water mark of the message pool and the minimum free heap
+
+    test/bench/ConflationBenchmark runs this overload on the host, against
+    the in-process broker of the mocked MQTT client, with conflation and
+    with a plain and a deep mailbox.
+*/
+
+MqttMailingService mqttMailingService;
+
+// Configuration
+constexpr auto ssid = "ap-name";
+constexpr auto password = "ap-pass.";
+constexpr auto broker_uri = "mqtt://mqtt.yourserver.com:1883";
+constexpr bool useConflation = true;
+constexpr size_t inFlightWindow = 2;
+constexpr size_t deviceCount = 16;
+constexpr uint32_t samplesPerSecond = 1000;
+constexpr uint32_t runDurationMs = 10000;
+
+/**
+ * Sends samplesPerSecond measurements of deviceCount devices for
+ * runDurationMs and reports the metrics of the run
+ */
+void runOverload() {
+    const MqttMetrics before = mqttMailingService.getMetrics();
+    const auto normal = static_cast<size_t>(MessagePriority::NORMAL);
+    core::Measurement m{core::MetaData{core::SCD4X()},
+                        core::SignalType::CO2_PARTS_PER_MILLION,
+                        core::DataPoint{0, 400.0f}};
+    const uint32_t intervalUs = 1000000 / samplesPerSecond;
+    const int64_t start = esp_timer_get_time();
+    uint32_t samples = 0;
+    while (esp_timer_get_time() - start < runDurationMs * 1000LL) {
+        m.metaData.deviceID = samples % deviceCount;
+        m.dataPoint.t_offset = millis();
+        m.dataPoint.value = 400.0f + samples % 100;
+        mqttMailingService.sendMeasurement(m);
+        samples++;
+        const int64_t wait =
+            start + static_cast<int64_t>(samples) * intervalUs -
+            esp_timer_get_time();
+        if (wait > 0) {
+            delay(static_cast<uint32_t>((wait + 999) / 1000));
+        }
+    }
+
+    const MqttMetrics after = mqttMailingService.getMetrics();
+    // The histograms are cumulative, keep this run only
+    LatencyHistogram age = after.priorities[normal].latency;
+    for (size_t b = 0; b < LatencyHistogram::kBucketCount; ++b) {
+        age.counts[b] -= before.priorities[normal].latency.counts[b];
+    }
+    Serial.printf("%s: %u samples, %u published, %u conflated, %u dropped, "
+                  "%u pending\n",
+                  useConflation ? "Conflation" : "Mailbox",
+                  static_cast<unsigned>(samples),
+                  static_cast<unsigned>(after.priorities[normal].sent -
+                                        before.priorities[normal].sent),
+                  static_cast<unsigned>(after.conflation.conflated -
+                                        before.conflation.conflated),
+                  static_cast<unsigned>(after.mailbox.dropped -
+                                        before.mailbox.dropped),
+                  static_cast<unsigned>(after.conflation.pending));
+    Serial.printf("Age of the published values: p50 <= %u us, p99 <= %u us\n",
+                  static_cast<unsigned>(age.percentileUpperBoundUs(50)),
+                  static_cast<unsigned>(age.percentileUpperBoundUs(99)));
+    Serial.printf("Message pool high-water mark %u/%u blocks, minimum free "
+                  "heap %u bytes\n\n",
+                  static_cast<unsigned>(after.pool.highWaterMark),
+                  static_cast<unsigned>(after.pool.capacity),
+                  ESP.getMinFreeHeap());
+}
+
+void setup() {
+    Serial.begin(115200);
+    sleep(1);
+
+    mqttMailingService.setBrokerURI(broker_uri);
+    mqttMailingService.setGlobalTopicPrefix("benchmark/conflation/");
+    mqttMailingService.setQOS(1);
+    mqttMailingService.setInFlightWindow(inFlightWindow);
+    mqttMailingService.setMeasurementTemplate(
+        R"({"t":{t_offset},"v":{value:.1f}})");
+    mqttMailingService.setTopicSuffixTemplate("{deviceID}/{quantity}");
+    mqttMailingService.setConflation(useConflation);
+    mqttMailingService.startWithDelegatedWiFi(ssid, password, true);
+    Serial.println("MQTT Mailing Service started and connected !");
+}
+
+void loop() {
+    mqttMailingService.waitUntilConnected(30000);
+    runOverload();
+    // Let the backlog drain before the next run
+    delay(5000);
+}
@@ -0,0 +1,191 @@
+#include "MessageStore.h"
+#include "MqttMailingService.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+
+using namespace sensirion::upt::mqtt;
+
+/*
+    This example measures the whole publish path, from sendPayload through
+    the ESP MQTT client and the broker back to the device: it subscribes to
+    the topic it publishes to, so every message makes a round trip through
+    the broker. Use a broker close to the device (e.g. mosquitto on the
+    local network) to measure the library rather than the network.
+
+    Each scenario sends numbered messages carrying their send time and
+    reports, once all messages came back or none arrived for
+    drainTimeoutMs:
+    - the rate at which messages came back, in messages per second
+    - the p50 and p99 latency from sendPayload to the subscription callback
+    - the number of lost and duplicated messages
+
+    Scenarios:
+    - sustained: a steady rate below the capacity of the link
+    - burst: all messages sent back to back, limited by the mailbox
+    - reconnect storm: a steady rate while the Wi-Fi is dropped every few
+      seconds, the messages are held in the store until reconnected
+
+    Broker stalls can be observed by pausing the broker during a scenario,
+    e.g. with kill -STOP on the machine running mosquitto.
+
+    test/bench/EndToEndBenchmark runs these scenarios and a broker stall on
+    the host, against the in-process broker of the mocked MQTT client.
+*/
+
+MqttMailingService mqttMailingService;
+RamMessageStore messageStore{64};
+
+// Configuration
+constexpr auto ssid = "ap-name";
+constexpr auto password = "ap-pass.";
+constexpr auto broker_uri = "mqtt://mqtt.yourserver.com:1883";
+constexpr auto topicPrefix = "benchmark/e2e/";
+constexpr auto topicSuffix = "load";
+constexpr auto loadTopic = "benchmark/e2e/load";
+constexpr uint32_t drainTimeoutMs = 10000;
+constexpr size_t maxMessages = 1000;
+
+struct Scenario {
+    const char* name;
+    size_t messages;
+    // Time between two messages, 0 to send them back to back
+    uint32_t intervalUs;
+    // Time between two Wi-Fi drops, 0 to keep the connection
+    uint32_t disconnectEveryMs;
+};
+
+constexpr Scenario scenarios[] = {
+    {"sustained 50 msg/s", 500, 20000, 0},
+    {"burst", maxMessages, 0, 0},
+    {"reconnect storm", 600, 25000, 3000},
+};
+
+// Written by the receiver task, read once a scenario is drained
+std::atomic<uint32_t> currentRun{0};
+std::atomic<uint32_t> receivedCount{0};
+std::atomic<uint32_t> duplicateCount{0};
+std::atomic<int64_t> lastReceiveUs{0};
+std::bitset<maxMessages> received;
+uint32_t latenciesUs[maxMessages];
+
+/**
+ * Subscription callback, the payload is "<run>,<sequence>,<send time us>"
+ */
+void onLoadMessage([[maybe_unused]] std::string_view topic,
+                   std::string_view payload) {
+    char text[48];
+    const size_t length = std::min(payload.size(), sizeof(text) - 1);
+    memcpy(text, payload.data(), length);
+    text[length] = '\0';
+    unsigned run = 0;
+    unsigned sequence = 0;
+    long long sentUs = 0;
+    if (sscanf(text, "%u,%u,%lld", &run, &sequence, &sentUs) != 3 ||
+        run != currentRun || sequence >= maxMessages) {
+        return;
+    }
+    const int64_t now = esp_timer_get_time();
+    if (received[sequence]) {
+        duplicateCount++;
+        return;
+    }
+    received[sequence] = true;
+    latenciesUs[receivedCount] = static_cast<uint32_t>(now - sentUs);
+    lastReceiveUs = now;
+    receivedCount++;
+}
+
+void runScenario(const Scenario& scenario) {
+    received.reset();
+    receivedCount = 0;
+    duplicateCount = 0;
+    const uint32_t run = currentRun + 1;
+    currentRun = run;
+
+    const int64_t start = esp_timer_get_time();
+    lastReceiveUs = start;
+    uint32_t lastDisconnectMs = millis();
+    for (size_t i = 0; i < scenario.messages; ++i) {
+        char payload[48];
+        const int length =
+            snprintf(payload, sizeof(payload), "%u,%u,%lld",
+                     static_cast<unsigned>(run), static_cast<unsigned>(i),
+                     static_cast<long long>(esp_timer_get_time()));
+        mqttMailingService.sendPayload(
+            std::string_view{payload, static_cast<size_t>(length)},
+            topicSuffix);
+
+        if (scenario.disconnectEveryMs > 0 &&
+            millis() - lastDisconnectMs >= scenario.disconnectEveryMs) {
+            // The service reconnects by itself, see Reconnection in the
+            // API guide
+            WiFi.disconnect();
+            lastDisconnectMs = millis();
+        }
+        if (scenario.intervalUs > 0) {
+            const int64_t next = start + (i + 1) * scenario.intervalUs;
+            const int64_t wait = next - esp_timer_get_time();
+            if (wait > 0) {
+                delay(static_cast<uint32_t>((wait + 999) / 1000));
+            }
+        }
+    }
+
+    // Wait for the stragglers
+    while (receivedCount < scenario.messages &&
+           esp_timer_get_time() - lastReceiveUs < drainTimeoutMs * 1000LL) {
+        delay(10);
+    }
+    // Late messages of this run are ignored from now on
+    currentRun = 0;
+    delay(10);
+
+    const size_t count = receivedCount;
+    std::sort(latenciesUs, latenciesUs + count);
+    const float seconds = (lastReceiveUs - start) / 1e6f;
+    Serial.printf("%-20s %8.1f msg/s  p50 %7u us  p99 %7u us  lost %4u/%u  "
+                  "duplicates %u\n",
+                  scenario.name, seconds > 0 ? count / seconds : 0.0f,
+                  count > 0 ? latenciesUs[count / 2] : 0,
+                  count > 0 ? latenciesUs[count * 99 / 100] : 0,
+                  static_cast<unsigned>(scenario.messages - count),
+                  static_cast<unsigned>(scenario.messages),
+                  static_cast<unsigned>(duplicateCount));
+}
+
+void setup() {
+    Serial.begin(115200);
+    sleep(1);
+
+    mqttMailingService.setBrokerURI(broker_uri);
+    mqttMailingService.setBrokerAddressTtl(600000);
+    mqttMailingService.setGlobalTopicPrefix(topicPrefix);
+    mqttMailingService.setQOS(1);
+    mqttMailingService.setMessageStore(&messageStore);
+    mqttMailingService.setReplayRate(50);
+    mqttMailingService.setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK,
+                                                1000);
+    mqttMailingService.subscribe(loadTopic, onLoadMessage, 1);
+    mqttMailingService.startWithDelegatedWiFi(ssid, password, true);
+    Serial.println("MQTT Mailing Service started and connected !");
+}
+
+void loop() {
+    Serial.println("--- End to end ---");
+    for (const Scenario& scenario : scenarios) {
+        mqttMailingService.waitUntilConnected(30000);
+        runScenario(scenario);
+    }
+    const MqttMetrics metrics = mqttMailingService.getMetrics();
+    Serial.printf("Time to connect %u ms, to first publish %u ms\n",
+                  static_cast<unsigned>(metrics.timeToConnectMs),
+                  static_cast<unsigned>(metrics.timeToFirstPublishMs));
+    Serial.printf("Reconnects %u, max time to reconnect %u ms\n\n",
+                  static_cast<unsigned>(metrics.reconnects),
+                  static_cast<unsigned>(metrics.maxTimeToReconnectMs));
+
+    delay(10000);
+}
@@ -0,0 +1,57 @@
+#include "MqttMailingService.h"
+#include <Arduino.h>
+#include <string>
+
+/*
+    In this usage example, the device receives its configuration and
+    commands from the broker:
+    - "devices/<any id>/config" messages set the measurement interval
+    - "commands/#" messages are printed
+*/
+using namespace sensirion::upt;
+
+mqtt::MqttMailingService mqttMailingService;
+volatile uint32_t measurementIntervalMs = 1000;
+
+// Configuration
+constexpr auto ssid = "ap-name";
+constexpr auto password = "ap-pass.";
+constexpr auto broker_uri = "mqtt://mqtt.yourserver.com:1883";
+
+void onConfig(std::string_view topic, std::string_view payload) {
+    // The payload is not NUL-terminated
+    const std::string value{payload};
+    const uint32_t interval = strtoul(value.c_str(), nullptr, 10);
+    if (interval > 0) {
+        measurementIntervalMs = interval;
+    }
+    Serial.printf("Interval set to %u ms by %.*s\n",
+                  static_cast<unsigned>(measurementIntervalMs),
+                  static_cast<int>(topic.size()), topic.data());
+}
+
+void setup() {
+    Serial.begin(115200);
+    sleep(1);
+
+    mqttMailingService.setBrokerURI(broker_uri);
+    mqttMailingService.setGlobalTopicPrefix("devices/deviceID2345/");
+
+    // Subscriptions can be added before or after start, they are renewed
+    // at every connection
+    mqttMailingService.subscribe("devices/+/config", onConfig, 1);
+    mqttMailingService.subscribe(
+        "commands/#", [](std::string_view topic, std::string_view payload) {
+            Serial.printf("Command on %.*s: %.*s\n",
+                          static_cast<int>(topic.size()), topic.data(),
+                          static_cast<int>(payload.size()), payload.data());
+        });
+
+    mqttMailingService.startWithDelegatedWiFi(ssid, password, true);
+    Serial.println("MQTT Mailing Service started and connected !");
+}
+
+void loop() {
+    mqttMailingService.sendTextMessage("alive", "status");
+    delay(measurementIntervalMs);
+}
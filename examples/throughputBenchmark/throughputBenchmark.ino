@@ -0,0 +1,316 @@
+#include "MeasurementBatch.h"
+#include "MeasurementPublisher.h"
+#include "MeasurementTemplate.h"
+#include "MqttMailingService.h"
+#include "PayloadCompression.h"
+#include <Arduino.h>
+#include <MeasurementFormatting.hpp>
+#include <algorithm>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+/*
+    This example benchmarks the publish paths of the MqttMailingService:
+    sendTextMessage, sendPayload, the sendMeasurement overloads and the
+    compile-time MeasurementPublisher, as well as the provided formatters,
+    called directly and through a std::function, and a MeasurementTemplate
+    parsed at runtime.
+
+    For each path it reports the rate at which messages are handed over to
+    the ESP MQTT client, the percentiles of the send call latency and the
+    number of heap allocations per message. With the buffer formatter and
+    the topics cached, the publish paths are expected to allocate nothing:
+    the messages are written into the preallocated message pool.
+
+    It also reports the compression ratio and time of batches of
+    measurements, as published with setBatching and setCompression, and the
+    bytes saved per message.
+
+    Finally it saturates the BULK lane of the mailbox with an URGENT alarm
+    every alarmInterval messages and reports the latency of each class from
+    posting to the ESP MQTT client: the alarms do not wait behind the
+    backlog of bulk messages (see setSchedulingPolicy).
+
+    Allocations are counted by wrapping malloc, which requires the linker
+    flag -Wl,--wrap=malloc and BENCHMARK_COUNT_ALLOCATIONS to be defined (see
+    the throughputBenchmark environment in platformio.ini).
+*/
+
+MqttMailingService mqttMailingService;
+MeasurementPublisher<FullMeasurementFormatter, MeasurementToTopicSuffixTree>
+    publisher{mqttMailingService};
+// Same formatter behind a std::function, as registered in the service
+MeasurementBufferFormatterType bufferFormatterFn = FullMeasurementFormatter{};
+
+// Configuration
+constexpr auto ssid = "ap-name";
+constexpr auto password = "ap-pass.";
+constexpr auto broker_uri = "mqtt://mqtt.yourserver.com:1883";
+constexpr size_t messagesPerRun = 500;
+constexpr size_t formatterIterations = 10000;
+constexpr size_t alarmInterval = 25;
+
+volatile uint32_t allocationCount = 0;
+
+#ifdef BENCHMARK_COUNT_ALLOCATIONS
+extern "C" {
+void* __real_malloc(size_t size);
+void* __wrap_malloc(size_t size) {
+    allocationCount++;
+    return __real_malloc(size);
+}
+}
+#endif
+
+core::Measurement getSampleMeasurement();
+core::Measurement dummyMeasurement = getSampleMeasurement();
+int64_t latenciesUs[messagesPerRun];
+
+struct RunResult {
+    float messagesPerSecond;
+    int64_t p50Us;
+    int64_t p90Us;
+    int64_t p99Us;
+    float allocationsPerMessage;
+};
+
+/**
+ * Calls sendFn messagesPerRun times and waits until the sender task has
+ * handed all messages over to the ESP MQTT client
+ */
+template <typename SendFn> RunResult runBenchmark(SendFn sendFn) {
+    const auto sentBefore = mqttMailingService.getMailboxStatistics().sent;
+    const uint32_t allocationsBefore = allocationCount;
+    const int64_t start = esp_timer_get_time();
+
+    for (size_t i = 0; i < messagesPerRun; ++i) {
+        dummyMeasurement.dataPoint.t_offset = i;
+        const int64_t callStart = esp_timer_get_time();
+        sendFn();
+        latenciesUs[i] = esp_timer_get_time() - callStart;
+    }
+    const uint32_t allocations = allocationCount - allocationsBefore;
+
+    while (mqttMailingService.getMailboxStatistics().sent - sentBefore <
+           messagesPerRun) {
+        delay(1);
+    }
+    const int64_t elapsedUs = esp_timer_get_time() - start;
+
+    std::sort(latenciesUs, latenciesUs + messagesPerRun);
+    RunResult result;
+    result.messagesPerSecond = messagesPerRun * 1e6f / elapsedUs;
+    result.p50Us = latenciesUs[messagesPerRun / 2];
+    result.p90Us = latenciesUs[messagesPerRun * 90 / 100];
+    result.p99Us = latenciesUs[messagesPerRun * 99 / 100];
+    result.allocationsPerMessage =
+        static_cast<float>(allocations) / messagesPerRun;
+    return result;
+}
+
+void printResult(const char* name, const RunResult& result) {
+    Serial.printf("%-28s %8.1f msg/s  p50 %5lld us  p90 %5lld us  p99 %5lld "
+                  "us  %5.2f alloc/msg\n",
+                  name, result.messagesPerSecond, result.p50Us, result.p90Us,
+                  result.p99Us, result.allocationsPerMessage);
+}
+
+/**
+ * Measures the average time and number of allocations of a formatter
+ */
+template <typename FormatFn>
+void benchmarkFormatter(const char* name, FormatFn formatFn) {
+    const uint32_t allocationsBefore = allocationCount;
+    const int64_t start = esp_timer_get_time();
+    size_t totalLength = 0;
+    for (size_t i = 0; i < formatterIterations; ++i) {
+        dummyMeasurement.dataPoint.t_offset = i;
+        totalLength += formatFn();
+    }
+    const int64_t elapsedUs = esp_timer_get_time() - start;
+    Serial.printf("%-36s %7.0f ns/measurement  %5.2f alloc/measurement  "
+                  "(%u bytes)\n",
+                  name, elapsedUs * 1000.0f / formatterIterations,
+                  static_cast<float>(allocationCount - allocationsBefore) /
+                      formatterIterations,
+                  static_cast<unsigned>(totalLength / formatterIterations));
+}
+
+/**
+ * Compresses a full batch of measurements and reports the compression ratio
+ * and the time per KB of payload
+ */
+void benchmarkCompression(const char* name, BatchMode mode) {
+    static HeatshrinkEncoder encoder;
+    static uint8_t compressed[MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH];
+    MeasurementBatch batch;
+    core::Measurement m = dummyMeasurement;
+    batch.open("benchmark/batch", m, mode, 0);
+    while (batch.append(m, MQTT_BATCH_MAX_LENGTH - 1)) {
+        m.dataPoint.t_offset += 5000;
+        m.dataPoint.value += 1.5f;
+    }
+    const size_t count = batch.count();
+    batch.close();
+    const auto* payload = reinterpret_cast<const uint8_t*>(batch.payload());
+    const size_t length = batch.length();
+
+    size_t compressedLength = 0;
+    const int64_t start = esp_timer_get_time();
+    for (size_t i = 0; i < formatterIterations; ++i) {
+        compressedLength =
+            encoder.compress(payload, length, compressed, sizeof(compressed));
+    }
+    const int64_t elapsedUs = esp_timer_get_time() - start;
+    Serial.printf("%-36s %u measurements  %3u -> %3u bytes (%3.0f %%)  "
+                  "%6.1f us/KB  saves %u bytes/message\n",
+                  name, static_cast<unsigned>(count),
+                  static_cast<unsigned>(length),
+                  static_cast<unsigned>(compressedLength),
+                  100.0f * compressedLength / length,
+                  elapsedUs * 1024.0f / formatterIterations / length,
+                  static_cast<unsigned>(length - compressedLength));
+}
+
+/**
+ * Sends messagesPerRun BULK messages back to back, every alarmInterval-th
+ * one URGENT, and reports the latency of both lanes
+ */
+void benchmarkPriorities() {
+    const MqttMetrics before = mqttMailingService.getMetrics();
+    const auto sentBefore = before.mailbox.sent;
+    for (size_t i = 0; i < messagesPerRun; ++i) {
+        if (i % alarmInterval == 0) {
+            mqttMailingService.sendPayload("{\"alarm\":1}", "alarm", 0,
+                                           MessagePriority::URGENT);
+        } else {
+            mqttMailingService.sendPayload("{\"value\":42}", "bulk", 0,
+                                           MessagePriority::BULK);
+        }
+    }
+    while (mqttMailingService.getMailboxStatistics().sent - sentBefore <
+           messagesPerRun) {
+        delay(1);
+    }
+    const MqttMetrics after = mqttMailingService.getMetrics();
+    for (const auto priority :
+         {MessagePriority::URGENT, MessagePriority::BULK}) {
+        const size_t index = static_cast<size_t>(priority);
+        // The histograms are cumulative, keep this run only
+        LatencyHistogram latency = after.priorities[index].latency;
+        for (size_t b = 0; b < LatencyHistogram::kBucketCount; ++b) {
+            latency.counts[b] -= before.priorities[index].latency.counts[b];
+        }
+        Serial.printf("%-28s %5u sent  p50 <= %6u us  p99 <= %6u us  "
+                      "%u dropped\n",
+                      priority == MessagePriority::URGENT ? "URGENT" : "BULK",
+                      static_cast<unsigned>(latency.total()),
+                      static_cast<unsigned>(
+                          latency.percentileUpperBoundUs(50)),
+                      static_cast<unsigned>(
+                          latency.percentileUpperBoundUs(99)),
+                      static_cast<unsigned>(after.priorities[index].dropped -
+                                            before.priorities[index].dropped));
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    sleep(1);
+
+    mqttMailingService.setBrokerURI(broker_uri);
+    mqttMailingService.setGlobalTopicPrefix("benchmark/");
+    mqttMailingService.setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK,
+                                                1000);
+    // Alarms jump the queue, see benchmarkPriorities
+    mqttMailingService.setSchedulingPolicy(SchedulingPolicy::STRICT);
+    mqttMailingService.setMeasurementBufferFormatterFn(
+        FullMeasurementFormatter{});
+    mqttMailingService.setMeasurementToTopicSuffixFn(
+        MeasurementToTopicSuffixTree{});
+    mqttMailingService.startWithDelegatedWiFi(ssid, password, true);
+    Serial.println("MQTT Mailing Service started and connected !");
+}
+
+void loop() {
+    Serial.println("--- Formatters ---");
+    char buffer[MQTT_MESSAGE_MAX_LENGTH];
+    benchmarkFormatter("FullMeasurementFormatter (string)", []() {
+        return FullMeasurementFormatter{}(dummyMeasurement).size();
+    });
+    benchmarkFormatter("FullMeasurementFormatter (buffer)", [&buffer]() {
+        return FullMeasurementFormatter{}(dummyMeasurement, buffer,
+                                          sizeof(buffer));
+    });
+    benchmarkFormatter("FullMeasurementFormatter (function)", [&buffer]() {
+        return bufferFormatterFn(dummyMeasurement, buffer, sizeof(buffer));
+    });
+    static const MeasurementTemplate templateFormatter{
+        R"({"t":{t_offset},"v":{value:.2f},"id":{deviceID},"q":"{quantity}"})"};
+    benchmarkFormatter("MeasurementTemplate (buffer)", [&buffer]() {
+        return templateFormatter(dummyMeasurement, buffer, sizeof(buffer));
+    });
+    benchmarkFormatter("MeasurementToTopicSuffixTree (buffer)", [&buffer]() {
+        return MeasurementToTopicSuffixTree{}(dummyMeasurement, buffer,
+                                              sizeof(buffer));
+    });
+
+    Serial.println("--- Compression ---");
+    benchmarkCompression("Batch per topic", BatchMode::PER_TOPIC);
+    benchmarkCompression("Batch across topics", BatchMode::ACROSS_TOPICS);
+
+    Serial.println("--- Publish paths ---");
+    const std::string message{"{\"value\":42}"};
+    const std::string topicSuffix{"text"};
+    printResult("sendTextMessage", runBenchmark([&]() {
+                    mqttMailingService.sendTextMessage(message, topicSuffix);
+                }));
+    printResult("sendPayload", runBenchmark([&]() {
+                    mqttMailingService.sendPayload("{\"value\":42}", "text");
+                }));
+    printResult("acquireMessage/sendMessage", runBenchmark([]() {
+                    MailboxMessage* msg = mqttMailingService.acquireMessage();
+                    if (msg != nullptr) {
+                        msg->payloadLength = FullMeasurementFormatter{}(
+                            dummyMeasurement, msg->payload,
+                            sizeof(msg->payload));
+                        mqttMailingService.sendMessage(msg, "inplace");
+                    }
+                }));
+    printResult("sendMeasurement(m, suffix)", runBenchmark([&]() {
+                    mqttMailingService.sendMeasurement(dummyMeasurement,
+                                                       topicSuffix);
+                }));
+    printResult("sendMeasurement(m)", runBenchmark([]() {
+                    mqttMailingService.sendMeasurement(dummyMeasurement);
+                }));
+    printResult("MeasurementPublisher::send", runBenchmark([]() {
+                    publisher.send(dummyMeasurement);
+                }));
+
+    Serial.println("--- Priority lanes ---");
+    benchmarkPriorities();
+
+    const auto pool = mqttMailingService.getMessagePoolStatistics();
+    Serial.printf("Message pool: %u blocks, high-water mark %u, exhausted "
+                  "%u times\n",
+                  static_cast<unsigned>(pool.capacity),
+                  static_cast<unsigned>(pool.highWaterMark),
+                  static_cast<unsigned>(pool.exhausted));
+    Serial.printf("Free heap: %u bytes, minimum: %u bytes\n\n",
+                  ESP.getFreeHeap(), ESP.getMinFreeHeap());
+
+    delay(10000);
+}
+
+/**
+ * Returns a dummy measurement filled with realistic data combination
+ */
+core::Measurement getSampleMeasurement() {
+    core::MetaData meta{core::SCD4X()};
+    meta.deviceID = 932780134865341212;
+    core::Measurement m{meta, core::SignalType::CO2_PARTS_PER_MILLION,
+                        core::DataPoint{0, 100.0}};
+    return m;
+}
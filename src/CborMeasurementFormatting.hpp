@@ -0,0 +1,308 @@
+#ifndef UPT_MQTT_CBOR_MEASUREMENT_FORMATTING_HPP
+#define UPT_MQTT_CBOR_MEASUREMENT_FORMATTING_HPP
+
+#include <Sensirion_UPT_Core.h>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace sensirion::upt::mqtt
+{
+
+    /**
+     * Integer keys of the CBOR measurement map:
+     * {0: time_offset_ms, 1: value (float32), 2: device_id,
+     *  3: device_type (label), 4: signal (SignalType as integer)}
+     */
+    enum CborMeasurementKey : uint8_t {
+        CBOR_KEY_TIME_OFFSET_MS = 0,
+        CBOR_KEY_VALUE = 1,
+        CBOR_KEY_DEVICE_ID = 2,
+        CBOR_KEY_DEVICE_TYPE = 3,
+        CBOR_KEY_SIGNAL_TYPE = 4,
+    };
+
+    /**
+     * Encodes CBOR (RFC 8949) items into a caller-provided byte buffer.
+     * Writes that do not fit are dropped and reported through overflowed().
+     */
+    class CborWriter
+    {
+      public:
+        CborWriter(uint8_t* buffer, size_t capacity)
+            : mBuffer{buffer}, mCapacity{capacity} {}
+
+        CborWriter& writeUnsigned(uint64_t value) {
+            return writeHead(0, value);
+        }
+
+        CborWriter& writeText(std::string_view text) {
+            writeHead(3, text.size());
+            return writeBytes(reinterpret_cast<const uint8_t*>(text.data()),
+                              text.size());
+        }
+
+        CborWriter& writeMapHeader(size_t pairs) {
+            return writeHead(5, pairs);
+        }
+
+        CborWriter& writeArrayHeader(size_t items) {
+            return writeHead(4, items);
+        }
+
+        CborWriter& writeFloat(float value) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            const uint8_t encoded[] = {0xFA, static_cast<uint8_t>(bits >> 24),
+                                       static_cast<uint8_t>(bits >> 16),
+                                       static_cast<uint8_t>(bits >> 8),
+                                       static_cast<uint8_t>(bits)};
+            return writeBytes(encoded, sizeof(encoded));
+        }
+
+        size_t length() const {
+            return mLength;
+        }
+
+        bool overflowed() const {
+            return mOverflowed;
+        }
+
+        /**
+         * @brief returns the number of written bytes, or the buffer capacity
+         * if the output did not fit
+         */
+        size_t result() const {
+            return mOverflowed ? mCapacity : mLength;
+        }
+
+      private:
+        uint8_t* mBuffer;
+        size_t mCapacity;
+        size_t mLength = 0;
+        bool mOverflowed = false;
+
+        CborWriter& writeHead(uint8_t major, uint64_t value) {
+            uint8_t head[9];
+            size_t size;
+            major = static_cast<uint8_t>(major << 5);
+            if (value < 24) {
+                head[0] = major | static_cast<uint8_t>(value);
+                size = 1;
+            } else if (value <= 0xFF) {
+                head[0] = major | 24;
+                size = 2;
+            } else if (value <= 0xFFFF) {
+                head[0] = major | 25;
+                size = 3;
+            } else if (value <= 0xFFFFFFFF) {
+                head[0] = major | 26;
+                size = 5;
+            } else {
+                head[0] = major | 27;
+                size = 9;
+            }
+            for (size_t i = size - 1; i > 0; --i) {
+                head[i] = static_cast<uint8_t>(value);
+                value >>= 8;
+            }
+            return writeBytes(head, size);
+        }
+
+        CborWriter& writeBytes(const uint8_t* data, size_t size) {
+            if (mOverflowed || mLength + size > mCapacity) {
+                mOverflowed = true;
+                return *this;
+            }
+            memcpy(mBuffer + mLength, data, size);
+            mLength += size;
+            return *this;
+        }
+    };
+
+    /**
+     * Formats a Measurement as a CBOR map with integer keys, see
+     * CborMeasurementKey. Typically 30 bytes instead of ~130 for the JSON of
+     * FullMeasurementFormatter.
+     */
+    struct CborMeasurementFormatter
+    {
+        /**
+         * @return number of bytes written. A value >= size means the output
+         * did not fit into the buffer.
+         */
+        size_t operator () (const sensirion::upt::core::Measurement& m,
+                            uint8_t* buffer, size_t size) const {
+            CborWriter writer{buffer, size};
+            writer.writeMapHeader(5);
+            writer.writeUnsigned(CBOR_KEY_TIME_OFFSET_MS)
+                .writeUnsigned(m.dataPoint.t_offset);
+            writer.writeUnsigned(CBOR_KEY_VALUE)
+                .writeFloat(m.dataPoint.value);
+            writer.writeUnsigned(CBOR_KEY_DEVICE_ID)
+                .writeUnsigned(m.metaData.deviceID);
+            writer.writeUnsigned(CBOR_KEY_DEVICE_TYPE)
+                .writeText(core::deviceLabel(m.metaData.deviceType));
+            writer.writeUnsigned(CBOR_KEY_SIGNAL_TYPE)
+                .writeUnsigned(static_cast<uint64_t>(m.signalType));
+            return writer.result();
+        }
+    };
+
+    /* Measurement as decoded from a CborMeasurementFormatter payload */
+    struct DecodedCborMeasurement {
+        uint64_t timeOffsetMs = 0;
+        float value = 0;
+        uint64_t deviceID = 0;
+        // points into the decoded payload
+        std::string_view deviceLabel{};
+        sensirion::upt::core::SignalType signalType{};
+    };
+
+    /**
+     * Decodes payloads of CborMeasurementFormatter. Has no dependency on the
+     * ESP32 platform so it can be used on the receiving side as well.
+     */
+    class CborMeasurementDecoder
+    {
+      public:
+        /**
+         * @brief Decodes a payload into out
+         *
+         * @return false if the payload is malformed. Unknown keys with
+         * integer, text or float values are skipped.
+         */
+        bool decode(const uint8_t* data, size_t size,
+                    DecodedCborMeasurement& out) {
+            mData = data;
+            mSize = size;
+            mPos = 0;
+
+            uint8_t major;
+            uint64_t pairs;
+            if (!readHead(major, pairs) || major != 5) {
+                return false;
+            }
+            for (uint64_t i = 0; i < pairs; ++i) {
+                uint64_t key;
+                if (!readHead(major, key) || major != 0) {
+                    return false;
+                }
+                if (!readValue(key, out)) {
+                    return false;
+                }
+            }
+            return mPos == mSize;
+        }
+
+      private:
+        const uint8_t* mData = nullptr;
+        size_t mSize = 0;
+        size_t mPos = 0;
+
+        bool readValue(uint64_t key, DecodedCborMeasurement& out) {
+            if (mPos >= mSize) {
+                return false;
+            }
+            const uint8_t initial = mData[mPos];
+            if (initial == 0xFA || initial == 0xFB) {
+                double value;
+                if (!readFloat(value)) {
+                    return false;
+                }
+                if (key == CBOR_KEY_VALUE) {
+                    out.value = static_cast<float>(value);
+                }
+                return true;
+            }
+
+            uint8_t major;
+            uint64_t arg;
+            if (!readHead(major, arg)) {
+                return false;
+            }
+            if (major == 3) {
+                if (arg > mSize - mPos) {
+                    return false;
+                }
+                if (key == CBOR_KEY_DEVICE_TYPE) {
+                    out.deviceLabel = std::string_view{
+                        reinterpret_cast<const char*>(mData + mPos),
+                        static_cast<size_t>(arg)};
+                }
+                mPos += static_cast<size_t>(arg);
+                return true;
+            }
+            if (major != 0) {
+                return false;
+            }
+            switch (key) {
+                case CBOR_KEY_TIME_OFFSET_MS:
+                    out.timeOffsetMs = arg;
+                    break;
+                case CBOR_KEY_DEVICE_ID:
+                    out.deviceID = arg;
+                    break;
+                case CBOR_KEY_SIGNAL_TYPE:
+                    out.signalType =
+                        static_cast<sensirion::upt::core::SignalType>(arg);
+                    break;
+                default:
+                    break;
+            }
+            return true;
+        }
+
+        bool readHead(uint8_t& major, uint64_t& arg) {
+            if (mPos >= mSize) {
+                return false;
+            }
+            const uint8_t initial = mData[mPos++];
+            major = initial >> 5;
+            const uint8_t info = initial & 0x1F;
+            if (info < 24) {
+                arg = info;
+                return true;
+            }
+            if (info > 27) {
+                return false;
+            }
+            const size_t count = size_t{1} << (info - 24);
+            return readBigEndian(count, arg);
+        }
+
+        bool readFloat(double& value) {
+            const uint8_t initial = mData[mPos++];
+            uint64_t bits;
+            if (initial == 0xFA) {
+                if (!readBigEndian(4, bits)) {
+                    return false;
+                }
+                const auto bits32 = static_cast<uint32_t>(bits);
+                float f;
+                memcpy(&f, &bits32, sizeof(f));
+                value = f;
+                return true;
+            }
+            if (!readBigEndian(8, bits)) {
+                return false;
+            }
+            memcpy(&value, &bits, sizeof(value));
+            return true;
+        }
+
+        bool readBigEndian(size_t count, uint64_t& value) {
+            if (count > mSize - mPos) {
+                return false;
+            }
+            value = 0;
+            for (size_t i = 0; i < count; ++i) {
+                value = (value << 8) | mData[mPos++];
+            }
+            return true;
+        }
+    };
+
+} // end namespace
+
+#endif /* UPT_MQTT_CBOR_MEASUREMENT_FORMATTING_HPP */
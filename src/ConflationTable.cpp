@@ -0,0 +1,117 @@
+#include "ConflationTable.h"
+#include <cstring>
+#include <new>
+
+namespace sensirion::upt::mqtt {
+
+ConflationTable::~ConflationTable() {
+    end();
+}
+
+bool ConflationTable::begin(size_t slotCount) {
+    end();
+    // Zeroed, the slots are not pending
+    mSlots = new (std::nothrow) Slot[slotCount]();
+    if (mSlots == nullptr) {
+        return false;
+    }
+    mSlotCount = slotCount;
+    return true;
+}
+
+void ConflationTable::end() {
+    delete[] mSlots;
+    mSlots = nullptr;
+    mSlotCount = 0;
+    mUsedCount = 0;
+    mPendingCount = 0;
+    mSequence = 0;
+}
+
+bool ConflationTable::put(const MailboxMessage& msg, bool& replaced,
+                          uint32_t& replacedToken) {
+    replaced = false;
+    replacedToken = 0;
+    const uint32_t hash = hashTopic(msg.topic);
+    Slot* slot = findSlot(msg.topic, hash);
+    if (slot == nullptr && mUsedCount < mSlotCount) {
+        slot = &mSlots[mUsedCount++];
+    }
+    if (slot == nullptr) {
+        // Reuse the slot of a topic with nothing pending
+        for (size_t i = 0; i < mUsedCount && slot == nullptr; ++i) {
+            if (mSlots[i].sequence == 0) {
+                slot = &mSlots[i];
+            }
+        }
+        if (slot == nullptr) {
+            return false;
+        }
+    }
+    if (slot->sequence != 0) {
+        replaced = true;
+        replacedToken = slot->message.deliveryToken;
+    } else {
+        mPendingCount++;
+    }
+    slot->hash = hash;
+    // 0 marks the slots that are not pending
+    if (++mSequence == 0) {
+        ++mSequence;
+    }
+    slot->sequence = mSequence;
+    slot->message = msg;
+    return true;
+}
+
+void ConflationTable::restore(const MailboxMessage& msg) {
+    const Slot* slot = findSlot(msg.topic, hashTopic(msg.topic));
+    if (slot != nullptr && slot->sequence != 0) {
+        return;
+    }
+    bool replaced;
+    uint32_t replacedToken;
+    put(msg, replaced, replacedToken);
+}
+
+bool ConflationTable::take(MailboxMessage& msg) {
+    Slot* oldest = nullptr;
+    for (size_t i = 0; i < mUsedCount; ++i) {
+        Slot& slot = mSlots[i];
+        // Wrap-around safe comparison of the sequence numbers
+        if (slot.sequence != 0 &&
+            (oldest == nullptr ||
+             static_cast<int32_t>(slot.sequence - oldest->sequence) < 0)) {
+            oldest = &slot;
+        }
+    }
+    if (oldest == nullptr) {
+        return false;
+    }
+    msg = oldest->message;
+    oldest->sequence = 0;
+    mPendingCount--;
+    return true;
+}
+
+ConflationTable::Slot* ConflationTable::findSlot(const char* topic,
+                                                 uint32_t hash) {
+    for (size_t i = 0; i < mUsedCount; ++i) {
+        Slot& slot = mSlots[i];
+        if (slot.hash == hash && strcmp(slot.message.topic, topic) == 0) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t ConflationTable::hashTopic(const char* topic) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *topic != '\0'; ++topic) {
+        hash = (hash ^ static_cast<uint8_t>(*topic)) * 16777619u;
+    }
+    return hash;
+}
+
+}  // namespace sensirion::upt::mqtt
@@ -0,0 +1,90 @@
+#ifndef UPT_MQTT_CONFLATION_TABLE_H
+#define UPT_MQTT_CONFLATION_TABLE_H
+
+#include "MailboxMessage.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Last value per topic: a message replaces the pending message of the same
+ * topic instead of queuing behind it, so the memory is bounded by the number
+ * of topics rather than by the sample rate. The slots are allocated once by
+ * begin(), a slot whose message was taken is reused by its topic or, if all
+ * slots are in use, by a new topic.
+ *
+ * @note Not thread safe, the owner serializes the calls.
+ */
+class ConflationTable {
+  public:
+    ConflationTable() = default;
+    ~ConflationTable();
+
+    ConflationTable(const ConflationTable&) = delete;
+    ConflationTable& operator=(const ConflationTable&) = delete;
+
+    /**
+     * @brief Allocates slotCount slots
+     *
+     * @return false if the memory could not be allocated
+     */
+    bool begin(size_t slotCount);
+
+    void end();
+
+    /**
+     * @brief Copies the message into the slot of its topic
+     *
+     * @param replaced: set to true if the message replaced a pending one
+     * @param replacedToken: set to the delivery token of the replaced
+     *        message, 0 if none was replaced
+     *
+     * @return false if all slots hold a pending message of another topic
+     */
+    bool put(const MailboxMessage& msg, bool& replaced,
+             uint32_t& replacedToken);
+
+    /**
+     * @brief Puts back a message that could not be published, unless a newer
+     *        message of its topic is pending
+     */
+    void restore(const MailboxMessage& msg);
+
+    /**
+     * @brief Copies the oldest pending message into msg, its slot is no
+     *        longer pending
+     *
+     * @return false if no message is pending
+     */
+    bool take(MailboxMessage& msg);
+
+    size_t pending() const {
+        return mPendingCount;
+    }
+
+    size_t capacity() const {
+        return mSlotCount;
+    }
+
+  private:
+    struct Slot {
+        uint32_t hash;
+        // Order of the pending messages, 0 if the slot is not pending
+        uint32_t sequence;
+        MailboxMessage message;
+    };
+
+    Slot* findSlot(const char* topic, uint32_t hash);
+    static uint32_t hashTopic(const char* topic);
+
+    Slot* mSlots = nullptr;
+    size_t mSlotCount = 0;
+    size_t mUsedCount = 0;
+    size_t mPendingCount = 0;
+    uint32_t mSequence = 0;
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_CONFLATION_TABLE_H */
@@ -0,0 +1,87 @@
+#include "HostResolver.h"
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include <new>
+#include <string>
+
+namespace sensirion::upt::mqtt {
+
+namespace {
+
+// Shared by the caller and the lookup in the tcpip thread, freed by the
+// last of them: the caller may give up before the DNS server answers
+struct Lookup {
+    std::atomic<int> references{2};
+    SemaphoreHandle_t done = nullptr;
+    std::string host;
+    ip_addr_t address{};
+    bool found = false;
+};
+
+void release(Lookup* lookup) {
+    if (lookup->references.fetch_sub(1) == 1) {
+        vSemaphoreDelete(lookup->done);
+        delete lookup;
+    }
+}
+
+void finish(Lookup* lookup, const ip_addr_t* address) {
+    if (address != nullptr && IP_IS_V4(address)) {
+        lookup->address = *address;
+        lookup->found = true;
+    }
+    xSemaphoreGive(lookup->done);
+    release(lookup);
+}
+
+void onFound(const char*, const ip_addr_t* address, void* arg) {
+    finish(static_cast<Lookup*>(arg), address);
+}
+
+// Runs in the tcpip thread, the only one calling into the DNS client
+void startLookup(void* arg) {
+    auto* lookup = static_cast<Lookup*>(arg);
+    ip_addr_t address{};
+    const err_t err =
+        dns_gethostbyname(lookup->host.c_str(), &address, onFound, lookup);
+    if (err == ERR_INPROGRESS) {
+        // onFound is called with the answer
+        return;
+    }
+    finish(lookup, err == ERR_OK ? &address : nullptr);
+}
+
+}  // namespace
+
+bool resolveHostName(const char* host, uint32_t timeoutMs, char* address,
+                     size_t size) {
+    auto* lookup = new (std::nothrow) Lookup;
+    if (lookup == nullptr) {
+        return false;
+    }
+    lookup->done = xSemaphoreCreateBinary();
+    lookup->host = host;
+    if (lookup->done == nullptr ||
+        tcpip_callback(startLookup, lookup) != ERR_OK) {
+        // never started, this is the last reference
+        lookup->references = 1;
+        if (lookup->done != nullptr) {
+            release(lookup);
+        } else {
+            delete lookup;
+        }
+        return false;
+    }
+    bool found = false;
+    if (xSemaphoreTake(lookup->done, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) {
+        found = lookup->found &&
+                ipaddr_ntoa_r(&lookup->address, address, size) != nullptr;
+    }
+    release(lookup);
+    return found;
+}
+
+}  // namespace sensirion::upt::mqtt
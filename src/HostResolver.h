@@ -0,0 +1,27 @@
+#ifndef UPT_MQTT_HOST_RESOLVER_H
+#define UPT_MQTT_HOST_RESOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * @brief Resolves a host name to its IPv4 address with the DNS client of
+ *        lwIP, waiting at most timeoutMs.
+ *
+ * Unlike WiFi.hostByName, the wait is bounded: the lookup runs in the
+ * tcpip thread and the caller gives up after timeoutMs, the answer of a
+ * lookup still running is then discarded.
+ *
+ * @param address: receives the address in dotted notation
+ * @param size: size of address, at least 16 bytes
+ *
+ * @return false if the name could not be resolved within timeoutMs
+ */
+bool resolveHostName(const char* host, uint32_t timeoutMs, char* address,
+                     size_t size);
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_HOST_RESOLVER_H */
@@ -0,0 +1,76 @@
+#include "InFlightWindow.h"
+
+namespace sensirion::upt::mqtt {
+
+bool InFlightWindow::add(int msgId, uint32_t token, int64_t nowUs) {
+    const bool acknowledged = takeEarlyAck(msgId, nowUs);
+    if (acknowledged && token == 0) {
+        return true;
+    }
+    for (auto& slot : mSlots) {
+        if (slot.state == SlotState::FREE) {
+            // with a token, kept until the outcome is taken
+            slot = {msgId, token, nowUs,
+                    acknowledged ? SlotState::ACKNOWLEDGED
+                                 : SlotState::IN_FLIGHT};
+            mOccupied++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool InFlightWindow::acknowledge(int msgId, int64_t nowUs,
+                                 uint32_t& latencyUs, uint32_t& token) {
+    for (auto& slot : mSlots) {
+        if (slot.state == SlotState::IN_FLIGHT && slot.msgId == msgId) {
+            latencyUs = static_cast<uint32_t>(nowUs - slot.publishedAtUs);
+            token = slot.token;
+            if (token != 0) {
+                // kept until the outcome is taken
+                slot.state = SlotState::ACKNOWLEDGED;
+            } else {
+                free(slot);
+            }
+            return true;
+        }
+    }
+    mEarlyAcks[mNextEarlyAck] = {msgId, nowUs};
+    mNextEarlyAck = (mNextEarlyAck + 1) % kEarlyAcks;
+    return false;
+}
+
+bool InFlightWindow::takeCompleted(int64_t nowUs, int64_t timeoutUs,
+                                   Completion& completion) {
+    for (auto& slot : mSlots) {
+        if (slot.state == SlotState::ACKNOWLEDGED) {
+            completion = {slot.token, DeliveryStatus::DELIVERED};
+        } else if (slot.state == SlotState::IN_FLIGHT &&
+                   nowUs - slot.publishedAtUs > timeoutUs) {
+            completion = {slot.token, DeliveryStatus::TIMED_OUT};
+        } else {
+            continue;
+        }
+        free(slot);
+        return true;
+    }
+    return false;
+}
+
+bool InFlightWindow::takeEarlyAck(int msgId, int64_t nowUs) {
+    for (auto& early : mEarlyAcks) {
+        if (early.msgId == msgId &&
+            nowUs - early.acknowledgedAtUs <= kEarlyAckMaxAgeUs) {
+            early.msgId = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+void InFlightWindow::free(Slot& slot) {
+    slot.state = SlotState::FREE;
+    mOccupied--;
+}
+
+}  // namespace sensirion::upt::mqtt
@@ -0,0 +1,117 @@
+#ifndef UPT_MQTT_IN_FLIGHT_WINDOW_H
+#define UPT_MQTT_IN_FLIGHT_WINDOW_H
+
+#include "mqtt_cfg.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+/* Outcome of a message, reported to the delivery callback */
+enum class DeliveryStatus {
+    DELIVERED = 0,  // acknowledged by the broker (QoS 1/2) or sent (QoS 0)
+    DROPPED,        // discarded: mailbox overflow or publish error
+    STORED,         // moved to the offline message store, replayed later
+    TIMED_OUT,      // not acknowledged within MQTT_INFLIGHT_TIMEOUT_MS
+};
+
+/**
+ * QoS 1/2 messages published and not yet acknowledged, identified by the
+ * message id returned by esp_mqtt_client_publish.
+ *
+ * Messages carrying a delivery token keep their slot once acknowledged,
+ * until the outcome is taken with takeCompleted. A message that is not
+ * acknowledged within the timeout is reported as TIMED_OUT and forgotten.
+ *
+ * The broker may acknowledge a message before its id is known to the
+ * publisher, which only gets it once esp_mqtt_client_publish returns. The
+ * last unknown acknowledgements are therefore kept for a short time and
+ * applied by add.
+ *
+ * @note Not thread safe, the owner serializes the calls.
+ */
+class InFlightWindow {
+  public:
+    struct Completion {
+        uint32_t token;
+        DeliveryStatus status;
+    };
+
+    /**
+     * @brief Tracks a published message, acknowledged at once if its
+     *        acknowledgement arrived first
+     *
+     * @return false if MQTT_INFLIGHT_MAX_MESSAGES messages are tracked
+     */
+    bool add(int msgId, uint32_t token, int64_t nowUs);
+
+    /**
+     * @brief Marks a message as acknowledged
+     *
+     * @param latencyUs: receives the time since the message was published
+     * @param token: receives the delivery token of the message
+     *
+     * @return false if the message is not tracked, e.g. timed out or not
+     *         added yet
+     */
+    bool acknowledge(int msgId, int64_t nowUs, uint32_t& latencyUs,
+                     uint32_t& token);
+
+    /**
+     * @brief returns true if msgId was acknowledged shortly before, without
+     *        being tracked, and forgets the acknowledgement. For messages
+     *        acknowledged elsewhere, e.g. the topic alias mappings.
+     */
+    bool takeEarlyAck(int msgId, int64_t nowUs);
+
+    /**
+     * @brief Takes the next acknowledged message with a token, or the next
+     *        message in flight for longer than timeoutUs
+     *
+     * @return false if there is none
+     */
+    bool takeCompleted(int64_t nowUs, int64_t timeoutUs,
+                       Completion& completion);
+
+    /**
+     * @brief returns the number of slots taken, by messages in flight or
+     *        acknowledged and not taken yet
+     */
+    size_t occupied() const {
+        return mOccupied;
+    }
+
+  private:
+    enum class SlotState : uint8_t {
+        FREE = 0,
+        IN_FLIGHT,
+        ACKNOWLEDGED,
+    };
+
+    struct Slot {
+        int msgId;
+        uint32_t token;
+        int64_t publishedAtUs;
+        SlotState state;
+    };
+
+    // Acknowledgements of messages not added yet, msgId 0 for none. Only
+    // recent ones are applied: message ids are reused after 65535 messages
+    struct EarlyAck {
+        int msgId;
+        int64_t acknowledgedAtUs;
+    };
+    static constexpr size_t kEarlyAcks = 4;
+    static constexpr int64_t kEarlyAckMaxAgeUs = 100000;
+
+    Slot mSlots[MQTT_INFLIGHT_MAX_MESSAGES]{};
+    size_t mOccupied = 0;
+    EarlyAck mEarlyAcks[kEarlyAcks]{};
+    size_t mNextEarlyAck = 0;
+
+    void free(Slot& slot);
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_IN_FLIGHT_WINDOW_H */
@@ -0,0 +1,35 @@
+#ifndef UPT_MQTT_MAILBOX_MESSAGE_H
+#define UPT_MQTT_MAILBOX_MESSAGE_H
+
+#include "mqtt_cfg.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+/* Priority of a message, each one has its own lane in the mailbox. The names
+ * avoid the HIGH and LOW macros of Arduino. */
+enum class MessagePriority : uint8_t {
+    BULK = 0,  // e.g. routine samples, served last
+    NORMAL,    // default
+    URGENT,    // e.g. alarms, served first
+};
+
+constexpr size_t kMessagePriorityCount = 3;
+
+/* Message as stored in the mailbox. The topic is NUL-terminated, the payload
+ * may contain binary data and is delimited by payloadLength. */
+struct MailboxMessage {
+    char topic[MQTT_TOPIC_MAX_LENGTH];
+    char payload[MQTT_MESSAGE_MAX_LENGTH];
+    size_t payloadLength;
+    // Reported to the delivery callback of the service, 0 for none
+    uint32_t deliveryToken;
+    MessagePriority priority;
+    // Time it was posted (esp_timer, truncated), for the latency per lane
+    uint32_t postedUs;
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MAILBOX_MESSAGE_H */
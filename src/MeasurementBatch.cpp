@@ -0,0 +1,98 @@
+#include "MeasurementBatch.h"
+#include <cstring>
+
+namespace sensirion::upt::mqtt {
+
+bool MeasurementBatch::open(const char* topic, const core::Measurement& m,
+                            BatchMode mode, uint32_t nowMs) {
+    const size_t topicLen = strlen(topic);
+    if (topicLen >= sizeof(mTopic)) {
+        return false;
+    }
+    size_t headerLen;
+    if (mode == BatchMode::PER_TOPIC) {
+        headerLen =
+            BatchMeasurementFormatter{}.header(m, mPayload, sizeof(mPayload));
+    } else {
+        headerLen = MixedBatchMeasurementFormatter{}.header(m, mPayload,
+                                                            sizeof(mPayload));
+    }
+    if (headerLen >= sizeof(mPayload)) {
+        return false;
+    }
+    memcpy(mTopic, topic, topicLen + 1);
+    mMode = mode;
+    mDeviceID = m.metaData.deviceID;
+    mSignalType = m.signalType;
+    mLength = headerLen;
+    mCount = 0;
+    mOpenedAtMs = nowMs;
+    mState = State::OPEN;
+    return true;
+}
+
+bool MeasurementBatch::append(const core::Measurement& m, size_t maxBytes) {
+    const size_t footerLen = strlen(footer());
+    size_t limit = maxBytes + 1 < sizeof(mPayload) ? maxBytes + 1
+                                                   : sizeof(mPayload);
+    if (mLength + footerLen + 1 >= limit) {
+        return false;
+    }
+    // Reserve room for the footer, so close() always succeeds
+    limit -= footerLen;
+
+    size_t offset = mLength;
+    if (mCount > 0) {
+        mPayload[offset++] = ',';
+    }
+    size_t len;
+    if (mMode == BatchMode::PER_TOPIC) {
+        len = BatchMeasurementFormatter{}.element(m, mPayload + offset,
+                                                  limit - offset);
+    } else {
+        len = MixedBatchMeasurementFormatter{}.element(m, mPayload + offset,
+                                                       limit - offset);
+    }
+    if (len >= limit - offset) {
+        mPayload[mLength] = '\0';
+        return false;
+    }
+    mLength = offset + len;
+    mCount++;
+    return true;
+}
+
+bool MeasurementBatch::accepts(const char* topic,
+                               const core::Measurement& m) const {
+    if (mState != State::OPEN || strcmp(topic, mTopic) != 0) {
+        return false;
+    }
+    if (mMode == BatchMode::PER_TOPIC) {
+        // metadata is hoisted, so it has to be identical for all elements
+        return m.metaData.deviceID == mDeviceID && m.signalType == mSignalType;
+    }
+    return true;
+}
+
+void MeasurementBatch::close(uint32_t sequence, uint32_t nowUs) {
+    const char* end = footer();
+    const size_t footerLen = strlen(end);
+    memcpy(mPayload + mLength, end, footerLen + 1);
+    mLength += footerLen;
+    mSequence = sequence;
+    mClosedAtUs = nowUs;
+    mState = State::READY;
+}
+
+void MeasurementBatch::release() {
+    mState = State::FREE;
+}
+
+const char* MeasurementBatch::footer() const {
+    if (mMode == BatchMode::PER_TOPIC) {
+        return BatchMeasurementFormatter::footer;
+    }
+    return MixedBatchMeasurementFormatter::footer;
+}
+
+}  // namespace sensirion::upt::mqtt
@@ -0,0 +1,142 @@
+#ifndef UPT_MQTT_MEASUREMENT_BATCH_H
+#define UPT_MQTT_MEASUREMENT_BATCH_H
+
+#include "MeasurementFormatting.hpp"
+#include "mqtt_cfg.h"
+#include <Sensirion_UPT_Core.h>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+enum class BatchMode {
+    DISABLED = 0,
+    PER_TOPIC,      // one batch per topic and signal, metadata is hoisted
+    ACROSS_TOPICS,  // one batch per topic, mixing devices and signals
+};
+
+struct BatchConfig {
+    BatchMode mode = BatchMode::DISABLED;
+    // Flush once the batch holds this many measurements
+    size_t maxCount = 10;
+    // Flush once the payload would exceed this many bytes, at most
+    // MQTT_BATCH_MAX_LENGTH - 1
+    size_t maxBytes = MQTT_BATCH_MAX_LENGTH - 1;
+    // Flush once the oldest measurement in the batch is this old
+    uint32_t maxAgeMs = 5000;
+    // Topic suffix of the ACROSS_TOPICS batches of sendMeasurement without
+    // topic suffix
+    std::string topicSuffix{"batch"};
+    // Delivery token of the batch messages, 0 for none
+    uint32_t deliveryToken = 0;
+};
+
+/**
+ * A batch of formatted measurements being collected for one topic. Once
+ * closed, the batch is ready to be published and keeps its payload until
+ * released, then its buffer can be opened again.
+ */
+class MeasurementBatch {
+  public:
+    /**
+     * @brief Starts a new batch for the given topic, writing the batch header
+     *
+     * @return false if topic or header do not fit in the batch buffers
+     */
+    bool open(const char* topic, const core::Measurement& m, BatchMode mode,
+              uint32_t nowMs);
+
+    /**
+     * @brief Appends the measurement to the batch
+     *
+     * @param maxBytes: payload size limit, footer included
+     *
+     * @return false if the measurement does not fit, the batch is unchanged
+     */
+    bool append(const core::Measurement& m, size_t maxBytes);
+
+    /**
+     * @brief returns whether the measurement belongs to this batch
+     */
+    bool accepts(const char* topic, const core::Measurement& m) const;
+
+    /**
+     * @brief Terminates the payload and closes the batch, which is then ready
+     *        to be published
+     *
+     * @param sequence: order in which the ready batches are published
+     * @param nowUs: time it was closed, see closedAtUs()
+     *
+     * @note topic() and payload() stay valid until the batch is released
+     */
+    void close(uint32_t sequence = 0, uint32_t nowUs = 0);
+
+    /**
+     * @brief Frees the buffer of a closed batch, e.g. once published
+     */
+    void release();
+
+    bool isOpen() const {
+        return mState == State::OPEN;
+    }
+
+    bool isReady() const {
+        return mState == State::READY;
+    }
+
+    bool isFree() const {
+        return mState == State::FREE;
+    }
+
+    uint32_t sequence() const {
+        return mSequence;
+    }
+
+    uint32_t closedAtUs() const {
+        return mClosedAtUs;
+    }
+
+    size_t length() const {
+        return mLength;
+    }
+
+    size_t count() const {
+        return mCount;
+    }
+
+    uint32_t openedAtMs() const {
+        return mOpenedAtMs;
+    }
+
+    const char* topic() const {
+        return mTopic;
+    }
+
+    const char* payload() const {
+        return mPayload;
+    }
+
+  private:
+    enum class State : uint8_t {
+        FREE = 0,
+        OPEN,
+        READY,
+    };
+
+    State mState = State::FREE;
+    BatchMode mMode = BatchMode::DISABLED;
+    uint64_t mDeviceID = 0;
+    core::SignalType mSignalType{};
+    size_t mCount = 0;
+    size_t mLength = 0;
+    uint32_t mOpenedAtMs = 0;
+    uint32_t mSequence = 0;
+    uint32_t mClosedAtUs = 0;
+    char mTopic[MQTT_TOPIC_MAX_LENGTH]{};
+    char mPayload[MQTT_BATCH_MAX_LENGTH]{};
+
+    const char* footer() const;
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MEASUREMENT_BATCH_H */
@@ -0,0 +1,156 @@
+#include "MeasurementFilter.h"
+#include <cmath>
+
+namespace sensirion::upt::mqtt {
+
+void MeasurementFilter::setDefaultConfig(const FilterConfig& config) {
+    mDefaultConfig = config;
+}
+
+bool MeasurementFilter::setSignalConfig(core::SignalType signalType,
+                                        const FilterConfig& config) {
+    SignalConfig* target = nullptr;
+    for (auto& signalConfig : mSignalConfigs) {
+        if (signalConfig.valid && signalConfig.signalType == signalType) {
+            target = &signalConfig;
+            break;
+        }
+        if (!signalConfig.valid && target == nullptr) {
+            target = &signalConfig;
+        }
+    }
+    if (target == nullptr) {
+        return false;
+    }
+    target->valid = true;
+    target->signalType = signalType;
+    target->config = config;
+    return true;
+}
+
+bool MeasurementFilter::active() const {
+    if (!passesAll(mDefaultConfig)) {
+        return true;
+    }
+    for (const auto& signalConfig : mSignalConfigs) {
+        if (signalConfig.valid && !passesAll(signalConfig.config)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MeasurementFilter::apply(core::Measurement& m, uint32_t nowMs) {
+    const FilterConfig& config = configOf(m.signalType);
+    if (passesAll(config)) {
+        return true;
+    }
+    State& state = stateOf(m);
+    float value = m.dataPoint.value;
+
+    if (config.aggregation != FilterAggregation::NONE &&
+        config.sampleCount > 1) {
+        if (state.samples == 0) {
+            state.aggregate = value;
+        } else if (config.aggregation == FilterAggregation::AVERAGE) {
+            state.aggregate += value;
+        } else if (config.aggregation == FilterAggregation::MIN) {
+            state.aggregate = value < state.aggregate ? value : state.aggregate;
+        } else {
+            state.aggregate = value > state.aggregate ? value : state.aggregate;
+        }
+        if (++state.samples < config.sampleCount) {
+            return false;
+        }
+        value = config.aggregation == FilterAggregation::AVERAGE
+                    ? state.aggregate / state.samples
+                    : state.aggregate;
+        state.samples = 0;
+    }
+
+    bool publish = !state.published;
+    if (!publish) {
+        const uint32_t elapsedMs = nowMs - state.lastPublishedMs;
+        const float delta = std::fabs(value - state.lastPublishedValue);
+        switch (config.deadbandMode) {
+            case FilterDeadband::ABSOLUTE:
+                publish = delta > config.deadband;
+                break;
+            case FilterDeadband::RELATIVE:
+                publish = delta >
+                          config.deadband * std::fabs(state.lastPublishedValue);
+                break;
+            default:
+                publish = true;
+                break;
+        }
+        if (elapsedMs < config.minIntervalMs) {
+            publish = false;
+        }
+        if (config.heartbeatMs > 0 && elapsedMs >= config.heartbeatMs) {
+            publish = true;
+        }
+    }
+
+    if (publish) {
+        state.published = true;
+        state.lastPublishedValue = value;
+        state.lastPublishedMs = nowMs;
+        m.dataPoint.value = value;
+    }
+    return publish;
+}
+
+void MeasurementFilter::reset() {
+    for (auto& state : mStates) {
+        state.valid = false;
+    }
+}
+
+/**
+ * Without aggregation, deadband and minimum interval every sample is
+ * published as is, the heartbeat has nothing to add
+ */
+bool MeasurementFilter::passesAll(const FilterConfig& config) {
+    return (config.aggregation == FilterAggregation::NONE ||
+            config.sampleCount <= 1) &&
+           config.deadbandMode == FilterDeadband::NONE &&
+           config.minIntervalMs == 0;
+}
+
+const FilterConfig&
+MeasurementFilter::configOf(core::SignalType signalType) const {
+    for (const auto& signalConfig : mSignalConfigs) {
+        if (signalConfig.valid && signalConfig.signalType == signalType) {
+            return signalConfig.config;
+        }
+    }
+    return mDefaultConfig;
+}
+
+MeasurementFilter::State&
+MeasurementFilter::stateOf(const core::Measurement& m) {
+    State* target = &mStates[0];
+    for (auto& state : mStates) {
+        if (state.valid && state.deviceID == m.metaData.deviceID &&
+            state.signalType == m.signalType) {
+            state.lastUse = ++mUseCounter;
+            return state;
+        }
+        if (!state.valid) {
+            if (target->valid) {
+                target = &state;
+            }
+        } else if (target->valid && state.lastUse < target->lastUse) {
+            target = &state;
+        }
+    }
+    *target = State{};
+    target->valid = true;
+    target->deviceID = m.metaData.deviceID;
+    target->signalType = m.signalType;
+    target->lastUse = ++mUseCounter;
+    return *target;
+}
+
+}  // namespace sensirion::upt::mqtt
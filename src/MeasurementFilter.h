@@ -0,0 +1,114 @@
+#ifndef UPT_MQTT_MEASUREMENT_FILTER_H
+#define UPT_MQTT_MEASUREMENT_FILTER_H
+
+#include "mqtt_cfg.h"
+#include <Sensirion_UPT_Core.h>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+enum class FilterAggregation {
+    NONE = 0,
+    AVERAGE,  // publish the average of sampleCount samples
+    MIN,      // publish the minimum of sampleCount samples
+    MAX,      // publish the maximum of sampleCount samples
+};
+
+enum class FilterDeadband {
+    NONE = 0,
+    ABSOLUTE,  // publish if |value - last published| > deadband
+    RELATIVE,  // publish if |value - last published| > deadband * |last|
+};
+
+/**
+ * Configuration of the filter applied to the measurements of a signal.
+ * Samples are first aggregated, then the aggregated value is published if
+ * it passes the deadband and minimum interval, or if the heartbeat is due.
+ */
+struct FilterConfig {
+    FilterAggregation aggregation = FilterAggregation::NONE;
+    uint16_t sampleCount = 1;
+    FilterDeadband deadbandMode = FilterDeadband::NONE;
+    float deadband = 0.0f;
+    // Minimum time between two published measurements, 0 to disable
+    uint32_t minIntervalMs = 0;
+    // Publish at least once per heartbeat even without change, 0 to disable.
+    // Only evaluated when a sample arrives: a silent sensor publishes nothing
+    uint32_t heartbeatMs = 0;
+};
+
+/**
+ * Decides which measurements are published, with a per signal
+ * configuration and a state per (device ID, signal type) kept in a fixed
+ * capacity table. The least recently used state is evicted when full.
+ *
+ * @note Not thread safe, the owner has to serialize the accesses.
+ */
+class MeasurementFilter {
+  public:
+    /**
+     * @brief Set the configuration used for signals without specific one
+     */
+    void setDefaultConfig(const FilterConfig& config);
+
+    /**
+     * @brief Set the configuration for one signal type
+     *
+     * @return false if MQTT_FILTER_SIGNAL_CONFIGS signals are configured
+     */
+    bool setSignalConfig(core::SignalType signalType,
+                         const FilterConfig& config);
+
+    /**
+     * @brief returns false if every configuration lets all measurements
+     *        through unchanged, the filter can then be skipped
+     */
+    bool active() const;
+
+    /**
+     * @brief Passes a measurement through the filter
+     *
+     * @param m: the measurement, its value is replaced by the aggregated one
+     * @param nowMs: the current time
+     *
+     * @return true if the measurement should be published
+     */
+    bool apply(core::Measurement& m, uint32_t nowMs);
+
+    /**
+     * @brief Forget the state of all signals
+     */
+    void reset();
+
+  private:
+    struct SignalConfig {
+        bool valid = false;
+        core::SignalType signalType{};
+        FilterConfig config{};
+    };
+
+    struct State {
+        bool valid = false;
+        uint64_t deviceID = 0;
+        core::SignalType signalType{};
+        bool published = false;
+        float lastPublishedValue = 0.0f;
+        uint32_t lastPublishedMs = 0;
+        float aggregate = 0.0f;
+        uint16_t samples = 0;
+        uint32_t lastUse = 0;
+    };
+
+    FilterConfig mDefaultConfig{};
+    SignalConfig mSignalConfigs[MQTT_FILTER_SIGNAL_CONFIGS];
+    State mStates[MQTT_FILTER_STATE_SLOTS];
+    uint32_t mUseCounter = 0;
+
+    static bool passesAll(const FilterConfig& config);
+    const FilterConfig& configOf(core::SignalType signalType) const;
+    State& stateOf(const core::Measurement& m);
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MEASUREMENT_FILTER_H */
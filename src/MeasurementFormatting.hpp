@@ -1,72 +1,402 @@
+#ifndef UPT_MQTT_MEASUREMENT_FORMATTING_HPP
+#define UPT_MQTT_MEASUREMENT_FORMATTING_HPP
+
+#include "mqtt_cfg.h"
 #include <Sensirion_UPT_Core.h>
-#include <iostream>   
-#include <sstream>    
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace sensirion::upt::mqtt
 {
 
+    /**
+     * Appends text to a caller-provided, fixed size buffer.
+     *
+     * The buffer is always kept NUL-terminated. Writes that do not fit are
+     * dropped and reported through overflowed(); no heap memory is used.
+     */
+    class FixedBufferWriter
+    {
+      public:
+        FixedBufferWriter(char* buffer, size_t capacity)
+            : mBuffer{buffer}, mCapacity{capacity} {
+            if (mCapacity > 0) {
+                mBuffer[0] = '\0';
+            }
+        }
+
+        FixedBufferWriter& append(char c) {
+            if (mLength + 1 >= mCapacity) {
+                mOverflowed = true;
+                return *this;
+            }
+            mBuffer[mLength++] = c;
+            mBuffer[mLength] = '\0';
+            return *this;
+        }
+
+        FixedBufferWriter& append(const char* str) {
+            return append(std::string_view{str == nullptr ? "" : str});
+        }
+
+        FixedBufferWriter& append(std::string_view str) {
+            if (mLength + str.size() >= mCapacity) {
+                mOverflowed = true;
+                return *this;
+            }
+            str.copy(mBuffer + mLength, str.size());
+            mLength += str.size();
+            mBuffer[mLength] = '\0';
+            return *this;
+        }
+
+        template <typename T>
+        FixedBufferWriter& appendInteger(T value) {
+            static_assert(std::is_integral<T>::value, "integer type expected");
+            char digits[24];
+            size_t count = 0;
+            bool negative = false;
+            uint64_t magnitude = static_cast<uint64_t>(value);
+            if constexpr (std::is_signed<T>::value) {
+                if (value < 0) {
+                    negative = true;
+                    magnitude = 0 - static_cast<uint64_t>(value);
+                }
+            }
+            do {
+                digits[count++] = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude != 0);
+
+            if (mLength + count + (negative ? 1 : 0) >= mCapacity) {
+                mOverflowed = true;
+                return *this;
+            }
+            if (negative) {
+                mBuffer[mLength++] = '-';
+            }
+            while (count > 0) {
+                mBuffer[mLength++] = digits[--count];
+            }
+            mBuffer[mLength] = '\0';
+            return *this;
+        }
+
+        /**
+         * Appends value with a fixed number of decimals (max 9). NaN and
+         * infinities are written as null to keep the JSON output valid.
+         */
+        FixedBufferWriter& appendFixed(float value, uint8_t decimals) {
+            static constexpr uint32_t kPow10[] = {
+                1,      10,      100,      1000,      10000,
+                100000, 1000000, 10000000, 100000000, 1000000000};
+            if (!std::isfinite(value)) {
+                return append("null");
+            }
+            if (decimals > 9) {
+                decimals = 9;
+            }
+            const double scale = kPow10[decimals];
+            const double magnitude = std::fabs(static_cast<double>(value));
+            if (magnitude * scale >= 1e18) {
+                // out of range for the integer path, rare enough for snprintf
+                char tmp[48];
+                int len = snprintf(tmp, sizeof(tmp), "%.*f", decimals,
+                                   static_cast<double>(value));
+                return append(std::string_view{tmp, static_cast<size_t>(len)});
+            }
+            const auto scaled = static_cast<uint64_t>(magnitude * scale + 0.5);
+            const uint64_t integral = scaled / kPow10[decimals];
+            uint64_t fraction = scaled % kPow10[decimals];
+
+            if (value < 0 && scaled != 0) {
+                append('-');
+            }
+            appendInteger(integral);
+            if (decimals == 0) {
+                return *this;
+            }
+            char digits[9];
+            for (int i = decimals - 1; i >= 0; --i) {
+                digits[i] = static_cast<char>('0' + fraction % 10);
+                fraction /= 10;
+            }
+            append('.');
+            return append(std::string_view{digits, decimals});
+        }
+
+        const char* c_str() const {
+            return mBuffer;
+        }
+
+        size_t length() const {
+            return mLength;
+        }
+
+        bool overflowed() const {
+            return mOverflowed;
+        }
+
+        /**
+         * @brief returns the number of written characters, or the buffer
+         * capacity if the output did not fit (same convention as snprintf)
+         */
+        size_t result() const {
+            return mOverflowed ? mCapacity : mLength;
+        }
+
+      private:
+        char* mBuffer;
+        size_t mCapacity;
+        size_t mLength = 0;
+        bool mOverflowed = false;
+    };
+
+    /**
+     * Fixed size string built at compile time, see concat
+     */
+    template <size_t N>
+    struct StaticString
+    {
+        char data[N + 1]{};
+
+        constexpr size_t size() const {
+            return N;
+        }
+
+        constexpr operator std::string_view() const {
+            return std::string_view{data, N};
+        }
+    };
+
+    /**
+     * Concatenates string literals at compile time, e.g.
+     * constexpr auto field = concat(", \"", "value", "\":");
+     */
+    template <size_t... Ns>
+    constexpr StaticString<((Ns - 1) + ... + 0)>
+    concat(const char (&... parts)[Ns]) {
+        StaticString<((Ns - 1) + ... + 0)> result{};
+        size_t pos = 0;
+        const auto appendPart = [&result, &pos](const char* part, size_t n) {
+            for (size_t i = 0; i + 1 < n; ++i) {
+                result.data[pos++] = part[i];
+            }
+        };
+        (appendPart(parts, Ns), ...);
+        result.data[pos] = '\0';
+        return result;
+    }
+
+    /**
+     * JSON keys of the provided formatters and the fragments surrounding the
+     * values, assembled at compile time so their length is known.
+     */
+    namespace json
+    {
+        inline constexpr char kTimeOffsetKey[] = "time_offset_ms";
+        inline constexpr char kValueKey[] = "value";
+        inline constexpr char kDeviceIdKey[] = "device_id";
+        inline constexpr char kDeviceTypeKey[] = "device_type";
+        inline constexpr char kSignalKey[] = "signal";
+        inline constexpr char kSignalUnitKey[] = "signal_unit";
+        inline constexpr char kValuesKey[] = "values";
+
+        inline constexpr auto kTimeOffsetOpen =
+            concat("{\"", kTimeOffsetKey, "\":");
+        inline constexpr auto kValueField = concat(", \"", kValueKey, "\":");
+        inline constexpr auto kDeviceIdOpen =
+            concat("{\"", kDeviceIdKey, "\":");
+        inline constexpr auto kDeviceIdField =
+            concat(", \"", kDeviceIdKey, "\":");
+        inline constexpr auto kDeviceTypeField =
+            concat(", \"", kDeviceTypeKey, "\":\"");
+        inline constexpr auto kSignalField =
+            concat("\", \"", kSignalKey, "\":\"");
+        inline constexpr auto kSignalUnitField =
+            concat("\", \"", kSignalUnitKey, "\":\"");
+        inline constexpr auto kValuesOpen =
+            concat("\", \"", kValuesKey, "\":[");
+    } // namespace json
+
+    /**
+     * Runs the buffer based operator of a formatter on a stack buffer and
+     * copies the result into a string. Used by the std::string operators to
+     * stay compatible with MeasurementFormatterType.
+     *
+     * The text is never truncated: if it does not fit into the stack buffer,
+     * it is formatted again into a growing string. The service then rejects
+     * a payload or topic that is too long instead of sending it cut or empty.
+     */
+    template <typename Formatter>
+    std::string formatToString(const Formatter& formatter,
+                               const sensirion::upt::core::Measurement& m) {
+        char buffer[MQTT_MESSAGE_MAX_LENGTH];
+        const size_t len = formatter(m, buffer, sizeof(buffer));
+        if (len < sizeof(buffer)) {
+            return std::string(buffer, len);
+        }
+        std::string text(2 * sizeof(buffer), '\0');
+        size_t written = formatter(m, text.data(), text.size());
+        while (written >= text.size()) {
+            text.resize(2 * text.size());
+            written = formatter(m, text.data(), text.size());
+        }
+        text.resize(written);
+        return text;
+    }
+
     struct DefaultMeasurementFormatter
     {
-        std::string operator () (const sensirion::upt::core::Measurement& m){
-            std::stringstream stream{};
-            stream.precision(4);
-            stream << "{\"time_offset_ms\":";
-            stream << m.dataPoint.t_offset;
-            stream << ", \"value\":";
-            stream << m.dataPoint.value;
-            stream << "}";
-            return stream.str();
+        /**
+         * @brief Formats the Measurement into the provided buffer
+         *
+         * @return number of characters written (NUL excluded). A value >= size
+         * means the output did not fit into the buffer.
+         */
+        size_t operator () (const sensirion::upt::core::Measurement& m,
+                            char* buffer, size_t size) const {
+            FixedBufferWriter writer{buffer, size};
+            writer.append(json::kTimeOffsetOpen);
+            writer.appendInteger(m.dataPoint.t_offset);
+            writer.append(json::kValueField);
+            writer.appendFixed(m.dataPoint.value, MQTT_FORMATTER_VALUE_DECIMALS);
+            writer.append('}');
+            return writer.result();
+        }
+
+        std::string operator () (const sensirion::upt::core::Measurement& m) const {
+            return formatToString(*this, m);
         }
     };
 
     struct FullMeasurementFormatter
     {
-        std::string operator () (const sensirion::upt::core::Measurement& m){
-            std::stringstream stream{};
-            stream.precision(4);
-            stream << "{\"time_offset_ms\":";
-            stream << m.dataPoint.t_offset;
-            stream << ", \"value\":";
-            stream << m.dataPoint.value;
-            stream << ", \"device_id\":";
-            stream << m.metaData.deviceID;
-            stream << ", \"device_type\":\"";
-            stream << m.metaData.deviceType;
-            stream << "\", \"signal\":\"";
-            stream << quantityOf(m.signalType);
-            stream << "\", \"signal_unit\":\"";
-            stream << unitOf(m.signalType);
-            stream << "\"}";
-            return stream.str();
+        size_t operator () (const sensirion::upt::core::Measurement& m,
+                            char* buffer, size_t size) const {
+            FixedBufferWriter writer{buffer, size};
+            writer.append(json::kTimeOffsetOpen);
+            writer.appendInteger(m.dataPoint.t_offset);
+            writer.append(json::kValueField);
+            writer.appendFixed(m.dataPoint.value, MQTT_FORMATTER_VALUE_DECIMALS);
+            writer.append(json::kDeviceIdField);
+            writer.appendInteger(m.metaData.deviceID);
+            writer.append(json::kDeviceTypeField);
+            writer.append(core::deviceLabel(m.metaData.deviceType));
+            writer.append(json::kSignalField);
+            writer.append(quantityOf(m.signalType));
+            writer.append(json::kSignalUnitField);
+            writer.append(unitOf(m.signalType));
+            writer.append("\"}");
+            return writer.result();
+        }
+
+        std::string operator () (const sensirion::upt::core::Measurement& m) const {
+            return formatToString(*this, m);
+        }
+    };
+
+    /**
+     * Formats a batch of measurements sharing the same metadata. The metadata
+     * is written once in the header, each element only holds the data point:
+     *
+     * {"device_id":..., "device_type":"...", "signal":"...",
+     *  "signal_unit":"...", "values":[{"time_offset_ms":..., "value":...}]}
+     */
+    struct BatchMeasurementFormatter
+    {
+        static constexpr const char* footer = "]}";
+
+        size_t header(const sensirion::upt::core::Measurement& m,
+                      char* buffer, size_t size) const {
+            FixedBufferWriter writer{buffer, size};
+            writer.append(json::kDeviceIdOpen);
+            writer.appendInteger(m.metaData.deviceID);
+            writer.append(json::kDeviceTypeField);
+            writer.append(core::deviceLabel(m.metaData.deviceType));
+            writer.append(json::kSignalField);
+            writer.append(quantityOf(m.signalType));
+            writer.append(json::kSignalUnitField);
+            writer.append(unitOf(m.signalType));
+            writer.append(json::kValuesOpen);
+            return writer.result();
+        }
+
+        size_t element(const sensirion::upt::core::Measurement& m,
+                       char* buffer, size_t size) const {
+            return DefaultMeasurementFormatter{}(m, buffer, size);
+        }
+    };
+
+    /**
+     * Formats a batch of measurements with different metadata as a JSON array
+     * of FullMeasurementFormatter elements.
+     */
+    struct MixedBatchMeasurementFormatter
+    {
+        static constexpr const char* footer = "]";
+
+        size_t header(const sensirion::upt::core::Measurement& m,
+                      char* buffer, size_t size) const {
+            FixedBufferWriter writer{buffer, size};
+            writer.append('[');
+            return writer.result();
+        }
+
+        size_t element(const sensirion::upt::core::Measurement& m,
+                       char* buffer, size_t size) const {
+            return FullMeasurementFormatter{}(m, buffer, size);
         }
     };
 
     struct DefaultMeasurementToTopicSuffix{
-        std::string operator() (const sensirion::upt::core::Measurement& m){
-            
-            std::stringstream stream{};
-            stream << core::deviceLabel( m.metaData.deviceType); 
-            stream << " " << m.metaData.deviceID 
-                   << " " << sensirion::upt::core::quantityOf(m.signalType);
-            return stream.str();
+        size_t operator() (const sensirion::upt::core::Measurement& m,
+                           char* buffer, size_t size) const {
+            FixedBufferWriter writer{buffer, size};
+            writer.append(core::deviceLabel(m.metaData.deviceType));
+            writer.append(' ').appendInteger(m.metaData.deviceID);
+            writer.append(' ').append(
+                sensirion::upt::core::quantityOf(m.signalType));
+            return writer.result();
+        }
+
+        std::string operator() (const sensirion::upt::core::Measurement& m) const {
+            return formatToString(*this, m);
         }
     };
     
     struct MeasurementToTopicSuffixTree{
-        std::string operator() (const sensirion::upt::core::Measurement& m){
-            
-            std::stringstream stream{};
-            stream << core::deviceLabel(m.metaData.deviceType); 
-            stream << "/" << m.metaData.deviceID 
-                   << "/" << sensirion::upt::core::quantityOf(m.signalType);
-            return stream.str();
+        size_t operator() (const sensirion::upt::core::Measurement& m,
+                           char* buffer, size_t size) const {
+            FixedBufferWriter writer{buffer, size};
+            writer.append(core::deviceLabel(m.metaData.deviceType));
+            writer.append('/').appendInteger(m.metaData.deviceID);
+            writer.append('/').append(
+                sensirion::upt::core::quantityOf(m.signalType));
+            return writer.result();
+        }
+
+        std::string operator() (const sensirion::upt::core::Measurement& m) const {
+            return formatToString(*this, m);
         }
     };
 
     struct MeasurementToTopicSuffixEmpty{
-        std::string operator() (const sensirion::upt::core::Measurement& m){
+        size_t operator() (const sensirion::upt::core::Measurement& m,
+                           char* buffer, size_t size) const {
+            FixedBufferWriter writer{buffer, size};
+            return writer.result();
+        }
+
+        std::string operator() (const sensirion::upt::core::Measurement& m) const {
             return "";
         }
     };
 
 } // end namespace
+
+#endif /* UPT_MQTT_MEASUREMENT_FORMATTING_HPP */
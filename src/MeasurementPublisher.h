@@ -0,0 +1,79 @@
+#ifndef UPT_MQTT_MEASUREMENT_PUBLISHER_H
+#define UPT_MQTT_MEASUREMENT_PUBLISHER_H
+
+#include "MeasurementFormatting.hpp"
+#include "MqttMailingService.h"
+#include <string_view>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Publishes measurements through an MqttMailingService with a formatter and
+ * a topic suffix function chosen at compile time, e.g.
+ *
+ *   MeasurementPublisher<FullMeasurementFormatter,
+ *                        MeasurementToTopicSuffixTree> publisher{service};
+ *   publisher.send(measurement);
+ *
+ * Unlike the functions registered with setMeasurementMessageFormatterFn and
+ * setMeasurementToTopicSuffixFn, the calls are not dispatched through
+ * std::function: the compiler sees the formatter and the topic function and
+ * can inline them. Both are written directly into buffers, without heap
+ * allocation.
+ *
+ * Formatter and TopicSuffixFn must provide
+ * size_t operator()(const core::Measurement&, char* buffer, size_t size),
+ * as the formatters of MeasurementFormatting.hpp do.
+ *
+ * @note The topic suffix is computed for every measurement, the topic cache
+ *       of the service is not used.
+ */
+template <typename Formatter,
+          typename TopicSuffixFn = MeasurementToTopicSuffixTree>
+class MeasurementPublisher {
+  public:
+    explicit MeasurementPublisher(MqttMailingService& service,
+                                  Formatter formatter = Formatter{},
+                                  TopicSuffixFn topicSuffixFn = TopicSuffixFn{})
+        : mService{service}, mFormatter{formatter},
+          mTopicSuffixFn{topicSuffixFn} {
+    }
+
+    /**
+     * @brief Send a measurement to the topic defined by TopicSuffixFn
+     *
+     * @return true if the message was successfully posted to the mailbox
+     */
+    bool send(const core::Measurement& measurement) {
+        char topicSuffix[MQTT_TOPIC_MAX_LENGTH];
+        const size_t length =
+            mTopicSuffixFn(measurement, topicSuffix, sizeof(topicSuffix));
+        if (length >= sizeof(topicSuffix)) {
+            return false;
+        }
+        return send(measurement, std::string_view{topicSuffix, length});
+    }
+
+    /**
+     * @brief Send a measurement to a given topic
+     *
+     * @param topicSuffix the topic suffix (will be combined with the global
+     *        prefix)
+     *
+     * @return true if the message was successfully posted to the mailbox
+     */
+    bool send(const core::Measurement& measurement,
+              std::string_view topicSuffix) {
+        return mService.sendMeasurementWith(mFormatter, measurement,
+                                            topicSuffix);
+    }
+
+  private:
+    MqttMailingService& mService;
+    Formatter mFormatter;
+    TopicSuffixFn mTopicSuffixFn;
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MEASUREMENT_PUBLISHER_H */
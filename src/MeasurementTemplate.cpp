@@ -0,0 +1,163 @@
+#include "MeasurementTemplate.h"
+#include "MeasurementFormatting.hpp"
+#include <cctype>
+
+namespace sensirion::upt::mqtt {
+
+MeasurementTemplate::MeasurementTemplate(std::string_view text) {
+    parse(text);
+}
+
+bool MeasurementTemplate::parse(std::string_view text) {
+    mInstructionCount = 0;
+    mLiteralsLength = 0;
+    mHasDataPointFields = false;
+    mValid = false;
+    if (text.size() >= sizeof(mLiterals)) {
+        return false;
+    }
+    size_t literalStart = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        if (text[pos] != '{') {
+            pos++;
+            continue;
+        }
+        // A placeholder is "{name}" or "{name:format}", other braces are
+        // literal, e.g. those of a JSON object
+        size_t nameEnd = pos + 1;
+        while (nameEnd < text.size() &&
+               (std::isalpha(static_cast<unsigned char>(text[nameEnd])) ||
+                text[nameEnd] == '_')) {
+            nameEnd++;
+        }
+        const size_t close = text.find('}', nameEnd);
+        if (nameEnd == pos + 1 || close == std::string_view::npos ||
+            (text[nameEnd] != '}' && text[nameEnd] != ':')) {
+            pos++;
+            continue;
+        }
+        Field field;
+        uint8_t decimals;
+        if (!addLiteral(text.substr(literalStart, pos - literalStart)) ||
+            !parseField(text.substr(pos + 1, close - pos - 1), field,
+                        decimals) ||
+            !addInstruction(field, decimals)) {
+            mInstructionCount = 0;
+            return false;
+        }
+        mHasDataPointFields = mHasDataPointFields ||
+                              field == Field::TIME_OFFSET ||
+                              field == Field::VALUE;
+        pos = close + 1;
+        literalStart = pos;
+    }
+    if (!addLiteral(text.substr(literalStart))) {
+        mInstructionCount = 0;
+        return false;
+    }
+    mValid = true;
+    return true;
+}
+
+bool MeasurementTemplate::addInstruction(Field field, uint8_t decimals) {
+    if (mInstructionCount == MQTT_TEMPLATE_MAX_INSTRUCTIONS) {
+        return false;
+    }
+    mInstructions[mInstructionCount++] = {field, decimals, 0, 0};
+    return true;
+}
+
+bool MeasurementTemplate::addLiteral(std::string_view text) {
+    if (text.empty()) {
+        return true;
+    }
+    if (!addInstruction(Field::LITERAL)) {
+        return false;
+    }
+    Instruction& instruction = mInstructions[mInstructionCount - 1];
+    instruction.offset = static_cast<uint16_t>(mLiteralsLength);
+    instruction.length = static_cast<uint16_t>(text.size());
+    text.copy(mLiterals + mLiteralsLength, text.size());
+    mLiteralsLength += text.size();
+    return true;
+}
+
+bool MeasurementTemplate::parseField(std::string_view placeholder,
+                                     Field& field, uint8_t& decimals) {
+    static constexpr struct {
+        std::string_view name;
+        Field field;
+    } kFields[] = {
+        {"t_offset", Field::TIME_OFFSET},
+        {"value", Field::VALUE},
+        {"deviceID", Field::DEVICE_ID},
+        {"deviceLabel", Field::DEVICE_LABEL},
+        {"quantity", Field::QUANTITY},
+        {"unit", Field::UNIT},
+    };
+    const size_t colon = placeholder.find(':');
+    const std::string_view name = placeholder.substr(0, colon);
+    decimals = MQTT_FORMATTER_VALUE_DECIMALS;
+    bool known = false;
+    for (const auto& entry : kFields) {
+        if (entry.name == name) {
+            field = entry.field;
+            known = true;
+            break;
+        }
+    }
+    if (!known) {
+        return false;
+    }
+    if (colon == std::string_view::npos) {
+        return true;
+    }
+    // Only the value has a format: .Nf
+    const std::string_view format = placeholder.substr(colon + 1);
+    if (field != Field::VALUE || format.size() != 3 || format[0] != '.' ||
+        format[1] < '0' || format[1] > '9' || format[2] != 'f') {
+        return false;
+    }
+    decimals = static_cast<uint8_t>(format[1] - '0');
+    return true;
+}
+
+size_t MeasurementTemplate::operator()(const core::Measurement& m,
+                                       char* buffer, size_t size) const {
+    FixedBufferWriter writer{buffer, size};
+    for (size_t i = 0; i < mInstructionCount; ++i) {
+        const Instruction& instruction = mInstructions[i];
+        switch (instruction.field) {
+            case Field::LITERAL:
+                writer.append(std::string_view{
+                    mLiterals + instruction.offset, instruction.length});
+                break;
+            case Field::TIME_OFFSET:
+                writer.appendInteger(m.dataPoint.t_offset);
+                break;
+            case Field::VALUE:
+                writer.appendFixed(m.dataPoint.value, instruction.decimals);
+                break;
+            case Field::DEVICE_ID:
+                writer.appendInteger(m.metaData.deviceID);
+                break;
+            case Field::DEVICE_LABEL:
+                writer.append(core::deviceLabel(m.metaData.deviceType));
+                break;
+            case Field::QUANTITY:
+                writer.append(core::quantityOf(m.signalType));
+                break;
+            case Field::UNIT:
+                writer.append(core::unitOf(m.signalType));
+                break;
+        }
+    }
+    return writer.result();
+}
+
+std::string MeasurementTemplate::operator()(const core::Measurement& m) const {
+    return formatToString(*this, m);
+}
+
+}  // namespace sensirion::upt::mqtt
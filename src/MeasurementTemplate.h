@@ -0,0 +1,106 @@
+#ifndef UPT_MQTT_MEASUREMENT_TEMPLATE_H
+#define UPT_MQTT_MEASUREMENT_TEMPLATE_H
+
+#include "mqtt_cfg.h"
+#include <Sensirion_UPT_Core.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Measurement formatter defined by a template string at runtime, e.g.
+ *
+ * {"t":{t_offset},"v":{value:.2f},"id":{deviceID},"q":"{quantity}"}
+ *
+ * A placeholder is a field name in braces, all other characters (braces
+ * included) are copied as is. Fields:
+ * - t_offset: time offset of the data point
+ * - value: value of the data point, {value:.Nf} with N decimals (max 9),
+ *   MQTT_FORMATTER_VALUE_DECIMALS by default
+ * - deviceID, deviceLabel: ID and label of the device type of the sensor
+ * - quantity, unit: quantity and unit of the signal type
+ *
+ * The template is parsed once into a list of instructions, formatting a
+ * measurement runs them into the output buffer without parsing nor heap
+ * allocation.
+ */
+class MeasurementTemplate {
+  public:
+    MeasurementTemplate() = default;
+
+    /**
+     * @brief Parses the template, see valid()
+     */
+    explicit MeasurementTemplate(std::string_view text);
+
+    /**
+     * @brief Replaces the template
+     *
+     * @return false if the template has an unknown field or an invalid
+     *         format, or has more than MQTT_TEMPLATE_MAX_INSTRUCTIONS
+     *         instructions or MQTT_MESSAGE_MAX_LENGTH - 1 characters. The
+     *         template is then empty.
+     */
+    bool parse(std::string_view text);
+
+    bool valid() const {
+        return mValid;
+    }
+
+    /**
+     * @brief true if the template has a field of the data point (t_offset
+     *        or value), it then cannot be used as topic suffix function
+     */
+    bool hasDataPointFields() const {
+        return mHasDataPointFields;
+    }
+
+    /**
+     * @brief Formats the Measurement into the provided buffer
+     *
+     * @return number of characters written (NUL excluded). A value >= size
+     * means the output did not fit into the buffer.
+     */
+    size_t operator()(const core::Measurement& m, char* buffer,
+                      size_t size) const;
+
+    std::string operator()(const core::Measurement& m) const;
+
+  private:
+    enum class Field : uint8_t {
+        LITERAL = 0,
+        TIME_OFFSET,
+        VALUE,
+        DEVICE_ID,
+        DEVICE_LABEL,
+        QUANTITY,
+        UNIT,
+    };
+
+    // Literals are slices of mLiterals
+    struct Instruction {
+        Field field;
+        uint8_t decimals;
+        uint16_t offset;
+        uint16_t length;
+    };
+
+    bool addInstruction(Field field, uint8_t decimals = 0);
+    bool addLiteral(std::string_view text);
+    static bool parseField(std::string_view placeholder, Field& field,
+                           uint8_t& decimals);
+
+    Instruction mInstructions[MQTT_TEMPLATE_MAX_INSTRUCTIONS]{};
+    size_t mInstructionCount = 0;
+    char mLiterals[MQTT_MESSAGE_MAX_LENGTH]{};
+    size_t mLiteralsLength = 0;
+    bool mValid = false;
+    bool mHasDataPointFields = false;
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MEASUREMENT_TEMPLATE_H */
@@ -0,0 +1,30 @@
+#include "MessageAssembler.h"
+#include <cstring>
+
+namespace sensirion::upt::mqtt {
+
+MessageAssembler::Status
+MessageAssembler::addFragment(MailboxMessage& message, std::string_view topic,
+                              const char* data, size_t length, size_t offset,
+                              size_t totalLength) {
+    if (offset == 0) {
+        if (topic.empty() || topic.size() >= sizeof(message.topic) ||
+            totalLength > sizeof(message.payload)) {
+            return Status::REJECTED;
+        }
+        memcpy(message.topic, topic.data(), topic.size());
+        message.topic[topic.size()] = '\0';
+        message.payloadLength = 0;
+    }
+    if (offset != message.payloadLength || length > totalLength - offset) {
+        return Status::REJECTED;
+    }
+    if (length > 0) {
+        memcpy(message.payload + offset, data, length);
+    }
+    message.payloadLength += length;
+    return message.payloadLength == totalLength ? Status::COMPLETE
+                                                : Status::INCOMPLETE;
+}
+
+}  // namespace sensirion::upt::mqtt
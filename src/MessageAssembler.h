@@ -0,0 +1,44 @@
+#ifndef UPT_MQTT_MESSAGE_ASSEMBLER_H
+#define UPT_MQTT_MESSAGE_ASSEMBLER_H
+
+#include "MailboxMessage.h"
+#include <cstddef>
+#include <string_view>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Reassembles a received message from the fragments of MQTT_EVENT_DATA.
+ *
+ * The ESP MQTT client delivers messages larger than its buffer in several
+ * events, each holding a part of the payload at current_data_offset of
+ * total_data_len bytes. Only the first one carries the topic.
+ *
+ * The message is written into a MailboxMessage, so it is bounded by
+ * MQTT_TOPIC_MAX_LENGTH and MQTT_MESSAGE_MAX_LENGTH: larger messages are
+ * rejected, as are fragments not following the previous one.
+ */
+class MessageAssembler {
+  public:
+    enum class Status {
+        INCOMPLETE,  // more fragments are expected
+        COMPLETE,    // the message holds the whole payload
+        REJECTED,    // too large or out of sequence, the message is invalid
+    };
+
+    /**
+     * @brief Adds a fragment to message
+     *
+     * @param topic: topic of the message, only read from the first fragment
+     *        (offset 0), which resets the message
+     * @param offset: position of the fragment in the payload
+     * @param totalLength: length of the whole payload
+     */
+    static Status addFragment(MailboxMessage& message, std::string_view topic,
+                              const char* data, size_t length, size_t offset,
+                              size_t totalLength);
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MESSAGE_ASSEMBLER_H */
@@ -0,0 +1,81 @@
+#include "MessagePool.h"
+#include <new>
+
+namespace sensirion::upt::mqtt {
+
+MessagePool::~MessagePool() {
+    end();
+}
+
+bool MessagePool::begin(size_t blockCount) {
+    end();
+    mBlocks = new (std::nothrow) MailboxMessage[blockCount];
+    mFreeBlocks = xQueueCreate(blockCount, sizeof(MailboxMessage*));
+    if (mBlocks == nullptr || mFreeBlocks == nullptr) {
+        end();
+        return false;
+    }
+    mBlockCount = blockCount;
+    mInUse = 0;
+    mHighWaterMark = 0;
+    mExhaustedCount = 0;
+    for (size_t i = 0; i < blockCount; ++i) {
+        MailboxMessage* block = &mBlocks[i];
+        xQueueSendToBack(mFreeBlocks, &block, 0);
+    }
+    return true;
+}
+
+void MessagePool::end() {
+    if (mFreeBlocks != nullptr) {
+        vQueueDelete(mFreeBlocks);
+        mFreeBlocks = nullptr;
+    }
+    delete[] mBlocks;
+    mBlocks = nullptr;
+    mBlockCount = 0;
+}
+
+MailboxMessage* MessagePool::acquire(TickType_t wait) {
+    MailboxMessage* block = nullptr;
+    if (mFreeBlocks == nullptr ||
+        xQueueReceive(mFreeBlocks, &block, wait) != pdTRUE) {
+        mExhaustedCount++;
+        return nullptr;
+    }
+    const uint32_t inUse = ++mInUse;
+    uint32_t highWaterMark = mHighWaterMark.load();
+    while (inUse > highWaterMark &&
+           !mHighWaterMark.compare_exchange_weak(highWaterMark, inUse)) {
+    }
+    block->topic[0] = '\0';
+    block->payloadLength = 0;
+    return block;
+}
+
+void MessagePool::release(MailboxMessage* message) {
+    if (message == nullptr || mFreeBlocks == nullptr) {
+        return;
+    }
+    mInUse--;
+    xQueueSendToBack(mFreeBlocks, &message, 0);
+}
+
+size_t MessagePool::capacity() const {
+    return mBlockCount;
+}
+
+size_t MessagePool::available() const {
+    return mFreeBlocks == nullptr ? 0 : uxQueueMessagesWaiting(mFreeBlocks);
+}
+
+MessagePoolStatistics MessagePool::statistics() const {
+    MessagePoolStatistics stats;
+    stats.capacity = static_cast<uint32_t>(mBlockCount);
+    stats.inUse = mInUse.load();
+    stats.highWaterMark = mHighWaterMark.load();
+    stats.exhausted = mExhaustedCount.load();
+    return stats;
+}
+
+}  // namespace sensirion::upt::mqtt
@@ -0,0 +1,75 @@
+#ifndef UPT_MQTT_MESSAGE_POOL_H
+#define UPT_MQTT_MESSAGE_POOL_H
+
+#include "MailboxMessage.h"
+#include "MqttMetrics.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <atomic>
+#include <cstddef>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Pool of MailboxMessage blocks, allocated once by begin(). Messages are
+ * passed around by pointer, from the producer filling them to the sender
+ * task publishing them, and released back to the pool afterwards.
+ *
+ * Once begin() succeeded, no memory is allocated: the publish path does not
+ * fragment the heap however long the device runs.
+ *
+ * @note acquire() and release() may be called concurrently from any task,
+ *       the free blocks are held in a FreeRTOS queue.
+ */
+class MessagePool {
+  public:
+    MessagePool() = default;
+    ~MessagePool();
+
+    MessagePool(const MessagePool&) = delete;
+    MessagePool& operator=(const MessagePool&) = delete;
+
+    /**
+     * @brief Allocates blockCount blocks
+     *
+     * @return false if the memory could not be allocated
+     */
+    bool begin(size_t blockCount);
+
+    /**
+     * @brief Frees the blocks, none of them may be in use
+     */
+    void end();
+
+    /**
+     * @brief Takes a free block, waiting up to wait ticks
+     *
+     * @return the block, nullptr if none became free
+     */
+    MailboxMessage* acquire(TickType_t wait = 0);
+
+    /**
+     * @brief Gives a block back to the pool, nullptr is ignored
+     */
+    void release(MailboxMessage* message);
+
+    size_t capacity() const;
+    size_t available() const;
+
+    /**
+     * @brief returns the usage, high-water mark and exhaustion counters
+     */
+    MessagePoolStatistics statistics() const;
+
+  private:
+    MailboxMessage* mBlocks = nullptr;
+    size_t mBlockCount = 0;
+    QueueHandle_t mFreeBlocks = nullptr;
+    std::atomic<uint32_t> mInUse{0};
+    std::atomic<uint32_t> mHighWaterMark{0};
+    std::atomic<uint32_t> mExhaustedCount{0};
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MESSAGE_POOL_H */
@@ -0,0 +1,257 @@
+#include "MessageStore.h"
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+namespace sensirion::upt::mqtt {
+
+/*
+ *   RamMessageStore
+ */
+
+RamMessageStore::RamMessageStore(size_t capacity)
+    : mCapacity{capacity > 0 ? capacity : 1} {
+}
+
+RamMessageStore::~RamMessageStore() {
+    delete[] mSlots;
+}
+
+bool RamMessageStore::begin() {
+    if (mSlots == nullptr) {
+        mSlots = new (std::nothrow) MailboxMessage[mCapacity];
+    }
+    return mSlots != nullptr;
+}
+
+bool RamMessageStore::push(const MailboxMessage& msg) {
+    if (mSlots == nullptr) {
+        return false;
+    }
+    if (mCount == mCapacity) {
+        pop();
+        mOverwritten++;
+    }
+    mSlots[(mHead + mCount) % mCapacity] = msg;
+    mCount++;
+    return true;
+}
+
+bool RamMessageStore::front(MailboxMessage& msg) {
+    if (mCount == 0) {
+        return false;
+    }
+    msg = mSlots[mHead];
+    return true;
+}
+
+void RamMessageStore::pop() {
+    if (mCount == 0) {
+        return;
+    }
+    mHead = (mHead + 1) % mCapacity;
+    mCount--;
+}
+
+size_t RamMessageStore::count() const {
+    return mCount;
+}
+
+/*
+ *   FileMessageStore
+ */
+
+FileMessageStore::FileMessageStore(const char* path, size_t capacity)
+    : mPath{path}, mCapacity{capacity > 0 ? capacity : 1} {
+}
+
+FileMessageStore::~FileMessageStore() {
+    if (mFile != nullptr) {
+        fclose(mFile);
+    }
+}
+
+bool FileMessageStore::begin() {
+    if (mFile != nullptr) {
+        return true;
+    }
+    mFile = fopen(mPath, "r+b");
+    const long expectedSize = static_cast<long>(kRecordSize * mCapacity);
+    if (mFile != nullptr && (fseek(mFile, 0, SEEK_END) != 0 ||
+                             ftell(mFile) != expectedSize)) {
+        // Another layout, the records cannot be located
+        fclose(mFile);
+        mFile = nullptr;
+    }
+    if (mFile == nullptr && !create()) {
+        return false;
+    }
+
+    // Recover the ring position from the records left by a previous run
+    bool found = false;
+    bool pendingFound = false;
+    uint32_t maxSequence = 0;
+    uint32_t minPendingSequence = 0;
+    mCount = 0;
+    for (size_t slot = 0; slot < mCapacity; ++slot) {
+        RecordHeader header;
+        if (!readHeader(slot, header)) {
+            continue;
+        }
+        if (!found || header.sequence - maxSequence < 0x80000000u) {
+            maxSequence = header.sequence;
+            mWriteSlot = (slot + 1) % mCapacity;
+            found = true;
+        }
+        if (header.state == kPending) {
+            if (!pendingFound ||
+                minPendingSequence - header.sequence < 0x80000000u) {
+                minPendingSequence = header.sequence;
+                mReadSlot = slot;
+                pendingFound = true;
+            }
+            mCount++;
+        }
+    }
+    mNextSequence = found ? maxSequence + 1 : 0;
+    if (!pendingFound) {
+        mReadSlot = mWriteSlot;
+    }
+    return true;
+}
+
+bool FileMessageStore::push(const MailboxMessage& msg) {
+    if (mFile == nullptr) {
+        return false;
+    }
+    const size_t topicLength = strlen(msg.topic);
+    if (mCount == mCapacity) {
+        // The write slot holds the oldest record
+        mReadSlot = (mReadSlot + 1) % mCapacity;
+        mCount--;
+        mOverwritten++;
+    }
+
+    RecordHeader header{};
+    header.magic = kMagic;
+    header.sequence = mNextSequence;
+    header.topicLength = static_cast<uint16_t>(topicLength);
+    header.payloadLength = static_cast<uint16_t>(msg.payloadLength);
+    header.state = kPending;
+
+    // The previous header of the slot is invalidated before the body is
+    // overwritten and the new one goes last, so a torn write leaves no valid
+    // header over a partial body
+    const long offset = static_cast<long>(mWriteSlot * kRecordSize);
+    mDirty = true;
+    bool success = writeHeader(mWriteSlot, RecordHeader{});
+    success = success && fseek(mFile, offset, SEEK_SET) == 0 &&
+              fwrite(msg.topic, 1, topicLength, mFile) == topicLength;
+    success = success &&
+              fseek(mFile, offset + MQTT_TOPIC_MAX_LENGTH, SEEK_SET) == 0 &&
+              fwrite(msg.payload, 1, msg.payloadLength, mFile) ==
+                  msg.payloadLength;
+    success = success && writeHeader(mWriteSlot, header);
+    if (!success) {
+        return false;
+    }
+
+    mNextSequence++;
+    mWriteSlot = (mWriteSlot + 1) % mCapacity;
+    mCount++;
+    return true;
+}
+
+bool FileMessageStore::front(MailboxMessage& msg) {
+    RecordHeader header;
+    if (mCount == 0 || !readHeader(mReadSlot, header) ||
+        header.state != kPending ||
+        header.topicLength >= sizeof(msg.topic) ||
+        header.payloadLength > sizeof(msg.payload)) {
+        return false;
+    }
+    const long offset = static_cast<long>(mReadSlot * kRecordSize);
+    if (fseek(mFile, offset, SEEK_SET) != 0 ||
+        fread(msg.topic, 1, header.topicLength, mFile) != header.topicLength) {
+        return false;
+    }
+    msg.topic[header.topicLength] = '\0';
+    if (fseek(mFile, offset + MQTT_TOPIC_MAX_LENGTH, SEEK_SET) != 0 ||
+        fread(msg.payload, 1, header.payloadLength, mFile) !=
+            header.payloadLength) {
+        return false;
+    }
+    msg.payloadLength = header.payloadLength;
+    if (msg.payloadLength < sizeof(msg.payload)) {
+        msg.payload[msg.payloadLength] = '\0';
+    }
+    return true;
+}
+
+void FileMessageStore::pop() {
+    if (mCount == 0) {
+        return;
+    }
+    markConsumed(mReadSlot);
+    mReadSlot = (mReadSlot + 1) % mCapacity;
+    mCount--;
+}
+
+size_t FileMessageStore::count() const {
+    return mCount;
+}
+
+void FileMessageStore::sync() {
+    if (mFile != nullptr && mDirty) {
+        fflush(mFile);
+        mDirty = false;
+    }
+}
+
+bool FileMessageStore::create() {
+    mFile = fopen(mPath, "w+b");
+    if (mFile == nullptr) {
+        return false;
+    }
+    // Zeroed headers are invalid, all slots are free
+    const long size = static_cast<long>(kRecordSize * mCapacity);
+    if (fseek(mFile, size - 1, SEEK_SET) != 0 || fputc(0, mFile) == EOF ||
+        fflush(mFile) != 0) {
+        fclose(mFile);
+        mFile = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool FileMessageStore::readHeader(size_t slot, RecordHeader& header) {
+    const long offset = static_cast<long>(slot * kRecordSize +
+                                          MQTT_TOPIC_MAX_LENGTH +
+                                          MQTT_MESSAGE_MAX_LENGTH);
+    if (fseek(mFile, offset, SEEK_SET) != 0 ||
+        fread(&header, sizeof(header), 1, mFile) != 1) {
+        return false;
+    }
+    return header.magic == kMagic;
+}
+
+bool FileMessageStore::writeHeader(size_t slot, const RecordHeader& header) {
+    const long offset = static_cast<long>(slot * kRecordSize +
+                                          MQTT_TOPIC_MAX_LENGTH +
+                                          MQTT_MESSAGE_MAX_LENGTH);
+    return fseek(mFile, offset, SEEK_SET) == 0 &&
+           fwrite(&header, sizeof(header), 1, mFile) == 1;
+}
+
+bool FileMessageStore::markConsumed(size_t slot) {
+    const long offset =
+        static_cast<long>(slot * kRecordSize + MQTT_TOPIC_MAX_LENGTH +
+                          MQTT_MESSAGE_MAX_LENGTH +
+                          offsetof(RecordHeader, state));
+    const uint8_t state = kConsumed;
+    mDirty = true;
+    return fseek(mFile, offset, SEEK_SET) == 0 &&
+           fwrite(&state, 1, 1, mFile) == 1;
+}
+
+}  // namespace sensirion::upt::mqtt
@@ -0,0 +1,149 @@
+#ifndef UPT_MQTT_MESSAGE_STORE_H
+#define UPT_MQTT_MESSAGE_STORE_H
+
+#include "MailboxMessage.h"
+#include <cstdint>
+#include <cstdio>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Storage for messages that could not be published, replayed in FIFO order
+ * once the connection to the broker is back.
+ *
+ * Only accessed from the sender task, implementations need not be thread
+ * safe. When full, the oldest message is overwritten.
+ */
+class MessageStore {
+  public:
+    virtual ~MessageStore() = default;
+
+    /**
+     * @brief Prepares the storage, called once when the service starts
+     *
+     * @return false if the storage is not usable
+     */
+    virtual bool begin() = 0;
+
+    /**
+     * @brief Appends a message, overwriting the oldest one if full
+     */
+    virtual bool push(const MailboxMessage& msg) = 0;
+
+    /**
+     * @brief Copies the oldest message into msg without removing it
+     *
+     * @return false if the store is empty or the message is unreadable
+     */
+    virtual bool front(MailboxMessage& msg) = 0;
+
+    /**
+     * @brief Removes the oldest message
+     */
+    virtual void pop() = 0;
+
+    virtual size_t count() const = 0;
+
+    /**
+     * @brief Writes the buffered changes to the storage medium. Called by
+     *        the service every MQTT_STORE_SYNC_INTERVAL_MS after changes and
+     *        once the outbox is drained, not after every push and pop.
+     */
+    virtual void sync() {
+    }
+
+    /**
+     * @brief returns the number of messages overwritten because the store
+     * was full
+     */
+    uint32_t overwritten() const {
+        return mOverwritten;
+    }
+
+  protected:
+    uint32_t mOverwritten = 0;
+};
+
+/* Ring buffer of messages in RAM */
+class RamMessageStore : public MessageStore {
+  public:
+    explicit RamMessageStore(size_t capacity);
+    ~RamMessageStore() override;
+    RamMessageStore(const RamMessageStore&) = delete;
+    RamMessageStore& operator=(const RamMessageStore&) = delete;
+
+    bool begin() override;
+    bool push(const MailboxMessage& msg) override;
+    bool front(MailboxMessage& msg) override;
+    void pop() override;
+    size_t count() const override;
+
+  private:
+    MailboxMessage* mSlots = nullptr;
+    size_t mCapacity;
+    size_t mHead = 0;
+    size_t mCount = 0;
+};
+
+/**
+ * Ring log of fixed size records in a file, e.g. on LittleFS
+ * ("/littlefs/mqtt_outbox.bin" once LittleFS.begin() was called).
+ *
+ * Records carry a sequence number and are marked consumed once replayed, so
+ * pending messages survive a reboot. Uses stdio only and runs on a host as
+ * well.
+ *
+ * The file is allocated to its full size by begin(). A file of another size,
+ * e.g. written with another capacity or MQTT_MESSAGE_MAX_LENGTH, is
+ * discarded. Writes are buffered until sync(): on power loss, the changes
+ * of the last sync interval are lost and consumed messages may be replayed
+ * again, but a torn write never yields a corrupted record.
+ */
+class FileMessageStore : public MessageStore {
+  public:
+    FileMessageStore(const char* path, size_t capacity);
+    ~FileMessageStore() override;
+    FileMessageStore(const FileMessageStore&) = delete;
+    FileMessageStore& operator=(const FileMessageStore&) = delete;
+
+    bool begin() override;
+    bool push(const MailboxMessage& msg) override;
+    bool front(MailboxMessage& msg) override;
+    void pop() override;
+    size_t count() const override;
+    void sync() override;
+
+  private:
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint16_t topicLength;
+        uint16_t payloadLength;
+        uint8_t state;
+        uint8_t reserved[3];
+    };
+    static constexpr uint32_t kMagic = 0x4D515454;  // "MQTT"
+    static constexpr uint8_t kPending = 0xA5;
+    static constexpr uint8_t kConsumed = 0x00;
+    static constexpr size_t kRecordSize = sizeof(RecordHeader) +
+                                          MQTT_TOPIC_MAX_LENGTH +
+                                          MQTT_MESSAGE_MAX_LENGTH;
+
+    const char* mPath;
+    FILE* mFile = nullptr;
+    size_t mCapacity;
+    size_t mReadSlot = 0;
+    size_t mWriteSlot = 0;
+    size_t mCount = 0;
+    uint32_t mNextSequence = 0;
+    bool mDirty = false;
+
+    bool create();
+    bool readHeader(size_t slot, RecordHeader& header);
+    bool writeHeader(size_t slot, const RecordHeader& header);
+    bool markConsumed(size_t slot);
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_MESSAGE_STORE_H */
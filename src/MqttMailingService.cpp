@@ -1,15 +1,25 @@
 #include "MqttMailingService.h"
+#include "HostResolver.h"
 #include <WiFi.h>
+#include <algorithm>
+#include <esp_timer.h>
 
 namespace sensirion::upt::mqtt{
 
-#ifndef WIFI_CHECK_INTERVAL_MS
-#define WIFI_CHECK_INTERVAL_MS 10000
-#endif
-
-
 const char* TAG = "MQTT Mail";
-esp_mqtt_client_handle_t MqttMailingService::mEspMqttClient = nullptr;
+
+// Bits of mConnectionEvents
+constexpr EventBits_t WIFI_CONNECTED_BIT = 1 << 0;
+constexpr EventBits_t WIFI_LOST_BIT = 1 << 1;
+constexpr EventBits_t MQTT_CONNECTED_BIT = 1 << 2;
+constexpr EventBits_t MQTT_LOST_BIT = 1 << 3;
+constexpr EventBits_t STOP_BIT = 1 << 4;
+// Duty cycle: flush requested, sender task drained, radio off
+constexpr EventBits_t FLUSH_BIT = 1 << 5;
+constexpr EventBits_t DRAINED_BIT = 1 << 6;
+constexpr EventBits_t RADIO_OFF_BIT = 1 << 7;
+// The station got an IP address, ends a pending backoff
+constexpr EventBits_t NETWORK_UP_BIT = 1 << 8;
 
 constexpr auto ssl_cert =
     "------BEGIN CERTIFICATE-----\n" MQTT_BROKER_CERTIFICATE_OVERRIDE
@@ -22,23 +32,101 @@ MqttMailingService::MqttMailingService():
     mLwtTopic{"defaultTopic/"},
     mLwtMessage{"The MQTT Mailman unexpectedly disconnected."},
     mSslCert{""},
-    mUseSsl{false},
-    mQos{0},
-    mRetainFlag{0} {}
+    mUseSsl{false} {
+    // Batching may be enabled while producers are running
+    mBatchMutex = xSemaphoreCreateMutex();
+    mBatchSlotFreed = xSemaphoreCreateBinary();
+}
 
 MqttMailingService::~MqttMailingService() {
+    // First stop everything calling into the service: the connection task
+    // and the Wi-Fi events, the sender task, the ESP MQTT client and its
+    // events, the receiver task. Then free the queues and pools they use, the locks go last.
+    destroyConnectionManager();
+    stopSenderTask();
     destroyEspMqttClient();
-
-    if (mShouldManageWifiConnection) {
-        xTaskAbortDelay(mWifiCheckTaskHandle);
-        vTaskDelete(mWifiCheckTaskHandle);
-        mWifiCheckTaskHandle = nullptr;
+    releaseSenderTask();
+    stopReceiverTask();
+    destroyMailbox();
+    destroyReceiver();
+    if (mBatchMutex != nullptr) {
+        vSemaphoreDelete(mBatchMutex);
+        vSemaphoreDelete(mBatchSlotFreed);
+        mBatchMutex = nullptr;
+        mBatchSlotFreed = nullptr;
+    }
+    if (mTopicCacheMutex != nullptr) {
+        vSemaphoreDelete(mTopicCacheMutex);
+        mTopicCacheMutex = nullptr;
+    }
+    if (mFilterMutex != nullptr) {
+        vSemaphoreDelete(mFilterMutex);
+        mFilterMutex = nullptr;
+    }
+    if (mConflationMutex != nullptr) {
+        vSemaphoreDelete(mConflationMutex);
+        mConflationMutex = nullptr;
+    }
+    if (mSubscriptionMutex != nullptr) {
+        vSemaphoreDelete(mSubscriptionMutex);
+        mSubscriptionMutex = nullptr;
+    }
+    if (mAckSignal != nullptr) {
+        vSemaphoreDelete(mAckSignal);
+        mAckSignal = nullptr;
+    }
+    if (mConnectionEvents != nullptr) {
+        vEventGroupDelete(mConnectionEvents);
+        mConnectionEvents = nullptr;
     }
 }
 
 void MqttMailingService::start() {
     if (mState == MqttMailingServiceState::UNINITIALIZED) {
+        // From now on the configuration is only read, the tasks created
+        // below and the producers see its final value
+        mConfigFrozen.store(true, std::memory_order_release);
+        if (mConnectionEvents == nullptr) {
+            mConnectionEvents = xEventGroupCreate();
+        }
+        if (mTopicCacheMutex == nullptr) {
+            mTopicCacheMutex = xSemaphoreCreateMutex();
+        }
+        if (mFilterMutex == nullptr) {
+            mFilterMutex = xSemaphoreCreateMutex();
+        }
+        if (mConfig.conflation && mConflationMutex == nullptr) {
+            if (mConflation.begin(MQTT_CONFLATION_SLOTS)) {
+                mConflationMutex = xSemaphoreCreateMutex();
+            } else {
+                ESP_LOGE(TAG, "Could not allocate the conflation slots, "
+                              "conflation disabled.");
+            }
+        }
+        if (mSubscriptionMutex == nullptr) {
+            mSubscriptionMutex = xSemaphoreCreateMutex();
+        }
+        if (mAckSignal == nullptr) {
+            mAckSignal = xSemaphoreCreateBinary();
+        }
+        mStartedAtMs = millis();
+        // The first flush lasts until the first connection is drained
+        mRadioOnSinceMs = mStartedAtMs;
+        initMessageStore();
+        initMailbox();
+        xSemaphoreTake(mSubscriptionMutex, portMAX_DELAY);
+        if (hasSubscriptions()) {
+            initReceiver();
+        }
+        xSemaphoreGive(mSubscriptionMutex);
         initEspMqttClient();
+        initBrokerAddressCache();
+        initConnectionManager();
+    }
+    if (mShouldManageWifiConnection && !WiFi.isConnected()) {
+        // Started by the connection task once the Wi-Fi is connected
+        xEventGroupSetBits(mConnectionEvents, MQTT_LOST_BIT);
+        return;
     }
     startEspMqttClient();
 }
@@ -48,34 +136,19 @@ MqttMailingService::startWithDelegatedWiFi(const char* ssid, const char* pass,
                                            const bool shouldBeBlocking) {
 
     mShouldManageWifiConnection = true;
-    WiFi.begin(ssid, pass);
-
-    if (shouldBeBlocking) {
-        ESP_LOGI(TAG, "Waiting for Wi-Fi connection...");
-        // Wait for Wi-Fi connection, since MQTT mailing service
-        // can't establish a connection without Wi-Fi.
-        while (!WiFi.isConnected()) {
-            sleep(1);
-        }
-        ESP_LOGD(TAG, "Wi-Fi connected");
-    }
-
+    // Kept to bring the Wi-Fi up again in duty-cycle mode
+    mWifiSsid = ssid;
+    mWifiPassword = pass;
+    // Reconnections are made by the connection task, with backoff
+    WiFi.setAutoReconnect(false);
+    // The MQTT client is started once the Wi-Fi is connected, since MQTT
+    // mailing service can't establish a connection without Wi-Fi.
     start();
-
-    // Create Wi-Fi monitoring task to ensure reconnection
-    if (mWifiCheckTaskHandle == nullptr) {
-        xTaskCreate(MqttMailingService::wifiCheckTaskCode, "Wi-Fi Check", 1 * 1024,
-                    nullptr, tskIDLE_PRIORITY + 1, &(mWifiCheckTaskHandle));
-        ESP_LOGI(TAG, "WiFi check task launched.");
-    }
+    WiFi.begin(ssid, pass);
 
     if (shouldBeBlocking) {
-        // Wait until MQTT service connects to broker
-        ESP_LOGD(TAG,
-                 "MQTT mailing service is connecting...");
-        while (getServiceState() != MqttMailingServiceState::CONNECTED) {
-            sleep(1);
-        }
+        ESP_LOGI(TAG, "Waiting for Wi-Fi and broker connection...");
+        waitUntilConnected(UINT32_MAX);
         ESP_LOGD(TAG, "MQTT mailing service is connected.");
     }
 }
@@ -89,13 +162,65 @@ MqttMailingService::startWithDelegatedWiFi(const char* ssid, const char* pass) {
     startWithDelegatedWiFi(WIFI_SSID_OVERRIDE, WIFI_PW_OVERRIDE, false);
 }
 
+[[maybe_unused]] bool MqttMailingService::waitUntilConnected(uint32_t timeoutMs) {
+    if (mConnectionEvents == nullptr) {
+        return false;
+    }
+    const TickType_t wait =
+        timeoutMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    return (xEventGroupWaitBits(mConnectionEvents, MQTT_CONNECTED_BIT, pdFALSE,
+                                pdTRUE, wait) &
+            MQTT_CONNECTED_BIT) != 0;
+}
+
+[[maybe_unused]] void
+MqttMailingService::setConnectionCallback(ConnectionCallbackType callback) {
+    if (!isConfigurable("connection callback")) {
+        return;
+    }
+    mConfig.connectionCallback = std::move(callback);
+}
+
+[[maybe_unused]] void
+MqttMailingService::setDutyCycle(const DutyCycleConfig& config) {
+    if (!isConfigurable("duty cycle")) {
+        return;
+    }
+    mConfig.dutyCycle = config;
+}
+
+[[maybe_unused]] void MqttMailingService::requestFlush() {
+    if (mConnectionEvents == nullptr || !mConfig.dutyCycle.enabled) {
+        return;
+    }
+    xEventGroupClearBits(mConnectionEvents, RADIO_OFF_BIT);
+    xEventGroupSetBits(mConnectionEvents, FLUSH_BIT);
+}
+
+[[maybe_unused]] bool MqttMailingService::waitUntilFlushed(uint32_t timeoutMs) {
+    if (mConnectionEvents == nullptr || !mConfig.dutyCycle.enabled) {
+        return false;
+    }
+    const TickType_t wait =
+        timeoutMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    return (xEventGroupWaitBits(mConnectionEvents, RADIO_OFF_BIT, pdFALSE,
+                                pdTRUE, wait) &
+            RADIO_OFF_BIT) != 0;
+}
+
 [[maybe_unused]] bool
 MqttMailingService::setBrokerURI(std::string&& brokerURI) {
+    if (!isConfigurable("broker URI")) {
+        return false;
+    }
     mBrokerFullURI = brokerURI;
     return true;
 }
 
 [[maybe_unused]] bool MqttMailingService::setBroker(std::string&& brokerDomain, const bool hasSsl) {
+    if (!isConfigurable("broker")) {
+        return false;
+    }
     std::string protocol{"mqtt://"};
     std::string port{":1883"};
     if (hasSsl){
@@ -108,196 +233,2400 @@ MqttMailingService::setBrokerURI(std::string&& brokerURI) {
 
 [[maybe_unused]] void
 MqttMailingService::setLWTTopic(std::string&& lwtTopic) {
+    if (!isConfigurable("LWT topic")) {
+        return;
+    }
     mLwtTopic = lwtTopic;
 }
 
 [[maybe_unused]] void
 MqttMailingService::setLWTMessage(std::string&& lwtMessage) {
+    if (!isConfigurable("LWT message")) {
+        return;
+    }
     mLwtMessage = lwtMessage;
 }
 
 [[maybe_unused]] void
 MqttMailingService::setSslCertificate(std::string&& sslCert) {
+    if (!isConfigurable("SSL certificate")) {
+        return;
+    }
     mSslCert = sslCert;
     mUseSsl = true;
 }
 
 [[maybe_unused]] void
 MqttMailingService::enableSsl() {
+    if (!isConfigurable("SSL")) {
+        return;
+    }
     mSslCert = ssl_cert;
     mUseSsl = true;
 }
 
+[[maybe_unused]] void MqttMailingService::setBrokerAddressTtl(uint32_t ttlMs) {
+    if (!isConfigurable("broker address TTL")) {
+        return;
+    }
+    mBrokerAddressTtlMs = ttlMs;
+}
+
 [[maybe_unused]] void MqttMailingService::setQOS(int qos) {
-    mQos = qos;
+    if (!isConfigurable("QoS")) {
+        return;
+    }
+    mConfig.qos = qos;
 }
 
 [[maybe_unused]] void
 MqttMailingService::setGlobalTopicPrefix(std::string&& topicPrefix) {
-    mGlobalTopicPrefix = topicPrefix;
+    if (!isConfigurable("global topic prefix")) {
+        return;
+    }
+    mConfig.globalTopicPrefix = topicPrefix;
+    clearTopicCache();
 }
 
 void MqttMailingService::setRetainFlag(int retainFlag) {
+    if (!isConfigurable("retain flag")) {
+        return;
+    }
     if (retainFlag < 0 || retainFlag > 1) {
         ESP_LOGW(
             TAG,
             "Warning: attempt to set illegal retain flag %i. Reverting to 0.",
             retainFlag);
-        mRetainFlag = 0;
+        mConfig.retainFlag = 0;
     } else {
-        mRetainFlag = retainFlag;
+        mConfig.retainFlag = retainFlag;
     }
 }
 
-[[maybe_unused]] MqttMailingServiceState
-MqttMailingService::getServiceState() {
-    return mState;
+[[maybe_unused]] void MqttMailingService::setMailboxDepth(size_t depth) {
+    if (mMailbox != nullptr) {
+        ESP_LOGW(TAG, "Mailbox already created, depth change ignored.");
+        return;
+    }
+    mMailboxDepth = depth > 0 ? depth : 1;
 }
 
-[[maybe_unused]] bool MqttMailingService::isReady() {
-    if (mShouldManageWifiConnection) {
-        return WiFi.isConnected() &&
-               getServiceState() == MqttMailingServiceState::CONNECTED;
+[[maybe_unused]] void
+MqttMailingService::setMailboxOverflowPolicy(MailboxOverflowPolicy policy,
+                                             uint32_t blockTimeoutMs) {
+    mOverflowPolicy = policy;
+    mBlockTimeoutMs = blockTimeoutMs;
+}
+
+[[maybe_unused]] void
+MqttMailingService::setSchedulingPolicy(SchedulingPolicy policy) {
+    if (!isConfigurable("scheduling policy")) {
+        return;
     }
-    return getServiceState() == MqttMailingServiceState::CONNECTED;
+    mConfig.scheduling = policy;
 }
 
-void MqttMailingService::setMeasurementMessageFormatterFn(MeasurementFormatterType fFmt) {
-    mMeasurementFormatterFn = fFmt;
+[[maybe_unused]] void
+MqttMailingService::setPriorityClass(MessagePriority priority,
+                                     const PriorityClassConfig& config) {
+    if (!isConfigurable("priority class")) {
+        return;
+    }
+    PriorityClassConfig& target =
+        mConfig.priorityClasses[static_cast<size_t>(priority)];
+    target = config;
+    target.weight = config.weight > 0 ? config.weight : 1;
+    target.depth = config.depth > 0 ? config.depth : 1;
 }
 
-void MqttMailingService::setMeasurementToTopicSuffixFn(MeasurementFormatterType fFmt) {
-    mTopicSuffixFn = fFmt;
+[[maybe_unused]] void MqttMailingService::setMessageStore(MessageStore* store) {
+    if (mMailbox != nullptr) {
+        ESP_LOGW(TAG, "Service already started, message store ignored.");
+        return;
+    }
+    mStore = store;
 }
 
-bool MqttMailingService::fwdMqttMessage(const char* topic, const char* message){
-    // Forward message in mailbox to the ESP MQTT client
-    return esp_mqtt_client_publish(mEspMqttClient, topic, message, 0, mQos, mRetainFlag) != -1;
+[[maybe_unused]] void
+MqttMailingService::setReplayRate(uint32_t messagesPerSecond) {
+    if (messagesPerSecond == 0) {
+        messagesPerSecond = 1;
+    }
+    mReplayIntervalMs = 1000 / messagesPerSecond;
 }
 
-[[maybe_unused]]
-bool MqttMailingService::sendTextMessage(const std::string& message,
-                                         const std::string& topicSuffix) {
+[[maybe_unused]] QueueHandle_t MqttMailingService::getMailbox() const {
+    return mMailbox;
+}
 
+[[maybe_unused]] MailboxStatistics
+MqttMailingService::getMailboxStatistics() const {
+    MailboxStatistics stats;
+    stats.enqueued = mEnqueuedCount.load();
+    stats.sent = mSentCount.load();
+    stats.dropped = mDroppedCount.load();
+    if (mStore != nullptr) {
+        stats.dropped += mStore->overwritten();
+    }
+    stats.stored = mStoredCount.load();
+    stats.replayed = mReplayedCount.load();
+    return stats;
+}
 
-    const auto topic{mGlobalTopicPrefix + topicSuffix};                                        
-    return fwdMqttMessage(topic.c_str(), message.c_str());
+[[maybe_unused]] MessagePoolStatistics
+MqttMailingService::getMessagePoolStatistics() const {
+    return mPool.statistics();
 }
 
-bool MqttMailingService::sendMeasurement(const sensirion::upt::core::Measurement measurement, 
-                                         const std::string& topicSuffix) {
-    if (!mMeasurementFormatterFn){
-        ESP_LOGE(TAG, "Formatter not set, message not sent");
+[[maybe_unused]] bool
+MqttMailingService::subscribe(const char* topicFilter,
+                              MessageCallbackType callback, int qos) {
+    if (topicFilter == nullptr || !callback ||
+        !TopicFilterTrie::isValidFilter(topicFilter) ||
+        strlen(topicFilter) >= MQTT_TOPIC_MAX_LENGTH) {
+        ESP_LOGE(TAG, "Invalid topic filter, subscription ignored.");
+        return false;
+    }
+    if (mSubscriptionMutex == nullptr) {
+        // Not started yet, configuration is done from a single task
+        mSubscriptionMutex = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(mSubscriptionMutex, portMAX_DELAY);
+    Subscription* slot = nullptr;
+    for (auto& subscription : mSubscriptions) {
+        if (!subscription.callback) {
+            slot = &subscription;
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        xSemaphoreGive(mSubscriptionMutex);
+        ESP_LOGE(TAG, "Maximum number of subscriptions (%d) reached.",
+                 MQTT_MAX_SUBSCRIPTIONS);
         return false;
     }
-    auto message = mMeasurementFormatterFn(measurement);
-    return sendTextMessage(message, topicSuffix);
+    slot->filter = topicFilter;
+    slot->qos = qos;
+    slot->callback = std::move(callback);
+    mTopicFilters.insert(slot->filter,
+                         static_cast<uint16_t>(slot - mSubscriptions));
+    if (mState != MqttMailingServiceState::UNINITIALIZED) {
+        initReceiver();
+    }
+    xSemaphoreGive(mSubscriptionMutex);
+
+    // Otherwise subscribed by the receiver task once connected
+    if (mState == MqttMailingServiceState::CONNECTED &&
+        esp_mqtt_client_subscribe(mEspMqttClient, topicFilter, qos) < 0) {
+        ESP_LOGW(TAG, "Could not subscribe to %s, retried on reconnection.",
+                 topicFilter);
+    }
+    return true;
 }
 
-bool MqttMailingService::sendMeasurement(const sensirion::upt::core::Measurement measurement) {
-    if (!mTopicSuffixFn){
-        ESP_LOGE(TAG, "TopicSuffixFunction is not set, message not sent");
+[[maybe_unused]] bool MqttMailingService::unsubscribe(const char* topicFilter) {
+    if (topicFilter == nullptr || mSubscriptionMutex == nullptr) {
         return false;
     }
-    
-    auto suffix = mTopicSuffixFn(measurement);
+    bool found = false;
+    xSemaphoreTake(mSubscriptionMutex, portMAX_DELAY);
+    for (auto& subscription : mSubscriptions) {
+        if (subscription.callback && subscription.filter == topicFilter) {
+            mTopicFilters.remove(
+                subscription.filter,
+                static_cast<uint16_t>(&subscription - mSubscriptions));
+            subscription = Subscription{};
+            found = true;
+        }
+    }
+    xSemaphoreGive(mSubscriptionMutex);
 
-    return sendMeasurement(measurement, suffix);
+    if (found && mState == MqttMailingServiceState::CONNECTED) {
+        esp_mqtt_client_unsubscribe(mEspMqttClient, topicFilter);
+    }
+    return found;
 }
 
-/*
- *   Private
- */
+[[maybe_unused]] SubscriptionStatistics
+MqttMailingService::getSubscriptionStatistics() const {
+    SubscriptionStatistics stats;
+    stats.received = mReceivedCount.load();
+    stats.unmatched = mUnmatchedCount.load();
+    stats.dropped = mReceiveDroppedCount.load();
+    return stats;
+}
 
-void MqttMailingService::initEspMqttClient() {
-    esp_mqtt_client_config_t mqtt_cfg = {.uri = mBrokerFullURI.data(),
-                                         .lwt_topic = mLwtTopic.data(),
-                                         .lwt_msg = mLwtMessage.data(),
-                                         .disable_auto_reconnect = false};
-    if (mUseSsl) {
-        mqtt_cfg.cert_pem = mSslCert.c_str();
+[[maybe_unused]] void
+MqttMailingService::setMeasurementFilter(const FilterConfig& config) {
+    if (mFilterMutex != nullptr) {
+        xSemaphoreTake(mFilterMutex, portMAX_DELAY);
     }
+    mFilter.setDefaultConfig(config);
+    mFilter.reset();
+    // Measurements skip the lock and the lookup while it lets all through
+    mFilterEnabled = mFilter.active();
+    if (mFilterMutex != nullptr) {
+        xSemaphoreGive(mFilterMutex);
+    }
+}
 
-    mEspMqttClient = esp_mqtt_client_init(&mqtt_cfg);
-    if (!mEspMqttClient) {
-        ESP_LOGE(TAG, "Fatal error: Could not initiate MQTT Client. Aborting.");
-        assert(0);
+[[maybe_unused]] bool
+MqttMailingService::setMeasurementFilter(core::SignalType signalType,
+                                         const FilterConfig& config) {
+    if (mFilterMutex != nullptr) {
+        xSemaphoreTake(mFilterMutex, portMAX_DELAY);
+    }
+    const bool success = mFilter.setSignalConfig(signalType, config);
+    mFilter.reset();
+    mFilterEnabled = mFilter.active();
+    if (mFilterMutex != nullptr) {
+        xSemaphoreGive(mFilterMutex);
     }
+    if (!success) {
+        ESP_LOGW(TAG, "Too many filtered signals, filter not set.");
+    }
+    return success;
+}
 
-    esp_mqtt_client_register_event(
-        mEspMqttClient, static_cast<esp_mqtt_event_id_t>(ESP_EVENT_ANY_ID),
-        espMqttEventHandler, this);
+[[maybe_unused]] void MqttMailingService::setBatching(const BatchConfig& config) {
+    // Pending batches were collected with the previous configuration
+    flushBatches();
 
-    mState = MqttMailingServiceState::INITIALIZED;
-    ESP_LOGI(TAG, "ESP MQTT client initialized.");
+    xSemaphoreTake(mBatchMutex, portMAX_DELAY);
+    mBatchConfig = config;
+    if (mBatchConfig.maxCount == 0) {
+        mBatchConfig.maxCount = 1;
+    }
+    if (mBatchConfig.maxBytes >= MQTT_BATCH_MAX_LENGTH) {
+        mBatchConfig.maxBytes = MQTT_BATCH_MAX_LENGTH - 1;
+    }
+    mBatchMode = mBatchConfig.mode;
+    xSemaphoreGive(mBatchMutex);
 }
 
-void MqttMailingService::startEspMqttClient() {
-    esp_err_t ret;
+[[maybe_unused]] bool MqttMailingService::flushBatches() {
+    xSemaphoreTake(mBatchMutex, portMAX_DELAY);
+    for (auto& batch : mBatches) {
+        if (batch.isOpen()) {
+            closeBatch(batch);
+        }
+    }
+    xSemaphoreGive(mBatchMutex);
+    return true;
+}
 
-    if (mState == MqttMailingServiceState::CONNECTED ||
-        mState == MqttMailingServiceState::CONNECTING) {
-        // nothing to do
+[[maybe_unused]] void
+MqttMailingService::setDeliveryCallback(DeliveryCallbackType callback) {
+    if (!isConfigurable("delivery callback")) {
         return;
     }
+    mConfig.deliveryCallback = std::move(callback);
+}
 
-    ret = esp_mqtt_client_start(mEspMqttClient);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start MQTT client");
+[[maybe_unused]] void MqttMailingService::setInFlightWindow(size_t maxInFlight) {
+    if (!isConfigurable("in-flight window")) {
         return;
     }
-    mState = MqttMailingServiceState::CONNECTING;
-    ESP_LOGI(TAG, "MQTT client connecting...");
+    if (maxInFlight == 0 || maxInFlight > MQTT_INFLIGHT_MAX_MESSAGES) {
+        ESP_LOGW(TAG, "In-flight window must be between 1 and %d.",
+                 MQTT_INFLIGHT_MAX_MESSAGES);
+        maxInFlight = maxInFlight == 0 ? 1 : MQTT_INFLIGHT_MAX_MESSAGES;
+    }
+    mConfig.inFlightWindow = maxInFlight;
 }
 
-void MqttMailingService::destroyEspMqttClient() {
-    mState = MqttMailingServiceState::UNINITIALIZED;
-    esp_mqtt_client_stop(mEspMqttClient);
-    esp_mqtt_client_destroy(mEspMqttClient);
-    mEspMqttClient = nullptr;
-    ESP_LOGI(TAG, "MQTT client has been destroyed.");
+[[maybe_unused]] void
+MqttMailingService::setCompression(const CompressionConfig& config) {
+    if (!isConfigurable("compression")) {
+        return;
+    }
+    mConfig.compression = config;
 }
 
-void MqttMailingService::espMqttEventHandler(
-    void* handler_args, 
-    [[maybe_unused]] esp_event_base_t base,
-    int32_t event_id, void* event_data) {
-    auto* pMailingService = reinterpret_cast<MqttMailingService*>(handler_args);
-    auto event = reinterpret_cast<esp_mqtt_event_handle_t>(event_data);
+[[maybe_unused]] void
+MqttMailingService::setTopicAliases(const TopicAliasConfig& config) {
+    if (!isConfigurable("topic aliases")) {
+        return;
+    }
+    if (config.enabled && (config.aliasTopicSuffix.empty() ||
+                           config.mappingTopicSuffix.empty() ||
+                           config.aliasTopicSuffix == config.mappingTopicSuffix)) {
+        ESP_LOGW(TAG, "Alias and mapping topic suffixes must differ, "
+                      "topic aliases disabled.");
+        mConfig.topicAliases = TopicAliasConfig{};
+        return;
+    }
+    if (config.enabled) {
+        ESP_LOGW(TAG, "Topic aliases are experimental, consumers have to "
+                      "resolve them from the mapping messages.");
+    }
+    mConfig.topicAliases = config;
+}
 
-    switch ((esp_mqtt_event_id_t)event_id) {
-        case MQTT_EVENT_CONNECTED:
-            ESP_LOGI(TAG, "ESP MQTT client connected");
-            pMailingService->mState = MqttMailingServiceState::CONNECTED;
-            break;
-        case MQTT_EVENT_DISCONNECTED:
-            ESP_LOGI(TAG, "ESP MQTT client disconnected");
-            pMailingService->mState = MqttMailingServiceState::DISCONNECTED;
-            break;
-        case MQTT_EVENT_ERROR:
-            ESP_LOGW(TAG,
-                     "ESP MQTT client encountered an error (code %i)",
-                     (*event).error_handle->error_type);
-            break;
-        default:
-            break;
+[[maybe_unused]] void MqttMailingService::setConflation(bool enabled) {
+    if (!isConfigurable("conflation")) {
+        return;
     }
+    mConfig.conflation = enabled;
 }
 
-/**
- * Wi-Fi check task
- * This tasks checks if Wi-Fi is still connected every 10 second
- * and tries to reconnect if Wi-Fi connection is not established.
- */
-void MqttMailingService::wifiCheckTaskCode(
-    [[maybe_unused]] void* arg) {
-    while (true) {
-        vTaskDelay(pdMS_TO_TICKS(WIFI_CHECK_INTERVAL_MS));
+[[maybe_unused]] MqttMetrics MqttMailingService::getMetrics() {
+    const uint32_t now = millis();
+    MqttMetrics metrics;
+    portENTER_CRITICAL(&mMetricsLock);
+    metrics = mMetrics;
+    metrics.inFlight.inFlight = static_cast<uint32_t>(mInFlight.occupied());
+    // account for the time spent in the current state so far
+    const MqttMailingServiceState state = mState;
+    if (state == MqttMailingServiceState::CONNECTING) {
+        metrics.timeConnectingMs += now - mStateSinceMs;
+    } else if (state == MqttMailingServiceState::DISCONNECTED) {
+        metrics.timeDisconnectedMs += now - mStateSinceMs;
+    }
+    portEXIT_CRITICAL(&mMetricsLock);
 
-        if (!WiFi.isConnected()) {
-            WiFi.reconnect();
-        }
+    if (mEspMqttClient != nullptr) {
+        metrics.outboxSize = esp_mqtt_client_get_outbox_size(mEspMqttClient);
     }
+    metrics.measurementsFiltered = mFilteredCount.load();
+    metrics.conflation.pending = mConflationPending.load();
+    metrics.mailbox = getMailboxStatistics();
+    metrics.pool = getMessagePoolStatistics();
+    metrics.subscriptions = getSubscriptionStatistics();
+    return metrics;
+}
+
+[[maybe_unused]] void
+MqttMailingService::setTelemetry(std::string&& topicSuffix,
+                                 uint32_t intervalMs) {
+    if (!isConfigurable("telemetry")) {
+        return;
+    }
+    mConfig.telemetryTopicSuffix = topicSuffix;
+    mConfig.telemetryIntervalMs = intervalMs;
+}
+
+[[maybe_unused]] MqttMailingServiceState
+MqttMailingService::getServiceState() {
+    return mState;
+}
+
+[[maybe_unused]] bool MqttMailingService::isReady() {
+    if (mShouldManageWifiConnection) {
+        return WiFi.isConnected() &&
+               getServiceState() == MqttMailingServiceState::CONNECTED;
+    }
+    return getServiceState() == MqttMailingServiceState::CONNECTED;
+}
+
+void MqttMailingService::setMeasurementMessageFormatterFn(MeasurementFormatterType fFmt) {
+    if (!isConfigurable("measurement formatter")) {
+        return;
+    }
+    mConfig.measurementFormatterFn = fFmt;
+}
+
+void MqttMailingService::setMeasurementBinaryFormatterFn(
+    BinaryMeasurementFormatterType fFmt) {
+    if (!isConfigurable("binary measurement formatter")) {
+        return;
+    }
+    mConfig.bufferFormatterFn = fFmt;
+}
+
+void MqttMailingService::setMeasurementBufferFormatterFn(
+    MeasurementBufferFormatterType fFmt) {
+    if (!isConfigurable("buffer measurement formatter")) {
+        return;
+    }
+    if (!fFmt) {
+        mConfig.bufferFormatterFn = nullptr;
+        return;
+    }
+    mConfig.bufferFormatterFn = [fFmt](const core::Measurement& measurement,
+                                       uint8_t* buffer, size_t size) {
+        return fFmt(measurement, reinterpret_cast<char*>(buffer), size);
+    };
+}
+
+void MqttMailingService::setMeasurementToTopicSuffixFn(MeasurementFormatterType fFmt) {
+    if (!isConfigurable("topic suffix function")) {
+        return;
+    }
+    mConfig.topicSuffixFn = fFmt;
+    clearTopicCache();
 }
-} // end namespace
 
+bool MqttMailingService::setMeasurementTemplate(std::string_view text) {
+    if (!isConfigurable("measurement template")) {
+        return false;
+    }
+    MeasurementTemplate formatter{text};
+    if (!formatter.valid()) {
+        ESP_LOGE(TAG, "Invalid measurement template, ignored.");
+        return false;
+    }
+    setMeasurementBufferFormatterFn(formatter);
+    return true;
+}
+
+bool MqttMailingService::setTopicSuffixTemplate(std::string_view text) {
+    if (!isConfigurable("topic suffix template")) {
+        return false;
+    }
+    MeasurementTemplate formatter{text};
+    if (!formatter.valid() || formatter.hasDataPointFields()) {
+        ESP_LOGE(TAG, "Invalid topic suffix template, ignored.");
+        return false;
+    }
+    setMeasurementToTopicSuffixFn(formatter);
+    return true;
+}
+
+bool MqttMailingService::fwdMqttMessage(const char* topic, const char* message,
+                                        size_t length, uint32_t deliveryToken,
+                                        MessagePriority priority) {
+    // Forward message in mailbox to the ESP MQTT client
+    const int64_t start = esp_timer_get_time();
+    const int msgId = esp_mqtt_client_publish(
+        mEspMqttClient, topic, message, static_cast<int>(length),
+        qosOf(priority), retainFlagOf(priority));
+    const int64_t end = esp_timer_get_time();
+
+    portENTER_CRITICAL(&mMetricsLock);
+    mMetrics.publishLatency.record(static_cast<uint32_t>(end - start));
+    if (msgId == -1) {
+        mMetrics.publishFailures++;
+    } else {
+        mMetrics.messagesPublished++;
+        mMetrics.bytesPublished += length;
+        mMetrics.topicBytesPublished += strlen(topic);
+        if (!mHasPublished) {
+            mMetrics.timeToFirstPublishMs = millis() - mStartedAtMs;
+            mHasPublished = true;
+        }
+    }
+    if (msgId > 0) {
+        // QoS 1/2, acknowledged by MQTT_EVENT_PUBLISHED
+        mInFlight.add(msgId, deliveryToken, end);
+    }
+    portEXIT_CRITICAL(&mMetricsLock);
+    if (msgId == 0) {
+        notifyDelivery(deliveryToken, DeliveryStatus::DELIVERED);
+    }
+    return msgId != -1;
+}
+
+bool MqttMailingService::publishMessage(const MailboxMessage& msg) {
+    return publishMessage(msg.topic, msg.payload, msg.payloadLength,
+                          msg.deliveryToken, msg.priority);
+}
+
+bool MqttMailingService::publishMessage(const char* msgTopic,
+                                        const char* payload, size_t length,
+                                        uint32_t deliveryToken,
+                                        MessagePriority priority) {
+    const char* baseTopic = msgTopic;
+    char aliasedTopic[MQTT_TOPIC_MAX_LENGTH];
+    if (mConfig.topicAliases.enabled &&
+        aliasTopic(msgTopic, aliasedTopic, sizeof(aliasedTopic))) {
+        baseTopic = aliasedTopic;
+    }
+
+    const CompressionConfig& compression = mConfig.compression;
+    if (!compression.enabled || length < compression.minPayloadSize) {
+        return fwdMqttMessage(baseTopic, payload, length, deliveryToken,
+                              priority);
+    }
+
+    const char* topic = baseTopic;
+    char markedTopic[MQTT_TOPIC_MAX_LENGTH];
+    size_t headerLength = 0;
+    if (compression.marker == CompressionMarker::CONTENT_HEADER) {
+        headerLength = sizeof(kCompressedPayloadHeader);
+        memcpy(mCompressionBuffer, kCompressedPayloadHeader, headerLength);
+    } else {
+        const size_t topicLength = strlen(baseTopic);
+        const size_t suffixLength = compression.topicSuffix.size();
+        if (topicLength + suffixLength >= sizeof(markedTopic)) {
+            return fwdMqttMessage(baseTopic, payload, length, deliveryToken,
+                                  priority);
+        }
+        memcpy(markedTopic, baseTopic, topicLength);
+        memcpy(markedTopic + topicLength, compression.topicSuffix.c_str(),
+               suffixLength + 1);
+        topic = markedTopic;
+    }
+    // Only worth it if strictly smaller than the original payload
+    if (length <= headerLength + 1) {
+        return fwdMqttMessage(baseTopic, payload, length, deliveryToken,
+                              priority);
+    }
+    const size_t maxLength = std::min(sizeof(mCompressionBuffer) - headerLength,
+                                      length - headerLength - 1);
+    const size_t compressedLength = mCompressor.compress(
+        reinterpret_cast<const uint8_t*>(payload), length,
+        mCompressionBuffer + headerLength, maxLength);
+    if (compressedLength > maxLength) {
+        return fwdMqttMessage(baseTopic, payload, length, deliveryToken,
+                              priority);
+    }
+
+    const size_t compressed = headerLength + compressedLength;
+    const bool published = fwdMqttMessage(
+        topic, reinterpret_cast<const char*>(mCompressionBuffer), compressed,
+        deliveryToken, priority);
+    if (published) {
+        portENTER_CRITICAL(&mMetricsLock);
+        mMetrics.compression.compressed++;
+        mMetrics.compression.uncompressedBytes += length;
+        mMetrics.compression.compressedBytes += compressed;
+        portEXIT_CRITICAL(&mMetricsLock);
+    }
+    return published;
+}
+
+/**
+ * Writes the alias topic of topic into alias. Returns false if the message
+ * has to be published on its full topic: the topic has no alias, or the
+ * mapping of its alias was not acknowledged on this connection yet, in
+ * which case it is published if needed.
+ */
+bool MqttMailingService::aliasTopic(const char* topic, char* alias,
+                                    size_t size) {
+    if (mTopicAliasesStale.exchange(false)) {
+        mTopicAliases.deactivateAll();
+        if (!mAliasMappingsCleared) {
+            clearAliasMappings();
+        }
+    }
+    bool assigned = false;
+    const uint16_t number = mTopicAliases.lookup(topic, assigned);
+    if (number == 0) {
+        return false;
+    }
+    FixedBufferWriter writer{alias, size};
+    writer.append(mConfig.globalTopicPrefix)
+        .append(mConfig.topicAliases.aliasTopicSuffix)
+        .appendInteger(number);
+    if (writer.overflowed() || writer.length() >= strlen(topic)) {
+        // Does not pay off, the topic goes without alias
+        if (assigned) {
+            mTopicAliases.release(number);
+        }
+        return false;
+    }
+    if (!mTopicAliases.isActive(number)) {
+        if (!mTopicAliases.isMappingPending(number)) {
+            const int msgId = publishAliasMapping(number, topic);
+            if (msgId > 0) {
+                // Under the lock of recordAck: the acknowledgement either
+                // finds the mapping pending or was kept as early ack
+                const int64_t now = esp_timer_get_time();
+                portENTER_CRITICAL(&mMetricsLock);
+                mTopicAliases.setMappingPending(number, msgId);
+                if (mInFlight.takeEarlyAck(msgId, now)) {
+                    mTopicAliases.acknowledge(msgId);
+                }
+                portEXIT_CRITICAL(&mMetricsLock);
+            }
+        }
+        return false;
+    }
+    portENTER_CRITICAL(&mMetricsLock);
+    mMetrics.topicAliases.aliased++;
+    portEXIT_CRITICAL(&mMetricsLock);
+    return true;
+}
+
+/**
+ * Publishes an empty retained message on every mapping topic, so that the
+ * aliases of the previous boot are not resolved to their old topics. The
+ * new mappings follow on the same connection, hence in order.
+ */
+void MqttMailingService::clearAliasMappings() {
+    char mappingTopic[MQTT_TOPIC_MAX_LENGTH];
+    for (uint16_t alias = 1; alias <= MQTT_TOPIC_ALIAS_MAX; ++alias) {
+        FixedBufferWriter writer{mappingTopic, sizeof(mappingTopic)};
+        writer.append(mConfig.globalTopicPrefix)
+            .append(mConfig.topicAliases.mappingTopicSuffix)
+            .appendInteger(alias);
+        if (writer.overflowed() ||
+            esp_mqtt_client_publish(mEspMqttClient, mappingTopic, "", 0, 1,
+                                    1) == -1) {
+            // tried again on the next connection
+            ESP_LOGW(TAG, "Failed to clear the topic alias mappings");
+            return;
+        }
+    }
+    mAliasMappingsCleared = true;
+}
+
+/**
+ * Publishes the topic of alias on its mapping topic, returns the message id
+ * to wait for, -1 on failure
+ */
+int MqttMailingService::publishAliasMapping(uint16_t alias,
+                                            const char* topic) {
+    char mappingTopic[MQTT_TOPIC_MAX_LENGTH];
+    FixedBufferWriter writer{mappingTopic, sizeof(mappingTopic)};
+    writer.append(mConfig.globalTopicPrefix)
+        .append(mConfig.topicAliases.mappingTopicSuffix)
+        .appendInteger(alias);
+    if (writer.overflowed()) {
+        return -1;
+    }
+    // Retained, for consumers subscribing later, and acknowledged: the
+    // alias is only used once the broker has it
+    const size_t length = strlen(topic);
+    const int msgId = esp_mqtt_client_publish(
+        mEspMqttClient, mappingTopic, topic, static_cast<int>(length), 1, 1);
+    if (msgId == -1) {
+        ESP_LOGW(TAG, "Failed to publish mapping of topic alias %u", alias);
+        return -1;
+    }
+    portENTER_CRITICAL(&mMetricsLock);
+    mMetrics.topicAliases.mappings++;
+    mMetrics.bytesPublished += length;
+    mMetrics.topicBytesPublished += writer.length();
+    portEXIT_CRITICAL(&mMetricsLock);
+    return msgId;
+}
+
+[[maybe_unused]]
+bool MqttMailingService::sendTextMessage(const std::string& message,
+                                         const std::string& topicSuffix) {
+    return sendPayload(message, topicSuffix);
+}
+
+[[maybe_unused]] bool MqttMailingService::sendPayload(std::string_view payload,
+                                                      std::string_view topicSuffix,
+                                                      uint32_t deliveryToken,
+                                                      MessagePriority priority) {
+    if (payload.size() >= MQTT_MESSAGE_MAX_LENGTH) {
+        ESP_LOGE(TAG, "Message too long, message not sent");
+        return false;
+    }
+    MailboxMessage* msg = acquireMessage();
+    if (msg == nullptr) {
+        return false;
+    }
+    memcpy(msg->payload, payload.data(), payload.size());
+    msg->payload[payload.size()] = '\0';
+    msg->payloadLength = payload.size();
+    msg->deliveryToken = deliveryToken;
+    msg->priority = priority;
+    return sendMessage(msg, topicSuffix);
+}
+
+[[maybe_unused]] bool MqttMailingService::sendPayload(const uint8_t* data,
+                                                      size_t length,
+                                                      std::string_view topicSuffix,
+                                                      uint32_t deliveryToken,
+                                                      MessagePriority priority) {
+    return sendPayload(
+        std::string_view{reinterpret_cast<const char*>(data), length},
+        topicSuffix, deliveryToken, priority);
+}
+
+[[maybe_unused]] MailboxMessage* MqttMailingService::acquireMessage() {
+    if (mMailbox == nullptr) {
+        ESP_LOGE(TAG, "Mailbox not initialized, message not sent");
+        return nullptr;
+    }
+    MailboxMessage* msg = acquireBlock();
+    if (msg == nullptr) {
+        mDroppedCount++;
+        ESP_LOGW(TAG, "No free message block, message dropped");
+        return nullptr;
+    }
+    msg->deliveryToken = 0;
+    msg->priority = MessagePriority::NORMAL;
+    return msg;
+}
+
+[[maybe_unused]] bool MqttMailingService::sendMessage(MailboxMessage* msg,
+                                                      std::string_view topicSuffix) {
+    if (msg == nullptr) {
+        return false;
+    }
+    if (msg->payloadLength >= sizeof(msg->payload) ||
+        !composeTopic(msg->topic, sizeof(msg->topic), topicSuffix)) {
+        ESP_LOGE(TAG, "Topic or message too long, message not sent");
+        releaseMessage(msg);
+        return false;
+    }
+    return postToMailbox(msg);
+}
+
+[[maybe_unused]] void MqttMailingService::releaseMessage(MailboxMessage* msg) {
+    mPool.release(msg);
+}
+
+bool MqttMailingService::sendMeasurement(const sensirion::upt::core::Measurement measurement, 
+                                         const std::string& topicSuffix) {
+    char topic[MQTT_TOPIC_MAX_LENGTH];
+    if (!composeMeasurementTopic(topic, sizeof(topic), topicSuffix)) {
+        return false;
+    }
+    return sendMeasurementToTopic(measurement, topic);
+}
+
+bool MqttMailingService::sendMeasurement(const sensirion::upt::core::Measurement measurement) {
+    char topic[MQTT_TOPIC_MAX_LENGTH];
+    if (mBatchMode == BatchMode::ACROSS_TOPICS) {
+        xSemaphoreTake(mBatchMutex, portMAX_DELAY);
+        const bool composed = composeMeasurementTopic(
+            topic, sizeof(topic), mBatchConfig.topicSuffix);
+        xSemaphoreGive(mBatchMutex);
+        if (!composed) {
+            return false;
+        }
+        return sendMeasurementToTopic(measurement, topic);
+    }
+    if (!mConfig.topicSuffixFn){
+        ESP_LOGE(TAG, "TopicSuffixFunction is not set, message not sent");
+        return false;
+    }
+    if (mTopicCacheMutex == nullptr) {
+        ESP_LOGE(TAG, "Service not started, message not sent");
+        return false;
+    }
+
+    if (!mTopicCache.find(measurement, topic, sizeof(topic))) {
+        const auto suffix = mConfig.topicSuffixFn(measurement);
+        if (!composeTopic(topic, sizeof(topic), suffix)) {
+            ESP_LOGE(TAG, "Topic too long, measurement not sent");
+            mDroppedCount++;
+            return false;
+        }
+        xSemaphoreTake(mTopicCacheMutex, portMAX_DELAY);
+        mTopicCache.insert(measurement, topic);
+        xSemaphoreGive(mTopicCacheMutex);
+    }
+    return sendMeasurementToTopic(measurement, topic);
+}
+
+/*
+ *   Private
+ */
+
+bool MqttMailingService::isConfigurable(const char* setting) const {
+    if (mConfigFrozen.load(std::memory_order_acquire)) {
+        ESP_LOGW(TAG, "Service already started, %s change ignored.", setting);
+        return false;
+    }
+    return true;
+}
+
+void MqttMailingService::setState(MqttMailingServiceState state) {
+    const uint32_t now = millis();
+    portENTER_CRITICAL(&mMetricsLock);
+    if (mState == MqttMailingServiceState::CONNECTING) {
+        mMetrics.timeConnectingMs += now - mStateSinceMs;
+    } else if (mState == MqttMailingServiceState::DISCONNECTED) {
+        mMetrics.timeDisconnectedMs += now - mStateSinceMs;
+    }
+    if (state == MqttMailingServiceState::CONNECTED) {
+        if (!mHasConnectedOnce) {
+            mMetrics.timeToConnectMs = now - mStartedAtMs;
+            mHasConnectedOnce = true;
+        }
+        if (mHasBeenConnected) {
+            mMetrics.reconnects++;
+            const uint32_t timeToReconnect = now - mConnectionLostAtMs;
+            mMetrics.lastTimeToReconnectMs = timeToReconnect;
+            if (timeToReconnect > mMetrics.maxTimeToReconnectMs) {
+                mMetrics.maxTimeToReconnectMs = timeToReconnect;
+            }
+        }
+        mHasBeenConnected = true;
+    } else if (state == MqttMailingServiceState::DISCONNECTED &&
+               mState == MqttMailingServiceState::CONNECTED) {
+        mConnectionLostAtMs = now;
+    }
+    mStateSinceMs = now;
+    mState = state;
+    portEXIT_CRITICAL(&mMetricsLock);
+}
+
+void MqttMailingService::recordAck(int msgId) {
+    const int64_t now = esp_timer_get_time();
+    uint32_t latencyUs = 0;
+    uint32_t token = 0;
+    portENTER_CRITICAL(&mMetricsLock);
+    if (mConfig.topicAliases.enabled && mTopicAliases.acknowledge(msgId)) {
+        // the mapping of an alias, not a message of the window
+        portEXIT_CRITICAL(&mMetricsLock);
+        return;
+    }
+    const bool tracked = mInFlight.acknowledge(msgId, now, latencyUs, token);
+    if (tracked) {
+        mMetrics.ackLatency.record(latencyUs);
+    }
+    portEXIT_CRITICAL(&mMetricsLock);
+    if (!tracked) {
+        return;
+    }
+    xSemaphoreGive(mAckSignal);
+    // The sender task may wait for a free slot of the window to publish a
+    // conflated, batched or stored message, or have a delivery callback to
+    // run. A notification takes no slot of the lanes.
+    wakeSender();
+}
+
+bool MqttMailingService::isInFlightWindowFull() {
+    portENTER_CRITICAL(&mMetricsLock);
+    const bool full = mInFlight.occupied() >= mConfig.inFlightWindow;
+    portEXIT_CRITICAL(&mMetricsLock);
+    return full;
+}
+
+/**
+ * Called by the sender task before publishing with QoS 1/2, returns false
+ * if the service is stopping
+ */
+bool MqttMailingService::waitForInFlightWindow() {
+    bool counted = false;
+    while (true) {
+        processDeliveries();
+        if (!isInFlightWindowFull()) {
+            return true;
+        }
+        if (!counted) {
+            portENTER_CRITICAL(&mMetricsLock);
+            mMetrics.inFlight.windowFull++;
+            portEXIT_CRITICAL(&mMetricsLock);
+            counted = true;
+        }
+        if (mStopping) {
+            return false;
+        }
+        xSemaphoreTake(mAckSignal, pdMS_TO_TICKS(MQTT_SENDER_RETRY_INTERVAL_MS));
+    }
+}
+
+/**
+ * Called by the sender task: notifies the acknowledged messages and the
+ * ones that timed out, returns true if messages are still in flight
+ */
+bool MqttMailingService::processDeliveries() {
+    constexpr int64_t timeoutUs = MQTT_INFLIGHT_TIMEOUT_MS * 1000LL;
+    InFlightWindow::Completion completion{};
+    while (true) {
+        portENTER_CRITICAL(&mMetricsLock);
+        const bool completed = mInFlight.takeCompleted(
+            esp_timer_get_time(), timeoutUs, completion);
+        if (completed && completion.status == DeliveryStatus::TIMED_OUT) {
+            mMetrics.inFlight.timedOut++;
+        }
+        const bool inFlight = mInFlight.occupied() > 0;
+        portEXIT_CRITICAL(&mMetricsLock);
+        if (!completed) {
+            return inFlight;
+        }
+        notifyDelivery(completion.token, completion.status);
+    }
+}
+
+void MqttMailingService::notifyDelivery(uint32_t token, DeliveryStatus status) {
+    if (token != 0 && mConfig.deliveryCallback) {
+        mConfig.deliveryCallback(token, status);
+    }
+}
+
+void MqttMailingService::publishTelemetry(MailboxMessage& msg) {
+    const uint32_t now = millis();
+    if (mConfig.telemetryIntervalMs == 0 ||
+        now - mLastTelemetryMs < mConfig.telemetryIntervalMs ||
+        mState != MqttMailingServiceState::CONNECTED) {
+        return;
+    }
+    mLastTelemetryMs = now;
+
+    if (!composeTopic(msg.topic, sizeof(msg.topic),
+                      mConfig.telemetryTopicSuffix)) {
+        ESP_LOGW(TAG, "Telemetry topic too long, telemetry not sent");
+        return;
+    }
+    const size_t length = MetricsFormatter{}(
+        getMetrics(), mTelemetryPayload, sizeof(mTelemetryPayload));
+    if (length >= sizeof(mTelemetryPayload)) {
+        ESP_LOGW(TAG, "Telemetry message too long, telemetry not sent");
+        return;
+    }
+    if (qosOf(MessagePriority::NORMAL) > 0 && isInFlightWindowFull()) {
+        return;
+    }
+    fwdMqttMessage(msg.topic, mTelemetryPayload, length);
+}
+
+void MqttMailingService::clearTopicCache() {
+    if (mTopicCacheMutex == nullptr) {
+        mTopicCache.clear();
+        return;
+    }
+    xSemaphoreTake(mTopicCacheMutex, portMAX_DELAY);
+    mTopicCache.clear();
+    xSemaphoreGive(mTopicCacheMutex);
+}
+
+bool MqttMailingService::composeTopic(char* topic, size_t size,
+                                      std::string_view topicSuffix) const {
+    FixedBufferWriter writer{topic, size};
+    writer.append(mConfig.globalTopicPrefix).append(topicSuffix);
+    return !writer.overflowed();
+}
+
+bool MqttMailingService::composeMeasurementTopic(
+    char* topic, size_t size, std::string_view topicSuffix) const {
+    if (!composeTopic(topic, size, topicSuffix)) {
+        ESP_LOGE(TAG, "Topic too long, measurement not sent");
+        return false;
+    }
+    return true;
+}
+
+bool MqttMailingService::admitMeasurement(core::Measurement& measurement,
+                                          const char* topic, bool& result) {
+    if (mFilterEnabled && mFilterMutex != nullptr) {
+        xSemaphoreTake(mFilterMutex, portMAX_DELAY);
+        const bool publish = mFilter.apply(measurement, millis());
+        xSemaphoreGive(mFilterMutex);
+        if (!publish) {
+            mFilteredCount++;
+            result = true;
+            return false;
+        }
+    }
+    if (mBatchMode != BatchMode::DISABLED) {
+        result = addToBatch(measurement, topic);
+        return false;
+    }
+    return true;
+}
+
+bool MqttMailingService::postMeasurement(MailboxMessage* msg,
+                                         const char* topic) {
+    if (msg->payloadLength >= sizeof(msg->payload)) {
+        ESP_LOGE(TAG, "Formatted measurement too long, not sent");
+        mDroppedCount++;
+        releaseMessage(msg);
+        return false;
+    }
+    memcpy(msg->topic, topic, strlen(topic) + 1);
+    if (mConflationMutex != nullptr) {
+        return conflateMessage(msg);
+    }
+    return postToMailbox(msg);
+}
+
+bool MqttMailingService::conflateMessage(MailboxMessage* msg) {
+    msg->postedUs = static_cast<uint32_t>(esp_timer_get_time());
+    bool replaced = false;
+    uint32_t replacedToken = 0;
+    xSemaphoreTake(mConflationMutex, portMAX_DELAY);
+    const bool stored = mConflation.put(*msg, replaced, replacedToken);
+    mConflationPending = mConflation.pending();
+    xSemaphoreGive(mConflationMutex);
+    if (!stored) {
+        // More topics pending than slots, queued as usual
+        portENTER_CRITICAL(&mMetricsLock);
+        mMetrics.conflation.bypassed++;
+        portEXIT_CRITICAL(&mMetricsLock);
+        return postToMailbox(msg);
+    }
+    releaseMessage(msg);
+    if (replaced) {
+        portENTER_CRITICAL(&mMetricsLock);
+        mMetrics.conflation.conflated++;
+        portEXIT_CRITICAL(&mMetricsLock);
+        // The replaced message will not be published, like an overflow
+        notifyDelivery(replacedToken, DeliveryStatus::DROPPED);
+        return true;
+    }
+    mEnqueuedCount++;
+    wakeSender();
+    return true;
+}
+
+/**
+ * Called by the sender task, publishes the oldest pending conflated message
+ */
+void MqttMailingService::publishConflatedMessage(MailboxMessage& msg) {
+    if (mConflationPending == 0 ||
+        mState != MqttMailingServiceState::CONNECTED ||
+        (qosOf(MessagePriority::NORMAL) > 0 && isInFlightWindowFull())) {
+        return;
+    }
+    xSemaphoreTake(mConflationMutex, portMAX_DELAY);
+    const bool taken = mConflation.take(msg);
+    mConflationPending = mConflation.pending();
+    xSemaphoreGive(mConflationMutex);
+    if (!taken) {
+        return;
+    }
+    if (publishMessage(msg)) {
+        mSentCount++;
+        recordSent(msg.priority, msg.postedUs);
+        return;
+    }
+    // Retried unless a newer message of the topic arrived meanwhile
+    xSemaphoreTake(mConflationMutex, portMAX_DELAY);
+    mConflation.restore(msg);
+    mConflationPending = mConflation.pending();
+    xSemaphoreGive(mConflationMutex);
+}
+
+bool MqttMailingService::sendMeasurementToTopic(
+    const core::Measurement& sample, const char* topic) {
+    core::Measurement measurement = sample;
+    bool result = false;
+    if (!admitMeasurement(measurement, topic, result)) {
+        return result;
+    }
+    if (mMailbox == nullptr) {
+        ESP_LOGE(TAG, "Mailbox not initialized, message not sent");
+        return false;
+    }
+    if (!mConfig.bufferFormatterFn && !mConfig.measurementFormatterFn) {
+        ESP_LOGE(TAG, "Formatter not set, message not sent");
+        return false;
+    }
+
+    MailboxMessage* msg = acquireMessage();
+    if (msg == nullptr) {
+        return false;
+    }
+    if (mConfig.bufferFormatterFn) {
+        msg->payloadLength = mConfig.bufferFormatterFn(
+            measurement, reinterpret_cast<uint8_t*>(msg->payload),
+            sizeof(msg->payload));
+    } else {
+        const auto message = mConfig.measurementFormatterFn(measurement);
+        msg->payloadLength = message.size();
+        if (msg->payloadLength < sizeof(msg->payload)) {
+            memcpy(msg->payload, message.c_str(), msg->payloadLength + 1);
+        }
+    }
+    return postMeasurement(msg, topic);
+}
+
+bool MqttMailingService::addToBatch(const core::Measurement& measurement,
+                                    const char* topic) {
+    if (mMailbox == nullptr) {
+        ESP_LOGE(TAG, "Mailbox not initialized, measurement not sent");
+        return false;
+    }
+
+    xSemaphoreTake(mBatchMutex, portMAX_DELAY);
+    const uint32_t now = millis();
+    MeasurementBatch* target = nullptr;
+    for (auto& batch : mBatches) {
+        if (batch.accepts(topic, measurement)) {
+            target = &batch;
+            break;
+        }
+    }
+    if (target != nullptr &&
+        !target->append(measurement, mBatchConfig.maxBytes)) {
+        // Size limit reached, the batch goes and a new one starts
+        closeBatch(*target);
+        target = nullptr;
+    }
+    if (target == nullptr) {
+        target = acquireBatchSlot(now);
+        if (target == nullptr) {
+            xSemaphoreGive(mBatchMutex);
+            mDroppedCount++;
+            recordLaneDrop(MessagePriority::NORMAL);
+            ESP_LOGW(TAG, "No free batch, measurement to %s dropped", topic);
+            return false;
+        }
+        if (!target->open(topic, measurement, mBatchConfig.mode, now) ||
+            !target->append(measurement, mBatchConfig.maxBytes)) {
+            target->release();
+            xSemaphoreGive(mBatchMutex);
+            ESP_LOGE(TAG, "Measurement does not fit in a batch, not sent");
+            return false;
+        }
+    }
+
+    if (target->count() >= mBatchConfig.maxCount ||
+        now - target->openedAtMs() >= mBatchConfig.maxAgeMs) {
+        closeBatch(*target);
+    }
+    xSemaphoreGive(mBatchMutex);
+    return true;
+}
+
+/**
+ * Returns a free batch slot, called with mBatchMutex taken. If none is free,
+ * the oldest open batch is closed to make room and, since the slot is only
+ * freed once the sender task published it, the overflow policy of the
+ * mailbox applies: BLOCK waits for a slot without holding the lock,
+ * DROP_OLDEST discards the oldest batch waiting for the sender task and
+ * DROP_NEWEST gives up.
+ */
+MeasurementBatch* MqttMailingService::acquireBatchSlot(uint32_t nowMs) {
+    const auto findFree = [this]() -> MeasurementBatch* {
+        for (auto& batch : mBatches) {
+            if (batch.isFree()) {
+                return &batch;
+            }
+        }
+        return nullptr;
+    };
+    if (MeasurementBatch* slot = findFree()) {
+        return slot;
+    }
+    MeasurementBatch* oldest = nullptr;
+    for (auto& batch : mBatches) {
+        if (batch.isOpen() &&
+            (oldest == nullptr ||
+             nowMs - batch.openedAtMs() > nowMs - oldest->openedAtMs())) {
+            oldest = &batch;
+        }
+    }
+    if (oldest != nullptr) {
+        closeBatch(*oldest);
+    }
+
+    const MailboxOverflowPolicy policy = mOverflowPolicy;
+    if (policy == MailboxOverflowPolicy::BLOCK) {
+        const TickType_t timeout = pdMS_TO_TICKS(mBlockTimeoutMs.load());
+        const TickType_t start = xTaskGetTickCount();
+        TickType_t elapsed = 0;
+        while (elapsed < timeout) {
+            // A binary semaphore wakes a single producer up, the others
+            // check again after the retry interval
+            const TickType_t retry =
+                pdMS_TO_TICKS(MQTT_SENDER_RETRY_INTERVAL_MS) + 1;
+            xSemaphoreGive(mBatchMutex);
+            xSemaphoreTake(mBatchSlotFreed, std::min(timeout - elapsed, retry));
+            xSemaphoreTake(mBatchMutex, portMAX_DELAY);
+            if (MeasurementBatch* slot = findFree()) {
+                return slot;
+            }
+            elapsed = xTaskGetTickCount() - start;
+        }
+        return nullptr;
+    }
+    if (policy == MailboxOverflowPolicy::DROP_OLDEST) {
+        MeasurementBatch* discarded = nullptr;
+        for (auto& batch : mBatches) {
+            if (batch.isReady() && &batch != mPublishingBatch &&
+                (discarded == nullptr ||
+                 static_cast<int32_t>(batch.sequence() -
+                                      discarded->sequence()) < 0)) {
+                discarded = &batch;
+            }
+        }
+        if (discarded != nullptr) {
+            ESP_LOGW(TAG, "No free batch, batch to %s dropped",
+                     discarded->topic());
+            discarded->release();
+            mReadyBatches--;
+            mDroppedCount++;
+            recordLaneDrop(MessagePriority::NORMAL);
+            notifyDelivery(mBatchConfig.deliveryToken,
+                           DeliveryStatus::DROPPED);
+            return discarded;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Hands a batch over to the sender task, called with mBatchMutex taken
+ */
+void MqttMailingService::closeBatch(MeasurementBatch& batch) {
+    if (batch.count() == 0) {
+        batch.release();
+        return;
+    }
+    batch.close(mBatchSequence++,
+                static_cast<uint32_t>(esp_timer_get_time()));
+    mReadyBatches++;
+    mEnqueuedCount++;
+    if (mMailbox != nullptr) {
+        wakeSender();
+    }
+}
+
+void MqttMailingService::flushExpiredBatches() {
+    // Called by the sender task: it must not wait on producers holding the
+    // lock
+    if (xSemaphoreTake(mBatchMutex, 0) != pdTRUE) {
+        return;
+    }
+    const uint32_t now = millis();
+    for (auto& batch : mBatches) {
+        if (batch.isOpen() &&
+            now - batch.openedAtMs() >= mBatchConfig.maxAgeMs) {
+            closeBatch(batch);
+        }
+    }
+    xSemaphoreGive(mBatchMutex);
+}
+
+/**
+ * Publishes the oldest ready batch from its slot, called by the sender task.
+ * Batches wait in their slot while disconnected, a batch failing to publish
+ * goes to the message store if it fits in a message, else it is dropped.
+ */
+void MqttMailingService::publishReadyBatch(MailboxMessage& scratch) {
+    const MessagePriority priority = MessagePriority::NORMAL;
+    if (mReadyBatches == 0 || mState != MqttMailingServiceState::CONNECTED ||
+        (qosOf(priority) > 0 && isInFlightWindowFull())) {
+        return;
+    }
+    xSemaphoreTake(mBatchMutex, portMAX_DELAY);
+    MeasurementBatch* batch = nullptr;
+    for (auto& candidate : mBatches) {
+        if (candidate.isReady() &&
+            (batch == nullptr ||
+             static_cast<int32_t>(candidate.sequence() - batch->sequence()) <
+                 0)) {
+            batch = &candidate;
+        }
+    }
+    mPublishingBatch = batch;
+    const uint32_t token = mBatchConfig.deliveryToken;
+    xSemaphoreGive(mBatchMutex);
+    if (batch == nullptr) {
+        return;
+    }
+
+    if (publishMessage(batch->topic(), batch->payload(), batch->length(),
+                       token, priority)) {
+        mSentCount++;
+        recordSent(priority, batch->closedAtUs());
+    } else if (mStore != nullptr && batch->length() < sizeof(scratch.payload)) {
+        memcpy(scratch.topic, batch->topic(), strlen(batch->topic()) + 1);
+        memcpy(scratch.payload, batch->payload(), batch->length() + 1);
+        scratch.payloadLength = batch->length();
+        scratch.deliveryToken = token;
+        scratch.priority = priority;
+        storeMessage(scratch);
+        notifyDelivery(token, DeliveryStatus::STORED);
+    } else {
+        mDroppedCount++;
+        ESP_LOGW(TAG, "Failed to publish batch to %s", batch->topic());
+        notifyDelivery(token, DeliveryStatus::DROPPED);
+    }
+
+    xSemaphoreTake(mBatchMutex, portMAX_DELAY);
+    batch->release();
+    mPublishingBatch = nullptr;
+    mReadyBatches--;
+    xSemaphoreGive(mBatchMutex);
+    xSemaphoreGive(mBatchSlotFreed);
+}
+
+void MqttMailingService::initMailbox() {
+    if (mMailbox != nullptr) {
+        return;
+    }
+    mMailbox = xQueueCreate(mMailboxDepth, sizeof(MailboxMessage*));
+    size_t blocks = mMailboxDepth + MQTT_MESSAGE_POOL_EXTRA_BLOCKS;
+    bool created = mMailbox != nullptr;
+    for (size_t i = 0; i < kMessagePriorityCount; ++i) {
+        if (i == static_cast<size_t>(MessagePriority::NORMAL)) {
+            mLanes[i] = mMailbox;
+            continue;
+        }
+        const size_t depth = mConfig.priorityClasses[i].depth;
+        mLanes[i] = xQueueCreate(depth, sizeof(MailboxMessage*));
+        created = created && mLanes[i] != nullptr;
+        blocks += depth;
+    }
+    if (!created || !mPool.begin(blocks)) {
+        ESP_LOGE(TAG, "Fatal error: Could not create mailbox. Aborting.");
+        assert(0);
+    }
+    mSenderStopped = xSemaphoreCreateBinary();
+    mStopping = false;
+    mSenderReleased = false;
+    TaskHandle_t senderTask = nullptr;
+    xTaskCreate(MqttMailingService::senderTaskCode, "MQTT Sender",
+                MQTT_SENDER_TASK_STACK_SIZE, this, MQTT_SENDER_TASK_PRIORITY,
+                &senderTask);
+    mSenderTaskHandle = senderTask;
+    ESP_LOGI(TAG, "Mailbox created with depth %u.",
+             static_cast<unsigned>(mMailboxDepth));
+}
+
+void MqttMailingService::stopSenderTask() {
+    const TaskHandle_t senderTask = mSenderTaskHandle;
+    if (senderTask != nullptr) {
+        // Let the sender finish the message it may be publishing, deleting
+        // it while it holds the lock of the ESP MQTT client would block the
+        // destruction of the client
+        mStopping = true;
+        wakeSender();
+        if (xSemaphoreTake(mSenderStopped,
+                           pdMS_TO_TICKS(MQTT_SENDER_STOP_TIMEOUT_MS)) !=
+            pdTRUE) {
+            ESP_LOGW(TAG, "Sender task did not stop, deleting it.");
+            mSenderTaskHandle = nullptr;
+            vTaskDelete(senderTask);
+        }
+    }
+}
+
+/**
+ * Called once the ESP MQTT client is destroyed: until then its
+ * acknowledgements ring the stopped sender task, which must not be deleted
+ */
+void MqttMailingService::releaseSenderTask() {
+    if (mSenderTaskHandle != nullptr) {
+        mSenderReleased = true;
+        wakeSender();
+        xSemaphoreTake(mSenderStopped, portMAX_DELAY);
+        mSenderTaskHandle = nullptr;
+    }
+}
+
+void MqttMailingService::destroyMailbox() {
+    if (mSenderStopped != nullptr) {
+        vSemaphoreDelete(mSenderStopped);
+        mSenderStopped = nullptr;
+    }
+    for (auto& lane : mLanes) {
+        if (lane != nullptr && lane != mMailbox) {
+            vQueueDelete(lane);
+        }
+        lane = nullptr;
+    }
+    if (mMailbox != nullptr) {
+        vQueueDelete(mMailbox);
+        mMailbox = nullptr;
+    }
+    mPool.end();
+}
+
+MailboxMessage* MqttMailingService::acquireBlock() {
+    const MailboxOverflowPolicy policy = mOverflowPolicy;
+    MailboxMessage* block =
+        mPool.acquire(policy == MailboxOverflowPolicy::BLOCK
+                          ? pdMS_TO_TICKS(mBlockTimeoutMs.load())
+                          : 0);
+    if (block != nullptr || policy != MailboxOverflowPolicy::DROP_OLDEST) {
+        return block;
+    }
+    // All blocks are pending in the lanes, reuse the oldest one of the least
+    // important lane. Urgent messages are not dropped for another message.
+    for (const MessagePriority priority :
+         {MessagePriority::BULK, MessagePriority::NORMAL}) {
+        if (xQueueReceive(mLanes[static_cast<size_t>(priority)], &block, 0) ==
+            pdTRUE) {
+            mDroppedCount++;
+            recordLaneDrop(priority);
+            notifyDelivery(block->deliveryToken, DeliveryStatus::DROPPED);
+            block->topic[0] = '\0';
+            block->payloadLength = 0;
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+bool MqttMailingService::postToMailbox(MailboxMessage* msg) {
+    const MailboxOverflowPolicy policy = mOverflowPolicy;
+    const TickType_t wait = policy == MailboxOverflowPolicy::BLOCK
+                                ? pdMS_TO_TICKS(mBlockTimeoutMs.load())
+                                : 0;
+    const MessagePriority priority = msg->priority;
+    QueueHandle_t lane = mLanes[static_cast<size_t>(priority)];
+    msg->postedUs = static_cast<uint32_t>(esp_timer_get_time());
+    if (xQueueSendToBack(lane, &msg, wait) == pdTRUE) {
+        mEnqueuedCount++;
+        wakeSender();
+        return true;
+    }
+
+    if (policy == MailboxOverflowPolicy::DROP_OLDEST) {
+        // Other producers may refill the freed slot, hence the bounded retry
+        MailboxMessage* discarded = nullptr;
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            if (xQueueReceive(lane, &discarded, 0) == pdTRUE) {
+                notifyDelivery(discarded->deliveryToken,
+                               DeliveryStatus::DROPPED);
+                mPool.release(discarded);
+                mDroppedCount++;
+                recordLaneDrop(priority);
+            }
+            if (xQueueSendToBack(lane, &msg, 0) == pdTRUE) {
+                mEnqueuedCount++;
+                wakeSender();
+                return true;
+            }
+        }
+    }
+
+    mDroppedCount++;
+    recordLaneDrop(priority);
+    ESP_LOGW(TAG, "Mailbox full, message to %s dropped", msg->topic);
+    mPool.release(msg);
+    return false;
+}
+
+/**
+ * The sender task waits for a notification, the lanes, the conflation slots,
+ * the batches and the acknowledgements ring it. The notifications are
+ * counted, a ring is not lost while the sender is busy and none takes a slot
+ * of the lanes.
+ */
+void MqttMailingService::wakeSender() {
+    const TaskHandle_t senderTask = mSenderTaskHandle;
+    if (senderTask != nullptr) {
+        xTaskNotifyGive(senderTask);
+    }
+}
+
+void MqttMailingService::recordSent(MessagePriority priority,
+                                    uint32_t postedUs) {
+    const uint32_t latencyUs =
+        static_cast<uint32_t>(esp_timer_get_time()) - postedUs;
+    portENTER_CRITICAL(&mMetricsLock);
+    PriorityClassStatistics& stats =
+        mMetrics.priorities[static_cast<size_t>(priority)];
+    stats.sent++;
+    stats.latency.record(latencyUs);
+    portEXIT_CRITICAL(&mMetricsLock);
+}
+
+void MqttMailingService::recordLaneDrop(MessagePriority priority) {
+    portENTER_CRITICAL(&mMetricsLock);
+    mMetrics.priorities[static_cast<size_t>(priority)].dropped++;
+    portEXIT_CRITICAL(&mMetricsLock);
+}
+
+bool MqttMailingService::hasPendingLaneMessages() const {
+    for (const QueueHandle_t lane : mLanes) {
+        if (uxQueueMessagesWaiting(lane) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Takes the oldest message of a lane, nullptr if it is empty
+ */
+MailboxMessage* MqttMailingService::takeFromLane(size_t lane) {
+    MailboxMessage* msg = nullptr;
+    if (xQueueReceive(mLanes[lane], &msg, 0) != pdTRUE) {
+        return nullptr;
+    }
+    return msg;
+}
+
+/**
+ * Called by the sender task, takes the next message to publish according to
+ * the scheduling policy, nullptr if all lanes are empty
+ */
+MailboxMessage* MqttMailingService::takeNextMessage() {
+    constexpr size_t urgent = static_cast<size_t>(MessagePriority::URGENT);
+    if (mConfig.scheduling == SchedulingPolicy::STRICT) {
+        for (size_t i = urgent + 1; i-- > 0;) {
+            if (MailboxMessage* msg = takeFromLane(i)) {
+                return msg;
+            }
+        }
+        return nullptr;
+    }
+    // Weighted round robin: a lane is served while it has credits left, the
+    // credits of all lanes are refilled once no lane with credits has a
+    // message
+    for (int round = 0; round < 2; ++round) {
+        for (size_t i = urgent + 1; i-- > 0;) {
+            if (mLaneCredits[i] == 0) {
+                continue;
+            }
+            if (MailboxMessage* msg = takeFromLane(i)) {
+                mLaneCredits[i]--;
+                return msg;
+            }
+        }
+        for (size_t i = 0; i < kMessagePriorityCount; ++i) {
+            mLaneCredits[i] = mConfig.priorityClasses[i].weight;
+        }
+    }
+    return nullptr;
+}
+
+int MqttMailingService::qosOf(MessagePriority priority) const {
+    const int qos = mConfig.priorityClasses[static_cast<size_t>(priority)].qos;
+    return qos >= 0 ? qos : mConfig.qos;
+}
+
+int MqttMailingService::retainFlagOf(MessagePriority priority) const {
+    const int retainFlag =
+        mConfig.priorityClasses[static_cast<size_t>(priority)].retainFlag;
+    return retainFlag >= 0 ? retainFlag : mConfig.retainFlag;
+}
+
+/**
+ * Sender task
+ * Drains the mailbox into the ESP MQTT client. A message taken out of the
+ * mailbox is held until the client is connected, then its block goes back
+ * to the pool.
+ */
+void MqttMailingService::senderTaskCode(void* arg) {
+    auto* pMailingService = static_cast<MqttMailingService*>(arg);
+    MailboxMessage* msg = nullptr;
+    MailboxMessage& scratch = pMailingService->mSenderScratch;
+    uint32_t lastBatchCheckMs = millis();
+    bool inFlight = false;
+    while (true) {
+        const bool batching =
+            pMailingService->mBatchMode != BatchMode::DISABLED;
+        if (batching &&
+            millis() - lastBatchCheckMs >= MQTT_BATCH_AGE_CHECK_INTERVAL_MS) {
+            pMailingService->flushExpiredBatches();
+            lastBatchCheckMs = millis();
+        }
+        TickType_t wait = portMAX_DELAY;
+        const auto limitWait = [&wait](uint32_t ms) {
+            const TickType_t ticks = pdMS_TO_TICKS(ms) + 1;
+            wait = ticks < wait ? ticks : wait;
+        };
+        if (batching) {
+            limitWait(MQTT_BATCH_AGE_CHECK_INTERVAL_MS);
+        }
+        if (pMailingService->mReadyBatches > 0) {
+            // Like the conflated messages, a full window is freed by
+            // acknowledgements
+            const bool ready =
+                pMailingService->mState ==
+                    MqttMailingServiceState::CONNECTED &&
+                !(pMailingService->qosOf(MessagePriority::NORMAL) > 0 &&
+                  pMailingService->isInFlightWindowFull());
+            limitWait(ready ? 0 : MQTT_SENDER_RETRY_INTERVAL_MS);
+        }
+        const bool dutyCycle = pMailingService->mConfig.dutyCycle.enabled;
+        const bool radioOn = pMailingService->mRadioOn;
+        const MessageStore* store = pMailingService->mStore;
+        if (store != nullptr && store->count() > 0 && radioOn) {
+            // A flush replays the stored messages as fast as possible
+            limitWait(dutyCycle ? 0
+                                : pMailingService->mReplayIntervalMs.load());
+        }
+        if (dutyCycle && radioOn) {
+            // The outbox drains without waking the sender up
+            limitWait(MQTT_SENDER_RETRY_INTERVAL_MS);
+        }
+        if (pMailingService->mStoreDirty) {
+            limitWait(MQTT_STORE_SYNC_INTERVAL_MS);
+        }
+        if (pMailingService->mConflationPending > 0) {
+            // A full window is freed by acknowledgements, which wake the
+            // sender up
+            const bool ready =
+                pMailingService->mState ==
+                    MqttMailingServiceState::CONNECTED &&
+                !(pMailingService->qosOf(MessagePriority::NORMAL) > 0 &&
+                  pMailingService->isInFlightWindowFull());
+            limitWait(ready ? 0 : MQTT_SENDER_RETRY_INTERVAL_MS);
+        }
+        if (pMailingService->mConfig.telemetryIntervalMs > 0) {
+            limitWait(pMailingService->mConfig.telemetryIntervalMs);
+        }
+        // Acknowledgements wake the sender up, timeouts do not
+        if (inFlight) {
+            limitWait(MQTT_SENDER_RETRY_INTERVAL_MS);
+        }
+        if (pMailingService->hasPendingLaneMessages()) {
+            wait = 0;
+        }
+        // All the rings received meanwhile are taken at once
+        ulTaskNotifyTake(pdTRUE, wait);
+        if (pMailingService->mStopping) {
+            break;
+        }
+        msg = pMailingService->takeNextMessage();
+        if (msg != nullptr) {
+            pMailingService->deliverMessage(*msg);
+            pMailingService->mPool.release(msg);
+        }
+        inFlight = pMailingService->processDeliveries();
+        pMailingService->publishReadyBatch(scratch);
+        pMailingService->publishConflatedMessage(scratch);
+        // Live messages go first, stored ones are replayed at a limited rate
+        pMailingService->replayStoredMessage(scratch);
+        pMailingService->publishTelemetry(scratch);
+        pMailingService->syncMessageStore(false);
+        if (dutyCycle) {
+            pMailingService->checkDrained(inFlight);
+        }
+    }
+    pMailingService->syncMessageStore(true);
+    xSemaphoreGive(pMailingService->mSenderStopped);
+    // Rung by acknowledgements until the ESP MQTT client is destroyed
+    while (!pMailingService->mSenderReleased) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    xSemaphoreGive(pMailingService->mSenderStopped);
+    vTaskDelete(nullptr);
+}
+
+void MqttMailingService::deliverMessage(const MailboxMessage& msg) {
+    if (mStore == nullptr) {
+        while (mState != MqttMailingServiceState::CONNECTED) {
+            if (mStopping) {
+                return;
+            }
+            xEventGroupWaitBits(mConnectionEvents, MQTT_CONNECTED_BIT, pdFALSE,
+                                pdTRUE,
+                                pdMS_TO_TICKS(MQTT_SENDER_RETRY_INTERVAL_MS));
+        }
+    } else if (mState != MqttMailingServiceState::CONNECTED) {
+        storeMessage(msg);
+        notifyDelivery(msg.deliveryToken, DeliveryStatus::STORED);
+        return;
+    }
+    if (qosOf(msg.priority) > 0 && !waitForInFlightWindow()) {
+        return;
+    }
+
+    if (publishMessage(msg)) {
+        mSentCount++;
+        recordSent(msg.priority, msg.postedUs);
+    } else if (mStore != nullptr) {
+        storeMessage(msg);
+        notifyDelivery(msg.deliveryToken, DeliveryStatus::STORED);
+    } else {
+        mDroppedCount++;
+        ESP_LOGW(TAG, "Failed to publish message to %s", msg.topic);
+        notifyDelivery(msg.deliveryToken, DeliveryStatus::DROPPED);
+    }
+}
+
+void MqttMailingService::initMessageStore() {
+    if (mStore != nullptr && mStore->begin()) {
+        return;
+    }
+    if (mStore != nullptr) {
+        ESP_LOGW(TAG, "Message store not available, falling back to RAM.");
+    } else if (!mConfig.dutyCycle.enabled) {
+        return;
+    }
+    // In duty-cycle mode the store holds the messages while the radio is off
+    mFallbackStore =
+        std::make_unique<RamMessageStore>(MQTT_OFFLINE_RAM_STORE_CAPACITY);
+    mStore = mFallbackStore->begin() ? mFallbackStore.get() : nullptr;
+}
+
+void MqttMailingService::storeMessage(const MailboxMessage& msg) {
+    mStoreDirty = true;
+    if (mStore->push(msg)) {
+        mStoredCount++;
+        const DutyCycleConfig& dutyCycle = mConfig.dutyCycle;
+        if (dutyCycle.enabled && !mRadioOn && dutyCycle.flushFillLevel > 0 &&
+            mStore->count() >= dutyCycle.flushFillLevel) {
+            xEventGroupSetBits(mConnectionEvents, FLUSH_BIT);
+        }
+    } else {
+        mDroppedCount++;
+        ESP_LOGW(TAG, "Failed to store message to %s", msg.topic);
+    }
+}
+
+void MqttMailingService::replayStoredMessage(MailboxMessage& msg) {
+    if (mStore == nullptr || mStore->count() == 0 ||
+        mState != MqttMailingServiceState::CONNECTED) {
+        return;
+    }
+    const uint32_t now = millis();
+    const bool limited = !mConfig.dutyCycle.enabled;
+    if ((limited && now - mLastReplayMs < mReplayIntervalMs) ||
+        (qosOf(MessagePriority::NORMAL) > 0 && isInFlightWindowFull())) {
+        return;
+    }
+    mLastReplayMs = now;
+    mStoreDirty = true;
+
+    if (!mStore->front(msg)) {
+        ESP_LOGW(TAG, "Unreadable stored message dropped");
+        mStore->pop();
+        mDroppedCount++;
+        return;
+    }
+    // On failure the message stays in the store for the next attempt
+    if (fwdMqttMessage(msg.topic, msg.payload, msg.payloadLength)) {
+        mStore->pop();
+        mReplayedCount++;
+    }
+}
+
+void MqttMailingService::syncMessageStore(bool force) {
+    if (!mStoreDirty ||
+        (!force && millis() - mStoreSyncedAtMs < MQTT_STORE_SYNC_INTERVAL_MS)) {
+        return;
+    }
+    mStore->sync();
+    mStoreDirty = false;
+    mStoreSyncedAtMs = millis();
+}
+
+void MqttMailingService::initEspMqttClient() {
+    esp_mqtt_client_config_t mqtt_cfg = {.uri = mBrokerFullURI.data(),
+                                         .lwt_topic = mLwtTopic.data(),
+                                         .lwt_msg = mLwtMessage.data(),
+                                         .disable_auto_reconnect = true};
+    if (mUseSsl) {
+        mqtt_cfg.cert_pem = mSslCert.c_str();
+    }
+
+    mEspMqttClient = esp_mqtt_client_init(&mqtt_cfg);
+    if (!mEspMqttClient) {
+        ESP_LOGE(TAG, "Fatal error: Could not initiate MQTT Client. Aborting.");
+        assert(0);
+    }
+
+    esp_mqtt_client_register_event(
+        mEspMqttClient, static_cast<esp_mqtt_event_id_t>(ESP_EVENT_ANY_ID),
+        espMqttEventHandler, this);
+
+    setState(MqttMailingServiceState::INITIALIZED);
+    ESP_LOGI(TAG, "ESP MQTT client initialized.");
+}
+
+void MqttMailingService::startEspMqttClient() {
+    esp_err_t ret;
+
+    if (mState == MqttMailingServiceState::CONNECTED ||
+        mState == MqttMailingServiceState::CONNECTING) {
+        // nothing to do
+        return;
+    }
+
+    // Before the start: the client may connect, and its event set the
+    // state to CONNECTED, before esp_mqtt_client_start returns
+    const MqttMailingServiceState previous = mState;
+    setState(MqttMailingServiceState::CONNECTING);
+    ESP_LOGI(TAG, "MQTT client connecting...");
+    ret = esp_mqtt_client_start(mEspMqttClient);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MQTT client");
+        setState(previous);
+        // retried by the connection task
+        xEventGroupSetBits(mConnectionEvents, MQTT_LOST_BIT);
+        return;
+    }
+}
+
+void MqttMailingService::destroyEspMqttClient() {
+    setState(MqttMailingServiceState::UNINITIALIZED);
+    if (mEspMqttClient == nullptr) {
+        return;
+    }
+    esp_mqtt_client_stop(mEspMqttClient);
+    esp_mqtt_client_destroy(mEspMqttClient);
+    mEspMqttClient = nullptr;
+    ESP_LOGI(TAG, "MQTT client has been destroyed.");
+}
+
+void MqttMailingService::espMqttEventHandler(
+    void* handler_args, 
+    [[maybe_unused]] esp_event_base_t base,
+    int32_t event_id, void* event_data) {
+    auto* pMailingService = reinterpret_cast<MqttMailingService*>(handler_args);
+    auto event = reinterpret_cast<esp_mqtt_event_handle_t>(event_data);
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "ESP MQTT client connected");
+            pMailingService->setState(MqttMailingServiceState::CONNECTED);
+            pMailingService->mMqttBackoff.reset();
+            xEventGroupClearBits(pMailingService->mConnectionEvents,
+                                 MQTT_LOST_BIT);
+            xEventGroupSetBits(pMailingService->mConnectionEvents,
+                               MQTT_CONNECTED_BIT);
+            // the session is clean, subscriptions have to be renewed
+            pMailingService->requestResubscribe();
+            // the mappings are published again on this connection
+            pMailingService->mTopicAliasesStale = true;
+            if (pMailingService->mConfig.connectionCallback) {
+                pMailingService->mConfig.connectionCallback(true);
+            }
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ESP_LOGI(TAG, "ESP MQTT client disconnected");
+            pMailingService->setState(MqttMailingServiceState::DISCONNECTED);
+            xEventGroupClearBits(pMailingService->mConnectionEvents,
+                                 MQTT_CONNECTED_BIT);
+            // the client does not reconnect by itself, see connectionTaskCode
+            xEventGroupSetBits(pMailingService->mConnectionEvents,
+                               MQTT_LOST_BIT);
+            if (pMailingService->mConfig.connectionCallback) {
+                pMailingService->mConfig.connectionCallback(false);
+            }
+            break;
+        case MQTT_EVENT_BEFORE_CONNECT:
+            // Automatic reconnection attempt
+            if (pMailingService->mState ==
+                MqttMailingServiceState::DISCONNECTED) {
+                pMailingService->setState(MqttMailingServiceState::CONNECTING);
+            }
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            pMailingService->recordAck(event->msg_id);
+            break;
+        case MQTT_EVENT_DATA:
+            pMailingService->onData(*event);
+            break;
+        case MQTT_EVENT_ERROR:
+            ESP_LOGW(TAG,
+                     "ESP MQTT client encountered an error (code %i)",
+                     (*event).error_handle->error_type);
+            // the broker may have moved, resolve its address again
+            pMailingService->mBrokerAddressValid = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void MqttMailingService::initConnectionManager() {
+    if (mConnectionTaskHandle != nullptr) {
+        return;
+    }
+    // Also when the application manages the Wi-Fi, its reconnections end
+    // the broker backoff
+    if (mWifiEventGuard == nullptr) {
+        mWifiEventGuard = std::make_shared<WifiEventGuard>();
+        mWifiEventGuard->service = this;
+        mWifiEventId = WiFi.onEvent(
+            [guard = mWifiEventGuard](
+                arduino_event_id_t event,
+                [[maybe_unused]] arduino_event_info_t info) {
+                xSemaphoreTake(guard->mutex, portMAX_DELAY);
+                if (guard->service != nullptr) {
+                    guard->service->onWifiEvent(event);
+                }
+                xSemaphoreGive(guard->mutex);
+            });
+        if (WiFi.isConnected()) {
+            xEventGroupSetBits(mConnectionEvents, WIFI_CONNECTED_BIT);
+        }
+    }
+    mConnectionTaskStopped = xSemaphoreCreateBinary();
+    xTaskCreate(MqttMailingService::connectionTaskCode, "MQTT Connection",
+                MQTT_CONNECTION_TASK_STACK_SIZE, this,
+                tskIDLE_PRIORITY + 1, &mConnectionTaskHandle);
+}
+
+void MqttMailingService::destroyConnectionManager() {
+    if (mConnectionTaskHandle != nullptr) {
+        xEventGroupSetBits(mConnectionEvents, STOP_BIT);
+        if (xSemaphoreTake(mConnectionTaskStopped,
+                           pdMS_TO_TICKS(MQTT_SENDER_STOP_TIMEOUT_MS)) !=
+            pdTRUE) {
+            ESP_LOGW(TAG, "Connection task did not stop, deleting it.");
+            vTaskDelete(mConnectionTaskHandle);
+        }
+        mConnectionTaskHandle = nullptr;
+    }
+    if (mConnectionTaskStopped != nullptr) {
+        vSemaphoreDelete(mConnectionTaskStopped);
+        mConnectionTaskStopped = nullptr;
+    }
+    if (mWifiEventGuard != nullptr) {
+        // Waits for an event being handled, the later ones are skipped
+        xSemaphoreTake(mWifiEventGuard->mutex, portMAX_DELAY);
+        mWifiEventGuard->service = nullptr;
+        xSemaphoreGive(mWifiEventGuard->mutex);
+        WiFi.removeEvent(mWifiEventId);
+        mWifiEventGuard.reset();
+    }
+}
+
+void MqttMailingService::onWifiEvent(arduino_event_id_t event) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            ESP_LOGI(TAG, "Wi-Fi connected");
+            mWifiBackoff.reset();
+            // the broker is likely reachable again, do not wait long
+            mMqttBackoff.reset();
+            xEventGroupClearBits(mConnectionEvents, WIFI_LOST_BIT);
+            xEventGroupSetBits(mConnectionEvents,
+                               WIFI_CONNECTED_BIT | NETWORK_UP_BIT);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+            xEventGroupClearBits(mConnectionEvents, WIFI_CONNECTED_BIT);
+            if (mShouldManageWifiConnection) {
+                // otherwise the application reconnects its Wi-Fi
+                xEventGroupSetBits(mConnectionEvents, WIFI_LOST_BIT);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool MqttMailingService::waitBackoff(ReconnectBackoff& backoff) {
+    // Cleared first: a later Wi-Fi connection resets the backoff, or ends
+    // the wait
+    xEventGroupClearBits(mConnectionEvents, NETWORK_UP_BIT);
+    const uint32_t delayMs = backoff.nextDelayMs(esp_random());
+    if (delayMs == 0) {
+        return (xEventGroupGetBits(mConnectionEvents) & STOP_BIT) == 0;
+    }
+    ESP_LOGD(TAG, "Next connection attempt in %u ms",
+             static_cast<unsigned>(delayMs));
+    // false if the service is being destroyed meanwhile
+    return (xEventGroupWaitBits(mConnectionEvents, STOP_BIT | NETWORK_UP_BIT,
+                                pdFALSE, pdFALSE, pdMS_TO_TICKS(delayMs)) &
+            STOP_BIT) == 0;
+}
+
+void MqttMailingService::reconnectEspMqttClient() {
+    updateBrokerAddress();
+    if (mState == MqttMailingServiceState::INITIALIZED) {
+        // start was deferred until the Wi-Fi is connected
+        startEspMqttClient();
+        return;
+    }
+    ESP_LOGI(TAG, "Reconnecting to the broker...");
+    if (esp_mqtt_client_reconnect(mEspMqttClient) == ESP_OK) {
+        return;
+    }
+    // The client is not waiting for a reconnection request, restart it
+    esp_mqtt_client_stop(mEspMqttClient);
+    const MqttMailingServiceState previous = mState;
+    setState(MqttMailingServiceState::CONNECTING);
+    if (esp_mqtt_client_start(mEspMqttClient) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to restart MQTT client");
+        setState(previous);
+        xEventGroupSetBits(mConnectionEvents, MQTT_LOST_BIT);
+    }
+}
+
+/**
+ * Splits the broker URI around its host name, if the address cache applies
+ */
+void MqttMailingService::initBrokerAddressCache() {
+    if (mBrokerAddressTtlMs == 0) {
+        return;
+    }
+    const std::string_view uri{mBrokerFullURI.c_str()};
+    const size_t schemeEnd = uri.find("://");
+    if (schemeEnd == uri.npos) {
+        return;
+    }
+    const std::string_view scheme = uri.substr(0, schemeEnd);
+    if (mUseSsl || (scheme != "mqtt" && scheme != "ws")) {
+        // The client sends the host name for SNI and checks the
+        // certificate against it, an address in the URI would break both
+        ESP_LOGW(TAG, "Broker address cache not used with TLS, the host name "
+                      "is kept for SNI and the certificate check.");
+        return;
+    }
+    const size_t hostStart = schemeEnd + 3;
+    size_t hostEnd = uri.find_first_of(":/", hostStart);
+    if (hostEnd == uri.npos) {
+        hostEnd = uri.size();
+    }
+    const std::string_view host = uri.substr(hostStart, hostEnd - hostStart);
+    if (host.empty() || host.find_first_not_of("0123456789.") == host.npos) {
+        // already an address
+        return;
+    }
+    mBrokerUriScheme = std::string{uri.substr(0, hostStart)};
+    mBrokerHost = std::string{host};
+    mBrokerUriRest = std::string{uri.substr(hostEnd)};
+}
+
+static_assert(MQTT_DNS_TIMEOUT_MS < MQTT_SENDER_STOP_TIMEOUT_MS,
+              "the destructor would not wait for a pending DNS lookup");
+
+/**
+ * Called by the connection task before connecting: resolves the broker host
+ * name if its cached address expired and points the client to the address
+ */
+void MqttMailingService::updateBrokerAddress() {
+    if (mBrokerHost.empty()) {
+        return;
+    }
+    const uint32_t now = millis();
+    if (mBrokerAddressValid &&
+        now - mBrokerResolvedAtMs < mBrokerAddressTtlMs) {
+        return;
+    }
+    // Bounded wait, WiFi.hostByName could block the connection task, and
+    // with it stop(), for as long as the DNS server does not answer
+    char address[16];
+    if (!resolveHostName(mBrokerHost.c_str(), MQTT_DNS_TIMEOUT_MS, address,
+                         sizeof(address))) {
+        ESP_LOGW(TAG, "Could not resolve %s", mBrokerHost.c_str());
+        // the client resolves the host name itself
+        esp_mqtt_client_set_uri(mEspMqttClient, mBrokerFullURI.c_str());
+        mBrokerAddressValid = false;
+        return;
+    }
+    const std::string uri = mBrokerUriScheme + address + mBrokerUriRest;
+    esp_mqtt_client_set_uri(mEspMqttClient, uri.c_str());
+    mBrokerResolvedAtMs = now;
+    mBrokerAddressValid = true;
+    ESP_LOGD(TAG, "Broker address %s cached", uri.c_str());
+}
+
+/**
+ * Connection task
+ * Sleeps until the Wi-Fi (if managed) or the MQTT connection is lost, then
+ * reconnects after a jittered exponential backoff. The broker connection is
+ * only attempted while the Wi-Fi is connected.
+ * In duty-cycle mode, it also brings the radio up for a flush and down once
+ * the sender task is drained. Connection losses are ignored while the radio
+ * is off.
+ */
+void MqttMailingService::connectionTaskCode(void* arg) {
+    auto* pMailingService = static_cast<MqttMailingService*>(arg);
+    const EventGroupHandle_t events = pMailingService->mConnectionEvents;
+    const DutyCycleConfig& dutyCycle = pMailingService->mConfig.dutyCycle;
+    while (true) {
+        TickType_t wait = portMAX_DELAY;
+        if (dutyCycle.enabled) {
+            if (!pMailingService->mRadioOn) {
+                if (!pMailingService->sleepUntilFlush()) {
+                    break;
+                }
+                continue;
+            }
+            const uint32_t radioOnMs =
+                millis() - pMailingService->mRadioOnSinceMs;
+            if (radioOnMs >= dutyCycle.maxRadioOnMs ||
+                (xEventGroupGetBits(events) & DRAINED_BIT)) {
+                pMailingService->radioDown();
+                continue;
+            }
+            wait = pdMS_TO_TICKS(dutyCycle.maxRadioOnMs - radioOnMs) + 1;
+        }
+
+        const EventBits_t bits = xEventGroupWaitBits(
+            events, WIFI_LOST_BIT | MQTT_LOST_BIT | STOP_BIT | DRAINED_BIT,
+            pdFALSE, pdFALSE, wait);
+        if (bits & STOP_BIT) {
+            break;
+        }
+        if ((bits & (WIFI_LOST_BIT | MQTT_LOST_BIT)) == 0) {
+            // drained or radio on for too long
+            continue;
+        }
+
+        if (bits & WIFI_LOST_BIT) {
+            if (!pMailingService->waitBackoff(pMailingService->mWifiBackoff)) {
+                break;
+            }
+            // a failed attempt sets the bit again
+            xEventGroupClearBits(events, WIFI_LOST_BIT);
+            if ((xEventGroupGetBits(events) & WIFI_CONNECTED_BIT) == 0) {
+                ESP_LOGI(TAG, "Reconnecting Wi-Fi...");
+                WiFi.reconnect();
+            }
+            continue;
+        }
+
+        if (pMailingService->mShouldManageWifiConnection &&
+            (bits & WIFI_CONNECTED_BIT) == 0) {
+            xEventGroupWaitBits(events,
+                                WIFI_CONNECTED_BIT | WIFI_LOST_BIT | STOP_BIT,
+                                pdFALSE, pdFALSE, wait);
+            continue;
+        }
+        if (!pMailingService->waitBackoff(pMailingService->mMqttBackoff)) {
+            break;
+        }
+        xEventGroupClearBits(events, MQTT_LOST_BIT);
+        pMailingService->reconnectEspMqttClient();
+    }
+    xSemaphoreGive(pMailingService->mConnectionTaskStopped);
+    vTaskDelete(nullptr);
+}
+
+/**
+ * Waits with the radio off until a flush is due, then brings it up. Returns
+ * false if the service is being destroyed.
+ */
+bool MqttMailingService::sleepUntilFlush() {
+    const uint32_t intervalMs = mConfig.dutyCycle.flushIntervalMs;
+    const TickType_t wait =
+        intervalMs == 0 ? portMAX_DELAY : pdMS_TO_TICKS(intervalMs);
+    const EventBits_t bits = xEventGroupWaitBits(
+        mConnectionEvents, FLUSH_BIT | STOP_BIT, pdFALSE, pdFALSE, wait);
+    if (bits & STOP_BIT) {
+        return false;
+    }
+    radioUp();
+    return true;
+}
+
+void MqttMailingService::radioUp() {
+    // Only run by the connection task, which the destructor stops before
+    // the mailbox and the locks are deleted. Once the stop is requested,
+    // nothing of the flush is started anymore.
+    if (xEventGroupGetBits(mConnectionEvents) & STOP_BIT) {
+        return;
+    }
+    ESP_LOGI(TAG, "Radio on, flushing stored messages");
+    xEventGroupClearBits(mConnectionEvents, FLUSH_BIT | DRAINED_BIT |
+                                                WIFI_LOST_BIT | RADIO_OFF_BIT);
+    portENTER_CRITICAL(&mMetricsLock);
+    mPublishedAtRadioOn = mMetrics.messagesPublished;
+    portEXIT_CRITICAL(&mMetricsLock);
+    mRadioOnSinceMs = millis();
+    mRadioOn = true;
+    mWifiBackoff.reset();
+    mMqttBackoff.reset();
+    // The pending batches are part of this flush
+    flushBatches();
+    if (mShouldManageWifiConnection) {
+        WiFi.begin(mWifiSsid.c_str(), mWifiPassword.c_str());
+    }
+    // Connected by the connection task once the Wi-Fi is up
+    xEventGroupSetBits(mConnectionEvents, MQTT_LOST_BIT);
+    // The sender task sleeps until a message arrives, wake it up
+    wakeSender();
+}
+
+void MqttMailingService::radioDown() {
+    mRadioOn = false;
+    if (mState != MqttMailingServiceState::INITIALIZED) {
+        esp_mqtt_client_stop(mEspMqttClient);
+    }
+    xEventGroupClearBits(mConnectionEvents, MQTT_CONNECTED_BIT);
+    if (mShouldManageWifiConnection) {
+        // Switches the radio off
+        WiFi.disconnect(true);
+    }
+    // Started again by reconnectEspMqttClient at the next flush
+    setState(MqttMailingServiceState::INITIALIZED);
+
+    const uint32_t radioOnMs = millis() - mRadioOnSinceMs;
+    portENTER_CRITICAL(&mMetricsLock);
+    DutyCycleStatistics& statistics = mMetrics.dutyCycle;
+    statistics.flushes++;
+    statistics.lastRadioOnMs = radioOnMs;
+    statistics.totalRadioOnMs += radioOnMs;
+    statistics.lastFlushMessages =
+        mMetrics.messagesPublished - mPublishedAtRadioOn;
+    // Connecting again is not a reconnection
+    mHasBeenConnected = false;
+    const uint32_t flushed = statistics.lastFlushMessages;
+    portEXIT_CRITICAL(&mMetricsLock);
+    ESP_LOGI(TAG, "Radio off after %u ms, %u messages published",
+             static_cast<unsigned>(radioOnMs), static_cast<unsigned>(flushed));
+
+    // A request made while the radio was on is served by this flush
+    xEventGroupClearBits(mConnectionEvents, FLUSH_BIT | DRAINED_BIT);
+    xEventGroupSetBits(mConnectionEvents, RADIO_OFF_BIT);
+}
+
+/**
+ * Called by the sender task in duty-cycle mode, tells the connection task
+ * that the radio can go down: nothing is left to publish or to acknowledge
+ */
+void MqttMailingService::checkDrained(bool inFlight) {
+    if (!mRadioOn || inFlight ||
+        mState != MqttMailingServiceState::CONNECTED) {
+        return;
+    }
+    if (hasPendingLaneMessages() ||
+        mConflationPending > 0 || mReadyBatches > 0 ||
+        (mStore != nullptr && mStore->count() > 0) ||
+        esp_mqtt_client_get_outbox_size(mEspMqttClient) > 0) {
+        return;
+    }
+    // The node may go to deep sleep once the radio is down
+    syncMessageStore(true);
+    xEventGroupSetBits(mConnectionEvents, DRAINED_BIT);
+}
+
+bool MqttMailingService::hasSubscriptions() const {
+    for (const auto& subscription : mSubscriptions) {
+        if (subscription.callback) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Creates the receive queue, its pool and the receiver task. Called with
+ * mSubscriptionMutex taken, once started and subscribed.
+ */
+void MqttMailingService::initReceiver() {
+    if (mReceiverReady) {
+        return;
+    }
+    mIncomingQueue =
+        xQueueCreate(MQTT_RECEIVE_QUEUE_DEPTH, sizeof(MailboxMessage*));
+    // One block being reassembled and one being dispatched
+    if (!mIncomingQueue || !mIncomingPool.begin(MQTT_RECEIVE_QUEUE_DEPTH + 2)) {
+        ESP_LOGE(TAG, "Fatal error: Could not create receive queue. Aborting.");
+        assert(0);
+    }
+    mReceiverStopped = xSemaphoreCreateBinary();
+    xTaskCreate(MqttMailingService::receiverTaskCode, "MQTT Receiver",
+                MQTT_RECEIVER_TASK_STACK_SIZE, this,
+                MQTT_RECEIVER_TASK_PRIORITY, &mReceiverTaskHandle);
+    mReceiverReady = true;
+}
+
+void MqttMailingService::stopReceiverTask() {
+    if (mReceiverTaskHandle == nullptr) {
+        return;
+    }
+    mStopping = true;
+    MailboxMessage* wakeUp = nullptr;
+    xQueueSendToFront(mIncomingQueue, &wakeUp, 0);
+    if (xSemaphoreTake(mReceiverStopped,
+                       pdMS_TO_TICKS(MQTT_SENDER_STOP_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "Receiver task did not stop, deleting it.");
+        vTaskDelete(mReceiverTaskHandle);
+    }
+    mReceiverTaskHandle = nullptr;
+}
+
+void MqttMailingService::destroyReceiver() {
+    mReceiverReady = false;
+    if (mReceiverStopped != nullptr) {
+        vSemaphoreDelete(mReceiverStopped);
+        mReceiverStopped = nullptr;
+    }
+    if (mIncomingQueue != nullptr) {
+        vQueueDelete(mIncomingQueue);
+        mIncomingQueue = nullptr;
+    }
+    mAssembling = nullptr;
+    mIncomingPool.end();
+}
+
+void MqttMailingService::requestResubscribe() {
+    if (!mReceiverReady) {
+        return;
+    }
+    mResubscribePending = true;
+    MailboxMessage* wakeUp = nullptr;
+    // If the queue is full the request is handled with the next message
+    xQueueSendToFront(mIncomingQueue, &wakeUp, 0);
+}
+
+void MqttMailingService::resubscribe() {
+    xSemaphoreTake(mSubscriptionMutex, portMAX_DELAY);
+    for (const auto& subscription : mSubscriptions) {
+        if (subscription.callback &&
+            esp_mqtt_client_subscribe(mEspMqttClient,
+                                      subscription.filter.c_str(),
+                                      subscription.qos) < 0) {
+            ESP_LOGW(TAG, "Could not subscribe to %s",
+                     subscription.filter.c_str());
+        }
+    }
+    xSemaphoreGive(mSubscriptionMutex);
+}
+
+/**
+ * Handles MQTT_EVENT_DATA in the ESP MQTT task: reassembles the fragments
+ * and queues the complete message for the receiver task, without waiting.
+ */
+void MqttMailingService::onData(const esp_mqtt_event_t& event) {
+    if (!mReceiverReady) {
+        return;
+    }
+    const auto offset = static_cast<size_t>(event.current_data_offset);
+    if (offset == 0) {
+        if (mAssembling != nullptr) {
+            // The previous message was never completed, reuse its block
+            mReceiveDroppedCount++;
+        } else {
+            mAssembling = mIncomingPool.acquire();
+        }
+        if (mAssembling == nullptr) {
+            ESP_LOGW(TAG, "Receive queue full, message dropped.");
+            mReceiveDroppedCount++;
+            return;
+        }
+    } else if (mAssembling == nullptr) {
+        // Remaining fragment of a dropped message
+        return;
+    }
+
+    const std::string_view topic{event.topic,
+                                 static_cast<size_t>(event.topic_len)};
+    const auto status = MessageAssembler::addFragment(
+        *mAssembling, topic, event.data, static_cast<size_t>(event.data_len),
+        offset, static_cast<size_t>(event.total_data_len));
+    if (status == MessageAssembler::Status::INCOMPLETE) {
+        return;
+    }
+    if (status == MessageAssembler::Status::REJECTED) {
+        ESP_LOGW(TAG, "Received message too large or out of sequence, "
+                      "dropped.");
+        mReceiveDroppedCount++;
+        mIncomingPool.release(mAssembling);
+    } else if (xQueueSend(mIncomingQueue, &mAssembling, 0) == pdTRUE) {
+        mReceivedCount++;
+    } else {
+        mReceiveDroppedCount++;
+        mIncomingPool.release(mAssembling);
+    }
+    mAssembling = nullptr;
+}
+
+void MqttMailingService::dispatchMessage(const MailboxMessage& msg) {
+    const std::string_view topic{msg.topic};
+    const std::string_view payload{msg.payload, msg.payloadLength};
+    uint16_t ids[MQTT_MAX_SUBSCRIPTIONS];
+    // Copied under the lock and called without it, so that the callbacks
+    // may subscribe and unsubscribe
+    xSemaphoreTake(mSubscriptionMutex, portMAX_DELAY);
+    const size_t count = std::min<size_t>(
+        mTopicFilters.match(topic, ids, MQTT_MAX_SUBSCRIPTIONS),
+        MQTT_MAX_SUBSCRIPTIONS);
+    for (size_t i = 0; i < count; ++i) {
+        mDispatchedCallbacks[i] = mSubscriptions[ids[i]].callback;
+    }
+    xSemaphoreGive(mSubscriptionMutex);
+    for (size_t i = 0; i < count; ++i) {
+        if (mDispatchedCallbacks[i]) {
+            mDispatchedCallbacks[i](topic, payload);
+        }
+        mDispatchedCallbacks[i] = nullptr;
+    }
+    if (count == 0) {
+        mUnmatchedCount++;
+    }
+}
+
+/**
+ * Receiver task
+ * Runs the callbacks of the received messages, so that slow callbacks do not
+ * block the ESP MQTT client, and renews the subscriptions after connecting.
+ */
+void MqttMailingService::receiverTaskCode(void* arg) {
+    auto* pMailingService = static_cast<MqttMailingService*>(arg);
+    MailboxMessage* msg = nullptr;
+    while (true) {
+        xQueueReceive(pMailingService->mIncomingQueue, &msg, portMAX_DELAY);
+        if (pMailingService->mStopping) {
+            pMailingService->mIncomingPool.release(msg);
+            break;
+        }
+        if (pMailingService->mResubscribePending.exchange(false)) {
+            pMailingService->resubscribe();
+        }
+        if (msg != nullptr) {
+            pMailingService->dispatchMessage(*msg);
+            pMailingService->mIncomingPool.release(msg);
+        }
+    }
+    xSemaphoreGive(pMailingService->mReceiverStopped);
+    vTaskDelete(nullptr);
+}
+
+} // end namespace
@@ -1,14 +1,51 @@
 #ifndef UPT_MQTT_MAILING_SERVICE_H
 #define UPT_MQTT_MAILING_SERVICE_H
 
+#include "ConflationTable.h"
+#include "InFlightWindow.h"
+#include "MailboxMessage.h"
+#include "MeasurementBatch.h"
+#include "MeasurementFilter.h"
+#include "MeasurementTemplate.h"
+#include "MessageAssembler.h"
+#include "MessagePool.h"
+#include "MessageStore.h"
+#include "MqttMetrics.h"
+#include "PayloadCompression.h"
+#include "ReconnectBackoff.h"
+#include "TopicAliasTable.h"
+#include "TopicCache.h"
+#include "TopicFilterTrie.h"
 #include "mqtt_cfg.h"
 #include "mqtt_client.h"
 #include <Arduino.h>
 #include <Sensirion_UPT_Core.h>
+#include <WiFi.h>
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 
 namespace sensirion::upt::mqtt{
 
 using MeasurementFormatterType = std::function<std::string(const sensirion::upt::core::Measurement&)>;
+// Writes the text into buffer and returns its length (>= size on overflow)
+using MeasurementBufferFormatterType =
+    std::function<size_t(const sensirion::upt::core::Measurement&,
+                         char* buffer, size_t size)>;
+// Writes the payload into buffer and returns its length (>= size on overflow)
+using BinaryMeasurementFormatterType =
+    std::function<size_t(const sensirion::upt::core::Measurement&,
+                         uint8_t* buffer, size_t size)>;
+// Called with the delivery token and the outcome of a sent message
+using DeliveryCallbackType =
+    std::function<void(uint32_t token, DeliveryStatus status)>;
+// Called with the topic and the payload of a received message
+using MessageCallbackType =
+    std::function<void(std::string_view topic, std::string_view payload)>;
+// Called when the broker connection is established or lost
+using ConnectionCallbackType = std::function<void(bool connected)>;
 
 enum MqttMailingServiceState {
     UNINITIALIZED = 0,
@@ -18,15 +55,82 @@ enum MqttMailingServiceState {
     DISCONNECTED,
 };
 
-/* Class managing MQTT message dispatch. Optionally manages Wi-Fi connection. */
+/* Behaviour of the mailbox when a message is posted while it is full */
+enum class MailboxOverflowPolicy {
+    DROP_OLDEST = 0,  // discard the oldest pending message
+    DROP_NEWEST,      // discard the message being posted
+    BLOCK,            // wait for free space, up to the configured timeout
+};
+
+/* Order in which the sender task serves the lanes of the mailbox */
+enum class SchedulingPolicy {
+    STRICT = 0,  // a lane is only served while the higher ones are empty
+    WEIGHTED,    // the lanes take turns in proportion to their weight
+};
+
+/* Settings of a MessagePriority, see setPriorityClass */
+struct PriorityClassConfig {
+    // QoS and retain flag of its messages, -1 for those of the service
+    int qos = -1;
+    int retainFlag = -1;
+    // Share of the turns with SchedulingPolicy::WEIGHTED, at least 1
+    uint8_t weight = 1;
+    // Capacity of the lane, the NORMAL lane is the mailbox (setMailboxDepth)
+    size_t depth = MQTT_PRIORITY_LANE_DEPTH;
+};
+
+/* Radio duty cycle of battery-powered nodes, see setDutyCycle */
+struct DutyCycleConfig {
+    bool enabled = false;
+    // Time the radio stays off, 0 to only flush on fill level or request
+    uint32_t flushIntervalMs = 300000;
+    // Number of stored messages bringing the radio up, 0 to ignore
+    size_t flushFillLevel = MQTT_OFFLINE_RAM_STORE_CAPACITY * 3 / 4;
+    // The radio goes down after this time even if messages are left
+    uint32_t maxRadioOnMs = 30000;
+};
+
+/* Class managing MQTT message dispatch. Optionally manages Wi-Fi connection.
+ *
+ * Each instance owns its own ESP MQTT client, so several instances can be
+ * connected to different brokers at the same time (see MqttRouter). Only one
+ * of them should manage the Wi-Fi connection.
+ *
+ * Lost connections are re-established by a connection task woken by the
+ * Wi-Fi and MQTT events, with a jittered exponential backoff between the
+ * attempts (see MQTT_RECONNECT_MIN_DELAY_MS and MQTT_RECONNECT_MAX_DELAY_MS).
+ *
+ * Concurrency model:
+ * - Configure the service from one task, then call start(). The broker,
+ *   formatting, topic, QoS, retain and telemetry settings are frozen by
+ *   start(), later calls of their setters are ignored. The setters must not
+ *   run concurrently with start().
+ * - Once started, sendTextMessage, sendMeasurement and flushBatches may be
+ *   called from any number of tasks on both cores. They read the frozen
+ *   configuration without locking, look the topic up in a lock free cache
+ *   and post to the mailbox, a FreeRTOS queue drained by a single sender
+ *   task. Only the sender task publishes.
+ * - The ESP MQTT client, which locks internally, is also called by the
+ *   caller of subscribe and unsubscribe, by the receiver task renewing the
+ *   subscriptions, by the connection task reconnecting and, in duty-cycle
+ *   mode, stopping the client, and by getMetrics for the outbox size.
+ * - The state and the counters are atomics, the metrics are guarded by a
+ *   short critical section.
+ * - The stateful stages take a mutex, only when enabled: the measurement
+ *   filter, the batching and the first formatting of a topic (cache miss).
+ * - The filter, batching and overflow policy settings may be changed at any
+ *   time, the mailbox depth until start() creates the mailbox.
+ * - The instance must not be destroyed while other tasks still use it. */
 class MqttMailingService {
   public:
 
     MqttMailingService();
     ~MqttMailingService();
 
-    // we must not copy the MqttMailingService
-    const MqttMailingService& operator()(MqttMailingService&&) = delete;
+    // we must not copy the MqttMailingService, its tasks and the ESP MQTT
+    // client keep a pointer to it
+    MqttMailingService(const MqttMailingService&) = delete;
+    MqttMailingService& operator=(const MqttMailingService&) = delete;
 
     /**
      * @brief Starts the MqttMailingService
@@ -44,7 +148,8 @@ class MqttMailingService {
      * @param ssid: The SSID of the WiFi AP
      * @param pass: the password of the WiFi AP
      * @param should_be_blocking: Specify if the call should be blocking until
-     * connection is established with broker
+     * connection is established with broker. Use waitUntilConnected for a
+     * blocking start with timeout.
      */
     [[maybe_unused]] void
     startWithDelegatedWiFi(const char* ssid, const char* pass,
@@ -70,6 +175,36 @@ class MqttMailingService {
      */
     [[maybe_unused]] void startWithDelegatedWiFi();
 
+    /**
+     * @brief Wait until the service is connected to the broker, e.g. after
+     *        a non blocking start:
+     *
+     *        mqttMailingService.startWithDelegatedWiFi(ssid, pass);
+     *        if (!mqttMailingService.waitUntilConnected(30000)) {
+     *            // not connected after 30 s
+     *        }
+     *
+     * @param timeoutMs: maximum waiting time in ms, UINT32_MAX waits forever
+     *
+     * @return true if connected, false on timeout or if the service is not
+     *         started
+     */
+    [[maybe_unused]] bool waitUntilConnected(uint32_t timeoutMs);
+
+    /**
+     * @brief Set the function called when the broker connection is
+     *        established or lost, e.g. to continue once a non blocking start
+     *        is connected without waiting in waitUntilConnected.
+     *
+     * @note Must be called before start(). The callback runs in the ESP MQTT
+     *       task and must return quickly, without sending messages
+     *       synchronously.
+     *
+     * @param callback: called with true once connected, false once
+     *        disconnected
+     */
+    [[maybe_unused]] void setConnectionCallback(ConnectionCallbackType callback);
+
     /**
      * @brief Sets the broker URI used to send the MQTT messages.
      *
@@ -119,6 +254,7 @@ class MqttMailingService {
     /**
      * @brief Set the Ssl Certificate of the MQTT broker and enables SSL
      *
+     * @note Must be called before start()
      * @note The memory for the certificate needs to be managed by
      *       the callee.
      *
@@ -136,10 +272,31 @@ class MqttMailingService {
      */
     [[maybe_unused]] void enableSsl();
 
+    /**
+     * @brief Reuse the resolved address of the broker for reconnections
+     *        during ttlMs, instead of resolving its host name at each
+     *        attempt. The address is resolved again once expired or after
+     *        a connection error.
+     *
+     * @note Must be called before start(). The connection task waits at
+     *       most MQTT_DNS_TIMEOUT_MS for the DNS answer, without one the
+     *       client resolves the host name itself.
+     *
+     * @note Not applied with TLS (mqtts://, wss:// or enableSsl()), a
+     *       warning is logged: the host name stays in the URI, the client
+     *       sends it for SNI and checks the certificate against it.
+     *
+     * @param ttlMs: time to live of the address, 0 (default) disables the
+     *        cache
+     */
+    [[maybe_unused]] void setBrokerAddressTtl(uint32_t ttlMs);
+
 
     /**
      * @brief Set the Quality of Service (QoS) for the sent MQTT messages
      *
+     * @note Must be called before start()
+     *
      * @param qos: chosen QoS as integer
      */
     [[maybe_unused]] void setQOS(int qos);
@@ -149,6 +306,7 @@ class MqttMailingService {
      * Resulting topic will be: globalPrefix + messageTopicSuffix
      * 
      * @note Max length is MQTT_TOPIC_PREFIX_MAX_LENGTH
+     * @note Must be called before start()
      *
      * @param topicPrefix: chosen topic prefix string
      */
@@ -157,17 +315,307 @@ class MqttMailingService {
     /**
      * @brief Set the retain flag for the sent MQTT messages
      *
+     * @note Must be called before start()
+     *
      * @param flag: the chosen flag as integer
      */
     [[maybe_unused]] void setRetainFlag(int flag);
 
+    /**
+     * @brief Set the number of messages the mailbox can hold
+     *
+     * @note Must be called before start()
+     *
+     * @param depth: the mailbox depth, defaults to MQTT_MAILBOX_DEPTH
+     */
+    [[maybe_unused]] void setMailboxDepth(size_t depth);
+
+    /**
+     * @brief Set the behaviour of the mailbox when it is full
+     *
+     * @param policy: the chosen overflow policy, defaults to DROP_OLDEST
+     * @param blockTimeoutMs: maximum time a producer waits for free space,
+     *        only used with MailboxOverflowPolicy::BLOCK
+     */
+    [[maybe_unused]] void
+    setMailboxOverflowPolicy(MailboxOverflowPolicy policy,
+                             uint32_t blockTimeoutMs = 0);
+
+    /**
+     * @brief Set the order in which the lanes of the mailbox are served.
+     *        Each MessagePriority has its own lane: URGENT messages, e.g.
+     *        alarms, do not wait behind a backlog of NORMAL or BULK ones.
+     *
+     * @note Must be called before start()
+     *
+     * @param policy: STRICT (default) or WEIGHTED, see SchedulingPolicy
+     */
+    [[maybe_unused]] void setSchedulingPolicy(SchedulingPolicy policy);
+
+    /**
+     * @brief Set the QoS, retain flag, weight and lane depth of the messages
+     *        of a priority. By default they use the QoS and retain flag of
+     *        the service, with the weights 1 (BULK), 2 (NORMAL) and 4
+     *        (URGENT).
+     *
+     * @note Must be called before start(). The lanes follow the mailbox
+     *       overflow policy.
+     *
+     * @param priority: the priority to configure
+     * @param config: its settings
+     */
+    [[maybe_unused]] void setPriorityClass(MessagePriority priority,
+                                           const PriorityClassConfig& config);
+
+    /**
+     * @brief Set a store keeping the messages that cannot be published, e.g.
+     *        while the client is disconnected. Stored messages are replayed
+     *        in order once connected, at a limited rate so live messages are
+     *        not delayed.
+     *
+     * @note Must be called before start(). The memory of the store needs to
+     *       be managed by the callee. If the store cannot be used (begin()
+     *       fails), a RamMessageStore of MQTT_OFFLINE_RAM_STORE_CAPACITY
+     *       messages is used instead.
+     *
+     * @param store: the store, e.g. a FileMessageStore or a RamMessageStore
+     */
+    [[maybe_unused]] void setMessageStore(MessageStore* store);
+
+    /**
+     * @brief Set the maximum rate at which stored messages are replayed
+     *
+     * @note Every stored message is replayed as a message of its own, they
+     *       are not coalesced: replaying n messages takes n / rate seconds,
+     *       e.g. one minute for 600 messages at the default rate. The rate
+     *       is at most 1000 messages per second, and one message per loop of
+     *       the sender task. In duty-cycle mode the rate is not limited.
+     *       Use setBatching to store fewer, larger messages.
+     *
+     * @param messagesPerSecond: defaults to MQTT_REPLAY_RATE_PER_SECOND
+     */
+    [[maybe_unused]] void setReplayRate(uint32_t messagesPerSecond);
+
     /**
      * @brief returns the QueueHandle_t to the mailbox
      *
-     * @note: The mailbox is only available once initialized
+     * @note: The mailbox is only available once initialized. Items are
+     *        pointers to MailboxMessage blocks of the pool of the service,
+     *        use the handle to monitor the mailbox only.
      */
     [[maybe_unused]] QueueHandle_t getMailbox() const;
 
+    /**
+     * @brief returns the counters of enqueued, sent and dropped messages
+     */
+    [[maybe_unused]] MailboxStatistics getMailboxStatistics() const;
+
+    /**
+     * @brief returns the capacity, usage, high-water mark and exhaustion
+     *        counter of the message pool
+     *
+     * @note A high-water mark close to the capacity or a growing exhaustion
+     *       counter hint at a too small MQTT_MAILBOX_DEPTH or
+     *       MQTT_MESSAGE_POOL_EXTRA_BLOCKS.
+     */
+    [[maybe_unused]] MessagePoolStatistics getMessagePoolStatistics() const;
+
+    /**
+     * @brief Set the filter applied to the measurements of all signals
+     *        without a specific filter, e.g. to only publish a CO2 value
+     *        when it changed by more than 10 ppm, but at least every 10 min:
+     *
+     *        FilterConfig config;
+     *        config.deadbandMode = FilterDeadband::ABSOLUTE;
+     *        config.deadband = 10.0f;
+     *        config.heartbeatMs = 600000;
+     *
+     * @note Filtered measurements are reported as successfully sent
+     * @note The heartbeat is only evaluated when a sample arrives, a sensor
+     *       that stopped sampling does not publish heartbeats
+     *
+     * @param config: the filter configuration
+     */
+    [[maybe_unused]] void setMeasurementFilter(const FilterConfig& config);
+
+    /**
+     * @brief Set the filter applied to the measurements of one signal type
+     *
+     * @param signalType: the signal type to filter
+     * @param config: the filter configuration
+     *
+     * @return false if MQTT_FILTER_SIGNAL_CONFIGS signals are already
+     *         configured
+     */
+    [[maybe_unused]] bool setMeasurementFilter(core::SignalType signalType,
+                                               const FilterConfig& config);
+
+    /**
+     * @brief Configure batching of measurements. Instead of one message per
+     *        Measurement, measurements are collected and published together
+     *        as one JSON array once a limit of the configuration is reached.
+     *
+     * @note In BatchMode::PER_TOPIC the measurements are formatted with
+     *       BatchMeasurementFormatter, in BatchMode::ACROSS_TOPICS with
+     *       MixedBatchMeasurementFormatter, the formatter set with
+     *       setMeasurementMessageFormatterFn is not used.
+     * @note A batch is collected in one of MQTT_BATCH_SLOTS slots of
+     *       MQTT_BATCH_MAX_LENGTH bytes, one per topic, and published by the
+     *       sender task from its slot. If all slots wait to be published,
+     *       the overflow policy of the mailbox applies to the new batch.
+     *
+     * @param config: the batching configuration, BatchMode::DISABLED flushes
+     *        the pending batches and disables batching
+     */
+    [[maybe_unused]] void setBatching(const BatchConfig& config);
+
+    /**
+     * @brief Hand all pending batches over to the sender task
+     *
+     * @return true, the batches wait in their slots to be published
+     */
+    [[maybe_unused]] bool flushBatches();
+
+    /**
+     * @brief Set the function notified of the outcome of the messages sent
+     *        with a non-zero delivery token (see sendPayload, sendMessage and
+     *        BatchConfig::deliveryToken). With QoS 1/2 a message is
+     *        delivered once acknowledged by the broker, with QoS 0 once
+     *        handed over to the ESP MQTT client.
+     *
+     * @note The callback runs on the sender task, or on the producer task
+     *       when the mailbox discards an older message (DROP_OLDEST). Keep it
+     *       short, it delays the publication of the next messages.
+     * @note Must be called before start()
+     *
+     * @param callback: called with the token and the DeliveryStatus
+     */
+    [[maybe_unused]] void setDeliveryCallback(DeliveryCallbackType callback);
+
+    /**
+     * @brief Limit the number of QoS 1/2 messages published and not yet
+     *        acknowledged. Once the window is full, the sender task waits for
+     *        acknowledgements, the mailbox fills up and the producers are
+     *        held back according to the mailbox overflow policy. This bounds
+     *        the outbox of the ESP MQTT client when the broker is slow.
+     *
+     * @note The acknowledgement latency in the metrics (ackLatency) helps
+     *       sizing the window: about the message rate times the latency.
+     * @note Must be called before start()
+     *
+     * @param maxInFlight: between 1 and MQTT_INFLIGHT_MAX_MESSAGES (default)
+     */
+    [[maybe_unused]] void setInFlightWindow(size_t maxInFlight);
+
+    /**
+     * @brief Compress the payloads before publishing them, e.g. batches of
+     *        JSON measurements, whose keys, device types and units repeat.
+     *        Payloads are compressed with HeatshrinkEncoder and marked so
+     *        that consumers know to inflate them, see CompressionMarker.
+     *        Payloads that do not get smaller are published as is.
+     *
+     * @note Must be called before start()
+     *
+     * @param config: the compression configuration
+     */
+    [[maybe_unused]] void setCompression(const CompressionConfig& config);
+
+    /**
+     * @brief Experimental, disabled by default: publish the messages of the
+     *        first MQTT_TOPIC_ALIAS_MAX topics since boot on short alias
+     *        topics, see TopicAliasConfig. On every connection the topic of
+     *        an alias is first published as retained message (QoS 1) on
+     *        its mapping topic, for consumers to resolve the alias. The
+     *        messages keep their full topic until the broker acknowledged
+     *        the mapping. An alias keeps its topic until the next boot. The
+     *        mappings retained by the previous boot are cleared on the first
+     *        connection. Topics not longer than their alias topic are
+     *        published as is.
+     *
+     * @note Must be called before start()
+     *
+     * @note The ESP-IDF 4.4 MQTT client has no MQTT 5 support. This is not
+     *       the topic alias of MQTT 5 but a convention of this library,
+     *       consumers must resolve the aliases from the mapping messages.
+     *
+     * @param config: the topic alias configuration
+     */
+    [[maybe_unused]] void setTopicAliases(const TopicAliasConfig& config);
+
+    /**
+     * @brief Keep only the latest measurement of each topic while it waits
+     *        to be published. A measurement replaces the pending one of its
+     *        topic in place, so a slow broker or link delays the latest
+     *        values instead of building a backlog of stale ones, and the
+     *        memory is bounded by MQTT_CONFLATION_SLOTS topics.
+     *
+     * @note Must be called before start()
+     * @note Applies to the measurements (sendMeasurement, sendMeasurementWith),
+     *       not to batches nor text messages. The topic, e.g. computed by the
+     *       topic suffix function, should identify the device and signal.
+     * @note Conflated measurements are not saved in the message store, the
+     *       latest values wait for the connection in their slots.
+     *
+     * @param enabled: true to conflate the measurements
+     */
+    [[maybe_unused]] void setConflation(bool enabled);
+
+    /**
+     * @brief Keep the radio off between flushes, for battery-powered nodes.
+     *        While the radio is off, messages are held in the message store
+     *        (a RamMessageStore of MQTT_OFFLINE_RAM_STORE_CAPACITY messages
+     *        if none is set). After flushIntervalMs, once flushFillLevel
+     *        messages are stored or on requestFlush(), the Wi-Fi (if managed
+     *        by the service) and the broker connection are brought up, the
+     *        stored messages are published and the radio goes down again as
+     *        soon as the outbox is drained.
+     *
+     * @note Must be called before start(). The service connects once at
+     *       start, then follows the duty cycle. Messages of subscriptions
+     *       are only received while the radio is on.
+     *
+     * @note Combine it with setBatching to flush the measurements in fewer
+     *       messages, and with a FileMessageStore to keep them across deep
+     *       sleep.
+     *
+     * @param config: the duty cycle configuration
+     */
+    [[maybe_unused]] void setDutyCycle(const DutyCycleConfig& config);
+
+    /**
+     * @brief Bring the radio up to flush the stored messages, in duty-cycle
+     *        mode
+     */
+    [[maybe_unused]] void requestFlush();
+
+    /**
+     * @brief Wait until the radio went down after a flush, in duty-cycle
+     *        mode, e.g. before entering deep sleep
+     *
+     * @param timeoutMs: maximum time to wait in ms, UINT32_MAX for ever
+     *
+     * @return true if the radio is off
+     */
+    [[maybe_unused]] bool waitUntilFlushed(uint32_t timeoutMs);
+
+    /**
+     * @brief returns a snapshot of the publish side metrics
+     */
+    [[maybe_unused]] MqttMetrics getMetrics();
+
+    /**
+     * @brief Periodically publish the metrics as self-telemetry, formatted
+     *        with MetricsFormatter
+     *
+     * @note Must be called before start()
+     *
+     * @param topicSuffix: the topic suffix (will be combined with the global
+     *        prefix)
+     * @param intervalMs: publish interval in ms, 0 disables the telemetry
+     */
+    [[maybe_unused]] void setTelemetry(std::string&& topicSuffix,
+                                       uint32_t intervalMs);
+
     /**
      * @brief returns the state of the service
      */
@@ -182,27 +630,213 @@ class MqttMailingService {
     /**
      * @brief Set a measurement formatting function
      *
+     * @note Must be called before start()
+     * @note The returned string is allocated for every message, use
+     *       setMeasurementBufferFormatterFn for a publish path without heap
+     *       allocation.
+     *
      * @param fFmt: the function formatting a Measurement into a string
      */
     [[maybe_unused]] void setMeasurementMessageFormatterFn(MeasurementFormatterType formatterFunction);
 
+    /**
+     * @brief Set a measurement formatting function writing the text directly
+     *        into the message block, e.g. DefaultMeasurementFormatter{}.
+     *        When set, it is used by sendMeasurement instead of the function
+     *        set with setMeasurementMessageFormatterFn.
+     *
+     * @note Must be called before start()
+     * @note Replaces the function set with setMeasurementBinaryFormatterFn
+     *
+     * @param formatterFunction: the function writing a Measurement into a
+     *        char buffer, nullptr to go back to the string formatter
+     */
+    [[maybe_unused]] void setMeasurementBufferFormatterFn(
+        MeasurementBufferFormatterType formatterFunction);
+
+    /**
+     * @brief Set a binary measurement formatting function, e.g.
+     *        CborMeasurementFormatter. When set, it is used by sendMeasurement
+     *        instead of the function set with setMeasurementMessageFormatterFn.
+     *
+     * @note Batches are always formatted as JSON
+     * @note Must be called before start()
+     * @note Replaces the function set with setMeasurementBufferFormatterFn
+     *
+     * @param formatterFunction: the function writing a Measurement into a
+     *        byte buffer, nullptr to go back to the text formatter
+     */
+    [[maybe_unused]] void setMeasurementBinaryFormatterFn(
+        BinaryMeasurementFormatterType formatterFunction);
+
     /**
      * @brief Set the function used to define the topic suffix from the Measurement
      *
+     * @note The resulting topics are cached per device and signal, so the
+     *       function must only depend on the metadata and signal type of the
+     *       Measurement.
+     * @note Must be called before start()
+     *
      * @param fFmt: the function transforming a Measurement into a topic suffix
      */
     [[maybe_unused]] void setMeasurementToTopicSuffixFn(MeasurementFormatterType formatterFunction);
 
+    /**
+     * @brief Format the measurements with a template, e.g.
+     *        {"t":{t_offset},"v":{value:.2f},"id":{deviceID}}, see
+     *        MeasurementTemplate for the fields. The template is parsed once,
+     *        sendMeasurement then writes it directly into the message block.
+     *
+     * @note Must be called before start()
+     * @note Replaces the function set with setMeasurementBufferFormatterFn
+     *
+     * @param text: the template
+     *
+     * @return false if the template is invalid, it is then ignored
+     */
+    [[maybe_unused]] bool setMeasurementTemplate(std::string_view text);
+
+    /**
+     * @brief Define the topic suffix with a template, e.g.
+     *        {deviceLabel}/{deviceID}/{quantity}, see MeasurementTemplate for
+     *        the fields.
+     *
+     * @note Must be called before start()
+     * @note Replaces the function set with setMeasurementToTopicSuffixFn
+     *
+     * @param text: the template, without t_offset nor value fields since
+     *        the topics are cached
+     *
+     * @return false if the template is invalid, it is then ignored
+     */
+    [[maybe_unused]] bool setTopicSuffixTemplate(std::string_view text);
+
     /**
      * @brief Send a message to a given topic.
      *
-     * @param message: the message as a string. Maximum 256 characters.
+     * @note The message is posted to the mailbox and published by the sender
+     *       task, the call does not wait for the broker.
+     *
+     * @param message: the message as a string. Maximum
+     *        MQTT_MESSAGE_MAX_LENGTH - 1 characters.
      * @param topicSuffix the topic suffix (will be combined with the global prefix) 
      * 
-     * @return true is message was successfully sent
+     * @return true is message was successfully posted to the mailbox
      */
     [[maybe_unused]] bool sendTextMessage(const std::string& message, const std::string& topicSuffix);
 
+    /**
+     * @brief Send a payload to a given topic. The payload is delimited by its
+     *        length and may contain binary data.
+     *
+     * @param payload: the payload, maximum MQTT_MESSAGE_MAX_LENGTH - 1 bytes
+     * @param topicSuffix the topic suffix (will be combined with the global prefix)
+     * @param deliveryToken: reported to the delivery callback, 0 for none
+     * @param priority: the lane of the message, see setSchedulingPolicy
+     *
+     * @return true is message was successfully posted to the mailbox
+     */
+    [[maybe_unused]] bool
+    sendPayload(std::string_view payload, std::string_view topicSuffix,
+                uint32_t deliveryToken = 0,
+                MessagePriority priority = MessagePriority::NORMAL);
+
+    /**
+     * @brief Send a binary payload to a given topic.
+     *
+     * @param data: the payload, maximum MQTT_MESSAGE_MAX_LENGTH - 1 bytes
+     * @param length: the length of the payload in bytes
+     * @param topicSuffix the topic suffix (will be combined with the global prefix)
+     * @param deliveryToken: reported to the delivery callback, 0 for none
+     * @param priority: the lane of the message, see setSchedulingPolicy
+     *
+     * @return true is message was successfully posted to the mailbox
+     */
+    [[maybe_unused]] bool
+    sendPayload(const uint8_t* data, size_t length,
+                std::string_view topicSuffix, uint32_t deliveryToken = 0,
+                MessagePriority priority = MessagePriority::NORMAL);
+
+    /**
+     * @brief Take a message block from the pool of the service, so the
+     *        payload can be written in place and handed over to sendMessage
+     *        without copy:
+     *
+     *        MailboxMessage* msg = mqttMailingService.acquireMessage();
+     *        if (msg != nullptr) {
+     *            msg->payloadLength = myFormatter(msg->payload,
+     *                                             sizeof(msg->payload));
+     *            mqttMailingService.sendMessage(msg, "topic/");
+     *        }
+     *
+     * @note If the pool is exhausted, the block is taken according to the
+     *       mailbox overflow policy: waited for (BLOCK) or taken from the
+     *       oldest pending BULK, then NORMAL message (DROP_OLDEST). URGENT
+     *       messages are not discarded for another message.
+     *
+     * @return the message, nullptr if no block is available or the service
+     *         is not started
+     */
+    [[maybe_unused]] MailboxMessage* acquireMessage();
+
+    /**
+     * @brief Send a message obtained from acquireMessage. The service takes
+     *        ownership of the message, whether it is sent or not.
+     *
+     * @param message: the message, its payload and payloadLength filled in.
+     *        Maximum MQTT_MESSAGE_MAX_LENGTH - 1 bytes. Set its
+     *        deliveryToken to be notified of its delivery, its priority to
+     *        post it to another lane than NORMAL.
+     * @param topicSuffix the topic suffix (will be combined with the global prefix)
+     *
+     * @return true is message was successfully posted to the mailbox
+     */
+    [[maybe_unused]] bool sendMessage(MailboxMessage* message,
+                                      std::string_view topicSuffix);
+
+    /**
+     * @brief Give a message obtained from acquireMessage back without
+     *        sending it
+     */
+    [[maybe_unused]] void releaseMessage(MailboxMessage* message);
+
+    /**
+     * @brief Subscribe to a topic filter, e.g. "devices/+/config" or
+     *        "commands/#". The callback is called for every message received
+     *        on a matching topic.
+     *
+     * @note The filter is used as is, the global topic prefix is not added.
+     * @note The callbacks run on the receiver task, one after the other, and
+     *       may take their time without blocking the ESP MQTT client. They
+     *       may call subscribe and unsubscribe.
+     * @note A message being dispatched while its subscription is removed
+     *       may still reach the callback once.
+     * @note The payload is not NUL-terminated, both views are only valid
+     *       during the call.
+     * @note The subscriptions are renewed at every connection.
+     *
+     * @param topicFilter: the topic filter, with the wildcards '+' and '#'
+     * @param callback: called with the topic and payload of the message
+     * @param qos: maximum QoS of the messages received
+     *
+     * @return false if the filter is invalid or MQTT_MAX_SUBSCRIPTIONS is
+     *         reached
+     */
+    [[maybe_unused]] bool subscribe(const char* topicFilter,
+                                    MessageCallbackType callback, int qos = 0);
+
+    /**
+     * @brief Remove all subscriptions to a topic filter
+     *
+     * @return false if the filter was not subscribed
+     */
+    [[maybe_unused]] bool unsubscribe(const char* topicFilter);
+
+    /**
+     * @brief returns the counters of received, unmatched and dropped messages
+     */
+    [[maybe_unused]] SubscriptionStatistics getSubscriptionStatistics() const;
+
     /**
      * @brief Send a measurement to a given topic.
      * 
@@ -227,33 +861,330 @@ class MqttMailingService {
      */
     [[maybe_unused]] bool sendMeasurement(const sensirion::upt::core::Measurement measurement);
 
+    /**
+     * @brief Send a measurement to a given topic, formatted with the given
+     *        formatter instead of the registered function. The call to the
+     *        formatter is resolved at compile time and can be inlined, see
+     *        MeasurementPublisher.
+     *
+     * @note The measurement filter and the batching apply as for
+     *       sendMeasurement.
+     *
+     * @param formatter: a formatter writing into a buffer, e.g.
+     *        FullMeasurementFormatter{}
+     * @param measurement: the Measurement to send
+     * @param topicSuffix the topic suffix (will be combined with the global prefix)
+     *
+     * @return true is message was successfully posted to the mailbox
+     */
+    template <typename Formatter>
+    bool sendMeasurementWith(const Formatter& formatter,
+                             const core::Measurement& measurement,
+                             std::string_view topicSuffix) {
+        char topic[MQTT_TOPIC_MAX_LENGTH];
+        if (!composeMeasurementTopic(topic, sizeof(topic), topicSuffix)) {
+            return false;
+        }
+        core::Measurement admitted = measurement;
+        bool result = false;
+        if (!admitMeasurement(admitted, topic, result)) {
+            return result;
+        }
+        MailboxMessage* msg = acquireMessage();
+        if (msg == nullptr) {
+            return false;
+        }
+        msg->payloadLength =
+            formatter(admitted, msg->payload, sizeof(msg->payload));
+        return postMeasurement(msg, topic);
+    }
+
   private:
-    MqttMailingServiceState mState;
+    std::atomic<MqttMailingServiceState> mState;
     std::string mBrokerFullURI{};
     std::string mLwtTopic{};
     std::string mLwtMessage{};
     bool mUseSsl;
     std::string mSslCert{};
-    int mQos;
-    int mRetainFlag;
-    std::string mGlobalTopicPrefix{};
-    TaskHandle_t mWifiCheckTaskHandle = nullptr;
-    // Pointer to formatting function
-    MeasurementFormatterType mMeasurementFormatterFn{};
-    MeasurementFormatterType mTopicSuffixFn{};
+
+    // Settings read by the publish path, immutable once start() froze them
+    struct PublishConfig {
+        std::string globalTopicPrefix{};
+        int qos = 0;
+        int retainFlag = 0;
+        MeasurementFormatterType measurementFormatterFn{};
+        MeasurementFormatterType topicSuffixFn{};
+        // Binary or text formatter writing into the message block
+        BinaryMeasurementFormatterType bufferFormatterFn{};
+        std::string telemetryTopicSuffix{};
+        uint32_t telemetryIntervalMs = 0;
+        CompressionConfig compression{};
+        TopicAliasConfig topicAliases{};
+        DutyCycleConfig dutyCycle{};
+        ConnectionCallbackType connectionCallback{};
+        bool conflation = false;
+        SchedulingPolicy scheduling = SchedulingPolicy::STRICT;
+        // Indexed by MessagePriority
+        PriorityClassConfig priorityClasses[kMessagePriorityCount]{
+            {-1, -1, 1, MQTT_PRIORITY_LANE_DEPTH},
+            {-1, -1, 2, MQTT_PRIORITY_LANE_DEPTH},
+            {-1, -1, 4, MQTT_PRIORITY_LANE_DEPTH}};
+        DeliveryCallbackType deliveryCallback{};
+        size_t inFlightWindow = MQTT_INFLIGHT_MAX_MESSAGES;
+    };
+    PublishConfig mConfig{};
+    std::atomic<bool> mConfigFrozen{false};
+    bool isConfigurable(const char* setting) const;
+
+    // Mailbox, holding pointers to blocks of mPool. It is the NORMAL lane,
+    // posting to any lane rings the sender task with a notification
+    QueueHandle_t mMailbox = nullptr;
+    QueueHandle_t mLanes[kMessagePriorityCount]{};
+    // Turns left in the current round of SchedulingPolicy::WEIGHTED, only
+    // used by the sender task
+    uint8_t mLaneCredits[kMessagePriorityCount]{};
+    MessagePool mPool{};
+    size_t mMailboxDepth = MQTT_MAILBOX_DEPTH;
+    std::atomic<MailboxOverflowPolicy> mOverflowPolicy{
+        MailboxOverflowPolicy::DROP_OLDEST};
+    std::atomic<uint32_t> mBlockTimeoutMs{0};
+    std::atomic<uint32_t> mEnqueuedCount{0};
+    std::atomic<uint32_t> mSentCount{0};
+    std::atomic<uint32_t> mDroppedCount{0};
+    std::atomic<uint32_t> mStoredCount{0};
+    std::atomic<uint32_t> mReplayedCount{0};
+    // Read by the tasks ringing the sender task
+    std::atomic<TaskHandle_t> mSenderTaskHandle{nullptr};
+    SemaphoreHandle_t mSenderStopped = nullptr;
+    std::atomic<bool> mStopping{false};
+    // Set once nothing rings the stopped sender task anymore, it then exits
+    std::atomic<bool> mSenderReleased{false};
+    // Used by the sender task to replay stored messages and to publish the
+    // batches, conflated messages and telemetry, kept off its stack
+    MailboxMessage mSenderScratch{};
+    void initMailbox();
+    void stopSenderTask();
+    void releaseSenderTask();
+    void destroyMailbox();
+    MailboxMessage* acquireBlock();
+    bool postToMailbox(MailboxMessage* msg);
+    bool hasPendingLaneMessages() const;
+    MailboxMessage* takeFromLane(size_t lane);
+    MailboxMessage* takeNextMessage();
+    void recordLaneDrop(MessagePriority priority);
+    int qosOf(MessagePriority priority) const;
+    int retainFlagOf(MessagePriority priority) const;
+    static void senderTaskCode(void* arg);
+    void deliverMessage(const MailboxMessage& msg);
+
+    // Compression, only used by the sender task
+    HeatshrinkEncoder mCompressor{};
+    uint8_t mCompressionBuffer[MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH];
+    bool publishMessage(const MailboxMessage& msg);
+    bool publishMessage(const char* topic, const char* payload, size_t length,
+                        uint32_t deliveryToken, MessagePriority priority);
+
+    // Topic aliases, used by the sender task, their mappings acknowledged by
+    // the ESP MQTT task. mTopicAliasesStale is set on connection for the
+    // sender task to deactivate them until their mappings are published
+    // again. The retained mappings of the previous boot are cleared once.
+    TopicAliasTable mTopicAliases{};
+    std::atomic<bool> mTopicAliasesStale{false};
+    bool mAliasMappingsCleared = false;
+    bool aliasTopic(const char* topic, char* alias, size_t size);
+    void clearAliasMappings();
+    int publishAliasMapping(uint16_t alias, const char* topic);
+
+    // QoS 1/2 messages in flight, guarded by mMetricsLock. mAckSignal wakes
+    // the sender task waiting for a free slot of the window
+    InFlightWindow mInFlight{};
+    SemaphoreHandle_t mAckSignal = nullptr;
+    bool isInFlightWindowFull();
+    bool waitForInFlightWindow();
+    bool processDeliveries();
+    void notifyDelivery(uint32_t token, DeliveryStatus status);
+
+    // Offline message store, only accessed by the sender task once started
+    MessageStore* mStore = nullptr;
+    std::unique_ptr<RamMessageStore> mFallbackStore{};
+    std::atomic<uint32_t> mReplayIntervalMs{1000 / MQTT_REPLAY_RATE_PER_SECOND};
+    uint32_t mLastReplayMs = 0;
+    // Changes not yet synced, see MQTT_STORE_SYNC_INTERVAL_MS
+    bool mStoreDirty = false;
+    uint32_t mStoreSyncedAtMs = 0;
+    void initMessageStore();
+    void storeMessage(const MailboxMessage& msg);
+    void replayStoredMessage(MailboxMessage& msg);
+    void syncMessageStore(bool force);
+
+    // Batching, mBatchConfig and mBatches are guarded by mBatchMutex. A
+    // closed batch waits in its slot for the sender task, which publishes
+    // it without holding the lock: the producers leave ready batches alone,
+    // but for DROP_OLDEST, which skips mPublishingBatch. mBatchSlotFreed is
+    // given whenever the sender task releases a slot
+    BatchConfig mBatchConfig{};
+    std::atomic<BatchMode> mBatchMode{BatchMode::DISABLED};
+    MeasurementBatch mBatches[MQTT_BATCH_SLOTS];
+    MeasurementBatch* mPublishingBatch = nullptr;
+    uint32_t mBatchSequence = 0;
+    std::atomic<uint32_t> mReadyBatches{0};
+    SemaphoreHandle_t mBatchMutex = nullptr;
+    SemaphoreHandle_t mBatchSlotFreed = nullptr;
+    bool addToBatch(const core::Measurement& measurement, const char* topic);
+    MeasurementBatch* acquireBatchSlot(uint32_t nowMs);
+    void closeBatch(MeasurementBatch& batch);
+    void flushExpiredBatches();
+    void publishReadyBatch(MailboxMessage& scratch);
+    bool composeTopic(char* topic, size_t size,
+                      std::string_view topicSuffix) const;
+    bool composeMeasurementTopic(char* topic, size_t size,
+                                 std::string_view topicSuffix) const;
+    // Applies the filter and the batching, returns false if the measurement
+    // must not be posted, the result of the send is then in result
+    bool admitMeasurement(core::Measurement& measurement, const char* topic,
+                          bool& result);
+    bool postMeasurement(MailboxMessage* msg, const char* topic);
+    void wakeSender();
+    void recordSent(MessagePriority priority, uint32_t postedUs);
+
+    // Conflation, mConflation is guarded by mConflationMutex, which only
+    // exists if conflation is enabled. mConflationPending mirrors its count
+    ConflationTable mConflation{};
+    SemaphoreHandle_t mConflationMutex = nullptr;
+    std::atomic<uint32_t> mConflationPending{0};
+    bool conflateMessage(MailboxMessage* msg);
+    void publishConflatedMessage(MailboxMessage& msg);
+    bool sendMeasurementToTopic(const core::Measurement& measurement,
+                                const char* topic);
+
+    // Measurement filter
+    MeasurementFilter mFilter{};
+    std::atomic<bool> mFilterEnabled{false};
+    SemaphoreHandle_t mFilterMutex = nullptr;
+    std::atomic<uint32_t> mFilteredCount{0};
+
+    // Topics computed by the topic suffix function, prefix included. Lookups
+    // are lock free, insertions are serialized by mTopicCacheMutex
+    TopicCache mTopicCache{};
+    SemaphoreHandle_t mTopicCacheMutex = nullptr;
+    void clearTopicCache();
+
+    // Metrics, guarded by mMetricsLock
+    portMUX_TYPE mMetricsLock = portMUX_INITIALIZER_UNLOCKED;
+    MqttMetrics mMetrics{};
+    uint32_t mStateSinceMs = 0;
+    uint32_t mConnectionLostAtMs = 0;
+    bool mHasBeenConnected = false;
+    uint32_t mStartedAtMs = 0;
+    bool mHasConnectedOnce = false;
+    bool mHasPublished = false;
+    void setState(MqttMailingServiceState state);
+    void recordAck(int msgId);
+
+    // Self-telemetry, published by the sender task from its own buffer
+    uint32_t mLastTelemetryMs = 0;
+    char mTelemetryPayload[MetricsFormatter::kBufferSize]{};
+    void publishTelemetry(MailboxMessage& msg);
+
+    // Subscriptions, identified by their index in the trie, guarded by
+    // mSubscriptionMutex. Received messages are reassembled in the ESP MQTT
+    // task into blocks of mIncomingPool and dispatched by the receiver task
+    struct Subscription {
+        std::string filter{};
+        int qos = 0;
+        MessageCallbackType callback{};
+    };
+    Subscription mSubscriptions[MQTT_MAX_SUBSCRIPTIONS]{};
+    TopicFilterTrie mTopicFilters{};
+    SemaphoreHandle_t mSubscriptionMutex = nullptr;
+    QueueHandle_t mIncomingQueue = nullptr;
+    MessagePool mIncomingPool{};
+    // Message being reassembled, only accessed by the ESP MQTT task
+    MailboxMessage* mAssembling = nullptr;
+    // Callbacks of the message being dispatched, only used by the receiver
+    // task
+    MessageCallbackType mDispatchedCallbacks[MQTT_MAX_SUBSCRIPTIONS]{};
+    TaskHandle_t mReceiverTaskHandle = nullptr;
+    SemaphoreHandle_t mReceiverStopped = nullptr;
+    std::atomic<bool> mReceiverReady{false};
+    std::atomic<bool> mResubscribePending{false};
+    std::atomic<uint32_t> mReceivedCount{0};
+    std::atomic<uint32_t> mUnmatchedCount{0};
+    std::atomic<uint32_t> mReceiveDroppedCount{0};
+    bool hasSubscriptions() const;
+    void initReceiver();
+    void stopReceiverTask();
+    void destroyReceiver();
+    void requestResubscribe();
+    void resubscribe();
+    void onData(const esp_mqtt_event_t& event);
+    void dispatchMessage(const MailboxMessage& msg);
+    static void receiverTaskCode(void* arg);
 
     // ESP MQTT client
-    static esp_mqtt_client_handle_t mEspMqttClient;
+    esp_mqtt_client_handle_t mEspMqttClient = nullptr;
     void initEspMqttClient();
     void startEspMqttClient();
     void destroyEspMqttClient();
 
+    // Broker address cache, only used by the connection task. The URI is
+    // split around the host name, which is replaced by its address
+    uint32_t mBrokerAddressTtlMs = 0;
+    std::string mBrokerUriScheme{};
+    std::string mBrokerHost{};
+    std::string mBrokerUriRest{};
+    uint32_t mBrokerResolvedAtMs = 0;
+    std::atomic<bool> mBrokerAddressValid{false};
+    void initBrokerAddressCache();
+    void updateBrokerAddress();
+
     //  Forward function
-    bool fwdMqttMessage(const char* topic, const char* message);
+    bool fwdMqttMessage(const char* topic, const char* message, size_t length,
+                        uint32_t deliveryToken = 0,
+                        MessagePriority priority = MessagePriority::NORMAL);
 
     // Wi-fi related
     bool mShouldManageWifiConnection = false;
-    [[noreturn]] static void wifiCheckTaskCode(__attribute__((unused)) void* arg);
+    std::string mWifiSsid{};
+    std::string mWifiPassword{};
+
+    // Connection management, woken by the Wi-Fi and MQTT events
+    EventGroupHandle_t mConnectionEvents = nullptr;
+    TaskHandle_t mConnectionTaskHandle = nullptr;
+    SemaphoreHandle_t mConnectionTaskStopped = nullptr;
+    // Shared with the Wi-Fi event handler: the Arduino event task does not
+    // wait for it in removeEvent and may still run it afterwards, also once
+    // the service is freed. The handler does nothing once service is
+    // cleared, both under mutex.
+    struct WifiEventGuard {
+        SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+        MqttMailingService* service = nullptr;
+        ~WifiEventGuard() {
+            vSemaphoreDelete(mutex);
+        }
+    };
+    std::shared_ptr<WifiEventGuard> mWifiEventGuard{};
+    wifi_event_id_t mWifiEventId{};
+    ReconnectBackoff mWifiBackoff{MQTT_RECONNECT_MIN_DELAY_MS,
+                                  MQTT_RECONNECT_MAX_DELAY_MS};
+    ReconnectBackoff mMqttBackoff{MQTT_RECONNECT_MIN_DELAY_MS,
+                                  MQTT_RECONNECT_MAX_DELAY_MS};
+    void initConnectionManager();
+    void destroyConnectionManager();
+    void onWifiEvent(arduino_event_id_t event);
+    bool waitBackoff(ReconnectBackoff& backoff);
+    void reconnectEspMqttClient();
+    static void connectionTaskCode(void* arg);
+
+    // Duty cycle, the radio is only up while mRadioOn. The connection task
+    // brings it up and down, the sender task reports when it is drained
+    std::atomic<bool> mRadioOn{true};
+    uint32_t mRadioOnSinceMs = 0;
+    uint32_t mPublishedAtRadioOn = 0;
+    bool sleepUntilFlush();
+    void radioUp();
+    void radioDown();
+    void checkDrained(bool inFlight);
 
     // Event handler
     static void
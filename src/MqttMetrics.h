@@ -0,0 +1,210 @@
+#ifndef UPT_MQTT_METRICS_H
+#define UPT_MQTT_METRICS_H
+
+#include "MailboxMessage.h"
+#include "MeasurementFormatting.hpp"
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+struct MailboxStatistics {
+    uint32_t enqueued = 0;  // messages accepted by the mailbox
+    uint32_t sent = 0;      // messages handed over to the ESP MQTT client
+    uint32_t dropped = 0;   // messages discarded (overflow or publish error)
+    uint32_t stored = 0;    // messages moved to the offline message store
+    uint32_t replayed = 0;  // stored messages published after reconnection
+};
+
+struct MessagePoolStatistics {
+    uint32_t capacity = 0;       // blocks in the pool
+    uint32_t inUse = 0;          // blocks currently taken
+    uint32_t highWaterMark = 0;  // maximum number of blocks taken at once
+    uint32_t exhausted = 0;      // block requests finding the pool empty
+};
+
+struct InFlightStatistics {
+    uint32_t inFlight = 0;   // QoS 1/2 messages waiting for acknowledgement
+    uint32_t windowFull = 0; // times the sender waited for a free slot
+    uint32_t timedOut = 0;   // messages not acknowledged in time
+};
+
+struct CompressionStatistics {
+    uint32_t compressed = 0;         // messages published compressed
+    uint32_t uncompressedBytes = 0;  // their payload bytes before compression
+    uint32_t compressedBytes = 0;    // and after, marker included
+};
+
+struct DutyCycleStatistics {
+    uint32_t flushes = 0;
+    uint32_t lastRadioOnMs = 0;      // radio on time of the last flush
+    uint32_t totalRadioOnMs = 0;
+    uint32_t lastFlushMessages = 0;  // messages published by the last flush
+};
+
+struct TopicAliasStatistics {
+    uint32_t aliased = 0;   // messages published on an alias topic
+    uint32_t mappings = 0;  // alias mappings published
+};
+
+struct ConflationStatistics {
+    uint32_t conflated = 0;  // pending messages replaced by a newer one
+    uint32_t bypassed = 0;   // messages queued as usual, all slots pending
+    uint32_t pending = 0;    // messages waiting in the conflation slots
+};
+
+struct SubscriptionStatistics {
+    uint32_t received = 0;   // complete messages received
+    uint32_t unmatched = 0;  // received messages matching no subscription
+    uint32_t dropped = 0;    // messages too large, incomplete or not queued
+};
+
+/* Histogram of latencies with fixed, roughly logarithmic buckets */
+struct LatencyHistogram {
+    static constexpr size_t kBucketCount = 8;
+    // Inclusive upper bound of each bucket in us, the last one is unbounded
+    static constexpr uint32_t kBucketUpperBoundsUs[kBucketCount] = {
+        100, 500, 1000, 5000, 10000, 50000, 100000, UINT32_MAX};
+
+    uint32_t counts[kBucketCount]{};
+
+    void record(uint32_t latencyUs) {
+        size_t bucket = 0;
+        while (latencyUs > kBucketUpperBoundsUs[bucket]) {
+            bucket++;
+        }
+        counts[bucket]++;
+    }
+
+    uint32_t total() const {
+        uint32_t sum = 0;
+        for (const auto count : counts) {
+            sum += count;
+        }
+        return sum;
+    }
+
+    /**
+     * @brief returns the upper bound of the bucket holding the given
+     * percentile (0-100), 0 if the histogram is empty
+     */
+    uint32_t percentileUpperBoundUs(uint32_t percentile) const {
+        const uint32_t count = total();
+        if (count == 0) {
+            return 0;
+        }
+        const uint64_t rank = (static_cast<uint64_t>(count) * percentile + 99) / 100;
+        uint64_t cumulated = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            cumulated += counts[i];
+            if (cumulated >= rank) {
+                return kBucketUpperBoundsUs[i];
+            }
+        }
+        return kBucketUpperBoundsUs[kBucketCount - 1];
+    }
+};
+
+/* Messages of one lane of the mailbox, see MessagePriority */
+struct PriorityClassStatistics {
+    uint32_t sent = 0;     // messages handed over to the ESP MQTT client
+    // messages discarded because the lane was full or whose block was
+    // reused for a new message (DROP_OLDEST)
+    uint32_t dropped = 0;
+    // Time from posting to the lane until handed over to the client
+    LatencyHistogram latency{};
+};
+
+/* Publish side metrics of an MqttMailingService */
+struct MqttMetrics {
+    uint32_t messagesPublished = 0;
+    uint32_t bytesPublished = 0;
+    // Topic bytes of the published messages, bytesPublished counts payloads
+    uint32_t topicBytesPublished = 0;
+    uint32_t publishFailures = 0;
+    // Duration of the esp_mqtt_client_publish calls
+    LatencyHistogram publishLatency{};
+    uint32_t reconnects = 0;
+    // Time from the loss of the connection until it was re-established
+    uint32_t lastTimeToReconnectMs = 0;
+    uint32_t maxTimeToReconnectMs = 0;
+    // Time from start() to the first connection and to the first message
+    // handed over to the ESP MQTT client
+    uint32_t timeToConnectMs = 0;
+    uint32_t timeToFirstPublishMs = 0;
+    uint32_t timeConnectingMs = 0;
+    uint32_t timeDisconnectedMs = 0;
+    // Bytes held in the outbox of the ESP MQTT client
+    int outboxSize = 0;
+    // Time between publishing with QoS 1/2 and MQTT_EVENT_PUBLISHED
+    LatencyHistogram ackLatency{};
+    InFlightStatistics inFlight{};
+    // Measurements discarded or aggregated by the measurement filter
+    uint32_t measurementsFiltered = 0;
+    MailboxStatistics mailbox{};
+    MessagePoolStatistics pool{};
+    SubscriptionStatistics subscriptions{};
+    CompressionStatistics compression{};
+    TopicAliasStatistics topicAliases{};
+    DutyCycleStatistics dutyCycle{};
+    ConflationStatistics conflation{};
+    // Indexed by MessagePriority
+    PriorityClassStatistics priorities[kMessagePriorityCount]{};
+};
+
+/**
+ * Formats metrics as the compact JSON message published as self-telemetry:
+ * {"pub":..,"bytes":..,"fail":..,"lat_us":[..],"reconn":..,"ttr_ms":..,
+ *  "t_conn_ms":..,"t_disc_ms":..,"outbox":..,"ack_us":[..],"enq":..,
+ *  "sent":..,"drop":..,"pool_hwm":..,"pool_exh":..}
+ * Latency arrays hold the bucket counts of the histograms.
+ */
+struct MetricsFormatter {
+    // Fits the message with every counter at its maximum, about 460 bytes,
+    // more than a MailboxMessage payload
+    static constexpr size_t kBufferSize = 512;
+
+    size_t operator()(const MqttMetrics& metrics, char* buffer,
+                      size_t size) const {
+        FixedBufferWriter writer{buffer, size};
+        writer.append("{\"pub\":").appendInteger(metrics.messagesPublished);
+        writer.append(",\"bytes\":").appendInteger(metrics.bytesPublished);
+        writer.append(",\"fail\":").appendInteger(metrics.publishFailures);
+        writer.append(",\"lat_us\":");
+        appendHistogram(writer, metrics.publishLatency);
+        writer.append(",\"reconn\":").appendInteger(metrics.reconnects);
+        writer.append(",\"ttr_ms\":")
+            .appendInteger(metrics.lastTimeToReconnectMs);
+        writer.append(",\"t_conn_ms\":")
+            .appendInteger(metrics.timeConnectingMs);
+        writer.append(",\"t_disc_ms\":")
+            .appendInteger(metrics.timeDisconnectedMs);
+        writer.append(",\"outbox\":").appendInteger(metrics.outboxSize);
+        writer.append(",\"ack_us\":");
+        appendHistogram(writer, metrics.ackLatency);
+        writer.append(",\"enq\":").appendInteger(metrics.mailbox.enqueued);
+        writer.append(",\"sent\":").appendInteger(metrics.mailbox.sent);
+        writer.append(",\"drop\":").appendInteger(metrics.mailbox.dropped);
+        writer.append(",\"pool_hwm\":")
+            .appendInteger(metrics.pool.highWaterMark);
+        writer.append(",\"pool_exh\":").appendInteger(metrics.pool.exhausted);
+        writer.append('}');
+        return writer.result();
+    }
+
+  private:
+    static void appendHistogram(FixedBufferWriter& writer,
+                                const LatencyHistogram& histogram) {
+        writer.append('[');
+        for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+            if (i > 0) {
+                writer.append(',');
+            }
+            writer.appendInteger(histogram.counts[i]);
+        }
+        writer.append(']');
+    }
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_METRICS_H */
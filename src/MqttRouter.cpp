@@ -0,0 +1,57 @@
+#include "MqttRouter.h"
+
+namespace sensirion::upt::mqtt {
+
+[[maybe_unused]] void
+MqttRouter::setDefaultService(MqttMailingService* service) {
+    mDefaultService = service;
+}
+
+[[maybe_unused]] bool MqttRouter::addRoute(std::string&& topicSuffixPrefix,
+                                           MqttMailingService* service) {
+    if (mRouteCount >= MQTT_ROUTER_MAX_ROUTES) {
+        return false;
+    }
+    mRoutes[mRouteCount].prefix = topicSuffixPrefix;
+    mRoutes[mRouteCount].service = service;
+    mRouteCount++;
+    return true;
+}
+
+[[maybe_unused]] MqttMailingService*
+MqttRouter::route(std::string_view topicSuffix) const {
+    MqttMailingService* service = mDefaultService;
+    size_t matchLength = 0;
+    for (size_t i = 0; i < mRouteCount; ++i) {
+        const auto& prefix = mRoutes[i].prefix;
+        if (prefix.size() >= matchLength &&
+            topicSuffix.compare(0, prefix.size(), prefix) == 0) {
+            service = mRoutes[i].service;
+            matchLength = prefix.size();
+        }
+    }
+    return service;
+}
+
+[[maybe_unused]] bool
+MqttRouter::sendTextMessage(const std::string& message,
+                            const std::string& topicSuffix) {
+    MqttMailingService* service = route(topicSuffix);
+    return service != nullptr && service->sendTextMessage(message, topicSuffix);
+}
+
+[[maybe_unused]] bool MqttRouter::sendPayload(std::string_view payload,
+                                              std::string_view topicSuffix) {
+    MqttMailingService* service = route(topicSuffix);
+    return service != nullptr && service->sendPayload(payload, topicSuffix);
+}
+
+[[maybe_unused]] bool
+MqttRouter::sendMeasurement(const core::Measurement& measurement,
+                            const std::string& topicSuffix) {
+    MqttMailingService* service = route(topicSuffix);
+    return service != nullptr &&
+           service->sendMeasurement(measurement, topicSuffix);
+}
+
+}  // namespace sensirion::upt::mqtt
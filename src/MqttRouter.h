@@ -0,0 +1,75 @@
+#ifndef UPT_MQTT_ROUTER_H
+#define UPT_MQTT_ROUTER_H
+
+#include "MqttMailingService.h"
+#include <string>
+#include <string_view>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Dispatches messages to several MqttMailingService instances, e.g. a cloud
+ * broker and a local edge broker, based on the prefix of the topic suffix.
+ * The longest matching prefix wins, messages without match go to the
+ * default service.
+ *
+ * @note Routes must be configured before sending messages.
+ */
+class MqttRouter {
+  public:
+    /**
+     * @brief Set the service receiving the messages without matching route
+     */
+    [[maybe_unused]] void setDefaultService(MqttMailingService* service);
+
+    /**
+     * @brief Route the messages whose topic suffix starts with prefix
+     *
+     * @return false if MQTT_ROUTER_MAX_ROUTES routes are already configured
+     */
+    [[maybe_unused]] bool addRoute(std::string&& topicSuffixPrefix,
+                                   MqttMailingService* service);
+
+    /**
+     * @brief returns the service handling the given topic suffix, nullptr
+     * if none
+     */
+    [[maybe_unused]] MqttMailingService* route(std::string_view topicSuffix) const;
+
+    /**
+     * @brief Send a message through the service matching the topic suffix
+     *
+     * @return true if the message was posted, false if no service matches
+     */
+    [[maybe_unused]] bool sendTextMessage(const std::string& message,
+                                          const std::string& topicSuffix);
+
+    /**
+     * @brief Send a payload through the service matching the topic suffix
+     *
+     * @return true if the message was posted, false if no service matches
+     */
+    [[maybe_unused]] bool sendPayload(std::string_view payload,
+                                      std::string_view topicSuffix);
+
+    /**
+     * @brief Send a measurement through the service matching the topic suffix
+     *
+     * @return true if the message was posted, false if no service matches
+     */
+    [[maybe_unused]] bool sendMeasurement(const core::Measurement& measurement,
+                                          const std::string& topicSuffix);
+
+  private:
+    struct Route {
+        std::string prefix{};
+        MqttMailingService* service = nullptr;
+    };
+    Route mRoutes[MQTT_ROUTER_MAX_ROUTES];
+    size_t mRouteCount = 0;
+    MqttMailingService* mDefaultService = nullptr;
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_ROUTER_H */
@@ -0,0 +1,198 @@
+#include "PayloadCompression.h"
+#include <algorithm>
+
+namespace sensirion::upt::mqtt {
+
+namespace {
+
+constexpr size_t kWindowSize = 1u << HeatshrinkEncoder::kWindowBits;
+constexpr size_t kMaxMatchLength = 1u << HeatshrinkEncoder::kLookaheadBits;
+// A back-reference takes 13 bits, two literals 18 bits
+constexpr size_t kMinMatchLength = 2;
+// Bounds the time spent on payloads with many repetitions
+constexpr int kMaxChainSteps = 32;
+
+/* Writes bits most significant first, as heatshrink does */
+class BitWriter {
+  public:
+    BitWriter(uint8_t* buffer, size_t size) : mBuffer{buffer}, mSize{size} {
+    }
+
+    void push(uint32_t value, unsigned bitCount) {
+        while (bitCount-- > 0) {
+            if ((value >> bitCount) & 1u) {
+                mCurrent |= mMask;
+            }
+            mMask >>= 1;
+            if (mMask == 0) {
+                flush();
+            }
+        }
+    }
+
+    // returns the length written, size + 1 on overflow
+    size_t finish() {
+        if (mMask != 0x80) {
+            flush();
+        }
+        return mOverflow ? mSize + 1 : mLength;
+    }
+
+  private:
+    uint8_t* mBuffer;
+    size_t mSize;
+    size_t mLength = 0;
+    uint8_t mCurrent = 0;
+    uint8_t mMask = 0x80;
+    bool mOverflow = false;
+
+    void flush() {
+        if (mLength < mSize) {
+            mBuffer[mLength++] = mCurrent;
+        } else {
+            mOverflow = true;
+        }
+        mCurrent = 0;
+        mMask = 0x80;
+    }
+};
+
+class BitReader {
+  public:
+    BitReader(const uint8_t* buffer, size_t length)
+        : mBuffer{buffer}, mLength{length} {
+    }
+
+    // returns false if fewer than bitCount bits are left
+    bool read(unsigned bitCount, uint32_t& value) {
+        if (bitCount > (mLength - mPosition) * 8 - mBit) {
+            return false;
+        }
+        value = 0;
+        while (bitCount-- > 0) {
+            value = (value << 1) | ((mBuffer[mPosition] >> (7 - mBit)) & 1u);
+            if (++mBit == 8) {
+                mBit = 0;
+                mPosition++;
+            }
+        }
+        return true;
+    }
+
+  private:
+    const uint8_t* mBuffer;
+    size_t mLength;
+    size_t mPosition = 0;
+    unsigned mBit = 0;
+};
+
+inline uint8_t hashAt(const uint8_t* input, size_t position) {
+    return static_cast<uint8_t>((input[position] << 3) ^ input[position + 1]);
+}
+
+}  // namespace
+
+size_t HeatshrinkEncoder::compress(const uint8_t* input, size_t length,
+                                   uint8_t* output, size_t size) {
+    if (length > MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH) {
+        return size + 1;
+    }
+    std::fill(std::begin(mHead), std::end(mHead), kNoPosition);
+    const auto insert = [this, input, length](size_t position) {
+        if (position + 1 < length) {
+            const uint8_t hash = hashAt(input, position);
+            mPrevious[position] = mHead[hash];
+            mHead[hash] = static_cast<int16_t>(position);
+        }
+    };
+
+    BitWriter writer{output, size};
+    size_t position = 0;
+    while (position < length) {
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        if (position + kMinMatchLength <= length) {
+            const size_t maxLength =
+                std::min(kMaxMatchLength, length - position);
+            int16_t candidate = mHead[hashAt(input, position)];
+            // Chains hold decreasing positions, the closest first
+            for (int step = 0; candidate != kNoPosition && step < kMaxChainSteps;
+                 ++step) {
+                const size_t offset = position - candidate;
+                if (offset > kWindowSize) {
+                    break;
+                }
+                size_t matchLength = 0;
+                while (matchLength < maxLength &&
+                       input[candidate + matchLength] ==
+                           input[position + matchLength]) {
+                    matchLength++;
+                }
+                if (matchLength > bestLength) {
+                    bestLength = matchLength;
+                    bestOffset = offset;
+                    if (matchLength == maxLength) {
+                        break;
+                    }
+                }
+                candidate = mPrevious[candidate];
+            }
+        }
+
+        if (bestLength >= kMinMatchLength) {
+            writer.push(0, 1);
+            writer.push(bestOffset - 1, kWindowBits);
+            writer.push(bestLength - 1, kLookaheadBits);
+            for (size_t i = 0; i < bestLength; ++i) {
+                insert(position + i);
+            }
+            position += bestLength;
+        } else {
+            writer.push(1, 1);
+            writer.push(input[position], 8);
+            insert(position);
+            position++;
+        }
+    }
+    return writer.finish();
+}
+
+size_t HeatshrinkDecoder::decompress(const uint8_t* input, size_t length,
+                                     uint8_t* output, size_t size) {
+    BitReader reader{input, length};
+    size_t outputLength = 0;
+    uint32_t tag = 0;
+    // The padding of the last byte is too short for a back-reference
+    while (reader.read(1, tag)) {
+        if (tag == 1) {
+            uint32_t byte = 0;
+            if (!reader.read(8, byte)) {
+                break;
+            }
+            if (outputLength >= size) {
+                return size + 1;
+            }
+            output[outputLength++] = static_cast<uint8_t>(byte);
+            continue;
+        }
+        uint32_t index = 0;
+        uint32_t count = 0;
+        if (!reader.read(HeatshrinkEncoder::kWindowBits, index) ||
+            !reader.read(HeatshrinkEncoder::kLookaheadBits, count)) {
+            break;
+        }
+        const size_t offset = index + 1;
+        const size_t matchLength = count + 1;
+        if (offset > outputLength || outputLength + matchLength > size) {
+            return size + 1;
+        }
+        // Byte by byte, the match may overlap the bytes it produces
+        for (size_t i = 0; i < matchLength; ++i) {
+            output[outputLength] = output[outputLength - offset];
+            outputLength++;
+        }
+    }
+    return outputLength;
+}
+
+}  // namespace sensirion::upt::mqtt
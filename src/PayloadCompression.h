@@ -0,0 +1,81 @@
+#ifndef UPT_MQTT_PAYLOAD_COMPRESSION_H
+#define UPT_MQTT_PAYLOAD_COMPRESSION_H
+
+#include "mqtt_cfg.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sensirion::upt::mqtt {
+
+/* How consumers recognize a compressed message */
+enum class CompressionMarker {
+    TOPIC_SUFFIX = 0,  // CompressionConfig::topicSuffix is appended to the topic
+    CONTENT_HEADER,    // the payload starts with kCompressedPayloadHeader
+};
+
+struct CompressionConfig {
+    bool enabled = false;
+    // Shorter payloads are published as is
+    size_t minPayloadSize = MQTT_COMPRESSION_MIN_PAYLOAD_SIZE;
+    CompressionMarker marker = CompressionMarker::TOPIC_SUFFIX;
+    std::string topicSuffix{"/hs"};
+};
+
+/* Prepended to compressed payloads with CompressionMarker::CONTENT_HEADER.
+ * 0x1F is neither a valid first byte of a JSON text nor of a CBOR item. */
+constexpr char kCompressedPayloadHeader[] = {0x1F, 'H', 'S'};
+
+/**
+ * LZSS compressor producing the bit stream of heatshrink with a window of
+ * 2^8 bytes and a lookahead of 2^4 bytes, so consumers can inflate with any
+ * heatshrink decoder, e.g. heatshrink2.decompress(data, window_sz2=8,
+ * lookahead_sz2=4) in Python, or with HeatshrinkDecoder.
+ *
+ * Matches are found through hash chains held in the object: its size is
+ * fixed, compressing does not allocate memory. Inputs are limited to
+ * MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH bytes, messages and batches.
+ *
+ * @note One instance must not be used by several tasks at the same time.
+ */
+class HeatshrinkEncoder {
+  public:
+    static constexpr unsigned kWindowBits = 8;
+    static constexpr unsigned kLookaheadBits = 4;
+
+    /**
+     * @brief Compresses input into output
+     *
+     * @return the compressed length, > size if it does not fit in output or
+     *         if input is longer than MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH
+     */
+    size_t compress(const uint8_t* input, size_t length, uint8_t* output,
+                    size_t size);
+
+  private:
+    static constexpr size_t kHashSize = 256;
+    static constexpr int16_t kNoPosition = -1;
+
+    int16_t mHead[kHashSize];
+    static_assert(MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH <= INT16_MAX,
+                  "positions are stored as int16_t");
+    int16_t mPrevious[MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH];
+};
+
+/**
+ * Decoder of the bit stream written by HeatshrinkEncoder
+ */
+struct HeatshrinkDecoder {
+    /**
+     * @brief Inflates input into output
+     *
+     * @return the inflated length, > size if it does not fit in output or
+     *         if input is not a valid stream
+     */
+    static size_t decompress(const uint8_t* input, size_t length,
+                             uint8_t* output, size_t size);
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_PAYLOAD_COMPRESSION_H */
@@ -0,0 +1,34 @@
+#include "ReconnectBackoff.h"
+
+namespace sensirion::upt::mqtt {
+
+ReconnectBackoff::ReconnectBackoff(uint32_t minDelayMs, uint32_t maxDelayMs)
+    : mMinDelayMs{minDelayMs > 0 ? minDelayMs : 1},
+      mMaxDelayMs{maxDelayMs > minDelayMs ? maxDelayMs : minDelayMs} {
+}
+
+uint32_t ReconnectBackoff::nextDelayMs(uint32_t random) {
+    const uint32_t attempt = mAttempts.fetch_add(1);
+    if (attempt == 0) {
+        return 0;
+    }
+    uint64_t delay = mMinDelayMs;
+    for (uint32_t i = 1; i < attempt && delay < mMaxDelayMs; ++i) {
+        delay *= 2;
+    }
+    if (delay > mMaxDelayMs) {
+        delay = mMaxDelayMs;
+    }
+    const uint32_t half = static_cast<uint32_t>(delay / 2);
+    return half + random % (static_cast<uint32_t>(delay) - half + 1);
+}
+
+void ReconnectBackoff::reset() {
+    mAttempts = 0;
+}
+
+uint32_t ReconnectBackoff::attempts() const {
+    return mAttempts.load();
+}
+
+}  // namespace sensirion::upt::mqtt
@@ -0,0 +1,46 @@
+#ifndef UPT_MQTT_RECONNECT_BACKOFF_H
+#define UPT_MQTT_RECONNECT_BACKOFF_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Delays between reconnection attempts: exponential backoff with jitter.
+ *
+ * The first attempt is made at once. The delay then doubles with every
+ * attempt, from minDelayMs up to maxDelayMs, and is randomized between half
+ * and all of it, so devices losing their connection at the same time do not
+ * reconnect in lockstep.
+ *
+ * @note reset() may be called from any task while another one requests
+ *       delays.
+ */
+class ReconnectBackoff {
+  public:
+    ReconnectBackoff(uint32_t minDelayMs, uint32_t maxDelayMs);
+
+    /**
+     * @brief returns the delay before the next attempt and counts it
+     *
+     * @param random: a random number, e.g. from esp_random()
+     */
+    uint32_t nextDelayMs(uint32_t random);
+
+    /**
+     * @brief Restarts from minDelayMs, to be called once connected
+     */
+    void reset();
+
+    uint32_t attempts() const;
+
+  private:
+    uint32_t mMinDelayMs;
+    uint32_t mMaxDelayMs;
+    std::atomic<uint32_t> mAttempts{0};
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_RECONNECT_BACKOFF_H */
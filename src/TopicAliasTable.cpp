@@ -0,0 +1,81 @@
+#include "TopicAliasTable.h"
+#include <cstring>
+
+namespace sensirion::upt::mqtt {
+
+uint16_t TopicAliasTable::lookup(std::string_view topic, bool& assigned) {
+    assigned = false;
+    const uint32_t hash = hashTopic(topic);
+    for (size_t i = 0; i < mSize; ++i) {
+        const Entry& entry = mEntries[i];
+        if (entry.hash == hash && topic == entry.topic) {
+            return static_cast<uint16_t>(i + 1);
+        }
+    }
+    if (mSize == MQTT_TOPIC_ALIAS_MAX ||
+        topic.size() >= MQTT_TOPIC_MAX_LENGTH) {
+        return 0;
+    }
+    Entry& entry = mEntries[mSize++];
+    entry.hash = hash;
+    memcpy(entry.topic, topic.data(), topic.size());
+    entry.topic[topic.size()] = '\0';
+    entry.mappingMsgId = 0;
+    entry.active = false;
+    assigned = true;
+    return static_cast<uint16_t>(mSize);
+}
+
+void TopicAliasTable::release(uint16_t alias) {
+    if (alias != 0 && alias == mSize) {
+        mSize--;
+    }
+}
+
+bool TopicAliasTable::isActive(uint16_t alias) const {
+    return alias != 0 && alias <= mSize && mEntries[alias - 1].active;
+}
+
+bool TopicAliasTable::isMappingPending(uint16_t alias) const {
+    return alias != 0 && alias <= mSize &&
+           mEntries[alias - 1].mappingMsgId != 0;
+}
+
+void TopicAliasTable::setMappingPending(uint16_t alias, int msgId) {
+    if (alias != 0 && alias <= mSize) {
+        mEntries[alias - 1].mappingMsgId = msgId;
+    }
+}
+
+bool TopicAliasTable::acknowledge(int msgId) {
+    if (msgId <= 0) {
+        return false;
+    }
+    // All entries, mSize belongs to the other task
+    for (auto& entry : mEntries) {
+        int expected = msgId;
+        if (entry.mappingMsgId.compare_exchange_strong(expected, 0)) {
+            entry.active = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TopicAliasTable::deactivateAll() {
+    for (auto& entry : mEntries) {
+        entry.mappingMsgId = 0;
+        entry.active = false;
+    }
+}
+
+uint32_t TopicAliasTable::hashTopic(std::string_view topic) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char c : topic) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+}  // namespace sensirion::upt::mqtt
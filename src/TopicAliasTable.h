@@ -0,0 +1,107 @@
+#ifndef UPT_MQTT_TOPIC_ALIAS_TABLE_H
+#define UPT_MQTT_TOPIC_ALIAS_TABLE_H
+
+#include "mqtt_cfg.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Experimental topic aliases on top of MQTT 3.1.1: a topic is replaced by
+ * <prefix><aliasTopicSuffix><alias>, once its full topic was published as
+ * retained message on <prefix><mappingTopicSuffix><alias> and acknowledged
+ * by the broker. <prefix> is the global topic prefix.
+ *
+ * This is a convention of this library, not part of MQTT: consumers have to
+ * resolve the aliases themselves.
+ */
+struct TopicAliasConfig {
+    bool enabled = false;
+    std::string aliasTopicSuffix{"a/"};
+    std::string mappingTopicSuffix{"alias/"};
+};
+
+/**
+ * Aliases (1 to MQTT_TOPIC_ALIAS_MAX) assigned to topics in the order they
+ * are first published. An alias keeps its topic until the device restarts,
+ * further topics have none once all aliases are assigned.
+ *
+ * On every connection an alias is inactive until the mapping published for
+ * it is acknowledged, messages go on the full topic meanwhile.
+ *
+ * @note lookup, release, setMappingPending and deactivateAll are called by
+ *       a single task, acknowledge may be called concurrently by another one.
+ */
+class TopicAliasTable {
+  public:
+    /**
+     * @brief Looks up the alias of a topic, assigns the next free one if the
+     *        topic has none yet
+     *
+     * @param assigned: set to true if the alias was assigned by this call
+     *
+     * @return the alias, 0 if the topic has none and all are assigned
+     */
+    uint16_t lookup(std::string_view topic, bool& assigned);
+
+    /**
+     * @brief Frees the last assigned alias, e.g. if it does not pay off
+     */
+    void release(uint16_t alias);
+
+    /**
+     * @brief returns true if the mapping of alias was acknowledged on this
+     *        connection, the alias can be used
+     */
+    bool isActive(uint16_t alias) const;
+
+    /**
+     * @brief returns true if the mapping of alias was published on this
+     *        connection and waits for its acknowledgement
+     */
+    bool isMappingPending(uint16_t alias) const;
+
+    /**
+     * @brief Records the message id of the mapping published for alias
+     */
+    void setMappingPending(uint16_t alias, int msgId);
+
+    /**
+     * @brief Activates the alias whose mapping has the message id msgId
+     *
+     * @return false if msgId is not the id of a pending mapping
+     */
+    bool acknowledge(int msgId);
+
+    /**
+     * @brief Deactivates all aliases, on a new connection: their mappings
+     *        have to be published again
+     */
+    void deactivateAll();
+
+    size_t size() const {
+        return mSize;
+    }
+
+  private:
+    struct Entry {
+        uint32_t hash;
+        char topic[MQTT_TOPIC_MAX_LENGTH];
+        // Message id of the mapping waiting for acknowledgement, 0 if none
+        std::atomic<int> mappingMsgId{0};
+        std::atomic<bool> active{false};
+    };
+
+    Entry mEntries[MQTT_TOPIC_ALIAS_MAX];
+    size_t mSize = 0;
+
+    static uint32_t hashTopic(std::string_view topic);
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_TOPIC_ALIAS_TABLE_H */
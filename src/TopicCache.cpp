@@ -0,0 +1,99 @@
+#include "TopicCache.h"
+#include <cstring>
+
+namespace sensirion::upt::mqtt {
+
+// A reader giving up reports a miss instead of spinning on a preempted writer
+constexpr int kMaxReadAttempts = 4;
+
+bool TopicCache::find(const core::Measurement& m, char* topic, size_t size) {
+    for (auto& entry : mEntries) {
+        for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+            const uint32_t before =
+                entry.sequence.load(std::memory_order_acquire);
+            if (before & 1u) {
+                continue;
+            }
+            bool hit = matches(entry, m);
+            if (hit) {
+                const size_t length =
+                    strnlen(entry.topic, MQTT_TOPIC_MAX_LENGTH - 1);
+                hit = length < size;
+                if (hit) {
+                    memcpy(topic, entry.topic, length);
+                    topic[length] = '\0';
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.sequence.load(std::memory_order_relaxed) != before) {
+                continue;
+            }
+            if (!hit) {
+                break;
+            }
+            entry.lastUse.store(
+                mUseCounter.fetch_add(1, std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TopicCache::insert(const core::Measurement& m, const char* topic) {
+    const size_t topicLength = strlen(topic);
+    if (topicLength >= MQTT_TOPIC_MAX_LENGTH) {
+        return false;
+    }
+    Entry* target = &mEntries[0];
+    for (auto& entry : mEntries) {
+        if (matches(entry, m) || !entry.valid) {
+            target = &entry;
+            break;
+        }
+        if (entry.lastUse.load(std::memory_order_relaxed) <
+            target->lastUse.load(std::memory_order_relaxed)) {
+            target = &entry;
+        }
+    }
+
+    beginWrite(*target);
+    target->valid = true;
+    target->deviceID = m.metaData.deviceID;
+    target->deviceType = m.metaData.deviceType;
+    target->signalType = m.signalType;
+    memcpy(target->topic, topic, topicLength + 1);
+    endWrite(*target);
+    target->lastUse.store(
+        mUseCounter.fetch_add(1, std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    return true;
+}
+
+void TopicCache::clear() {
+    for (auto& entry : mEntries) {
+        beginWrite(entry);
+        entry.valid = false;
+        endWrite(entry);
+    }
+}
+
+void TopicCache::beginWrite(Entry& entry) {
+    entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TopicCache::endWrite(Entry& entry) {
+    entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+}
+
+bool TopicCache::matches(const Entry& entry, const core::Measurement& m) {
+    // Compared exactly, a topic is never shared by two measurement identities
+    return entry.valid && entry.deviceID == m.metaData.deviceID &&
+           entry.signalType == m.signalType &&
+           entry.deviceType == m.metaData.deviceType;
+}
+
+}  // namespace sensirion::upt::mqtt
@@ -0,0 +1,63 @@
+#ifndef UPT_MQTT_TOPIC_CACHE_H
+#define UPT_MQTT_TOPIC_CACHE_H
+
+#include "mqtt_cfg.h"
+#include <Sensirion_UPT_Core.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Bounded cache of fully prefixed topics, keyed by the identity of a
+ * Measurement (device type, device ID and signal type). The least recently
+ * used entry is evicted when the cache is full.
+ *
+ * Lookups are lock free: every entry is guarded by a sequence counter which
+ * is odd while the entry is written, a reader retries (or reports a miss)
+ * when the counter changed while it copied the entry.
+ *
+ * @note find() may run concurrently with anything, insert() and clear() have
+ *       to be serialized by the owner.
+ */
+class TopicCache {
+  public:
+    /**
+     * @brief Copies the cached topic of the measurement into topic
+     *
+     * @return false if the topic is not cached or does not fit in size bytes
+     */
+    bool find(const core::Measurement& m, char* topic, size_t size);
+
+    /**
+     * @brief Stores the topic of the measurement
+     *
+     * @return false if the topic is too long
+     */
+    bool insert(const core::Measurement& m, const char* topic);
+
+    void clear();
+
+  private:
+    struct Entry {
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<uint32_t> lastUse{0};
+        bool valid = false;
+        uint64_t deviceID = 0;
+        core::DeviceType deviceType{};
+        core::SignalType signalType{};
+        char topic[MQTT_TOPIC_MAX_LENGTH]{};
+    };
+
+    Entry mEntries[MQTT_TOPIC_CACHE_SIZE];
+    std::atomic<uint32_t> mUseCounter{0};
+
+    static void beginWrite(Entry& entry);
+    static void endWrite(Entry& entry);
+    static bool matches(const Entry& entry, const core::Measurement& m);
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_TOPIC_CACHE_H */
@@ -0,0 +1,185 @@
+#include "TopicFilterTrie.h"
+#include <algorithm>
+
+namespace sensirion::upt::mqtt {
+
+namespace {
+
+// Returns the end of the level starting at position
+size_t levelEnd(std::string_view topic, size_t position) {
+    const size_t end = topic.find('/', position);
+    return end == std::string_view::npos ? topic.size() : end;
+}
+
+}  // namespace
+
+TopicFilterTrie::TopicFilterTrie() {
+    clear();
+}
+
+bool TopicFilterTrie::isValidFilter(std::string_view filter) {
+    if (filter.empty()) {
+        return false;
+    }
+    for (size_t position = 0; position <= filter.size();) {
+        const size_t end = levelEnd(filter, position);
+        const std::string_view level = filter.substr(position, end - position);
+        const bool hasWildcard = level.find_first_of("+#") != level.npos;
+        if (hasWildcard && level != "+" && level != "#") {
+            return false;
+        }
+        if (level == "#" && end != filter.size()) {
+            return false;
+        }
+        position = end + 1;
+    }
+    return true;
+}
+
+bool TopicFilterTrie::insert(std::string_view filter, uint16_t id) {
+    if (!isValidFilter(filter)) {
+        return false;
+    }
+    uint16_t nodeIndex = 0;
+    for (size_t position = 0; position <= filter.size();) {
+        const size_t end = levelEnd(filter, position);
+        nodeIndex = addChild(nodeIndex, filter.substr(position, end - position));
+        position = end + 1;
+    }
+    std::vector<uint16_t>& ids = mNodes[nodeIndex].ids;
+    if (std::find(ids.begin(), ids.end(), id) == ids.end()) {
+        ids.push_back(id);
+    }
+    return true;
+}
+
+bool TopicFilterTrie::remove(std::string_view filter, uint16_t id) {
+    const int32_t nodeIndex = findNode(filter);
+    if (nodeIndex == kNone) {
+        return false;
+    }
+    std::vector<uint16_t>& ids = mNodes[nodeIndex].ids;
+    const auto it = std::find(ids.begin(), ids.end(), id);
+    if (it == ids.end()) {
+        return false;
+    }
+    ids.erase(it);
+    return true;
+}
+
+void TopicFilterTrie::clear() {
+    mNodes.clear();
+    mNodes.emplace_back();  // root
+}
+
+size_t TopicFilterTrie::match(std::string_view topic, uint16_t* ids,
+                              size_t maxIds) const {
+    Matches matches{ids, maxIds, 0};
+    if (!topic.empty()) {
+        matchFrom(0, topic, 0, matches);
+    }
+    return matches.count;
+}
+
+int32_t TopicFilterTrie::findChild(const Node& node,
+                                   std::string_view level) const {
+    if (level == "+") {
+        return node.plusChild;
+    }
+    if (level == "#") {
+        return node.hashChild;
+    }
+    return findExactChild(node, level);
+}
+
+int32_t TopicFilterTrie::findExactChild(const Node& node,
+                                        std::string_view level) const {
+    const auto it = std::lower_bound(
+        node.children.begin(), node.children.end(), level,
+        [this](uint16_t child, std::string_view value) {
+            return std::string_view{mNodes[child].level} < value;
+        });
+    if (it == node.children.end() || mNodes[*it].level != level) {
+        return kNone;
+    }
+    return *it;
+}
+
+int32_t TopicFilterTrie::findNode(std::string_view filter) const {
+    if (!isValidFilter(filter)) {
+        return kNone;
+    }
+    int32_t nodeIndex = 0;
+    for (size_t position = 0; position <= filter.size();) {
+        const size_t end = levelEnd(filter, position);
+        nodeIndex = findChild(mNodes[nodeIndex],
+                              filter.substr(position, end - position));
+        if (nodeIndex == kNone) {
+            return kNone;
+        }
+        position = end + 1;
+    }
+    return nodeIndex;
+}
+
+uint16_t TopicFilterTrie::addChild(uint16_t parent, std::string_view level) {
+    const int32_t existing = findChild(mNodes[parent], level);
+    if (existing != kNone) {
+        return static_cast<uint16_t>(existing);
+    }
+    const auto child = static_cast<uint16_t>(mNodes.size());
+    // May reallocate mNodes, parent is accessed by index afterwards
+    mNodes.emplace_back();
+    mNodes[child].level = std::string{level};
+    Node& node = mNodes[parent];
+    if (level == "+") {
+        node.plusChild = child;
+    } else if (level == "#") {
+        node.hashChild = child;
+    } else {
+        const auto it = std::lower_bound(
+            node.children.begin(), node.children.end(), level,
+            [this](uint16_t other, std::string_view value) {
+                return std::string_view{mNodes[other].level} < value;
+            });
+        node.children.insert(it, child);
+    }
+    return child;
+}
+
+void TopicFilterTrie::collect(const Node& node, Matches& matches) const {
+    for (const uint16_t id : node.ids) {
+        if (matches.count < matches.maxIds) {
+            matches.ids[matches.count] = id;
+        }
+        matches.count++;
+    }
+}
+
+void TopicFilterTrie::matchFrom(uint16_t nodeIndex, std::string_view topic,
+                                size_t position, Matches& matches) const {
+    const Node& node = mNodes[nodeIndex];
+    if (position > topic.size()) {
+        // All levels consumed, "a/#" matches "a" too
+        collect(node, matches);
+        if (node.hashChild != kNone) {
+            collect(mNodes[node.hashChild], matches);
+        }
+        return;
+    }
+    const bool wildcardsMatch = position > 0 || topic[0] != '$';
+    if (wildcardsMatch && node.hashChild != kNone) {
+        collect(mNodes[node.hashChild], matches);
+    }
+    const size_t end = levelEnd(topic, position);
+    if (wildcardsMatch && node.plusChild != kNone) {
+        matchFrom(node.plusChild, topic, end + 1, matches);
+    }
+    const int32_t child =
+        findExactChild(node, topic.substr(position, end - position));
+    if (child != kNone) {
+        matchFrom(child, topic, end + 1, matches);
+    }
+}
+
+}  // namespace sensirion::upt::mqtt
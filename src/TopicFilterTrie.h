@@ -0,0 +1,97 @@
+#ifndef UPT_MQTT_TOPIC_FILTER_TRIE_H
+#define UPT_MQTT_TOPIC_FILTER_TRIE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sensirion::upt::mqtt {
+
+/**
+ * Topic filters (with the MQTT wildcards '+' and '#') stored as a trie of
+ * topic levels, each filter identified by a number.
+ *
+ * Matching a topic walks the levels of the topic once, following the exact
+ * level, the '+' and the '#' branches of each node: its cost depends on the
+ * depth of the topic, not on the number of filters. The children of a node
+ * are kept sorted, an exact level is found by binary search. Matching does
+ * not allocate memory.
+ *
+ * As specified by MQTT, topics starting with '$' are not matched by filters
+ * starting with a wildcard, and "a/#" also matches "a".
+ *
+ * @note Not thread safe, the owner serializes the calls.
+ */
+class TopicFilterTrie {
+  public:
+    TopicFilterTrie();
+
+    /**
+     * @brief returns true if filter is a valid topic filter: not empty,
+     *        '+' and '#' occupy whole levels and '#' is the last one
+     */
+    static bool isValidFilter(std::string_view filter);
+
+    /**
+     * @brief Adds a filter with its identifier
+     *
+     * @return false if the filter is not valid
+     */
+    bool insert(std::string_view filter, uint16_t id);
+
+    /**
+     * @brief Removes the identifier from a filter
+     *
+     * @note The nodes are kept, to be reused if the filter is subscribed
+     *       again.
+     *
+     * @return false if the filter did not hold this identifier
+     */
+    bool remove(std::string_view filter, uint16_t id);
+
+    void clear();
+
+    /**
+     * @brief Finds the filters matching a topic
+     *
+     * @param ids: receives the identifiers of the matching filters, up to
+     *        maxIds of them
+     *
+     * @return the number of matching filters, may be larger than maxIds
+     */
+    size_t match(std::string_view topic, uint16_t* ids, size_t maxIds) const;
+
+  private:
+    static constexpr int32_t kNone = -1;
+
+    struct Node {
+        std::string level;
+        // Exact children, sorted by level
+        std::vector<uint16_t> children;
+        int32_t plusChild = kNone;
+        int32_t hashChild = kNone;
+        std::vector<uint16_t> ids;
+    };
+
+    struct Matches {
+        uint16_t* ids;
+        size_t maxIds;
+        size_t count;
+    };
+
+    std::vector<Node> mNodes;
+
+    int32_t findChild(const Node& node, std::string_view level) const;
+    int32_t findExactChild(const Node& node, std::string_view level) const;
+    int32_t findNode(std::string_view filter) const;
+    uint16_t addChild(uint16_t parent, std::string_view level);
+    void collect(const Node& node, Matches& matches) const;
+    void matchFrom(uint16_t nodeIndex, std::string_view topic, size_t position,
+                   Matches& matches) const;
+};
+
+}  // namespace sensirion::upt::mqtt
+
+#endif /* UPT_MQTT_TOPIC_FILTER_TRIE_H */
@@ -31,4 +31,258 @@
 #define WIFI_PW_OVERRIDE "ConnectToTheAP,IWill"
 #endif
 
+/**
+ * Size in bytes (terminating NUL included) of the buffers used to format
+ * messages and topics.
+ */
+#ifndef MQTT_MESSAGE_MAX_LENGTH
+#define MQTT_MESSAGE_MAX_LENGTH 256
+#endif
+
+#ifndef MQTT_TOPIC_MAX_LENGTH
+#define MQTT_TOPIC_MAX_LENGTH 128
+#endif
+
+/**
+ * Number of decimals used by the provided formatters to print measured values
+ * (max 9). Values below half of the last decimal are printed as 0, e.g.
+ * 0.0012 as "0.00" with the default.
+ */
+#ifndef MQTT_FORMATTER_VALUE_DECIMALS
+#define MQTT_FORMATTER_VALUE_DECIMALS 2
+#endif
+
+/**
+ * Maximum number of instructions (literal texts and fields) of a
+ * MeasurementTemplate.
+ */
+#ifndef MQTT_TEMPLATE_MAX_INSTRUCTIONS
+#define MQTT_TEMPLATE_MAX_INSTRUCTIONS 24
+#endif
+
+/**
+ * Mailbox configuration. The mailbox buffers the messages until the sender
+ * task forwards them to the ESP MQTT client. The depth can also be set at
+ * runtime using `setMailboxDepth`.
+ */
+#ifndef MQTT_MAILBOX_DEPTH
+#define MQTT_MAILBOX_DEPTH 16
+#endif
+
+/**
+ * The messages are held in a pool of fixed size blocks: one per mailbox slot
+ * plus MQTT_MESSAGE_POOL_EXTRA_BLOCKS for the messages being filled by the
+ * producers and the one being published.
+ */
+#ifndef MQTT_MESSAGE_POOL_EXTRA_BLOCKS
+#define MQTT_MESSAGE_POOL_EXTRA_BLOCKS 4
+#endif
+
+/**
+ * Stack of the sender task, in bytes. The messages it handles are not on its
+ * stack; the budget is about 1 KB for its frames, the topic buffers and the
+ * metrics formatted for the telemetry, 2.5 KB for esp_mqtt_client_publish
+ * writing through TLS, 1 KB for the logs and the remaining 1.5 KB for the
+ * delivery callback of the application, called from this task.
+ */
+#ifndef MQTT_SENDER_TASK_STACK_SIZE
+#define MQTT_SENDER_TASK_STACK_SIZE 6144
+#endif
+
+#ifndef MQTT_SENDER_TASK_PRIORITY
+#define MQTT_SENDER_TASK_PRIORITY (tskIDLE_PRIORITY + 2)
+#endif
+
+/**
+ * Time the destructor waits for the sender task to finish its current
+ * message before deleting it.
+ */
+#ifndef MQTT_SENDER_STOP_TIMEOUT_MS
+#define MQTT_SENDER_STOP_TIMEOUT_MS 2000
+#endif
+
+/**
+ * Interval at which the sender task checks the connection while it holds a
+ * message and the client is not connected.
+ */
+#ifndef MQTT_SENDER_RETRY_INTERVAL_MS
+#define MQTT_SENDER_RETRY_INTERVAL_MS 500
+#endif
+
+/**
+ * Reconnection of the Wi-Fi (when managed by the service) and of the MQTT
+ * client: the delay before an attempt doubles after every failure, from the
+ * minimum up to the maximum, and is randomized by up to one half.
+ */
+#ifndef MQTT_RECONNECT_MIN_DELAY_MS
+#define MQTT_RECONNECT_MIN_DELAY_MS 500
+#endif
+
+#ifndef MQTT_RECONNECT_MAX_DELAY_MS
+#define MQTT_RECONNECT_MAX_DELAY_MS 60000
+#endif
+
+/**
+ * Time the connection task waits for the DNS answer when resolving the
+ * broker address (see setBrokerAddressTtl), the client resolves the host
+ * name itself if none came. Below MQTT_SENDER_STOP_TIMEOUT_MS, which the
+ * destructor waits for the connection task.
+ */
+#ifndef MQTT_DNS_TIMEOUT_MS
+#define MQTT_DNS_TIMEOUT_MS 1500
+#endif
+
+#ifndef MQTT_CONNECTION_TASK_STACK_SIZE
+#define MQTT_CONNECTION_TASK_STACK_SIZE 3072
+#endif
+
+/**
+ * Subscriptions: maximum number of subscribed topic filters and number of
+ * received messages waiting for the receiver task, which runs the callbacks.
+ * Received messages are bounded by MQTT_TOPIC_MAX_LENGTH and
+ * MQTT_MESSAGE_MAX_LENGTH, larger ones are dropped.
+ */
+#ifndef MQTT_MAX_SUBSCRIPTIONS
+#define MQTT_MAX_SUBSCRIPTIONS 8
+#endif
+
+#ifndef MQTT_RECEIVE_QUEUE_DEPTH
+#define MQTT_RECEIVE_QUEUE_DEPTH 4
+#endif
+
+#ifndef MQTT_RECEIVER_TASK_STACK_SIZE
+#define MQTT_RECEIVER_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef MQTT_RECEIVER_TASK_PRIORITY
+#define MQTT_RECEIVER_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
+/**
+ * Number of batches that can be collected or wait for the sender task in
+ * parallel, one per topic, and interval at which the sender task checks the
+ * age of open batches.
+ */
+#ifndef MQTT_BATCH_SLOTS
+#define MQTT_BATCH_SLOTS 4
+#endif
+
+/**
+ * Maximum size of a batch payload, NUL included. Batches are not limited to
+ * MQTT_MESSAGE_MAX_LENGTH: each of the MQTT_BATCH_SLOTS slots holds a buffer
+ * of this size and is published from there by the sender task.
+ */
+#ifndef MQTT_BATCH_MAX_LENGTH
+#define MQTT_BATCH_MAX_LENGTH 1024
+#endif
+
+#ifndef MQTT_BATCH_AGE_CHECK_INTERVAL_MS
+#define MQTT_BATCH_AGE_CHECK_INTERVAL_MS 100
+#endif
+
+/**
+ * Payloads shorter than this are not compressed, even when compression is
+ * enabled (see `setCompression`).
+ */
+#ifndef MQTT_COMPRESSION_MIN_PAYLOAD_SIZE
+#define MQTT_COMPRESSION_MIN_PAYLOAD_SIZE 96
+#endif
+
+/**
+ * Largest payload that can be compressed, a message or a batch. Sizes the
+ * buffers of the encoder and of the compressed payload.
+ */
+#define MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH                                    \
+    (MQTT_BATCH_MAX_LENGTH > MQTT_MESSAGE_MAX_LENGTH ? MQTT_BATCH_MAX_LENGTH   \
+                                                     : MQTT_MESSAGE_MAX_LENGTH)
+
+/**
+ * Offline message store: capacity of the RAM store used when the configured
+ * store is not available, and default rate at which stored messages are
+ * replayed once connected.
+ */
+#ifndef MQTT_OFFLINE_RAM_STORE_CAPACITY
+#define MQTT_OFFLINE_RAM_STORE_CAPACITY 32
+#endif
+
+#ifndef MQTT_REPLAY_RATE_PER_SECOND
+#define MQTT_REPLAY_RATE_PER_SECOND 10
+#endif
+
+/**
+ * Interval at which the sender task writes the changes of the message store
+ * to the storage medium (MessageStore::sync). On power loss, the messages
+ * stored within the last interval are lost and the ones replayed within it
+ * are replayed again.
+ */
+#ifndef MQTT_STORE_SYNC_INTERVAL_MS
+#define MQTT_STORE_SYNC_INTERVAL_MS 1000
+#endif
+
+/**
+ * Number of topics computed by the topic suffix function that are cached,
+ * typically one per signal of each connected sensor.
+ */
+#ifndef MQTT_TOPIC_CACHE_SIZE
+#define MQTT_TOPIC_CACHE_SIZE 16
+#endif
+
+/**
+ * QoS 1/2 messages in flight: number of messages tracked until they are
+ * acknowledged, which bounds the window set with `setInFlightWindow`, and
+ * time after which a message that is not acknowledged is reported as timed
+ * out and no longer counts in the window.
+ */
+#ifndef MQTT_INFLIGHT_MAX_MESSAGES
+#define MQTT_INFLIGHT_MAX_MESSAGES 16
+#endif
+
+#ifndef MQTT_INFLIGHT_TIMEOUT_MS
+#define MQTT_INFLIGHT_TIMEOUT_MS 30000
+#endif
+
+/**
+ * Capacity of the BULK and URGENT lanes of the mailbox, the NORMAL lane is
+ * the mailbox itself (see `setMailboxDepth` and `setPriorityClass`).
+ */
+#ifndef MQTT_PRIORITY_LANE_DEPTH
+#define MQTT_PRIORITY_LANE_DEPTH 8
+#endif
+
+/**
+ * Number of topics that get an alias per connection when topic aliases are
+ * enabled (see `setTopicAliases`), further topics are published in full.
+ */
+#ifndef MQTT_TOPIC_ALIAS_MAX
+#define MQTT_TOPIC_ALIAS_MAX 8
+#endif
+
+/**
+ * Number of topics whose latest message can be pending at the same time when
+ * conflation is enabled (see `setConflation`), further topics go through the
+ * mailbox.
+ */
+#ifndef MQTT_CONFLATION_SLOTS
+#define MQTT_CONFLATION_SLOTS MQTT_TOPIC_CACHE_SIZE
+#endif
+
+/**
+ * Measurement filter: number of signal types with a specific configuration
+ * and number of (device ID, signal type) pairs whose state is tracked.
+ */
+#ifndef MQTT_FILTER_SIGNAL_CONFIGS
+#define MQTT_FILTER_SIGNAL_CONFIGS 8
+#endif
+
+#ifndef MQTT_FILTER_STATE_SLOTS
+#define MQTT_FILTER_STATE_SLOTS 16
+#endif
+
+/**
+ * Maximum number of topic prefix routes of an MqttRouter.
+ */
+#ifndef MQTT_ROUTER_MAX_ROUTES
+#define MQTT_ROUTER_MAX_ROUTES 8
+#endif
+
 #endif /* MQTT_CONFIG_H_ */
@@ -0,0 +1,156 @@
+#include "HostResolver.h"
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace sensirion::upt::mqtt;
+
+TEST_GROUP(HostResolver) {
+    void setup() override {
+        WiFi.mockReset();
+    }
+
+    void teardown() override {
+        WiFi.mockReset();
+    }
+};
+
+TEST(HostResolver, resolvesKnownHosts) {
+    WiFi.mockAddHost("broker.local", IPAddress(10, 0, 0, 5));
+    char address[16];
+    CHECK(resolveHostName("broker.local", 1000, address, sizeof(address)));
+    STRCMP_EQUAL("10.0.0.5", std::string{address});
+    CHECK_FALSE(resolveHostName("unknown.local", 1000, address,
+                                sizeof(address)));
+}
+
+TEST(HostResolver, givesUpAfterTheTimeout) {
+    WiFi.mockAddHost("broker.local", IPAddress(10, 0, 0, 5));
+    WiFi.mockSetResolveDelayMs(300);
+    char address[16];
+    const uint64_t start = mock::nowUs();
+    CHECK_FALSE(resolveHostName("broker.local", 50, address, sizeof(address)));
+    CHECK(mock::nowUs() - start < 250000);
+    // The late answer finds the lookup abandoned
+    mock::sleepMs(350);
+    WiFi.mockSetResolveDelayMs(0);
+    CHECK(resolveHostName("broker.local", 1000, address, sizeof(address)));
+}
+
+TEST_GROUP(BrokerAddress) {
+    std::unique_ptr<mock::MockBroker> broker;
+    std::unique_ptr<MqttMailingService> service;
+    std::mutex mutex;
+    std::vector<bool> connections;
+    size_t useAfterDelete = 0;
+
+    void setup() override {
+        WiFi.mockReset();
+        useAfterDelete = mock::useAfterDeleteCount();
+        WiFi.mockAddHost("broker.local", IPAddress(10, 0, 0, 5));
+        broker.reset(new mock::MockBroker{"broker.local", "10.0.0.5"});
+        service.reset(new MqttMailingService);
+        service->setConnectionCallback([this](bool connected) {
+            std::lock_guard<std::mutex> lock{mutex};
+            connections.push_back(connected);
+        });
+    }
+
+    void teardown() override {
+        service.reset();
+        broker.reset();
+        WiFi.mockReset();
+        LONGS_EQUAL(useAfterDelete, mock::useAfterDeleteCount());
+    }
+
+    void start(const char* uri, uint32_t ttlMs) {
+        service->setBrokerURI(uri);
+        service->setBrokerAddressTtl(ttlMs);
+        service->startWithDelegatedWiFi("ssid", "pass");
+    }
+
+    // Drops the connection and waits for the reconnection
+    void reconnect() {
+        const size_t connects = broker->connectCount();
+        broker->disconnectAll();
+        CHECK(mock::waitUntil(
+            [this, connects]() {
+                return broker->connectCount() == connects + 1 &&
+                       service->isReady();
+            },
+            2000));
+    }
+
+    std::vector<bool> connectionEvents() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return connections;
+    }
+};
+
+TEST(BrokerAddress, isResolvedOnceWithinTheTtl) {
+    start("mqtt://broker.local:1883", 60000);
+    CHECK(service->waitUntilConnected(2000));
+    reconnect();
+    reconnect();
+    reconnect();
+    LONGS_EQUAL(1, WiFi.mockResolveCount());
+    CHECK((connectionEvents() ==
+           std::vector<bool>{true, false, true, false, true, false, true}));
+}
+
+TEST(BrokerAddress, isResolvedAgainOnceExpired) {
+    start("mqtt://broker.local:1883", 1);
+    CHECK(service->waitUntilConnected(2000));
+    mock::sleepMs(5);
+    reconnect();
+    mock::sleepMs(5);
+    reconnect();
+    LONGS_EQUAL(3, WiFi.mockResolveCount());
+}
+
+TEST(BrokerAddress, slowDnsFallsBackToTheHostName) {
+    start("mqtt://broker.local:1883", 1);
+    CHECK(service->waitUntilConnected(2000));
+    mock::sleepMs(5);
+    WiFi.mockSetResolveDelayMs(MQTT_DNS_TIMEOUT_MS * 5);
+    const size_t resolved = WiFi.mockResolveCount();
+    const uint64_t start = mock::nowUs();
+    reconnect();
+    // Reconnected by the client resolving the name, not after the answer
+    CHECK(mock::nowUs() - start < MQTT_DNS_TIMEOUT_MS * 3 * 1000ULL);
+    LONGS_EQUAL(resolved + 1, WiFi.mockResolveCount());
+    CHECK((connectionEvents() == std::vector<bool>{true, false, true}));
+    // Destroyed while the abandoned lookup is still pending
+    service.reset();
+    mock::sleepMs(MQTT_DNS_TIMEOUT_MS * 5);
+}
+
+TEST(BrokerAddress, unknownHostFallsBackToTheHostName) {
+    mock::MockBroker unresolved{"unresolved.local"};
+    start("mqtt://unresolved.local:1883", 60000);
+    CHECK(service->waitUntilConnected(2000));
+    const size_t connects = unresolved.connectCount();
+    unresolved.disconnectAll();
+    CHECK(mock::waitUntil(
+        [this, &unresolved, connects]() {
+            return unresolved.connectCount() == connects + 1 &&
+                   service->isReady();
+        },
+        2000));
+    // Not cached, resolved again at every attempt
+    LONGS_EQUAL(2, WiFi.mockResolveCount());
+    // Before its broker
+    service.reset();
+}
+
+TEST(BrokerAddress, tlsKeepsTheHostName) {
+    start("mqtts://broker.local:8883", 60000);
+    CHECK(service->waitUntilConnected(2000));
+    reconnect();
+    LONGS_EQUAL(0, WiFi.mockResolveCount());
+}
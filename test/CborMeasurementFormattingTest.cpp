@@ -0,0 +1,166 @@
+#include "CborMeasurementFormatting.hpp"
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+core::Measurement measurementOf(uint32_t timeOffsetMs, float value,
+                                uint64_t deviceID, core::DeviceType type,
+                                core::SignalType signal) {
+    core::Measurement measurement;
+    measurement.dataPoint.t_offset = timeOffsetMs;
+    measurement.dataPoint.value = value;
+    measurement.metaData = core::MetaData{type};
+    measurement.metaData.deviceID = deviceID;
+    measurement.signalType = signal;
+    return measurement;
+}
+
+}  // namespace
+
+TEST_GROUP(CborMeasurementFormatting) {
+    uint8_t buffer[64];
+    CborMeasurementDecoder decoder;
+
+    DecodedCborMeasurement roundTrip(const core::Measurement& measurement) {
+        const size_t length =
+            CborMeasurementFormatter{}(measurement, buffer, sizeof(buffer));
+        CHECK(length < sizeof(buffer));
+        DecodedCborMeasurement decoded;
+        CHECK(decoder.decode(buffer, length, decoded));
+        return decoded;
+    }
+};
+
+TEST(CborMeasurementFormatting, roundTripsAllFields) {
+    const auto decoded = roundTrip(measurementOf(
+        5000, 412.5f, 0x1122334455667788ull, core::SCD4X(),
+        core::SignalType::CO2_PARTS_PER_MILLION));
+    LONGS_EQUAL(5000, decoded.timeOffsetMs);
+    DOUBLES_EQUAL(412.5, decoded.value, 0.0);
+    CHECK(decoded.deviceID == 0x1122334455667788ull);
+    STRCMP_EQUAL("SCD4X", std::string{decoded.deviceLabel});
+    CHECK(decoded.signalType == core::SignalType::CO2_PARTS_PER_MILLION);
+}
+
+TEST(CborMeasurementFormatting, roundTripsEveryIntegerWidth) {
+    // Each limit switches the argument to the next head size
+    const uint64_t limits[] = {0,     23,         24,
+                               255,   256,        65535,
+                               65536, UINT32_MAX, uint64_t{UINT32_MAX} + 1,
+                               UINT64_MAX};
+    for (const uint64_t deviceID : limits) {
+        const uint32_t timeOffset = static_cast<uint32_t>(
+            deviceID > UINT32_MAX ? UINT32_MAX : deviceID);
+        const auto decoded = roundTrip(
+            measurementOf(timeOffset, 1.0f, deviceID, core::SHT4X(),
+                          core::SignalType::TEMPERATURE_DEGREES_CELSIUS));
+        CHECK(decoded.deviceID == deviceID);
+        CHECK(decoded.timeOffsetMs == timeOffset);
+    }
+}
+
+TEST(CborMeasurementFormatting, roundTripsFloatValuesBitExact) {
+    const float values[] = {0.0f,
+                            -0.0f,
+                            -40.25f,
+                            1e-7f,
+                            3.4028235e38f,
+                            std::numeric_limits<float>::denorm_min(),
+                            std::numeric_limits<float>::infinity()};
+    for (const float value : values) {
+        const auto decoded = roundTrip(
+            measurementOf(0, value, 1, core::SEN5X(),
+                          core::SignalType::PM2P5_MICRO_GRAMM_PER_CUBIC_METER));
+        CHECK(std::memcmp(&value, &decoded.value, sizeof(value)) == 0);
+    }
+    const auto decoded =
+        roundTrip(measurementOf(0, std::nanf(""), 1, core::SEN5X(),
+                                core::SignalType::VOC_INDEX));
+    CHECK(std::isnan(decoded.value));
+}
+
+TEST(CborMeasurementFormatting, reportsOverflow) {
+    const auto measurement =
+        measurementOf(5000, 412.5f, 42, core::SCD4X(),
+                      core::SignalType::CO2_PARTS_PER_MILLION);
+    const size_t length =
+        CborMeasurementFormatter{}(measurement, buffer, sizeof(buffer));
+    for (size_t size = 0; size < length; ++size) {
+        CHECK(CborMeasurementFormatter{}(measurement, buffer, size) >= size);
+    }
+}
+
+TEST(CborMeasurementFormatting, rejectsTruncatedPayloads) {
+    const auto measurement =
+        measurementOf(5000, 412.5f, 42, core::SCD4X(),
+                      core::SignalType::CO2_PARTS_PER_MILLION);
+    const size_t length =
+        CborMeasurementFormatter{}(measurement, buffer, sizeof(buffer));
+    DecodedCborMeasurement decoded;
+    for (size_t size = 0; size < length; ++size) {
+        CHECK_FALSE(decoder.decode(buffer, size, decoded));
+    }
+    // Trailing bytes are not part of a measurement either
+    buffer[length] = 0;
+    CHECK_FALSE(decoder.decode(buffer, length + 1, decoded));
+}
+
+TEST(CborMeasurementFormatting, skipsUnknownKeysAndReadsDoubles) {
+    uint8_t payload[64];
+    CborWriter writer{payload, sizeof(payload)};
+    writer.writeMapHeader(3);
+    writer.writeUnsigned(99).writeText("future");
+    writer.writeUnsigned(100).writeUnsigned(70000);
+    writer.writeUnsigned(CBOR_KEY_SIGNAL_TYPE)
+        .writeUnsigned(static_cast<uint64_t>(core::SignalType::NOX_INDEX));
+    CHECK_FALSE(writer.overflowed());
+    // A float64 value, as written by other encoders: {1: 1.5}
+    const uint8_t doubleValue[] = {0xA1, 0x01, 0xFB, 0x3F, 0xF8, 0, 0,
+                                   0,    0,    0,    0};
+
+    DecodedCborMeasurement decoded;
+    CHECK(decoder.decode(payload, writer.length(), decoded));
+    CHECK(decoded.signalType == core::SignalType::NOX_INDEX);
+    CHECK(decoder.decode(doubleValue, sizeof(doubleValue), decoded));
+    DOUBLES_EQUAL(1.5, decoded.value, 0.0);
+}
+
+TEST(CborMeasurementFormatting, roundTripsThroughTheBroker) {
+    WiFi.mockReset();
+    mock::MockBroker broker{"broker.local"};
+    {
+        MqttMailingService service;
+        service.setBrokerURI("mqtt://broker.local:1883");
+        service.setMeasurementBinaryFormatterFn(CborMeasurementFormatter{});
+        service.setMeasurementToTopicSuffixFn(
+            DefaultMeasurementToTopicSuffix{});
+        service.startWithDelegatedWiFi("ssid", "pass");
+        CHECK(service.waitUntilConnected(2000));
+        const auto measurement =
+            measurementOf(1234, 21.5f, 7, core::SHT4X(),
+                          core::SignalType::TEMPERATURE_DEGREES_CELSIUS);
+        CHECK(service.sendMeasurement(measurement));
+        CHECK(mock::waitUntil(
+            [&broker]() { return broker.messageCount() == 1; }, 2000));
+    }
+    const std::string payload = broker.messages()[0].payload;
+    DecodedCborMeasurement decoded;
+    CHECK(decoder.decode(reinterpret_cast<const uint8_t*>(payload.data()),
+                         payload.size(), decoded));
+    LONGS_EQUAL(1234, decoded.timeOffsetMs);
+    DOUBLES_EQUAL(21.5, decoded.value, 0.0);
+    LONGS_EQUAL(7, decoded.deviceID);
+    STRCMP_EQUAL("SHT4X", std::string{decoded.deviceLabel});
+    WiFi.mockReset();
+}
@@ -0,0 +1,85 @@
+#include "ConflationTable.h"
+#include "UnitTest.h"
+#include <cstring>
+#include <string>
+
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+MailboxMessage message(const char* topic, const char* payload,
+                       uint32_t deliveryToken = 0) {
+    MailboxMessage msg{};
+    strcpy(msg.topic, topic);
+    strcpy(msg.payload, payload);
+    msg.payloadLength = strlen(payload);
+    msg.deliveryToken = deliveryToken;
+    return msg;
+}
+
+}  // namespace
+
+TEST_GROUP(ConflationTable) {
+    ConflationTable table;
+    MailboxMessage taken{};
+    bool replaced = false;
+    uint32_t replacedToken = 0;
+
+    void setup() override {
+        CHECK(table.begin(2));
+    }
+};
+
+TEST(ConflationTable, keepsTheLatestMessageOfATopic) {
+    CHECK(table.put(message("a", "1", 1), replaced, replacedToken));
+    CHECK_FALSE(replaced);
+    LONGS_EQUAL(0, replacedToken);
+    CHECK(table.put(message("a", "2", 2), replaced, replacedToken));
+    CHECK(replaced);
+    // Reported as dropped by the owner
+    LONGS_EQUAL(1, replacedToken);
+    LONGS_EQUAL(1, table.pending());
+
+    CHECK(table.take(taken));
+    STRCMP_EQUAL(std::string{"2"}, taken.payload);
+    LONGS_EQUAL(2, taken.deliveryToken);
+    CHECK_FALSE(table.take(taken));
+}
+
+TEST(ConflationTable, takesTheOldestMessageFirst) {
+    CHECK(table.put(message("a", "1"), replaced, replacedToken));
+    CHECK(table.put(message("b", "2"), replaced, replacedToken));
+    // The replacing message is the newest
+    CHECK(table.put(message("a", "3"), replaced, replacedToken));
+    CHECK(table.take(taken));
+    STRCMP_EQUAL(std::string{"b"}, taken.topic);
+    CHECK(table.take(taken));
+    STRCMP_EQUAL(std::string{"a"}, taken.topic);
+    STRCMP_EQUAL(std::string{"3"}, taken.payload);
+    LONGS_EQUAL(0, table.pending());
+}
+
+TEST(ConflationTable, isFullWhenEverySlotIsPending) {
+    CHECK(table.put(message("a", "1"), replaced, replacedToken));
+    CHECK(table.put(message("b", "2"), replaced, replacedToken));
+    CHECK_FALSE(table.put(message("c", "3"), replaced, replacedToken));
+    // A slot whose message was taken goes to a new topic
+    CHECK(table.take(taken));
+    CHECK(table.put(message("c", "3", 3), replaced, replacedToken));
+    CHECK_FALSE(replaced);
+    LONGS_EQUAL(0, replacedToken);
+    LONGS_EQUAL(2, table.pending());
+}
+
+TEST(ConflationTable, restoreDoesNotReplaceANewerMessage) {
+    CHECK(table.put(message("a", "1", 1), replaced, replacedToken));
+    CHECK(table.take(taken));
+    CHECK(table.put(message("a", "2", 2), replaced, replacedToken));
+    table.restore(taken);
+    CHECK(table.take(taken));
+    STRCMP_EQUAL(std::string{"2"}, taken.payload);
+
+    // Put back if nothing newer is pending
+    table.restore(taken);
+    LONGS_EQUAL(1, table.pending());
+}
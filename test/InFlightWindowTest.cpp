@@ -0,0 +1,83 @@
+#include "InFlightWindow.h"
+#include "UnitTest.h"
+
+using namespace sensirion::upt::mqtt;
+
+TEST_GROUP(InFlightWindow) {
+    InFlightWindow window;
+    InFlightWindow::Completion completion{};
+    uint32_t latencyUs = 0;
+    uint32_t token = 0;
+};
+
+TEST(InFlightWindow, holdsUpToTheMaximum) {
+    for (int i = 0; i < MQTT_INFLIGHT_MAX_MESSAGES; ++i) {
+        CHECK(window.add(i + 1, 0, 0));
+    }
+    CHECK_FALSE(window.add(100, 0, 0));
+    LONGS_EQUAL(MQTT_INFLIGHT_MAX_MESSAGES, window.occupied());
+    CHECK(window.acknowledge(3, 10, latencyUs, token));
+    CHECK(window.add(100, 0, 10));
+}
+
+TEST(InFlightWindow, acknowledgementWithoutTokenFreesTheSlot) {
+    CHECK(window.add(7, 0, 1000));
+    CHECK(window.acknowledge(7, 1250, latencyUs, token));
+    LONGS_EQUAL(250, latencyUs);
+    LONGS_EQUAL(0, window.occupied());
+    CHECK_FALSE(window.takeCompleted(2000, 100, completion));
+}
+
+TEST(InFlightWindow, acknowledgementWithTokenIsReportedOnce) {
+    CHECK(window.add(7, 42, 1000));
+    CHECK(window.acknowledge(7, 1100, latencyUs, token));
+    LONGS_EQUAL(42, token);
+    LONGS_EQUAL(1, window.occupied());
+    CHECK(window.takeCompleted(1100, 1000000, completion));
+    LONGS_EQUAL(42, completion.token);
+    CHECK(completion.status == DeliveryStatus::DELIVERED);
+    LONGS_EQUAL(0, window.occupied());
+    CHECK_FALSE(window.takeCompleted(1100, 1000000, completion));
+}
+
+TEST(InFlightWindow, unknownOrRepeatedAcknowledgementIsIgnored) {
+    CHECK(window.add(7, 0, 0));
+    CHECK_FALSE(window.acknowledge(8, 10, latencyUs, token));
+    CHECK(window.acknowledge(7, 10, latencyUs, token));
+    CHECK_FALSE(window.acknowledge(7, 20, latencyUs, token));
+}
+
+TEST(InFlightWindow, timesOutUnacknowledgedMessages) {
+    CHECK(window.add(7, 42, 0));
+    CHECK_FALSE(window.takeCompleted(1000, 1000, completion));
+    CHECK(window.takeCompleted(1001, 1000, completion));
+    LONGS_EQUAL(42, completion.token);
+    CHECK(completion.status == DeliveryStatus::TIMED_OUT);
+    // A late acknowledgement finds no slot
+    CHECK_FALSE(window.acknowledge(7, 2000, latencyUs, token));
+}
+
+TEST(InFlightWindow, acknowledgementBeforeAddIsApplied) {
+    // Acknowledged while esp_mqtt_client_publish was returning
+    CHECK_FALSE(window.acknowledge(7, 1000, latencyUs, token));
+    CHECK(window.add(7, 0, 1010));
+    LONGS_EQUAL(0, window.occupied());
+
+    CHECK_FALSE(window.acknowledge(8, 2000, latencyUs, token));
+    CHECK(window.add(8, 42, 2010));
+    CHECK(window.takeCompleted(2010, 1000000, completion));
+    LONGS_EQUAL(42, completion.token);
+    CHECK(completion.status == DeliveryStatus::DELIVERED);
+    LONGS_EQUAL(0, window.occupied());
+    // Applied once only
+    CHECK(window.add(8, 0, 2020));
+    LONGS_EQUAL(1, window.occupied());
+}
+
+TEST(InFlightWindow, staleAcknowledgementBeforeAddIsIgnored) {
+    // e.g. the late acknowledgement of a timed out message, whose id is
+    // reused much later
+    CHECK_FALSE(window.acknowledge(7, 0, latencyUs, token));
+    CHECK(window.add(7, 0, 1000000));
+    LONGS_EQUAL(1, window.occupied());
+}
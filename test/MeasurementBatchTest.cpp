@@ -0,0 +1,140 @@
+#include "MeasurementBatch.h"
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+core::Measurement co2(float value) {
+    core::Measurement measurement;
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.dataPoint.value = value;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    return measurement;
+}
+
+}  // namespace
+
+TEST_GROUP(MeasurementBatch){};
+
+TEST(MeasurementBatch, holdsPayloadsLargerThanAMessage) {
+    MeasurementBatch batch;
+    CHECK(batch.isFree());
+    CHECK(batch.open("node/co2", co2(400.0f), BatchMode::PER_TOPIC, 0));
+    size_t count = 0;
+    while (batch.append(co2(400.0f + count), MQTT_BATCH_MAX_LENGTH - 1)) {
+        count++;
+    }
+    batch.close(7, 1000);
+    CHECK(batch.isReady());
+    CHECK(batch.length() > MQTT_MESSAGE_MAX_LENGTH);
+    CHECK(batch.length() < MQTT_BATCH_MAX_LENGTH);
+    LONGS_EQUAL(count, batch.count());
+    LONGS_EQUAL(7, batch.sequence());
+    LONGS_EQUAL(1000, batch.closedAtUs());
+    // A ready batch collects nothing until released
+    CHECK_FALSE(batch.accepts("node/co2", co2(400.0f)));
+    batch.release();
+    CHECK(batch.isFree());
+}
+
+TEST_GROUP(MeasurementBatching) {
+    std::unique_ptr<mock::MockBroker> broker;
+    std::unique_ptr<MqttMailingService> service;
+
+    void setup() override {
+        WiFi.mockReset();
+        broker.reset(new mock::MockBroker{"broker.local"});
+        service.reset(new MqttMailingService);
+        service->setBrokerURI("mqtt://broker.local:1883");
+        service->setGlobalTopicPrefix("node/");
+        service->setMeasurementMessageFormatterFn(
+            DefaultMeasurementFormatter{});
+        service->setMeasurementToTopicSuffixFn(
+            DefaultMeasurementToTopicSuffix{});
+    }
+
+    void teardown() override {
+        service.reset();
+        broker.reset();
+        WiFi.mockReset();
+    }
+
+    void setBatching(BatchMode mode, size_t maxCount) {
+        BatchConfig config;
+        config.mode = mode;
+        config.maxCount = maxCount;
+        config.maxBytes = MQTT_BATCH_MAX_LENGTH - 1;
+        config.maxAgeMs = 60000;
+        service->setBatching(config);
+    }
+};
+
+TEST(MeasurementBatching, publishesBatchesLargerThanAMessage) {
+    setBatching(BatchMode::PER_TOPIC, 20);
+    service->startWithDelegatedWiFi("ssid", "pass");
+    CHECK(service->waitUntilConnected(2000));
+    for (int i = 0; i < 20; ++i) {
+        CHECK(service->sendMeasurement(co2(400.0f + i)));
+    }
+    CHECK(mock::waitUntil([this]() { return broker->messageCount() == 1; },
+                          2000));
+    const std::string payload = broker->messages()[0].payload;
+    CHECK(payload.size() > MQTT_MESSAGE_MAX_LENGTH);
+    CHECK(payload.find("400") != std::string::npos);
+    CHECK(payload.find("419") != std::string::npos);
+}
+
+TEST(MeasurementBatching, collectsOneBatchPerTopicAcrossTopics) {
+    setBatching(BatchMode::ACROSS_TOPICS, 4);
+    service->startWithDelegatedWiFi("ssid", "pass");
+    CHECK(service->waitUntilConnected(2000));
+    for (int i = 0; i < 4; ++i) {
+        CHECK(service->sendMeasurement(co2(400.0f + i), "a"));
+        CHECK(service->sendMeasurement(co2(500.0f + i), "b"));
+    }
+    CHECK(mock::waitUntil([this]() { return broker->messageCount() == 2; },
+                          2000));
+    for (const auto& message : broker->messages()) {
+        const char expected = message.topic == "node/a" ? '4' : '5';
+        CHECK_TEXT(message.topic == "node/a" || message.topic == "node/b",
+                   message.topic.c_str());
+        CHECK(message.payload.find(std::string{expected} + "03") !=
+              std::string::npos);
+    }
+}
+
+TEST(MeasurementBatching, blockedProducerDoesNotHoldTheLock) {
+    setBatching(BatchMode::PER_TOPIC, 1);
+    service->setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK, 5000);
+    broker->setAcceptConnections(false);
+    service->startWithDelegatedWiFi("ssid", "pass");
+    // Each measurement closes its batch, the slots wait for the connection
+    for (int i = 0; i < MQTT_BATCH_SLOTS; ++i) {
+        CHECK(service->sendMeasurement(co2(400.0f + i)));
+    }
+    std::atomic<bool> sent{false};
+    std::thread producer{[this, &sent]() {
+        sent = service->sendMeasurement(co2(500.0f));
+    }};
+    mock::sleepMs(50);
+    CHECK_FALSE(sent);
+    const uint64_t startUs = mock::nowUs();
+    CHECK(service->flushBatches());
+    CHECK(mock::nowUs() - startUs < 100000);
+
+    broker->setAcceptConnections(true);
+    producer.join();
+    CHECK(sent);
+    CHECK(mock::waitUntil(
+        [this]() { return broker->messageCount() == MQTT_BATCH_SLOTS + 1; },
+        5000));
+}
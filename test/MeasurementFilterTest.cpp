@@ -0,0 +1,216 @@
+#include "MeasurementFilter.h"
+#include "UnitTest.h"
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+core::Measurement sample(float value, uint64_t deviceID = 1) {
+    core::Measurement measurement;
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    measurement.metaData.deviceID = deviceID;
+    measurement.dataPoint.value = value;
+    return measurement;
+}
+
+}  // namespace
+
+TEST_GROUP(MeasurementFilter) {
+    MeasurementFilter filter;
+    FilterConfig config;
+
+    // Applies a sample, returns whether it is published
+    bool publishes(float value, uint32_t nowMs, uint64_t deviceID = 1) {
+        core::Measurement measurement = sample(value, deviceID);
+        return filter.apply(measurement, nowMs);
+    }
+
+    // Applies a sample that must be published, returns the published value
+    float published(float value, uint32_t nowMs) {
+        core::Measurement measurement = sample(value);
+        CHECK(filter.apply(measurement, nowMs));
+        return measurement.dataPoint.value;
+    }
+};
+
+TEST(MeasurementFilter, isInactiveForConfigsLettingEverythingThrough) {
+    CHECK_FALSE(filter.active());
+    config.aggregation = FilterAggregation::AVERAGE;
+    config.heartbeatMs = 1000;
+    filter.setDefaultConfig(config);
+    // One sample per average and a heartbeat alone change nothing
+    CHECK_FALSE(filter.active());
+    CHECK(publishes(400.0f, 0));
+    CHECK(publishes(400.0f, 1));
+
+    FilterConfig interval;
+    interval.minIntervalMs = 1000;
+    CHECK(filter.setSignalConfig(core::SignalType::TEMPERATURE_DEGREES_CELSIUS,
+                                 interval));
+    CHECK(filter.active());
+}
+
+TEST(MeasurementFilter, absoluteDeadband) {
+    config.deadbandMode = FilterDeadband::ABSOLUTE;
+    config.deadband = 10.0f;
+    filter.setDefaultConfig(config);
+    CHECK(publishes(400.0f, 0));
+    CHECK_FALSE(publishes(405.0f, 1));
+    CHECK_FALSE(publishes(410.0f, 2));
+    CHECK(publishes(411.0f, 3));
+    // Compared with the last published value, not the last sample
+    CHECK_FALSE(publishes(402.0f, 4));
+    CHECK(publishes(400.0f, 5));
+}
+
+TEST(MeasurementFilter, relativeDeadband) {
+    config.deadbandMode = FilterDeadband::RELATIVE;
+    config.deadband = 0.1f;
+    filter.setDefaultConfig(config);
+    CHECK(publishes(100.0f, 0));
+    CHECK_FALSE(publishes(109.0f, 1));
+    CHECK_FALSE(publishes(91.0f, 2));
+    CHECK(publishes(111.0f, 3));
+    // 10 % of 111
+    CHECK_FALSE(publishes(121.0f, 4));
+    CHECK(publishes(123.0f, 5));
+}
+
+TEST(MeasurementFilter, minimumIntervalSuppressesSamples) {
+    config.minIntervalMs = 1000;
+    filter.setDefaultConfig(config);
+    CHECK(publishes(400.0f, 0));
+    CHECK_FALSE(publishes(500.0f, 500));
+    CHECK_FALSE(publishes(600.0f, 999));
+    CHECK(publishes(600.0f, 1000));
+    CHECK_FALSE(publishes(700.0f, 1999));
+    CHECK(publishes(700.0f, 2500));
+}
+
+TEST(MeasurementFilter, heartbeatPublishesUnchangedValues) {
+    config.deadbandMode = FilterDeadband::ABSOLUTE;
+    config.deadband = 10.0f;
+    config.heartbeatMs = 1000;
+    filter.setDefaultConfig(config);
+    CHECK(publishes(400.0f, 0));
+    CHECK_FALSE(publishes(401.0f, 500));
+    DOUBLES_EQUAL(402.0f, published(402.0f, 1000), 0.001);
+    CHECK_FALSE(publishes(402.0f, 1999));
+    // Evaluated with the next sample, however late it arrives
+    CHECK(publishes(402.0f, 5000));
+    CHECK_FALSE(publishes(402.0f, 5001));
+}
+
+TEST(MeasurementFilter, averageOfSamples) {
+    config.aggregation = FilterAggregation::AVERAGE;
+    config.sampleCount = 3;
+    filter.setDefaultConfig(config);
+    CHECK_FALSE(publishes(1.0f, 0));
+    CHECK_FALSE(publishes(2.0f, 1));
+    DOUBLES_EQUAL(3.0f, published(6.0f, 2), 0.001);
+    // A new window starts
+    CHECK_FALSE(publishes(10.0f, 3));
+    CHECK_FALSE(publishes(20.0f, 4));
+    DOUBLES_EQUAL(20.0f, published(30.0f, 5), 0.001);
+}
+
+TEST(MeasurementFilter, minimumOfSamples) {
+    config.aggregation = FilterAggregation::MIN;
+    config.sampleCount = 3;
+    filter.setDefaultConfig(config);
+    CHECK_FALSE(publishes(5.0f, 0));
+    CHECK_FALSE(publishes(2.0f, 1));
+    DOUBLES_EQUAL(2.0f, published(7.0f, 2), 0.001);
+    CHECK_FALSE(publishes(9.0f, 3));
+    CHECK_FALSE(publishes(8.0f, 4));
+    DOUBLES_EQUAL(8.0f, published(9.5f, 5), 0.001);
+}
+
+TEST(MeasurementFilter, maximumOfSamples) {
+    config.aggregation = FilterAggregation::MAX;
+    config.sampleCount = 3;
+    filter.setDefaultConfig(config);
+    CHECK_FALSE(publishes(5.0f, 0));
+    CHECK_FALSE(publishes(2.0f, 1));
+    DOUBLES_EQUAL(7.0f, published(7.0f, 2), 0.001);
+    CHECK_FALSE(publishes(1.0f, 3));
+    CHECK_FALSE(publishes(3.0f, 4));
+    DOUBLES_EQUAL(3.0f, published(2.0f, 5), 0.001);
+}
+
+TEST(MeasurementFilter, aggregatedValueGoesThroughTheDeadband) {
+    config.aggregation = FilterAggregation::AVERAGE;
+    config.sampleCount = 2;
+    config.deadbandMode = FilterDeadband::ABSOLUTE;
+    config.deadband = 10.0f;
+    filter.setDefaultConfig(config);
+    CHECK_FALSE(publishes(400.0f, 0));
+    CHECK(publishes(400.0f, 1));
+    CHECK_FALSE(publishes(400.0f, 2));
+    // Average 405, within the deadband
+    CHECK_FALSE(publishes(410.0f, 3));
+    CHECK_FALSE(publishes(420.0f, 4));
+    DOUBLES_EQUAL(420.0f, published(420.0f, 5), 0.001);
+}
+
+TEST(MeasurementFilter, signalConfigOverridesTheDefault) {
+    config.deadbandMode = FilterDeadband::ABSOLUTE;
+    config.deadband = 10.0f;
+    filter.setDefaultConfig(config);
+    FilterConfig temperature;
+    temperature.minIntervalMs = 1000;
+    CHECK(filter.setSignalConfig(core::SignalType::TEMPERATURE_DEGREES_CELSIUS,
+                                 temperature));
+    core::Measurement t = sample(20.0f);
+    t.signalType = core::SignalType::TEMPERATURE_DEGREES_CELSIUS;
+    CHECK(filter.apply(t, 0));
+    // A large change, but within the minimum interval
+    t.dataPoint.value = 40.0f;
+    CHECK_FALSE(filter.apply(t, 10));
+    // The CO2 of the same device has its own state and configuration
+    CHECK(publishes(400.0f, 10));
+    CHECK_FALSE(publishes(401.0f, 11));
+}
+
+TEST(MeasurementFilter, rejectsTooManySignalConfigs) {
+    FilterConfig interval;
+    interval.minIntervalMs = 1000;
+    for (int i = 0; i < MQTT_FILTER_SIGNAL_CONFIGS; ++i) {
+        CHECK(filter.setSignalConfig(static_cast<core::SignalType>(i),
+                                     interval));
+    }
+    CHECK_FALSE(filter.setSignalConfig(
+        static_cast<core::SignalType>(MQTT_FILTER_SIGNAL_CONFIGS), interval));
+    // Replacing a configured signal still works
+    CHECK(filter.setSignalConfig(static_cast<core::SignalType>(0), config));
+}
+
+TEST(MeasurementFilter, evictsTheLeastRecentlyUsedState) {
+    config.deadbandMode = FilterDeadband::ABSOLUTE;
+    config.deadband = 10.0f;
+    filter.setDefaultConfig(config);
+    for (uint64_t device = 0; device < MQTT_FILTER_STATE_SLOTS; ++device) {
+        CHECK(publishes(400.0f, 0, device));
+    }
+    // Device 0 is used again, device 1 is now the least recently used
+    CHECK_FALSE(publishes(400.0f, 1, 0));
+    CHECK(publishes(400.0f, 2, MQTT_FILTER_STATE_SLOTS));
+    // Device 0 kept its state, device 1 starts again
+    CHECK_FALSE(publishes(400.0f, 3, 0));
+    CHECK(publishes(400.0f, 4, 1));
+    // which evicted device 2
+    CHECK_FALSE(publishes(400.0f, 5, 3));
+    CHECK(publishes(400.0f, 6, 2));
+}
+
+TEST(MeasurementFilter, resetForgetsTheState) {
+    config.deadbandMode = FilterDeadband::ABSOLUTE;
+    config.deadband = 10.0f;
+    filter.setDefaultConfig(config);
+    CHECK(publishes(400.0f, 0));
+    CHECK_FALSE(publishes(400.0f, 1));
+    filter.reset();
+    CHECK(publishes(400.0f, 2));
+}
@@ -0,0 +1,70 @@
+#include "MeasurementTemplate.h"
+#include "MockSupport.h"
+#include "UnitTest.h"
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+TEST_GROUP(MeasurementTemplate) {
+    core::Measurement measurement;
+    char buffer[MQTT_MESSAGE_MAX_LENGTH];
+
+    void setup() override {
+        measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+        measurement.dataPoint.t_offset = 1500;
+        measurement.dataPoint.value = 412.5f;
+        measurement.metaData = core::MetaData{core::SCD4X()};
+        measurement.metaData.deviceID = 42;
+    }
+
+    std::string format(const MeasurementTemplate& formatter) {
+        const size_t length = formatter(measurement, buffer, sizeof(buffer));
+        CHECK(length < sizeof(buffer));
+        return std::string{buffer, length};
+    }
+};
+
+TEST(MeasurementTemplate, formatsAllFields) {
+    const MeasurementTemplate formatter{
+        R"({"t":{t_offset},"v":{value:.1f},"id":{deviceID},)"
+        R"("d":"{deviceLabel}","q":"{quantity}","u":"{unit}"})"};
+    CHECK(formatter.valid());
+    CHECK(formatter.hasDataPointFields());
+    STRCMP_EQUAL(R"({"t":1500,"v":412.5,"id":42,"d":"SCD4X","q":"CO2",)"
+                 R"("u":"ppm"})",
+                 format(formatter));
+}
+
+TEST(MeasurementTemplate, valueHasTheDefaultDecimals) {
+    const MeasurementTemplate formatter{"{value}"};
+    STRCMP_EQUAL("412.50", format(formatter));
+}
+
+TEST(MeasurementTemplate, topicTemplateHasNoDataPointFields) {
+    const MeasurementTemplate formatter{"{deviceLabel}/{quantity}"};
+    CHECK(formatter.valid());
+    CHECK_FALSE(formatter.hasDataPointFields());
+    STRCMP_EQUAL("SCD4X/CO2", format(formatter));
+}
+
+TEST(MeasurementTemplate, rejectsUnknownFieldsAndFormats) {
+    CHECK_FALSE(MeasurementTemplate{"{temperature}"}.valid());
+    CHECK_FALSE(MeasurementTemplate{"{t_offset:.2f}"}.valid());
+    CHECK_FALSE(MeasurementTemplate{"{value:2f}"}.valid());
+}
+
+TEST(MeasurementTemplate, reportsOverflow) {
+    const MeasurementTemplate formatter{"{quantity}-{quantity}"};
+    char small[4];
+    CHECK(formatter(measurement, small, sizeof(small)) >= sizeof(small));
+}
+
+TEST(MeasurementTemplate, formatsWithoutAllocation) {
+    const MeasurementTemplate formatter{R"({"t":{t_offset},"v":{value}})"};
+    const uint64_t before = mock::allocationCount();
+    for (uint32_t i = 0; i < 100; ++i) {
+        measurement.dataPoint.t_offset = i;
+        formatter(measurement, buffer, sizeof(buffer));
+    }
+    LONGS_EQUAL(0, mock::allocationCount() - before);
+}
@@ -0,0 +1,178 @@
+#include "MessageAssembler.h"
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+using Status = MessageAssembler::Status;
+
+std::string payloadOf(size_t length) {
+    std::string payload(length, ' ');
+    for (size_t i = 0; i < length; ++i) {
+        payload[i] = static_cast<char>('a' + i % 26);
+    }
+    return payload;
+}
+
+}  // namespace
+
+TEST_GROUP(MessageAssembler) {
+    MailboxMessage message{};
+
+    Status add(const std::string& payload, size_t offset, size_t length) {
+        return MessageAssembler::addFragment(
+            message, offset == 0 ? "a/b" : "", payload.data() + offset, length,
+            offset, payload.size());
+    }
+
+    std::string assembled() const {
+        return std::string{message.payload, message.payloadLength};
+    }
+};
+
+TEST(MessageAssembler, reassemblesFragmentsInOrder) {
+    const std::string payload = payloadOf(100);
+    CHECK(add(payload, 0, 40) == Status::INCOMPLETE);
+    CHECK(add(payload, 40, 40) == Status::INCOMPLETE);
+    CHECK(add(payload, 80, 20) == Status::COMPLETE);
+    STRCMP_EQUAL("a/b", std::string{message.topic});
+    STRCMP_EQUAL(payload, assembled());
+}
+
+TEST(MessageAssembler, completesEmptyPayloads) {
+    CHECK(MessageAssembler::addFragment(message, "a/b", nullptr, 0, 0, 0) ==
+          Status::COMPLETE);
+    LONGS_EQUAL(0, message.payloadLength);
+}
+
+TEST(MessageAssembler, rejectsFragmentsOutOfSequence) {
+    const std::string payload = payloadOf(100);
+    CHECK(add(payload, 0, 40) == Status::INCOMPLETE);
+    // A fragment skipped or repeated
+    CHECK(add(payload, 60, 40) == Status::REJECTED);
+    CHECK(add(payload, 0, 40) == Status::INCOMPLETE);
+    CHECK(add(payload, 40, 40) == Status::INCOMPLETE);
+    CHECK(add(payload, 40, 40) == Status::REJECTED);
+    // A fragment past the announced length
+    CHECK(add(payload, 0, 90) == Status::INCOMPLETE);
+    CHECK(add(payload, 90, 20) == Status::REJECTED);
+}
+
+TEST(MessageAssembler, restartsWithTheFirstFragment) {
+    const std::string first = payloadOf(100);
+    CHECK(add(first, 0, 40) == Status::INCOMPLETE);
+    // The rest never came, the next message starts over
+    const std::string second = payloadOf(30);
+    CHECK(add(second, 0, 30) == Status::COMPLETE);
+    STRCMP_EQUAL(second, assembled());
+}
+
+TEST(MessageAssembler, rejectsMessagesLargerThanABlock) {
+    const std::string payload = payloadOf(MQTT_MESSAGE_MAX_LENGTH + 1);
+    CHECK(add(payload, 0, 40) == Status::REJECTED);
+    const std::string topic(MQTT_TOPIC_MAX_LENGTH, 't');
+    CHECK(MessageAssembler::addFragment(message, topic, "x", 1, 0, 1) ==
+          Status::REJECTED);
+    CHECK(MessageAssembler::addFragment(message, "", "x", 1, 0, 1) ==
+          Status::REJECTED);
+}
+
+TEST_GROUP(ReceivedMessages) {
+    std::unique_ptr<mock::MockBroker> broker;
+    std::unique_ptr<MqttMailingService> service;
+    std::mutex mutex;
+    std::vector<std::string> received;
+
+    void setup() override {
+        WiFi.mockReset();
+        // Messages larger than 64 bytes are received in fragments
+        mock::setDefaultClientBufferSize(64);
+        broker.reset(new mock::MockBroker{"broker.local"});
+        service.reset(new MqttMailingService);
+        service->setBrokerURI("mqtt://broker.local:1883");
+    }
+
+    void teardown() override {
+        service.reset();
+        broker.reset();
+        mock::setDefaultClientBufferSize(1024);
+        WiFi.mockReset();
+    }
+
+    void record(std::string_view payload) {
+        std::lock_guard<std::mutex> lock{mutex};
+        received.emplace_back(payload);
+    }
+
+    size_t receivedCount() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return received.size();
+    }
+
+    void start() {
+        service->startWithDelegatedWiFi("ssid", "pass");
+        CHECK(service->waitUntilConnected(2000));
+        CHECK(mock::waitUntil(
+            [this]() { return broker->subscriptionCount() > 0; }, 2000));
+    }
+};
+
+TEST(ReceivedMessages, reassemblesFragmentedMessages) {
+    CHECK(service->subscribe(
+        "commands/#",
+        [this](std::string_view, std::string_view payload) {
+            record(payload);
+        }));
+    start();
+    const std::string large = payloadOf(MQTT_MESSAGE_MAX_LENGTH);
+    const std::string small = payloadOf(10);
+    broker->inject("commands/a", large);
+    broker->inject("commands/b", small);
+    // Too large for a block, dropped without disturbing the next ones
+    broker->inject("commands/c", payloadOf(MQTT_MESSAGE_MAX_LENGTH + 1));
+    broker->inject("commands/d", large);
+    CHECK(mock::waitUntil([this]() { return receivedCount() == 3; }, 2000));
+    CHECK(received[0] == large);
+    CHECK(received[1] == small);
+    CHECK(received[2] == large);
+    CHECK(mock::waitUntil(
+        [this]() { return service->getSubscriptionStatistics().dropped == 1; },
+        2000));
+}
+
+TEST(ReceivedMessages, callbacksMaySubscribeAndUnsubscribe) {
+    std::atomic<size_t> once{0};
+    CHECK(service->subscribe(
+        "once/#", [this, &once](std::string_view, std::string_view) {
+            // Called without the subscription lock held
+            service->subscribe(
+                "later/#",
+                [this](std::string_view, std::string_view payload) {
+                    record(payload);
+                });
+            service->unsubscribe("once/#");
+            once++;
+        }));
+    start();
+    broker->inject("once/a", "1");
+    CHECK(mock::waitUntil(
+        [this, &once]() {
+            return broker->subscriptionCount() == 1 && once == 1;
+        },
+        2000));
+    broker->inject("once/a", "2");
+    broker->inject("later/a", "3");
+    CHECK(mock::waitUntil([this]() { return receivedCount() == 1; }, 2000));
+    STRCMP_EQUAL("3", received[0]);
+    LONGS_EQUAL(1, once.load());
+}
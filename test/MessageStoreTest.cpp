@@ -0,0 +1,158 @@
+#include "MessageStore.h"
+#include "UnitTest.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+MailboxMessage makeMessage(const char* topic, const std::string& payload) {
+    MailboxMessage msg{};
+    std::strncpy(msg.topic, topic, sizeof(msg.topic) - 1);
+    payload.copy(msg.payload, sizeof(msg.payload));
+    msg.payloadLength = payload.size();
+    return msg;
+}
+
+std::string payloadOf(const MailboxMessage& msg) {
+    return std::string{msg.payload, msg.payloadLength};
+}
+
+}  // namespace
+
+TEST_GROUP(RamMessageStore){};
+
+TEST(RamMessageStore, keepsTheOrder) {
+    RamMessageStore store{4};
+    CHECK(store.begin());
+    CHECK(store.push(makeMessage("a", "1")));
+    CHECK(store.push(makeMessage("b", "2")));
+    LONGS_EQUAL(2, store.count());
+    MailboxMessage msg;
+    CHECK(store.front(msg));
+    STRCMP_EQUAL("a", msg.topic);
+    STRCMP_EQUAL("1", payloadOf(msg));
+    store.pop();
+    CHECK(store.front(msg));
+    STRCMP_EQUAL("b", msg.topic);
+    store.pop();
+    CHECK_FALSE(store.front(msg));
+}
+
+TEST(RamMessageStore, overwritesTheOldestWhenFull) {
+    RamMessageStore store{2};
+    CHECK(store.begin());
+    for (int i = 0; i < 5; ++i) {
+        CHECK(store.push(makeMessage("t", std::to_string(i))));
+    }
+    LONGS_EQUAL(2, store.count());
+    LONGS_EQUAL(3, store.overwritten());
+    MailboxMessage msg;
+    CHECK(store.front(msg));
+    STRCMP_EQUAL("3", payloadOf(msg));
+}
+
+TEST_GROUP(FileMessageStore) {
+    std::string path;
+
+    void setup() override {
+        path = "FileMessageStoreTest.bin";
+        std::remove(path.c_str());
+    }
+
+    void teardown() override {
+        std::remove(path.c_str());
+    }
+};
+
+TEST(FileMessageStore, survivesARestart) {
+    {
+        FileMessageStore store{path.c_str(), 4};
+        CHECK(store.begin());
+        CHECK(store.push(makeMessage("a", "1")));
+        CHECK(store.push(makeMessage("b", "2")));
+        CHECK(store.push(makeMessage("c", "3")));
+        store.pop();
+    }
+    FileMessageStore store{path.c_str(), 4};
+    CHECK(store.begin());
+    LONGS_EQUAL(2, store.count());
+    MailboxMessage msg;
+    CHECK(store.front(msg));
+    STRCMP_EQUAL("b", msg.topic);
+    STRCMP_EQUAL("2", payloadOf(msg));
+}
+
+TEST(FileMessageStore, overwritesTheOldestWhenFull) {
+    FileMessageStore store{path.c_str(), 2};
+    CHECK(store.begin());
+    for (int i = 0; i < 5; ++i) {
+        CHECK(store.push(makeMessage("t", std::to_string(i))));
+    }
+    LONGS_EQUAL(2, store.count());
+    MailboxMessage msg;
+    CHECK(store.front(msg));
+    STRCMP_EQUAL("3", payloadOf(msg));
+}
+
+TEST(FileMessageStore, discardsAFileOfAnotherLayout) {
+    {
+        FileMessageStore store{path.c_str(), 4};
+        CHECK(store.begin());
+        CHECK(store.push(makeMessage("a", "1")));
+    }
+    // Offsets of another capacity do not match the records
+    FileMessageStore store{path.c_str(), 8};
+    CHECK(store.begin());
+    LONGS_EQUAL(0, store.count());
+    CHECK(store.push(makeMessage("b", "2")));
+    MailboxMessage msg;
+    CHECK(store.front(msg));
+    STRCMP_EQUAL("b", msg.topic);
+}
+
+TEST(FileMessageStore, ignoresASlotBeingOverwritten) {
+    constexpr size_t recordSize =
+        16 + MQTT_TOPIC_MAX_LENGTH + MQTT_MESSAGE_MAX_LENGTH;
+    {
+        FileMessageStore store{path.c_str(), 2};
+        CHECK(store.begin());
+        CHECK(store.push(makeMessage("a", "1")));
+        CHECK(store.push(makeMessage("b", "2")));
+    }
+    // A push first invalidates the header at the end of the slot, a torn
+    // write stops anywhere after it
+    FILE* file = std::fopen(path.c_str(), "r+b");
+    CHECK(file != nullptr);
+    const char zeros[16] = {};
+    std::fseek(file, recordSize - sizeof(zeros), SEEK_SET);
+    std::fwrite(zeros, 1, sizeof(zeros), file);
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite("torn", 1, 4, file);
+    std::fclose(file);
+
+    FileMessageStore store{path.c_str(), 2};
+    CHECK(store.begin());
+    LONGS_EQUAL(1, store.count());
+    MailboxMessage msg;
+    CHECK(store.front(msg));
+    STRCMP_EQUAL("b", msg.topic);
+}
+
+TEST(FileMessageStore, writesChangesOnSync) {
+    FileMessageStore store{path.c_str(), 4};
+    CHECK(store.begin());
+    CHECK(store.push(makeMessage("a", "1")));
+    store.pop();
+    CHECK(store.push(makeMessage("b", "2")));
+    store.sync();
+
+    FileMessageStore reader{path.c_str(), 4};
+    CHECK(reader.begin());
+    LONGS_EQUAL(1, reader.count());
+    MailboxMessage msg;
+    CHECK(reader.front(msg));
+    STRCMP_EQUAL("b", msg.topic);
+}
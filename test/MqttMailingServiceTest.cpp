@@ -0,0 +1,318 @@
+#include "MessageStore.h"
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+// Writes length characters, its std::string operator goes through
+// formatToString like those of the library
+struct RepeatFormatter {
+    size_t length;
+
+    size_t operator()(const core::Measurement&, char* buffer,
+                      size_t size) const {
+        FixedBufferWriter writer{buffer, size};
+        for (size_t i = 0; i < length; ++i) {
+            writer.append('a');
+        }
+        return writer.result();
+    }
+
+    std::string operator()(const core::Measurement& m) const {
+        return formatToString(*this, m);
+    }
+};
+
+}  // namespace
+
+TEST_GROUP(MqttMailingService) {
+    std::unique_ptr<mock::MockBroker> broker;
+    std::unique_ptr<MqttMailingService> service;
+    size_t useAfterDelete = 0;
+
+    void setup() override {
+        WiFi.mockReset();
+        useAfterDelete = mock::useAfterDeleteCount();
+        broker.reset(new mock::MockBroker{"broker.local"});
+        service.reset(new MqttMailingService);
+        service->setBrokerURI("mqtt://broker.local:1883");
+        service->setGlobalTopicPrefix("node/");
+        service->setMeasurementMessageFormatterFn(
+            DefaultMeasurementFormatter{});
+        service->setMeasurementToTopicSuffixFn(
+            DefaultMeasurementToTopicSuffix{});
+    }
+
+    void teardown() override {
+        service.reset();
+        broker.reset();
+        WiFi.mockReset();
+        LONGS_EQUAL(useAfterDelete, mock::useAfterDeleteCount());
+    }
+
+    void startConnected() {
+        service->startWithDelegatedWiFi("ssid", "pass");
+        CHECK(service->waitUntilConnected(2000));
+    }
+
+    /**
+     * Heap allocations of all threads of the library while count messages
+     * are sent and published, after a warm-up filling the caches and pools
+     */
+    template <typename Send>
+    uint64_t steadyStateAllocations(size_t count, Send send) {
+        for (const bool measured : {false, true}) {
+            const size_t received = broker->messageCount();
+            const uint64_t before = mock::allocationCount();
+            for (size_t i = 0; i < count; ++i) {
+                send(i);
+            }
+            CHECK(mock::waitUntil(
+                [this, received, count]() {
+                    return broker->messageCount() == received + count;
+                },
+                5000));
+            if (measured) {
+                return mock::allocationCount() - before;
+            }
+        }
+        return 0;
+    }
+};
+
+TEST(MqttMailingService, connectsThroughDelegatedWiFi) {
+    startConnected();
+    CHECK(WiFi.isConnected());
+    LONGS_EQUAL(1, broker->connectedClientCount());
+    CHECK(service->isReady());
+}
+
+TEST(MqttMailingService, publishesTextMessagesWithPrefix) {
+    startConnected();
+    CHECK(service->sendTextMessage("hello", "greeting"));
+    CHECK(mock::waitUntil([this]() { return broker->messageCount() == 1; },
+                          2000));
+    const auto messages = broker->messages();
+    STRCMP_EQUAL("node/greeting", messages[0].topic);
+    STRCMP_EQUAL("hello", messages[0].payload);
+}
+
+TEST(MqttMailingService, publishesMeasurements) {
+    startConnected();
+    core::Measurement measurement;
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.dataPoint.value = 412.0f;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    CHECK(service->sendMeasurement(measurement));
+    CHECK(mock::waitUntil([this]() { return broker->messageCount() == 1; },
+                          2000));
+    const auto messages = broker->messages();
+    CHECK(messages[0].topic.rfind("node/", 0) == 0);
+    CHECK(messages[0].payload.find("412") != std::string::npos);
+}
+
+TEST(MqttMailingService, overlongFormatterOutputIsDroppedNotTruncated) {
+    const core::Measurement measurement{
+        core::MetaData{core::SCD4X()}, core::SignalType::CO2_PARTS_PER_MILLION,
+        core::DataPoint{0, 412.0f}};
+    LONGS_EQUAL(600, RepeatFormatter{600}(measurement).size());
+
+    service->setMeasurementMessageFormatterFn(RepeatFormatter{600});
+    service->setMeasurementToTopicSuffixFn(RepeatFormatter{300});
+    startConnected();
+    // The suffix does not fit into the topic
+    CHECK_FALSE(service->sendMeasurement(measurement));
+    LONGS_EQUAL(1, service->getMailboxStatistics().dropped);
+
+    MqttMailingService payloadTooLong;
+    payloadTooLong.setBrokerURI("mqtt://broker.local:1883");
+    payloadTooLong.setMeasurementMessageFormatterFn(RepeatFormatter{600});
+    payloadTooLong.setMeasurementToTopicSuffixFn(RepeatFormatter{8});
+    payloadTooLong.startWithDelegatedWiFi("ssid", "pass");
+    CHECK(payloadTooLong.waitUntilConnected(2000));
+    CHECK_FALSE(payloadTooLong.sendMeasurement(measurement));
+    LONGS_EQUAL(1, payloadTooLong.getMailboxStatistics().dropped);
+    mock::sleepMs(50);
+    LONGS_EQUAL(0, broker->messageCount());
+}
+
+TEST(MqttMailingService, queuesMessagesUntilConnected) {
+    WiFi.mockSetConnectDelayMs(50);
+    service->startWithDelegatedWiFi("ssid", "pass");
+    CHECK(service->sendTextMessage("early", "queued"));
+    CHECK(service->waitUntilConnected(2000));
+    CHECK(mock::waitUntil([this]() { return broker->messageCount() == 1; },
+                          2000));
+    STRCMP_EQUAL("early", broker->messages()[0].payload);
+}
+
+TEST(MqttMailingService, steadyStatePublishPathsDoNotAllocate) {
+    broker->setRecordMessages(false);
+    service->setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK, 1000);
+    service->setMeasurementBufferFormatterFn(FullMeasurementFormatter{});
+    service->setMeasurementToTopicSuffixFn(MeasurementToTopicSuffixTree{});
+    startConnected();
+    core::Measurement measurement;
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    const std::string_view payload{"{\"value\":42}"};
+
+    LONGS_EQUAL(0, steadyStateAllocations(500, [&](size_t i) {
+                    measurement.dataPoint.value = 400.0f + i;
+                    CHECK(service->sendMeasurement(measurement));
+                }));
+    LONGS_EQUAL(0, steadyStateAllocations(500, [&](size_t) {
+                    CHECK(service->sendPayload(payload, "payload"));
+                }));
+    LONGS_EQUAL(0, steadyStateAllocations(500, [&](size_t i) {
+                    MailboxMessage* msg = service->acquireMessage();
+                    CHECK(msg != nullptr);
+                    msg->payloadLength = static_cast<size_t>(snprintf(
+                        msg->payload, sizeof(msg->payload), "%zu", i));
+                    CHECK(service->sendMessage(msg, "in-place"));
+                }));
+}
+
+TEST(MqttMailingService, steadyStateQos1PublishDoesNotAllocateNorLoseAcks) {
+    broker->setRecordMessages(false);
+    service->setQOS(1);
+    service->setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK, 1000);
+    startConnected();
+    const std::string_view payload{"{\"value\":42}"};
+
+    // The broker acknowledges at once, often before the sender task got
+    // the message id from esp_mqtt_client_publish
+    LONGS_EQUAL(0, steadyStateAllocations(2000, [&](size_t) {
+                    CHECK(service->sendPayload(payload, "payload"));
+                }));
+    CHECK(mock::waitUntil(
+        [this]() { return service->getMetrics().inFlight.inFlight == 0; },
+        2000));
+    const MqttMetrics metrics = service->getMetrics();
+    LONGS_EQUAL(0, metrics.inFlight.timedOut);
+    LONGS_EQUAL(0, metrics.mailbox.dropped);
+}
+
+TEST(MqttMailingService, dropOldestReusesTheBlocksOfTheLeastImportantLane) {
+    std::mutex mutex;
+    std::vector<uint32_t> dropped;
+    service->setDeliveryCallback(
+        [&mutex, &dropped](uint32_t token, DeliveryStatus status) {
+            if (status == DeliveryStatus::DROPPED) {
+                std::lock_guard<std::mutex> lock{mutex};
+                dropped.push_back(token);
+            }
+        });
+    service->setMailboxDepth(4);
+    service->setPriorityClass(MessagePriority::BULK, {-1, -1, 1, 2});
+    service->setPriorityClass(MessagePriority::URGENT, {-1, -1, 4, 2});
+    broker->setAcceptConnections(false);
+    service->startWithDelegatedWiFi("ssid", "pass");
+    const auto send = [this](uint32_t token, MessagePriority priority) {
+        return service->sendPayload(std::to_string(token), "lanes", token,
+                                    priority);
+    };
+
+    // Held by the sender task until connected
+    CHECK(send(1, MessagePriority::NORMAL));
+    mock::sleepMs(50);
+    CHECK(send(10, MessagePriority::BULK));
+    CHECK(send(11, MessagePriority::BULK));
+    for (uint32_t token = 2; token <= 5; ++token) {
+        CHECK(send(token, MessagePriority::NORMAL));
+    }
+    // The remaining blocks are being filled by the application
+    std::vector<MailboxMessage*> filling;
+    while (service->getMessagePoolStatistics().inUse <
+           service->getMessagePoolStatistics().capacity) {
+        filling.push_back(service->acquireMessage());
+    }
+
+    // The bulk messages go first, then the normal ones
+    CHECK(send(100, MessagePriority::URGENT));
+    CHECK(send(101, MessagePriority::URGENT));
+    CHECK(send(102, MessagePriority::BULK));
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        CHECK((dropped == std::vector<uint32_t>{10, 11, 2}));
+    }
+    const MqttMetrics metrics = service->getMetrics();
+    LONGS_EQUAL(2, metrics.priorities[0].dropped);
+    LONGS_EQUAL(1, metrics.priorities[1].dropped);
+    LONGS_EQUAL(0, metrics.priorities[2].dropped);
+    LONGS_EQUAL(3, metrics.mailbox.dropped);
+
+    for (MailboxMessage* msg : filling) {
+        service->releaseMessage(msg);
+    }
+    broker->setAcceptConnections(true);
+    CHECK(mock::waitUntil([this]() { return broker->messageCount() == 7; },
+                          2000));
+    LONGS_EQUAL(0, service->getMetrics().priorities[2].dropped);
+}
+
+TEST(MqttMailingService, acknowledgementsRingTheSenderWithoutTakingSlots) {
+    std::mutex mutex;
+    std::vector<uint32_t> delivered;
+    service->setDeliveryCallback(
+        [&mutex, &delivered](uint32_t token, DeliveryStatus status) {
+            if (status == DeliveryStatus::DELIVERED) {
+                std::lock_guard<std::mutex> lock{mutex};
+                delivered.push_back(token);
+            }
+        });
+    service->setQOS(1);
+    service->setMailboxDepth(1);
+    service->setMailboxOverflowPolicy(MailboxOverflowPolicy::DROP_NEWEST);
+    startConnected();
+
+    // Each acknowledgement rings the sender, which runs the callback without
+    // waiting for the next message
+    for (uint32_t token = 1; token <= 50; ++token) {
+        CHECK(service->sendPayload("{}", "acked", token));
+        CHECK(mock::waitUntil(
+            [&mutex, &delivered, token]() {
+                std::lock_guard<std::mutex> lock{mutex};
+                return delivered.size() == token;
+            },
+            2000));
+    }
+    LONGS_EQUAL(0, service->getMailboxStatistics().dropped);
+}
+
+TEST(MqttMailingService, dutyCycleFlushesAndCanBeDestroyedWhileFlushing) {
+    RamMessageStore store{32};
+    DutyCycleConfig dutyCycle;
+    dutyCycle.enabled = true;
+    dutyCycle.flushIntervalMs = 0;
+    dutyCycle.flushFillLevel = 0;
+    service->setMessageStore(&store);
+    service->setDutyCycle(dutyCycle);
+    startConnected();
+    CHECK(service->waitUntilFlushed(2000));
+
+    for (int i = 0; i < 5; ++i) {
+        CHECK(service->sendTextMessage("stored", "duty"));
+    }
+    CHECK(mock::waitUntil([&store]() { return store.count() == 5; }, 2000));
+    service->requestFlush();
+    CHECK(mock::waitUntil([this]() { return broker->messageCount() == 5; },
+                          2000));
+    CHECK(service->waitUntilFlushed(2000));
+
+    // Destroyed while the connection task brings the radio up
+    CHECK(service->sendTextMessage("stored", "duty"));
+    service->requestFlush();
+    service.reset();
+}
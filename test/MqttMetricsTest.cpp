@@ -0,0 +1,83 @@
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "MqttMetrics.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <limits>
+#include <string>
+
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+MqttMetrics saturatedMetrics() {
+    constexpr uint32_t max = std::numeric_limits<uint32_t>::max();
+    MqttMetrics metrics;
+    metrics.messagesPublished = max;
+    metrics.bytesPublished = max;
+    metrics.publishFailures = max;
+    metrics.reconnects = max;
+    metrics.lastTimeToReconnectMs = max;
+    metrics.timeConnectingMs = max;
+    metrics.timeDisconnectedMs = max;
+    metrics.outboxSize = std::numeric_limits<int>::min();
+    metrics.mailbox.enqueued = max;
+    metrics.mailbox.sent = max;
+    metrics.mailbox.dropped = max;
+    metrics.pool.highWaterMark = max;
+    metrics.pool.exhausted = max;
+    for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+        metrics.publishLatency.counts[i] = max;
+        metrics.ackLatency.counts[i] = max;
+    }
+    return metrics;
+}
+
+}  // namespace
+
+TEST_GROUP(MetricsFormatter) {
+    char buffer[MetricsFormatter::kBufferSize];
+};
+
+TEST(MetricsFormatter, fitsEveryCounterAtItsMaximum) {
+    const size_t length =
+        MetricsFormatter{}(saturatedMetrics(), buffer, sizeof(buffer));
+    CHECK(length < sizeof(buffer));
+    const std::string text{buffer, length};
+    CHECK(text.rfind("{\"pub\":4294967295,", 0) == 0);
+    CHECK(text.find("\"outbox\":-2147483648,") != std::string::npos);
+    CHECK(text.back() == '}');
+}
+
+TEST(MetricsFormatter, reportsWhatDoesNotFit) {
+    const size_t size = MQTT_MESSAGE_MAX_LENGTH;
+    LONGS_EQUAL(size, MetricsFormatter{}(saturatedMetrics(), buffer, size));
+}
+
+TEST_GROUP(Telemetry) {
+    void setup() override {
+        WiFi.mockReset();
+    }
+
+    void teardown() override {
+        WiFi.mockReset();
+    }
+};
+
+TEST(Telemetry, isPublishedPeriodically) {
+    mock::MockBroker broker{"broker.local"};
+    {
+        MqttMailingService service;
+        service.setBrokerURI("mqtt://broker.local:1883");
+        service.setGlobalTopicPrefix("node/");
+        service.setTelemetry("telemetry", 20);
+        service.startWithDelegatedWiFi("ssid", "pass");
+        CHECK(service.waitUntilConnected(2000));
+        CHECK(mock::waitUntil(
+            [&broker]() { return broker.messageCount() >= 2; }, 2000));
+    }
+    const auto messages = broker.messages();
+    STRCMP_EQUAL("node/telemetry", messages[0].topic);
+    CHECK(messages[0].payload.rfind("{\"pub\":", 0) == 0);
+}
@@ -0,0 +1,110 @@
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttRouter.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <memory>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+TEST_GROUP(MqttRouter) {
+    std::unique_ptr<mock::MockBroker> cloudBroker;
+    std::unique_ptr<mock::MockBroker> edgeBroker;
+    std::unique_ptr<MqttMailingService> cloud;
+    std::unique_ptr<MqttMailingService> edge;
+    MqttRouter router;
+    size_t useAfterDelete = 0;
+
+    void setup() override {
+        WiFi.mockReset();
+        useAfterDelete = mock::useAfterDeleteCount();
+        cloudBroker.reset(new mock::MockBroker{"cloud.local"});
+        edgeBroker.reset(new mock::MockBroker{"edge.local"});
+        cloud = makeService("mqtt://cloud.local:1883");
+        edge = makeService("mqtt://edge.local:1883");
+        edge->setQOS(1);
+        router.setDefaultService(cloud.get());
+        CHECK(router.addRoute("local/", edge.get()));
+        // Both share the Wi-Fi, each keeps its own broker connection
+        cloud->startWithDelegatedWiFi("ssid", "pass");
+        edge->startWithDelegatedWiFi("ssid", "pass");
+        CHECK(cloud->waitUntilConnected(2000));
+        CHECK(edge->waitUntilConnected(2000));
+    }
+
+    void teardown() override {
+        cloud.reset();
+        edge.reset();
+        cloudBroker.reset();
+        edgeBroker.reset();
+        WiFi.mockReset();
+        // The services stop their tasks before deleting what they use
+        LONGS_EQUAL(useAfterDelete, mock::useAfterDeleteCount());
+    }
+
+    static std::unique_ptr<MqttMailingService> makeService(const char* uri) {
+        std::unique_ptr<MqttMailingService> service{new MqttMailingService};
+        service->setBrokerURI(uri);
+        service->setMeasurementMessageFormatterFn(
+            DefaultMeasurementFormatter{});
+        service->setMeasurementToTopicSuffixFn(
+            DefaultMeasurementToTopicSuffix{});
+        return service;
+    }
+};
+
+TEST(MqttRouter, routesByLongestPrefix) {
+    CHECK(router.route("local/co2") == edge.get());
+    CHECK(router.route("cloud/co2") == cloud.get());
+    CHECK(router.route("") == cloud.get());
+
+    CHECK(router.sendTextMessage("edge", "local/status"));
+    CHECK(router.sendTextMessage("cloud", "status"));
+    CHECK(mock::waitUntil(
+        [this]() {
+            return edgeBroker->messageCount() == 1 &&
+                   cloudBroker->messageCount() == 1;
+        },
+        2000));
+    STRCMP_EQUAL("local/status", edgeBroker->messages()[0].topic);
+    STRCMP_EQUAL("status", cloudBroker->messages()[0].topic);
+}
+
+TEST(MqttRouter, keepsTheConnectionStatePerInstance) {
+    // The edge broker restarts and refuses the connections for a while
+    edgeBroker->setAcceptConnections(false);
+    edgeBroker->disconnectAll();
+    CHECK(mock::waitUntil([this]() { return !edge->isReady(); }, 2000));
+    CHECK(cloud->isReady());
+
+    CHECK(router.sendTextMessage("queued", "local/status"));
+    CHECK(router.sendTextMessage("live", "status"));
+    CHECK(mock::waitUntil(
+        [this]() { return cloudBroker->messageCount() == 1; }, 2000));
+    LONGS_EQUAL(0, edgeBroker->messageCount());
+    LONGS_EQUAL(1, cloudBroker->connectCount());
+
+    edgeBroker->setAcceptConnections(true);
+    CHECK(edge->waitUntilConnected(2000));
+    CHECK(mock::waitUntil(
+        [this]() { return edgeBroker->messageCount() == 1; }, 2000));
+    STRCMP_EQUAL("queued", edgeBroker->messages()[0].payload);
+    LONGS_EQUAL(1, cloudBroker->connectCount());
+}
+
+TEST(MqttRouter, destroyingAnInstanceLeavesTheOtherRunning) {
+    // Acknowledgements keep arriving while the instance is destroyed
+    edgeBroker->setAckDelayUs(500);
+    for (int i = 0; i < 50; ++i) {
+        CHECK(router.sendTextMessage("pending", "local/status"));
+    }
+    CHECK(mock::waitUntil(
+        [this]() { return edgeBroker->messageCount() > 0; }, 2000));
+    edge.reset();
+    LONGS_EQUAL(0, edgeBroker->connectedClientCount());
+    CHECK(cloud->isReady());
+    CHECK(cloud->sendTextMessage("still here", "status"));
+    CHECK(mock::waitUntil(
+        [this]() { return cloudBroker->messageCount() == 1; }, 2000));
+}
@@ -0,0 +1,56 @@
+#include "PayloadCompression.h"
+#include "UnitTest.h"
+#include <cstring>
+
+using namespace sensirion::upt::mqtt;
+
+TEST_GROUP(PayloadCompression) {
+    HeatshrinkEncoder encoder;
+    uint8_t compressed[MQTT_MESSAGE_MAX_LENGTH];
+    uint8_t decompressed[MQTT_MESSAGE_MAX_LENGTH];
+
+    size_t roundTrip(const std::string& text) {
+        const auto* input = reinterpret_cast<const uint8_t*>(text.data());
+        const size_t length = encoder.compress(input, text.size(), compressed,
+                                               sizeof(compressed));
+        CHECK(length <= sizeof(compressed));
+        const size_t restored = HeatshrinkDecoder::decompress(
+            compressed, length, decompressed, sizeof(decompressed));
+        LONGS_EQUAL(text.size(), restored);
+        CHECK(std::memcmp(input, decompressed, restored) == 0);
+        return length;
+    }
+};
+
+TEST(PayloadCompression, shrinksRepetitiveBatches) {
+    std::string batch{"["};
+    for (int i = 0; i < 8; ++i) {
+        batch += "{\"t\":" + std::to_string(i * 5000) + ",\"v\":412.50},";
+    }
+    batch.back() = ']';
+    const size_t length = roundTrip(batch);
+    CHECK(length < batch.size() * 2 / 3);
+}
+
+TEST(PayloadCompression, restoresIncompressibleInput) {
+    std::string noise;
+    uint32_t state = 12345;
+    for (int i = 0; i < 200; ++i) {
+        state = state * 1103515245 + 12345;
+        noise += static_cast<char>(state >> 24);
+    }
+    roundTrip(noise);
+}
+
+TEST(PayloadCompression, restoresShortInputs) {
+    roundTrip("");
+    roundTrip("a");
+    roundTrip("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+}
+
+TEST(PayloadCompression, reportsOverflow) {
+    const std::string text(MQTT_MESSAGE_MAX_LENGTH / 2, 'x');
+    uint8_t tiny[2];
+    CHECK(encoder.compress(reinterpret_cast<const uint8_t*>(text.data()),
+                           text.size(), tiny, sizeof(tiny)) > sizeof(tiny));
+}
@@ -0,0 +1,142 @@
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "ReconnectBackoff.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <atomic>
+#include <memory>
+
+using namespace sensirion::upt::mqtt;
+
+TEST_GROUP(ReconnectBackoff){};
+
+TEST(ReconnectBackoff, doublesUpToTheMaximum) {
+    ReconnectBackoff backoff{100, 1000};
+    // The first attempt is not delayed
+    LONGS_EQUAL(0, backoff.nextDelayMs(50));
+    // The largest random value gives the full delay
+    LONGS_EQUAL(100, backoff.nextDelayMs(50));
+    LONGS_EQUAL(200, backoff.nextDelayMs(100));
+    LONGS_EQUAL(400, backoff.nextDelayMs(200));
+    LONGS_EQUAL(800, backoff.nextDelayMs(400));
+    LONGS_EQUAL(1000, backoff.nextDelayMs(500));
+    LONGS_EQUAL(1000, backoff.nextDelayMs(500));
+    LONGS_EQUAL(7, backoff.attempts());
+}
+
+TEST(ReconnectBackoff, randomizesByUpToOneHalf) {
+    ReconnectBackoff backoff{100, 1000};
+    for (uint32_t random = 0; random < 1000; ++random) {
+        backoff.reset();
+        for (int i = 0; i < 4; ++i) {
+            backoff.nextDelayMs(random);
+        }
+        const uint32_t delay = backoff.nextDelayMs(random);
+        CHECK(delay >= 400 && delay <= 800);
+    }
+}
+
+TEST(ReconnectBackoff, resetStartsFromTheMinimum) {
+    ReconnectBackoff backoff{100, 1000};
+    for (int i = 0; i < 10; ++i) {
+        backoff.nextDelayMs(0);
+    }
+    backoff.reset();
+    LONGS_EQUAL(0, backoff.attempts());
+    LONGS_EQUAL(0, backoff.nextDelayMs(0));
+    LONGS_EQUAL(50, backoff.nextDelayMs(0));
+}
+
+TEST(ReconnectBackoff, doesNotOverflowAfterManyAttempts) {
+    ReconnectBackoff backoff{500, 60000};
+    for (int i = 0; i < 100; ++i) {
+        backoff.nextDelayMs(0);
+    }
+    LONGS_EQUAL(60000, backoff.nextDelayMs(30000));
+    LONGS_EQUAL(30000, backoff.nextDelayMs(0));
+}
+
+TEST_GROUP(ReconnectOnWifiEvents) {
+    std::unique_ptr<mock::MockBroker> broker;
+    std::unique_ptr<MqttMailingService> service;
+    std::atomic<size_t> failures{0};
+
+    void setup() override {
+        WiFi.mockReset();
+        broker.reset(new mock::MockBroker{"broker.local"});
+        service.reset(new MqttMailingService);
+        service->setBrokerURI("mqtt://broker.local:1883");
+        // Called for every failed connection attempt as well
+        service->setConnectionCallback([this](bool connected) {
+            if (!connected) {
+                failures++;
+            }
+        });
+        // The application manages the Wi-Fi
+        WiFi.mockConnect();
+    }
+
+    void teardown() override {
+        service.reset();
+        broker.reset();
+        WiFi.mockReset();
+    }
+};
+
+TEST(ReconnectOnWifiEvents, firstAttemptIsNotDelayed) {
+    service->start();
+    CHECK(service->waitUntilConnected(2000));
+    const uint64_t startUs = mock::nowUs();
+    broker->disconnectAll();
+    CHECK(mock::waitUntil([this]() { return broker->connectCount() == 2; },
+                          2000));
+    // The first delay of the backoff would be at least half the minimum
+    CHECK(mock::nowUs() - startUs < MQTT_RECONNECT_MIN_DELAY_MS * 500);
+}
+
+TEST(ReconnectOnWifiEvents, applicationWifiConnectionEndsTheBackoff) {
+    broker->setAcceptConnections(false);
+    service->start();
+    // The delays reach the maximum after a few attempts
+    CHECK(mock::waitUntil([this]() { return failures >= 8; }, 5000));
+    const size_t failed = failures;
+    CHECK(mock::waitUntil([this, failed]() { return failures > failed; },
+                          2000));
+    // Right after a failure, the next attempt is half the maximum away
+    broker->setAcceptConnections(true);
+    const uint64_t startUs = mock::nowUs();
+    WiFi.mockEmit(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    CHECK(service->waitUntilConnected(2000));
+    CHECK(mock::nowUs() - startUs < MQTT_RECONNECT_MAX_DELAY_MS * 250);
+}
+
+TEST(ReconnectOnWifiEvents, applicationWifiIsNotReconnected) {
+    service->start();
+    CHECK(service->waitUntilConnected(2000));
+    LONGS_EQUAL(1, WiFi.mockHandlerCount());
+    WiFi.mockLoseConnection();
+    WiFi.mockFlushEvents();
+    mock::sleepMs(MQTT_RECONNECT_MAX_DELAY_MS);
+    LONGS_EQUAL(0, WiFi.mockReconnectCount());
+    LONGS_EQUAL(0, WiFi.mockBeginCount());
+
+    WiFi.mockConnect();
+    CHECK(service->waitUntilConnected(2000));
+    service.reset();
+    LONGS_EQUAL(0, WiFi.mockHandlerCount());
+}
+
+TEST(ReconnectOnWifiEvents, eventDeliveredAfterDestructionIsIgnored) {
+    service->start();
+    CHECK(service->waitUntilConnected(2000));
+    const size_t useAfterDelete = mock::useAfterDeleteCount();
+    WiFi.mockSetDeliveryDelayMs(100);
+    WiFi.mockEmit(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    // The handler is looked up, then the service is destroyed before the
+    // event task calls it
+    mock::sleepMs(20);
+    service.reset();
+    WiFi.mockFlushEvents();
+    LONGS_EQUAL(useAfterDelete, mock::useAfterDeleteCount());
+}
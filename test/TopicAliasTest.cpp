@@ -0,0 +1,232 @@
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "TopicAliasTable.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+// Size of the PUBLISH packet of a message
+size_t wireSize(const mock::BrokerMessage& message) {
+    size_t remaining = 2 + message.topic.size() + message.payload.size();
+    if (message.qos > 0) {
+        remaining += 2;  // packet identifier
+    }
+    size_t lengthBytes = 1;
+    for (size_t rest = remaining / 128; rest > 0; rest /= 128) {
+        lengthBytes++;
+    }
+    return 1 + lengthBytes + remaining;
+}
+
+}  // namespace
+
+TEST_GROUP(TopicAliasTable) {
+    TopicAliasTable table;
+    bool assigned = false;
+};
+
+TEST(TopicAliasTable, keepsAliasesAndActivatesThemPerConnection) {
+    LONGS_EQUAL(1, table.lookup("node/a/long/topic", assigned));
+    CHECK(assigned);
+    CHECK_FALSE(table.isActive(1));
+    table.setMappingPending(1, 17);
+    CHECK(table.isMappingPending(1));
+    CHECK_FALSE(table.acknowledge(18));
+    CHECK(table.acknowledge(17));
+    CHECK(table.isActive(1));
+    CHECK_FALSE(table.isMappingPending(1));
+
+    // A new connection: same alias, to be mapped again
+    table.deactivateAll();
+    LONGS_EQUAL(1, table.lookup("node/a/long/topic", assigned));
+    CHECK_FALSE(assigned);
+    CHECK_FALSE(table.isActive(1));
+    CHECK_FALSE(table.isMappingPending(1));
+}
+
+TEST(TopicAliasTable, assignsUpToTheMaximum) {
+    for (int i = 0; i < MQTT_TOPIC_ALIAS_MAX; ++i) {
+        LONGS_EQUAL(i + 1, table.lookup("topic/" + std::to_string(i),
+                                        assigned));
+    }
+    LONGS_EQUAL(0, table.lookup("one/more", assigned));
+    CHECK_FALSE(assigned);
+}
+
+TEST_GROUP(TopicAliases) {
+    std::unique_ptr<mock::MockBroker> broker;
+    std::unique_ptr<MqttMailingService> service;
+
+    void setup() override {
+        WiFi.mockReset();
+        broker.reset(new mock::MockBroker{"broker.local"});
+    }
+
+    void teardown() override {
+        service.reset();
+        broker.reset();
+        WiFi.mockReset();
+    }
+
+    void start(bool aliases) {
+        service.reset(new MqttMailingService);
+        service->setBrokerURI("mqtt://broker.local:1883");
+        service->setGlobalTopicPrefix("node/");
+        service->setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK, 1000);
+        if (aliases) {
+            TopicAliasConfig config;
+            config.enabled = true;
+            service->setTopicAliases(config);
+        }
+        service->startWithDelegatedWiFi("ssid", "pass");
+        CHECK(service->waitUntilConnected(2000));
+    }
+
+    void send(const std::string& suffix, size_t expectedMessages) {
+        CHECK(service->sendTextMessage("42", suffix));
+        CHECK(mock::waitUntil(
+            [this, expectedMessages]() {
+                return broker->messageCount() >= expectedMessages;
+            },
+            2000));
+    }
+
+    // Topics of the messages with the given payload
+    std::vector<std::string> topicsOf(const std::string& payload) {
+        std::vector<std::string> topics;
+        for (const auto& message : broker->messages()) {
+            if (message.payload == payload) {
+                topics.push_back(message.topic);
+            }
+        }
+        return topics;
+    }
+};
+
+TEST(TopicAliases, areDisabledByDefault) {
+    start(false);
+    send("building/floor/room/co2", 1);
+    LONGS_EQUAL(1, broker->messageCount());
+    STRCMP_EQUAL("node/building/floor/room/co2", broker->messages()[0].topic);
+}
+
+TEST(TopicAliases, useTheFullTopicUntilTheMappingIsAcknowledged) {
+    start(true);
+    const std::string topic = "node/building/floor/room/co2";
+    broker->setAckDelayUs(200000);
+    CHECK(service->sendTextMessage("42", "building/floor/room/co2"));
+    CHECK(service->sendTextMessage("42", "building/floor/room/co2"));
+    CHECK(mock::waitUntil(
+        [this]() { return topicsOf("42").size() == 2; }, 2000));
+    CHECK((topicsOf("42") == std::vector<std::string>{topic, topic}));
+    STRCMP_EQUAL(topic, broker->retained("node/alias/1"));
+
+    CHECK(mock::waitUntil(
+        [this]() { return service->getMetrics().topicAliases.mappings == 1; },
+        2000));
+    mock::sleepMs(300);
+    CHECK(service->sendTextMessage("42", "building/floor/room/co2"));
+    CHECK(mock::waitUntil(
+        [this]() { return topicsOf("42").size() == 3; }, 2000));
+    STRCMP_EQUAL("node/a/1", topicsOf("42")[2]);
+    LONGS_EQUAL(1, service->getMetrics().topicAliases.aliased);
+}
+
+TEST(TopicAliases, clearTheMappingsOfThePreviousBoot) {
+    // Retained by the previous firmware run
+    broker->inject("node/alias/1", "node/old/topic", 1, true);
+    broker->inject("node/alias/5", "node/other/topic", 1, true);
+    start(true);
+    send("building/floor/room/co2", 1);
+    CHECK(mock::waitUntil(
+        [this]() {
+            return broker->retained("node/alias/1") ==
+                   "node/building/floor/room/co2";
+        },
+        2000));
+    STRCMP_EQUAL("", broker->retained("node/alias/5"));
+}
+
+TEST(TopicAliases, keepTheirTopicAcrossReconnections) {
+    start(true);
+    for (const char* suffix : {"building/floor/room/co2",
+                               "building/floor/room/temperature"}) {
+        CHECK(service->sendTextMessage("mapping", suffix));
+    }
+    CHECK(mock::waitUntil(
+        [this]() { return service->getMetrics().topicAliases.mappings == 2; },
+        2000));
+    mock::sleepMs(50);
+
+    broker->disconnectAll();
+    CHECK(mock::waitUntil([this]() { return broker->connectCount() == 2; },
+                          2000));
+    CHECK(service->waitUntilConnected(2000));
+    // In the opposite order, the aliases do not change
+    for (const char* suffix : {"building/floor/room/temperature",
+                               "building/floor/room/co2"}) {
+        CHECK(service->sendTextMessage("remapping", suffix));
+    }
+    CHECK(mock::waitUntil(
+        [this]() { return service->getMetrics().topicAliases.mappings == 4; },
+        2000));
+    mock::sleepMs(50);
+    for (const char* suffix : {"building/floor/room/temperature",
+                               "building/floor/room/co2"}) {
+        CHECK(service->sendTextMessage("aliased", suffix));
+    }
+    CHECK(mock::waitUntil(
+        [this]() { return topicsOf("aliased").size() == 2; }, 2000));
+    CHECK((topicsOf("aliased") ==
+           std::vector<std::string>{"node/a/2", "node/a/1"}));
+    STRCMP_EQUAL("node/building/floor/room/co2",
+                 broker->retained("node/alias/1"));
+    STRCMP_EQUAL("node/building/floor/room/temperature",
+                 broker->retained("node/alias/2"));
+}
+
+TEST(TopicAliases, reduceTheBytesOnTheWire) {
+    const std::vector<std::string> suffixes = {
+        "building-7/floor-3/room-12/scd41/co2",
+        "building-7/floor-3/room-12/scd41/temperature",
+        "building-7/floor-3/room-12/scd41/humidity",
+        "building-7/floor-3/room-12/sen55/pm2p5"};
+    constexpr size_t kMessages = 400;
+    size_t bytes[2] = {};
+    for (const bool aliases : {false, true}) {
+        // One broker per run, registered under the same host
+        broker.reset();
+        broker.reset(new mock::MockBroker{"broker.local"});
+        start(aliases);
+        for (size_t i = 0; i < kMessages; ++i) {
+            CHECK(service->sendTextMessage(std::to_string(400 + i % 50),
+                                           suffixes[i % suffixes.size()]));
+            if (i == suffixes.size()) {
+                // let the mappings be acknowledged
+                mock::sleepMs(20);
+            }
+        }
+        CHECK(mock::waitUntil(
+            [this]() {
+                return service->getMailboxStatistics().sent == kMessages;
+            },
+            5000));
+        service.reset();
+        // Mappings and cleared mappings included
+        for (const auto& message : broker->messages()) {
+            bytes[aliases] += wireSize(message);
+        }
+    }
+    // About 40 of 55 bytes per message are the topic, aliases cut it to 8
+    CHECK_TEXT(bytes[1] * 10 < bytes[0] * 6,
+               (std::to_string(bytes[1]) + " of " + std::to_string(bytes[0]) +
+                " bytes")
+                   .c_str());
+}
@@ -0,0 +1,180 @@
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include "MqttMailingService.h"
+#include "TopicCache.h"
+#include "UnitTest.h"
+#include <WiFi.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+core::Measurement deviceMeasurement(uint64_t deviceID) {
+    core::Measurement measurement;
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.dataPoint.value = 400.0f;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    measurement.metaData.deviceID = deviceID;
+    return measurement;
+}
+
+std::string topicOf(uint64_t deviceID) {
+    return "node/SCD4X " + std::to_string(deviceID) + " CO2";
+}
+
+}  // namespace
+
+TEST_GROUP(TopicCache) {
+    TopicCache cache;
+    char topic[MQTT_TOPIC_MAX_LENGTH];
+};
+
+TEST(TopicCache, findsInsertedTopics) {
+    CHECK_FALSE(cache.find(deviceMeasurement(1), topic, sizeof(topic)));
+    CHECK(cache.insert(deviceMeasurement(1), topicOf(1).c_str()));
+    CHECK(cache.find(deviceMeasurement(1), topic, sizeof(topic)));
+    STRCMP_EQUAL(topicOf(1), topic);
+    // Another signal of the same device is another topic
+    core::Measurement humidity = deviceMeasurement(1);
+    humidity.signalType = core::SignalType::RELATIVE_HUMIDITY_PERCENTAGE;
+    CHECK_FALSE(cache.find(humidity, topic, sizeof(topic)));
+    // Too small a buffer is a miss
+    CHECK_FALSE(cache.find(deviceMeasurement(1), topic, 4));
+}
+
+TEST(TopicCache, isKeyedByTheDeviceTypeNotItsLabel) {
+    // Both unknown to deviceLabel, they share the label "UNDEFINED"
+    core::Measurement first = deviceMeasurement(1);
+    first.metaData.deviceType = core::DeviceType{7, 1};
+    core::Measurement second = deviceMeasurement(1);
+    second.metaData.deviceType = core::DeviceType{7, 2};
+    CHECK(cache.insert(first, "node/first"));
+    CHECK_FALSE(cache.find(second, topic, sizeof(topic)));
+    CHECK(cache.insert(second, "node/second"));
+    CHECK(cache.find(first, topic, sizeof(topic)));
+    STRCMP_EQUAL("node/first", std::string{topic});
+    CHECK(cache.find(second, topic, sizeof(topic)));
+    STRCMP_EQUAL("node/second", std::string{topic});
+}
+
+TEST(TopicCache, evictsTheLeastRecentlyUsed) {
+    for (uint64_t id = 0; id < MQTT_TOPIC_CACHE_SIZE; ++id) {
+        CHECK(cache.insert(deviceMeasurement(id), topicOf(id).c_str()));
+    }
+    // Device 0 is used again, device 1 is now the oldest
+    CHECK(cache.find(deviceMeasurement(0), topic, sizeof(topic)));
+    CHECK(cache.insert(deviceMeasurement(100), topicOf(100).c_str()));
+    CHECK(cache.find(deviceMeasurement(0), topic, sizeof(topic)));
+    CHECK_FALSE(cache.find(deviceMeasurement(1), topic, sizeof(topic)));
+    CHECK(cache.find(deviceMeasurement(100), topic, sizeof(topic)));
+}
+
+TEST(TopicCache, readersNeverSeeATornEntry) {
+    constexpr uint64_t kDevices = MQTT_TOPIC_CACHE_SIZE * 2;
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> mismatches{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&, r]() {
+            char found[MQTT_TOPIC_MAX_LENGTH];
+            uint64_t id = r;
+            while (!stop) {
+                id = (id + 7) % kDevices;
+                if (cache.find(deviceMeasurement(id), found, sizeof(found))) {
+                    hits++;
+                    if (topicOf(id) != found) {
+                        mismatches++;
+                    }
+                }
+            }
+        });
+    }
+    // A single writer, as serialized by the service, keeps evicting until
+    // the readers got enough hits
+    const uint64_t deadlineUs = mock::nowUs() + 5000000;
+    for (uint64_t round = 0; hits < 10000 && mock::nowUs() < deadlineUs;
+         ++round) {
+        const uint64_t id = round % kDevices;
+        cache.insert(deviceMeasurement(id), topicOf(id).c_str());
+    }
+    stop = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    CHECK(hits > 0);
+    LONGS_EQUAL(0, mismatches.load());
+}
+
+TEST_GROUP(TopicCacheStress) {
+    std::unique_ptr<mock::MockBroker> broker;
+    std::unique_ptr<MqttMailingService> service;
+
+    void setup() override {
+        WiFi.mockReset();
+        broker.reset(new mock::MockBroker{"broker.local"});
+        service.reset(new MqttMailingService);
+        service->setBrokerURI("mqtt://broker.local:1883");
+        service->setGlobalTopicPrefix("node/");
+        // The payload names the device, to check its topic
+        service->setMeasurementMessageFormatterFn(
+            [](const core::Measurement& m) {
+                return std::to_string(m.metaData.deviceID);
+            });
+        service->setMeasurementToTopicSuffixFn(
+            DefaultMeasurementToTopicSuffix{});
+        service->setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK,
+                                          10000);
+    }
+
+    void teardown() override {
+        service.reset();
+        broker.reset();
+        WiFi.mockReset();
+    }
+};
+
+TEST(TopicCacheStress, manyProducersGetTheTopicOfTheirDevice) {
+    // More devices than cached topics, so producers race with evictions
+    constexpr uint64_t kDevices = MQTT_TOPIC_CACHE_SIZE + 8;
+    constexpr int kProducers = 8;
+    constexpr int kPerProducer = 500;
+    service->startWithDelegatedWiFi("ssid", "pass");
+    CHECK(service->waitUntilConnected(2000));
+
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < kPerProducer; ++i) {
+                const uint64_t id = (p * 3 + i) % kDevices;
+                if (!service->sendMeasurement(deviceMeasurement(id))) {
+                    failures++;
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    LONGS_EQUAL(0, failures.load());
+    const size_t expected = kProducers * kPerProducer;
+    CHECK(mock::waitUntil(
+        [this, expected]() { return broker->messageCount() == expected; },
+        10000));
+
+    std::map<std::string, size_t> perDevice;
+    for (const auto& message : broker->messages()) {
+        const uint64_t id = std::stoull(message.payload);
+        CHECK_TEXT(message.topic == topicOf(id), message.topic.c_str());
+        perDevice[message.payload]++;
+    }
+    LONGS_EQUAL(kDevices, perDevice.size());
+}
@@ -0,0 +1,57 @@
+#include "TopicFilterTrie.h"
+#include "UnitTest.h"
+#include <algorithm>
+#include <vector>
+
+using namespace sensirion::upt::mqtt;
+
+TEST_GROUP(TopicFilterTrie) {
+    TopicFilterTrie trie;
+
+    std::vector<uint16_t> match(const char* topic) {
+        uint16_t ids[16];
+        const size_t count = trie.match(topic, ids, 16);
+        std::vector<uint16_t> result{ids, ids + std::min<size_t>(count, 16)};
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+};
+
+TEST(TopicFilterTrie, validatesFilters) {
+    CHECK(TopicFilterTrie::isValidFilter("a/b"));
+    CHECK(TopicFilterTrie::isValidFilter("a/+/c"));
+    CHECK(TopicFilterTrie::isValidFilter("a/#"));
+    CHECK(TopicFilterTrie::isValidFilter("#"));
+    CHECK_FALSE(TopicFilterTrie::isValidFilter(""));
+    CHECK_FALSE(TopicFilterTrie::isValidFilter("a/#/c"));
+    CHECK_FALSE(TopicFilterTrie::isValidFilter("a/b+"));
+    CHECK_FALSE(TopicFilterTrie::isValidFilter("a#"));
+}
+
+TEST(TopicFilterTrie, matchesExactAndWildcardFilters) {
+    CHECK(trie.insert("home/kitchen/co2", 1));
+    CHECK(trie.insert("home/+/co2", 2));
+    CHECK(trie.insert("home/#", 3));
+    CHECK(trie.insert("office/#", 4));
+    CHECK((match("home/kitchen/co2") == std::vector<uint16_t>{1, 2, 3}));
+    CHECK((match("home/bath/co2") == std::vector<uint16_t>{2, 3}));
+    CHECK((match("home") == std::vector<uint16_t>{3}));
+    CHECK((match("home/kitchen/co2/raw") == std::vector<uint16_t>{3}));
+    CHECK(match("garden/co2").empty());
+}
+
+TEST(TopicFilterTrie, plusMatchesEmptyLevels) {
+    CHECK(trie.insert("a/+/c", 1));
+    CHECK((match("a//c") == std::vector<uint16_t>{1}));
+    CHECK(match("a/c").empty());
+}
+
+TEST(TopicFilterTrie, removesFilters) {
+    CHECK(trie.insert("a/+", 1));
+    CHECK(trie.insert("a/+", 2));
+    CHECK(trie.remove("a/+", 1));
+    CHECK_FALSE(trie.remove("a/+", 1));
+    CHECK((match("a/b") == std::vector<uint16_t>{2}));
+    trie.clear();
+    CHECK(match("a/b").empty());
+}
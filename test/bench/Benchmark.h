@@ -0,0 +1,81 @@
+/**
+ * Helpers of the host benchmarks: latency percentiles, heap allocations per
+ * operation and a common report line. The benchmarks print their results
+ * and fail (return 1) only if the library misbehaved, e.g. lost messages.
+ */
+#ifndef UPT_MQTT_BENCHMARK_H
+#define UPT_MQTT_BENCHMARK_H
+
+#include "MockSupport.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace bench {
+
+struct RunResult {
+    double messagesPerSecond = 0;
+    int64_t p50Us = 0;
+    int64_t p90Us = 0;
+    int64_t p99Us = 0;
+    double allocationsPerMessage = 0;
+};
+
+/**
+ * Returns the given percentile of latencies, sorting them
+ */
+inline int64_t percentile(std::vector<int64_t>& latencies, unsigned percent) {
+    if (latencies.empty()) {
+        return 0;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies[std::min(latencies.size() - 1,
+                              latencies.size() * percent / 100)];
+}
+
+/**
+ * Calls sendFn count times and waits until done() holds, e.g. until the
+ * sender task has handed all messages over to the ESP MQTT client. The
+ * latencies are those of the send calls, the allocations those of the
+ * library while sending (the mocks do not count).
+ *
+ * @return false if done() did not hold within timeoutMs
+ */
+template <typename SendFn, typename DoneFn>
+bool run(size_t count, SendFn sendFn, DoneFn done, RunResult& result,
+         uint32_t timeoutMs = 30000) {
+    std::vector<int64_t> latencies(count);
+    const uint64_t allocationsBefore = mock::allocationCount();
+    const uint64_t start = mock::nowUs();
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t callStart = mock::nowUs();
+        sendFn(i);
+        latencies[i] = static_cast<int64_t>(mock::nowUs() - callStart);
+    }
+    const bool completed = mock::waitUntil(done, timeoutMs);
+    const uint64_t allocations = mock::allocationCount() - allocationsBefore;
+    const uint64_t elapsedUs = std::max<uint64_t>(1, mock::nowUs() - start);
+
+    result.messagesPerSecond = count * 1e6 / elapsedUs;
+    result.p50Us = percentile(latencies, 50);
+    result.p90Us = percentile(latencies, 90);
+    result.p99Us = percentile(latencies, 99);
+    result.allocationsPerMessage = static_cast<double>(allocations) / count;
+    return completed;
+}
+
+inline void print(const char* name, const RunResult& result) {
+    std::printf("%-28s %10.0f msg/s  p50 %5lld us  p90 %5lld us  p99 %5lld "
+                "us  %5.2f alloc/msg\n",
+                name, result.messagesPerSecond,
+                static_cast<long long>(result.p50Us),
+                static_cast<long long>(result.p90Us),
+                static_cast<long long>(result.p99Us),
+                result.allocationsPerMessage);
+    std::fflush(stdout);
+}
+
+}  // namespace bench
+
+#endif /* UPT_MQTT_BENCHMARK_H */
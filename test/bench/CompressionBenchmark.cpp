@@ -0,0 +1,196 @@
+/**
+ * Compression of the payloads published by the library: for each kind of
+ * payload the compression ratio, the CPU time per KB to compress and to
+ * inflate it, and the bytes saved per message, marker included. Then
+ * batches published through MqttMailingService with compression enabled,
+ * reporting the bytes saved on the link from the metrics.
+ *
+ * Fails if a payload does not inflate to the original, if compressing
+ * allocates or if the broker did not receive every batch.
+ */
+#include "Benchmark.h"
+#include "CborMeasurementFormatting.hpp"
+#include "MeasurementBatch.h"
+#include "MockBroker.h"
+#include "MqttMailingService.h"
+#include "PayloadCompression.h"
+#include <MeasurementFormatting.hpp>
+#include <WiFi.h>
+#include <cstring>
+#include <string>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+constexpr size_t kIterations = 5000;
+constexpr size_t kPublishedBatches = 200;
+constexpr size_t kMeasurementsPerBatch = 10;
+// Marker of CompressionConfig::topicSuffix ("/hs") or of the content header
+constexpr size_t kMarkerBytes = sizeof(kCompressedPayloadHeader);
+
+HeatshrinkEncoder encoder;
+uint8_t compressed[MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH];
+uint8_t inflated[MQTT_COMPRESSION_MAX_PAYLOAD_LENGTH];
+
+core::Measurement sampleMeasurement() {
+    core::Measurement measurement;
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.dataPoint.value = 412.5f;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    measurement.metaData.deviceID = 0x123456789aULL;
+    return measurement;
+}
+
+// A full batch, as closed by the size limit
+std::string fullBatch(BatchMode mode) {
+    MeasurementBatch batch;
+    core::Measurement m = sampleMeasurement();
+    batch.open("benchmark/batch", m, mode, 0);
+    for (uint32_t i = 1; batch.append(m, MQTT_BATCH_MAX_LENGTH - 1); ++i) {
+        m.dataPoint.t_offset += 5000;
+        m.dataPoint.value += 1.5f;
+        if (mode == BatchMode::ACROSS_TOPICS) {
+            m.signalType = i % 2 ? core::SignalType::TEMPERATURE_DEGREES_CELSIUS
+                                 : core::SignalType::CO2_PARTS_PER_MILLION;
+            m.metaData.deviceID = 0x123456789aULL + i % 3;
+        }
+    }
+    batch.close();
+    return std::string{batch.payload(), batch.length()};
+}
+
+std::string jsonMeasurement() {
+    char buffer[MQTT_MESSAGE_MAX_LENGTH];
+    const size_t length = FullMeasurementFormatter{}(sampleMeasurement(),
+                                                     buffer, sizeof(buffer));
+    return std::string{buffer, length};
+}
+
+std::string cborMeasurement() {
+    uint8_t buffer[MQTT_MESSAGE_MAX_LENGTH];
+    const size_t length = CborMeasurementFormatter{}(sampleMeasurement(),
+                                                     buffer, sizeof(buffer));
+    return std::string{reinterpret_cast<const char*>(buffer), length};
+}
+
+bool benchmark(const char* name, const std::string& payload) {
+    const auto* input = reinterpret_cast<const uint8_t*>(payload.data());
+    size_t length = 0;
+    const uint64_t allocationsBefore = mock::allocationCount();
+    uint64_t start = mock::nowUs();
+    for (size_t i = 0; i < kIterations; ++i) {
+        length = encoder.compress(input, payload.size(), compressed,
+                                  sizeof(compressed));
+    }
+    const uint64_t compressUs = mock::nowUs() - start;
+    const uint64_t allocations = mock::allocationCount() - allocationsBefore;
+    if (length > sizeof(compressed)) {
+        std::printf("%s: does not fit the compression buffer\n", name);
+        return false;
+    }
+
+    size_t restored = 0;
+    start = mock::nowUs();
+    for (size_t i = 0; i < kIterations; ++i) {
+        restored = HeatshrinkDecoder::decompress(compressed, length, inflated,
+                                                 sizeof(inflated));
+    }
+    const uint64_t inflateUs = mock::nowUs() - start;
+
+    const double kilobytes = kIterations * payload.size() / 1024.0;
+    // Published uncompressed unless smaller with the marker
+    const size_t published = std::min(payload.size(), length + kMarkerBytes);
+    std::printf("%-28s %4zu -> %4zu bytes (%3.0f %%)  compress %6.2f us/KB  "
+                "inflate %5.2f us/KB  saves %3zu bytes/message\n",
+                name, payload.size(), length, 100.0 * length / payload.size(),
+                compressUs / kilobytes, inflateUs / kilobytes,
+                payload.size() - published);
+    if (restored != payload.size() ||
+        std::memcmp(inflated, payload.data(), restored) != 0 ||
+        allocations != 0) {
+        std::printf("%s: %zu of %zu bytes restored, %zu allocations\n", name,
+                    restored, payload.size(), static_cast<size_t>(allocations));
+        return false;
+    }
+    return true;
+}
+
+bool benchmarkPublishedBatches() {
+    mock::MockBroker broker{"broker.local"};
+    MqttMailingService service;
+    service.setBrokerURI("mqtt://broker.local:1883");
+    service.setGlobalTopicPrefix("benchmark/");
+    service.setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK, 1000);
+    service.setMeasurementBufferFormatterFn(FullMeasurementFormatter{});
+    service.setMeasurementToTopicSuffixFn(MeasurementToTopicSuffixTree{});
+    BatchConfig batching;
+    batching.mode = BatchMode::PER_TOPIC;
+    batching.maxCount = kMeasurementsPerBatch;
+    batching.maxAgeMs = 60000;
+    service.setBatching(batching);
+    CompressionConfig compression;
+    compression.enabled = true;
+    service.setCompression(compression);
+    service.startWithDelegatedWiFi("ssid", "pass", true);
+
+    core::Measurement m = sampleMeasurement();
+    const uint64_t start = mock::nowUs();
+    for (size_t i = 0; i < kPublishedBatches * kMeasurementsPerBatch; ++i) {
+        m.dataPoint.t_offset = static_cast<uint32_t>(i * 5000);
+        m.dataPoint.value = 400.0f + i % 50;
+        service.sendMeasurement(m);
+    }
+    const bool done = mock::waitUntil(
+        [&broker]() { return broker.messageCount() == kPublishedBatches; },
+        10000);
+    const uint64_t elapsedUs = mock::nowUs() - start;
+
+    const CompressionStatistics stats = service.getMetrics().compression;
+    size_t inflatedBytes = 0;
+    bool restored = done && stats.compressed == kPublishedBatches;
+    for (const auto& message : broker.messages()) {
+        const size_t length = HeatshrinkDecoder::decompress(
+            reinterpret_cast<const uint8_t*>(message.payload.data()),
+            message.payload.size(), inflated, sizeof(inflated));
+        // Marked by the topic suffix "/hs"
+        const size_t suffix = message.topic.rfind("/hs");
+        restored = restored && length <= sizeof(inflated) &&
+                   suffix == message.topic.size() - 3;
+        inflatedBytes += length;
+    }
+    std::printf("%-28s %zu batches  %u -> %u bytes  saved %u bytes "
+                "(%.0f bytes/batch)  %.1f ms\n",
+                "published batches", broker.messageCount(),
+                static_cast<unsigned>(stats.uncompressedBytes),
+                static_cast<unsigned>(stats.compressedBytes),
+                static_cast<unsigned>(stats.uncompressedBytes -
+                                      stats.compressedBytes),
+                static_cast<double>(stats.uncompressedBytes -
+                                    stats.compressedBytes) /
+                    std::max<uint32_t>(1, stats.compressed),
+                elapsedUs / 1000.0);
+    if (!restored || inflatedBytes != stats.uncompressedBytes) {
+        std::printf("published batches: %zu of %zu received, %zu of %u bytes "
+                    "restored\n",
+                    broker.messageCount(), kPublishedBatches, inflatedBytes,
+                    static_cast<unsigned>(stats.uncompressedBytes));
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool passed = true;
+    passed &= benchmark("JSON measurement", jsonMeasurement());
+    passed &= benchmark("CBOR measurement", cborMeasurement());
+    passed &=
+        benchmark("JSON batch, per topic", fullBatch(BatchMode::PER_TOPIC));
+    passed &= benchmark("JSON batch, across topics",
+                        fullBatch(BatchMode::ACROSS_TOPICS));
+    passed &= benchmarkPublishedBatches();
+    return passed ? 0 : 1;
+}
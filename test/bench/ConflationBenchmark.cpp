@@ -0,0 +1,185 @@
+/**
+ * Host counterpart of examples/conflationBenchmark: measurements of 16
+ * devices are sent faster than the link publishes them. The link is
+ * throttled by QoS 1, an in-flight window of 2 messages and the delayed
+ * acknowledgements of the in-process broker.
+ *
+ * The same overload runs with conflation and with the plain mailbox
+ * (DROP_OLDEST), of default depth and deep. For each it reports the
+ * published, conflated and dropped samples, the p50, p99 and maximum age of
+ * the values received by the broker, and the memory holding the backlog:
+ * the high-water mark of the message pool plus the conflation slots in use,
+ * in blocks and bytes.
+ *
+ * Fails if the last value of a device does not reach the broker, all modes
+ * must publish it once the overload ends.
+ */
+#include "Benchmark.h"
+#include "MockBroker.h"
+#include "MqttMailingService.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+constexpr size_t kDeviceCount = 16;
+constexpr uint32_t kSamplesPerSecond = 2000;
+constexpr uint32_t kRunDurationMs = 3000;
+// With a window of 2, at most about 400 messages per second
+constexpr size_t kInFlightWindow = 2;
+constexpr uint32_t kAckDelayUs = 5000;
+constexpr uint32_t kDrainTimeoutMs = 10000;
+constexpr const char* kPrefix = "benchmark/conflation/";
+
+struct Mode {
+    const char* name;
+    bool conflation;
+    size_t mailboxDepth;
+};
+
+constexpr Mode kModes[] = {
+    {"conflation", true, MQTT_MAILBOX_DEPTH},
+    {"mailbox", false, MQTT_MAILBOX_DEPTH},
+    {"deep mailbox", false, 256},
+};
+
+/**
+ * Values received by the broker, with the payload {"t":<send time ms>,
+ * "v":<sequence number>} on the topic <prefix><deviceID>/<quantity>
+ */
+class Receiver {
+  public:
+    void start() {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mAgesUs.clear();
+        mLastSequence.assign(kDeviceCount, -1);
+    }
+
+    void onMessage(const mock::BrokerMessage& message) {
+        unsigned device = 0;
+        unsigned sentMs = 0;
+        float sequence = 0;
+        if (std::sscanf(message.topic.c_str() + std::strlen(kPrefix), "%u/",
+                        &device) != 1 ||
+            std::sscanf(message.payload.c_str(), "{\"t\":%u,\"v\":%f}",
+                        &sentMs, &sequence) != 2 ||
+            device >= kDeviceCount) {
+            return;
+        }
+        const int64_t ageUs = static_cast<int64_t>(
+            mock::nowUs() - static_cast<uint64_t>(sentMs) * 1000);
+        std::lock_guard<std::mutex> lock{mMutex};
+        mAgesUs.push_back(ageUs);
+        mLastSequence[device] =
+            std::max(mLastSequence[device], static_cast<long>(sequence));
+    }
+
+    bool hasReceived(const std::vector<long>& lastSent) {
+        std::lock_guard<std::mutex> lock{mMutex};
+        return mLastSequence == lastSent;
+    }
+
+    std::vector<int64_t> agesUs() {
+        std::lock_guard<std::mutex> lock{mMutex};
+        return mAgesUs;
+    }
+
+  private:
+    std::mutex mMutex;
+    std::vector<int64_t> mAgesUs;
+    std::vector<long> mLastSequence;
+};
+
+Receiver receiver;
+
+bool runOverload(mock::MockBroker& broker, const Mode& mode) {
+    MqttMailingService service;
+    service.setBrokerURI("mqtt://broker.local:1883");
+    service.setGlobalTopicPrefix(kPrefix);
+    service.setQOS(1);
+    service.setInFlightWindow(kInFlightWindow);
+    service.setMeasurementTemplate(R"({"t":{t_offset},"v":{value:.1f}})");
+    service.setTopicSuffixTemplate("{deviceID}/{quantity}");
+    service.setConflation(mode.conflation);
+    service.setMailboxDepth(mode.mailboxDepth);
+    service.startWithDelegatedWiFi("ssid", "pass", true);
+    if (!service.isReady()) {
+        std::printf("not connected to the mocked broker\n");
+        return false;
+    }
+    broker.setAckDelayUs(kAckDelayUs);
+    receiver.start();
+
+    core::Measurement m{core::MetaData{core::SCD4X()},
+                        core::SignalType::CO2_PARTS_PER_MILLION,
+                        core::DataPoint{0, 0.0f}};
+    std::vector<long> lastSent(kDeviceCount, -1);
+    uint32_t maxPending = 0;
+    const uint32_t intervalUs = 1000000 / kSamplesPerSecond;
+    const uint64_t start = mock::nowUs();
+    long samples = 0;
+    while (mock::nowUs() - start < kRunDurationMs * 1000ULL) {
+        const size_t device = samples % kDeviceCount;
+        m.metaData.deviceID = device;
+        m.dataPoint.t_offset = static_cast<uint32_t>(mock::nowUs() / 1000);
+        m.dataPoint.value = static_cast<float>(samples);
+        service.sendMeasurement(m);
+        lastSent[device] = samples;
+        samples++;
+        if (samples % 100 == 0) {
+            maxPending =
+                std::max(maxPending, service.getMetrics().conflation.pending);
+        }
+        const uint64_t next = start + samples * intervalUs;
+        const uint64_t now = mock::nowUs();
+        if (next > now + 1000) {
+            mock::sleepMs(static_cast<uint32_t>((next - now) / 1000));
+        }
+    }
+    const bool drained = mock::waitUntil(
+        [&lastSent]() { return receiver.hasReceived(lastSent); },
+        kDrainTimeoutMs);
+    broker.setAckDelayUs(0);
+
+    const MqttMetrics metrics = service.getMetrics();
+    std::vector<int64_t> agesUs = receiver.agesUs();
+    const size_t blocks = metrics.pool.highWaterMark + maxPending;
+    std::printf("%-12s %6ld samples  %5zu published  %5u conflated  "
+                "%5u dropped  age p50 %7lld us  p99 %7lld us  max %7lld us  "
+                "backlog %3zu blocks (%zu bytes)\n",
+                mode.name, samples, agesUs.size(),
+                static_cast<unsigned>(metrics.conflation.conflated),
+                static_cast<unsigned>(metrics.mailbox.dropped),
+                static_cast<long long>(bench::percentile(agesUs, 50)),
+                static_cast<long long>(bench::percentile(agesUs, 99)),
+                static_cast<long long>(bench::percentile(agesUs, 100)), blocks,
+                blocks * sizeof(MailboxMessage));
+    std::fflush(stdout);
+    if (!drained) {
+        std::printf("%s: the last value of a device was not published\n",
+                    mode.name);
+    }
+    return drained;
+}
+
+}  // namespace
+
+int main() {
+    mock::MockBroker broker{"broker.local"};
+    broker.setRecordMessages(false);
+    broker.setObserver([](const mock::BrokerMessage& message) {
+        receiver.onMessage(message);
+    });
+
+    bool passed = true;
+    for (const Mode& mode : kModes) {
+        passed &= runOverload(broker, mode);
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+/**
+ * Host counterpart of examples/endToEndBenchmark: numbered messages go from
+ * sendPayload through the mocked ESP MQTT client to the in-process broker,
+ * which is observed directly rather than through a subscription round trip.
+ * For each scenario it reports the rate at which the broker received the
+ * messages, the p50, p99 and maximum latency from sendPayload to the broker,
+ * and the lost and duplicated messages.
+ *
+ * Scenarios:
+ * - sustained: a steady rate below the capacity of the link
+ * - burst: all messages sent back to back, limited by the mailbox
+ * - broker stall: a steady rate while the broker holds messages and
+ *   acknowledgements for a while, as a broker pausing under load
+ * - reconnect storm: a steady rate while the broker drops the connection
+ *   again and again, the messages are held in the store until reconnected
+ *
+ * Stalls and disconnections are driven by a thread of their own, they go on
+ * while sendPayload blocks. Duplicates are the QoS 1 messages sent again
+ * after a reconnection.
+ *
+ * Fails if a message is lost: all are sent with QoS 1 and a message store.
+ */
+#include "Benchmark.h"
+#include "MessageStore.h"
+#include "MockBroker.h"
+#include "MqttMailingService.h"
+#include <WiFi.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+constexpr uint32_t kDrainTimeoutMs = 5000;
+
+struct Scenario {
+    const char* name;
+    size_t messages;
+    // Time between two messages, 0 to send them back to back
+    uint32_t intervalUs;
+    // Time after which the broker stalls, and for how long, 0 for no stall
+    uint32_t stallAfterMs;
+    uint32_t stallForMs;
+    // Time between two dropped connections, 0 to keep the connection
+    uint32_t disconnectEveryMs;
+};
+
+constexpr Scenario kScenarios[] = {
+    {"sustained 2000 msg/s", 4000, 500, 0, 0, 0},
+    {"burst", 4000, 0, 0, 0, 0},
+    {"broker stall 500 ms", 4000, 500, 500, 500, 0},
+    {"reconnect storm", 4000, 500, 0, 0, 250},
+};
+
+/**
+ * Messages of the running scenario as received by the broker, with the
+ * payload "<run>,<sequence>,<send time us>"
+ */
+class Receiver {
+  public:
+    void start(unsigned run, size_t messages) {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mRun = run;
+        mReceived.assign(messages, false);
+        mLatenciesUs.clear();
+        mDuplicates = 0;
+        mLastReceiveUs = mock::nowUs();
+    }
+
+    void onMessage(std::string_view payload) {
+        const std::string text{payload};
+        unsigned run = 0;
+        size_t sequence = 0;
+        unsigned long long sentUs = 0;
+        if (std::sscanf(text.c_str(), "%u,%zu,%llu", &run, &sequence,
+                        &sentUs) != 3) {
+            return;
+        }
+        const uint64_t now = mock::nowUs();
+        std::lock_guard<std::mutex> lock{mMutex};
+        if (run != mRun || sequence >= mReceived.size()) {
+            return;
+        }
+        if (mReceived[sequence]) {
+            mDuplicates++;
+            return;
+        }
+        mReceived[sequence] = true;
+        mLatenciesUs.push_back(static_cast<int64_t>(now - sentUs));
+        mLastReceiveUs = now;
+    }
+
+    size_t receivedCount() {
+        std::lock_guard<std::mutex> lock{mMutex};
+        return mLatenciesUs.size();
+    }
+
+    uint64_t lastReceiveUs() {
+        std::lock_guard<std::mutex> lock{mMutex};
+        return mLastReceiveUs;
+    }
+
+    // Ends the run, late messages are ignored from now on
+    void stop(std::vector<int64_t>& latenciesUs, size_t& duplicates) {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mRun = 0;
+        latenciesUs = mLatenciesUs;
+        duplicates = mDuplicates;
+    }
+
+  private:
+    std::mutex mMutex;
+    unsigned mRun = 0;
+    std::vector<bool> mReceived;
+    std::vector<int64_t> mLatenciesUs;
+    size_t mDuplicates = 0;
+    uint64_t mLastReceiveUs = 0;
+};
+
+Receiver receiver;
+
+// Stalls the broker and drops its connections as set by the scenario, until
+// sending is done
+void disrupt(mock::MockBroker& broker, const Scenario& scenario,
+             const std::atomic<bool>& sending) {
+    if (scenario.stallForMs > 0) {
+        mock::sleepMs(scenario.stallAfterMs);
+        broker.setStalled(true);
+        mock::sleepMs(scenario.stallForMs);
+        broker.setStalled(false);
+    }
+    while (scenario.disconnectEveryMs > 0 && sending) {
+        mock::sleepMs(scenario.disconnectEveryMs);
+        // The service reconnects by itself
+        broker.disconnectAll();
+    }
+}
+
+bool runScenario(MqttMailingService& service, mock::MockBroker& broker,
+                 unsigned run, const Scenario& scenario) {
+    service.waitUntilConnected(5000);
+    receiver.start(run, scenario.messages);
+
+    const uint64_t start = mock::nowUs();
+    std::atomic<bool> sending{true};
+    std::thread disruptor{disrupt, std::ref(broker), std::cref(scenario),
+                          std::cref(sending)};
+    size_t rejected = 0;
+    for (size_t i = 0; i < scenario.messages; ++i) {
+        char payload[48];
+        const int length = std::snprintf(
+            payload, sizeof(payload), "%u,%zu,%llu", run, i,
+            static_cast<unsigned long long>(mock::nowUs()));
+        if (!service.sendPayload(
+                std::string_view{payload, static_cast<size_t>(length)},
+                "load")) {
+            rejected++;
+        }
+
+        if (scenario.intervalUs > 0) {
+            const uint64_t next = start + (i + 1) * scenario.intervalUs;
+            const uint64_t after = mock::nowUs();
+            if (next > after + 1000) {
+                mock::sleepMs(static_cast<uint32_t>((next - after) / 1000));
+            }
+        }
+    }
+    sending = false;
+    disruptor.join();
+
+    // Wait for the stragglers
+    while (receiver.receivedCount() < scenario.messages &&
+           mock::nowUs() - receiver.lastReceiveUs() <
+               kDrainTimeoutMs * 1000ULL) {
+        mock::sleepMs(10);
+    }
+    std::vector<int64_t> latenciesUs;
+    size_t duplicates = 0;
+    receiver.stop(latenciesUs, duplicates);
+
+    const size_t received = latenciesUs.size();
+    const uint64_t elapsedUs =
+        std::max<uint64_t>(1, receiver.lastReceiveUs() - start);
+    const size_t lost = scenario.messages - received;
+    std::printf("%-24s %8.0f msg/s  p50 %6lld us  p99 %6lld us  "
+                "max %6lld us  lost %zu/%zu  duplicates %zu\n",
+                scenario.name, received * 1e6 / elapsedUs,
+                static_cast<long long>(bench::percentile(latenciesUs, 50)),
+                static_cast<long long>(bench::percentile(latenciesUs, 99)),
+                static_cast<long long>(bench::percentile(latenciesUs, 100)),
+                lost, scenario.messages, duplicates);
+    std::fflush(stdout);
+    if (lost > 0 || rejected > 0) {
+        std::printf("%s: %zu lost, %zu rejected by the mailbox\n",
+                    scenario.name, lost, rejected);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    mock::MockBroker broker{"broker.local"};
+    broker.setRecordMessages(false);
+    RamMessageStore messageStore{64};
+
+    MqttMailingService service;
+    service.setBrokerURI("mqtt://broker.local:1883");
+    service.setGlobalTopicPrefix("benchmark/e2e/");
+    service.setQOS(1);
+    service.setMessageStore(&messageStore);
+    service.setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK, 1000);
+    broker.setObserver([](const mock::BrokerMessage& message) {
+        receiver.onMessage(message.payload);
+    });
+    service.startWithDelegatedWiFi("ssid", "pass", true);
+    if (!service.isReady()) {
+        std::printf("not connected to the mocked broker\n");
+        return 1;
+    }
+
+    bool passed = true;
+    unsigned run = 0;
+    for (const Scenario& scenario : kScenarios) {
+        passed &= runScenario(service, broker, ++run, scenario);
+    }
+    const MqttMetrics metrics = service.getMetrics();
+    std::printf("reconnects %u, max time to reconnect %u ms\n",
+                static_cast<unsigned>(metrics.reconnects),
+                static_cast<unsigned>(metrics.maxTimeToReconnectMs));
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+/**
+ * Time and heap allocations per measurement of the provided formatters and
+ * topic suffix functions, against a reference copy of the std::stringstream
+ * implementation they replaced (precision(4), as released in 0.4.1).
+ *
+ * It also prints sample values in both formats: the values are now printed
+ * with MQTT_FORMATTER_VALUE_DECIMALS fixed decimals, e.g. 0.0012 became
+ * "0.00" (see the [BREAKING] entry of the changelog).
+ */
+#include "Benchmark.h"
+#include <MeasurementFormatting.hpp>
+#include <sstream>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+constexpr size_t kIterations = 200000;
+
+// The formatters before the buffer formatter engine, unchanged
+struct StreamMeasurementFormatter {
+    std::string operator()(const core::Measurement& m) const {
+        std::stringstream stream{};
+        stream.precision(4);
+        stream << "{\"time_offset_ms\":";
+        stream << m.dataPoint.t_offset;
+        stream << ", \"value\":";
+        stream << m.dataPoint.value;
+        stream << ", \"device_id\":";
+        stream << m.metaData.deviceID;
+        stream << ", \"device_type\":\"";
+        stream << m.metaData.deviceType;
+        stream << "\", \"signal\":\"";
+        stream << quantityOf(m.signalType);
+        stream << "\", \"signal_unit\":\"";
+        stream << unitOf(m.signalType);
+        stream << "\"}";
+        return stream.str();
+    }
+};
+
+struct StreamMeasurementToTopicSuffixTree {
+    std::string operator()(const core::Measurement& m) const {
+        std::stringstream stream{};
+        stream << core::deviceLabel(m.metaData.deviceType);
+        stream << "/" << m.metaData.deviceID << "/"
+               << core::quantityOf(m.signalType);
+        return stream.str();
+    }
+};
+
+core::Measurement measurement;
+
+template <typename FormatFn>
+void benchmark(const char* name, FormatFn formatFn) {
+    size_t totalLength = 0;
+    const uint64_t allocationsBefore = mock::allocationCount();
+    const uint64_t start = mock::nowUs();
+    for (size_t i = 0; i < kIterations; ++i) {
+        measurement.dataPoint.t_offset = static_cast<uint32_t>(i);
+        totalLength += formatFn();
+    }
+    const uint64_t elapsedUs = mock::nowUs() - start;
+    std::printf("%-40s %7.1f ns/measurement  %5.2f alloc/measurement  "
+                "(%zu bytes)\n",
+                name, elapsedUs * 1000.0 / kIterations,
+                static_cast<double>(mock::allocationCount() -
+                                    allocationsBefore) /
+                    kIterations,
+                totalLength / kIterations);
+}
+
+}  // namespace
+
+int main() {
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.dataPoint.value = 412.5f;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    measurement.metaData.deviceID = 0x123456789aULL;
+
+    char buffer[MQTT_MESSAGE_MAX_LENGTH];
+    benchmark("stringstream reference (before)", []() {
+        return StreamMeasurementFormatter{}(measurement).size();
+    });
+    benchmark("FullMeasurementFormatter (string)", []() {
+        return FullMeasurementFormatter{}(measurement).size();
+    });
+    benchmark("FullMeasurementFormatter (buffer)", [&buffer]() {
+        return FullMeasurementFormatter{}(measurement, buffer,
+                                          sizeof(buffer));
+    });
+    benchmark("stringstream topic suffix (before)", []() {
+        return StreamMeasurementToTopicSuffixTree{}(measurement).size();
+    });
+    benchmark("MeasurementToTopicSuffixTree (buffer)", [&buffer]() {
+        return MeasurementToTopicSuffixTree{}(measurement, buffer,
+                                              sizeof(buffer));
+    });
+
+    std::printf("\n%-12s %-14s %s\n", "value", "before", "now");
+    bool passed = true;
+    for (const float value : {412.5f, 21.37f, 0.0012f, 123456.0f, -3.14159f}) {
+        measurement.dataPoint.value = value;
+        const std::string before = StreamMeasurementFormatter{}(measurement);
+        const std::string now = FullMeasurementFormatter{}(measurement);
+        const auto valueOf = [](const std::string& json) {
+            const size_t start = json.find("\"value\":") + 8;
+            return json.substr(start, json.find(',', start) - start);
+        };
+        std::printf("%-12g %-14s %s\n", value, valueOf(before).c_str(),
+                    valueOf(now).c_str());
+        // Same document apart from the value
+        passed = passed && before.substr(0, before.find("\"value\":")) ==
+                               now.substr(0, now.find("\"value\":"));
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+/**
+ * Host counterpart of examples/throughputBenchmark: the rate, send call
+ * latency percentiles and heap allocations per message of sendTextMessage
+ * and of both sendMeasurement overloads, with MqttMailingService publishing
+ * to the in-process broker of the mocked ESP MQTT client.
+ *
+ * The rates measure the library and the mocked FreeRTOS on a desktop CPU,
+ * compare them between revisions rather than with the ESP32.
+ */
+#include "Benchmark.h"
+#include "MockBroker.h"
+#include "MqttMailingService.h"
+#include <MeasurementFormatting.hpp>
+#include <WiFi.h>
+
+using namespace sensirion::upt;
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+constexpr size_t kMessagesPerRun = 20000;
+constexpr size_t kWarmupMessages = 500;
+
+core::Measurement sampleMeasurement() {
+    core::Measurement measurement;
+    measurement.signalType = core::SignalType::CO2_PARTS_PER_MILLION;
+    measurement.dataPoint.value = 412.5f;
+    measurement.metaData = core::MetaData{core::SCD4X()};
+    measurement.metaData.deviceID = 0x123456789aULL;
+    return measurement;
+}
+
+}  // namespace
+
+int main() {
+    mock::MockBroker broker{"broker.local"};
+    broker.setRecordMessages(false);
+
+    MqttMailingService service;
+    service.setBrokerURI("mqtt://broker.local:1883");
+    service.setGlobalTopicPrefix("benchmark/");
+    service.setMailboxOverflowPolicy(MailboxOverflowPolicy::BLOCK, 1000);
+    service.setMeasurementBufferFormatterFn(FullMeasurementFormatter{});
+    service.setMeasurementToTopicSuffixFn(MeasurementToTopicSuffixTree{});
+    service.startWithDelegatedWiFi("ssid", "pass", true);
+    if (!service.isReady()) {
+        std::printf("not connected to the mocked broker\n");
+        return 1;
+    }
+
+    core::Measurement measurement = sampleMeasurement();
+    const std::string message{"{\"value\":42}"};
+    const std::string topicSuffix{"text"};
+
+    struct Path {
+        const char* name;
+        std::function<void(size_t)> send;
+    };
+    const Path paths[] = {
+        {"sendTextMessage",
+         [&](size_t) { service.sendTextMessage(message, topicSuffix); }},
+        {"sendMeasurement(m, suffix)",
+         [&](size_t i) {
+             measurement.dataPoint.t_offset = i;
+             service.sendMeasurement(measurement, topicSuffix);
+         }},
+        {"sendMeasurement(m)",
+         [&](size_t i) {
+             measurement.dataPoint.t_offset = i;
+             service.sendMeasurement(measurement);
+         }},
+    };
+
+    bool passed = true;
+    for (const auto& path : paths) {
+        for (const size_t count : {kWarmupMessages, kMessagesPerRun}) {
+            const size_t sentBefore = service.getMailboxStatistics().sent;
+            const size_t receivedBefore = broker.messageCount();
+            bench::RunResult result;
+            const bool done = bench::run(
+                count, path.send,
+                [&]() {
+                    return broker.messageCount() - receivedBefore >= count;
+                },
+                result);
+            if (!done ||
+                service.getMailboxStatistics().sent - sentBefore != count) {
+                std::printf("%s: %zu of %zu messages received\n", path.name,
+                            broker.messageCount() - receivedBefore, count);
+                passed = false;
+            }
+            if (count == kMessagesPerRun) {
+                bench::print(path.name, result);
+            }
+        }
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/**
+ * Matching rate of TopicFilterTrie with a growing number of filters, against
+ * a linear scan comparing the topic with every filter, as done before the
+ * trie. The trie should keep its cost per match while the scan grows with
+ * the filters, neither allocates.
+ *
+ * Fails if the trie and the scan disagree or if matching allocates.
+ */
+#include "Benchmark.h"
+#include "TopicFilterTrie.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace sensirion::upt::mqtt;
+
+namespace {
+
+constexpr size_t kMatches = 200000;
+
+// The MQTT matching rules, level by level
+bool matchesFilter(std::string_view filter, std::string_view topic) {
+    size_t f = 0;
+    size_t t = 0;
+    while (true) {
+        const size_t filterEnd = std::min(filter.find('/', f), filter.size());
+        const std::string_view level = filter.substr(f, filterEnd - f);
+        if (level == "#") {
+            return true;
+        }
+        if (t > topic.size()) {
+            return false;
+        }
+        const size_t topicEnd = std::min(topic.find('/', t), topic.size());
+        if (level != "+" && level != topic.substr(t, topicEnd - t)) {
+            return false;
+        }
+        f = filterEnd + 1;
+        t = topicEnd + 1;
+        if (f > filter.size()) {
+            return t > topic.size();
+        }
+    }
+}
+
+// Rooms with an exact, a '+' and a '#' filter each
+std::vector<std::string> filtersOf(size_t count) {
+    std::vector<std::string> filters;
+    for (size_t i = 0; filters.size() < count; ++i) {
+        const std::string room = "site/room" + std::to_string(i);
+        filters.push_back(room + "/sensor/co2");
+        filters.push_back(room + "/+/temperature");
+        filters.push_back(room + "/#");
+    }
+    filters.resize(count);
+    return filters;
+}
+
+}  // namespace
+
+int main() {
+    const std::vector<std::string> topics = {
+        "site/room0/sensor/co2", "site/room3/sensor/temperature",
+        "site/room7/config", "other/room1/sensor/co2"};
+    bool passed = true;
+    for (const size_t filterCount : {3, 12, 48, 192, 768}) {
+        const std::vector<std::string> filters = filtersOf(filterCount);
+        TopicFilterTrie trie;
+        for (size_t i = 0; i < filters.size(); ++i) {
+            trie.insert(filters[i], static_cast<uint16_t>(i));
+        }
+
+        uint16_t ids[16];
+        size_t trieMatches = 0;
+        uint64_t allocationsBefore = mock::allocationCount();
+        uint64_t start = mock::nowUs();
+        for (size_t i = 0; i < kMatches; ++i) {
+            trieMatches += trie.match(topics[i % topics.size()], ids, 16);
+        }
+        const uint64_t trieUs = mock::nowUs() - start;
+        const uint64_t trieAllocations =
+            mock::allocationCount() - allocationsBefore;
+
+        size_t scanMatches = 0;
+        start = mock::nowUs();
+        for (size_t i = 0; i < kMatches; ++i) {
+            const std::string_view topic = topics[i % topics.size()];
+            for (const auto& filter : filters) {
+                scanMatches += matchesFilter(filter, topic) ? 1 : 0;
+            }
+        }
+        const uint64_t scanUs = mock::nowUs() - start;
+
+        std::printf("%4zu filters  trie %7.1f ns/match  scan %8.1f ns/match  "
+                    "%zu alloc\n",
+                    filterCount, trieUs * 1000.0 / kMatches,
+                    scanUs * 1000.0 / kMatches,
+                    static_cast<size_t>(trieAllocations));
+        if (trieMatches != scanMatches || trieAllocations != 0) {
+            std::printf("%zu filters: %zu matches, %zu expected\n",
+                        filterCount, trieMatches, scanMatches);
+            passed = false;
+        }
+    }
+    return passed ? 0 : 1;
+}
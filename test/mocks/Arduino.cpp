@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+namespace {
+
+const auto kBootTime = std::chrono::steady_clock::now();
+
+}  // namespace
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - kBootTime)
+        .count();
+}
+
+unsigned long millis() {
+    return static_cast<unsigned long>(
+        static_cast<uint32_t>(esp_timer_get_time() / 1000));
+}
+
+unsigned long micros() {
+    return static_cast<unsigned long>(
+        static_cast<uint32_t>(esp_timer_get_time()));
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+uint32_t esp_random() {
+    thread_local std::minstd_rand generator{std::random_device{}()};
+    return static_cast<uint32_t>(generator()) ^
+           (static_cast<uint32_t>(generator()) << 16);
+}
+
+namespace mock {
+
+bool logEnabled(char level) {
+    static const char* maxLevel = std::getenv("UPT_MQTT_LOG");
+    static const char kLevels[] = "EWIDV";
+    if (maxLevel == nullptr) {
+        return false;
+    }
+    for (const char* l = kLevels; *l != '\0'; ++l) {
+        if (*l == level) {
+            return true;
+        }
+        if (*l == *maxLevel) {
+            return false;
+        }
+    }
+    return false;
+}
+
+}  // namespace mock
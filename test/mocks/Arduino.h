@@ -0,0 +1,26 @@
+/**
+ * Host mock of the parts of the Arduino ESP32 core used by the library
+ */
+#ifndef UPT_MQTT_MOCK_ARDUINO_H
+#define UPT_MQTT_MOCK_ARDUINO_H
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+uint32_t esp_random();
+
+#endif /* UPT_MQTT_MOCK_ARDUINO_H */
@@ -0,0 +1,465 @@
+#include "MockSupport.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point kBootTime = Clock::now();
+
+std::atomic<size_t> gAbandonedTasks{0};
+std::atomic<size_t> gRunningTasks{0};
+std::atomic<size_t> gUseAfterDelete{0};
+
+/**
+ * Waits until the predicate holds, returns false if the wait expired first
+ */
+template <typename Predicate>
+bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+             TickType_t wait, Predicate predicate) {
+    if (wait == portMAX_DELAY) {
+        cv.wait(lock, predicate);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(wait), predicate);
+}
+
+void reportUseAfterDelete(const char* kind) {
+    gUseAfterDelete++;
+    fprintf(stderr, "[mock] %s used after its deletion\n", kind);
+}
+
+// Deleted objects are kept, so that using them afterwards is reported
+// instead of being undefined behaviour
+constexpr uint32_t kAlive = 0x51ed7e11;
+constexpr uint32_t kDeleted = 0xdeadbeef;
+
+}  // namespace
+
+struct QueueDefinition {
+    uint32_t magic = kAlive;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<uint8_t> storage;
+    size_t itemSize = 0;
+    size_t capacity = 0;
+    size_t head = 0;
+    size_t count = 0;
+
+    bool alive() {
+        if (magic == kAlive) {
+            return true;
+        }
+        reportUseAfterDelete("queue or semaphore");
+        return false;
+    }
+};
+
+struct EventGroupDef_t {
+    uint32_t magic = kAlive;
+    std::mutex mutex;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+
+    bool alive() {
+        if (magic == kAlive) {
+            return true;
+        }
+        reportUseAfterDelete("event group");
+        return false;
+    }
+};
+
+namespace {
+
+/**
+ * FreeRTOS asserts on null handles, e.g. one read after the object was
+ * deleted and the handle cleared: both are reported
+ */
+template <typename Object>
+bool usable(Object* object) {
+    if (object == nullptr) {
+        reportUseAfterDelete("null handle");
+        return false;
+    }
+    return object->alive();
+}
+
+}  // namespace
+
+struct tskTaskControlBlock {
+    std::string name;
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+    std::atomic<bool> deleted{false};
+};
+
+namespace {
+
+thread_local tskTaskControlBlock* tCurrentTask = nullptr;
+
+/**
+ * Unique non-zero identifier of the calling thread
+ */
+uint32_t threadId() {
+    static std::atomic<uint32_t> nextId{1};
+    thread_local const uint32_t id = nextId++;
+    return id;
+}
+
+BaseType_t send(QueueHandle_t queue, const void* item, TickType_t wait,
+                bool toFront) {
+    if (!usable(queue)) {
+        return pdFALSE;
+    }
+    std::unique_lock<std::mutex> lock{queue->mutex};
+    if (!waitFor(queue->notFull, lock, wait,
+                 [queue]() { return queue->count < queue->capacity; })) {
+        return pdFALSE;
+    }
+    size_t slot;
+    if (toFront) {
+        queue->head = (queue->head + queue->capacity - 1) % queue->capacity;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->capacity;
+    }
+    if (queue->itemSize > 0) {
+        memcpy(queue->storage.data() + slot * queue->itemSize, item,
+               queue->itemSize);
+    }
+    queue->count++;
+    lock.unlock();
+    queue->notEmpty.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t receive(QueueHandle_t queue, void* item, TickType_t wait,
+                   bool remove) {
+    if (!usable(queue)) {
+        return pdFALSE;
+    }
+    std::unique_lock<std::mutex> lock{queue->mutex};
+    if (!waitFor(queue->notEmpty, lock, wait,
+                 [queue]() { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    if (queue->itemSize > 0) {
+        memcpy(item, queue->storage.data() + queue->head * queue->itemSize,
+               queue->itemSize);
+    }
+    if (!remove) {
+        lock.unlock();
+        // Other peeking tasks may take it as well
+        queue->notEmpty.notify_one();
+        return pdTRUE;
+    }
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    lock.unlock();
+    queue->notFull.notify_one();
+    return pdTRUE;
+}
+
+QueueHandle_t createQueue(size_t length, size_t itemSize,
+                          size_t initialCount) {
+    auto* queue = new QueueDefinition;
+    queue->capacity = length > 0 ? length : 1;
+    queue->itemSize = itemSize;
+    queue->storage.resize(queue->capacity * itemSize);
+    queue->count = initialCount;
+    return queue;
+}
+
+}  // namespace
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    const uint32_t self = threadId();
+    if (__atomic_load_n(&mux->owner, __ATOMIC_ACQUIRE) == self) {
+        mux->count++;
+        return;
+    }
+    uint32_t unlocked = 0;
+    while (!__atomic_compare_exchange_n(&mux->owner, &unlocked, self, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        unlocked = 0;
+        std::this_thread::yield();
+    }
+    mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    if (--mux->count == 0) {
+        __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+    }
+}
+
+TickType_t xTaskGetTickCount() {
+    return static_cast<TickType_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                              kBootTime)
+            .count());
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name,
+                       [[maybe_unused]] uint32_t stackDepth, void* parameters,
+                       [[maybe_unused]] UBaseType_t priority,
+                       TaskHandle_t* createdTask) {
+    auto* task = new tskTaskControlBlock;
+    task->name = name;
+    if (createdTask != nullptr) {
+        *createdTask = task;
+    }
+    gRunningTasks++;
+    std::thread{[task, code, parameters]() {
+        tCurrentTask = task;
+        code(parameters);
+        if (!task->deleted) {
+            fprintf(stderr, "[mock] task %s returned without vTaskDelete\n",
+                    task->name.c_str());
+        }
+    }}.detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name,
+                                   uint32_t stackDepth, void* parameters,
+                                   UBaseType_t priority,
+                                   TaskHandle_t* createdTask,
+                                   [[maybe_unused]] BaseType_t core) {
+    return xTaskCreate(code, name, stackDepth, parameters, priority,
+                       createdTask);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = tCurrentTask;
+    } else if (task != tCurrentTask && !task->deleted) {
+        // A thread cannot be killed, it keeps running unattended
+        gAbandonedTasks++;
+        fprintf(stderr, "[mock] task %s deleted while running\n",
+                task->name.c_str());
+    }
+    if (task != nullptr && !task->deleted.exchange(true)) {
+        gRunningTasks--;
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (tCurrentTask == nullptr) {
+        // Threads not created by xTaskCreate, e.g. the main thread
+        tCurrentTask = new tskTaskControlBlock;
+        tCurrentTask->name = "thread";
+    }
+    return tCurrentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    if (task == nullptr) {
+        return pdFAIL;
+    }
+    if (task->deleted) {
+        reportUseAfterDelete("task");
+        return pdFAIL;
+    }
+    {
+        std::lock_guard<std::mutex> lock{task->mutex};
+        task->notifications++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t wait) {
+    tskTaskControlBlock* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock{task->mutex};
+    waitFor(task->notified, lock, wait,
+            [task]() { return task->notifications > 0; });
+    const uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return createQueue(length, itemSize, 0);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (!usable(queue)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{queue->mutex};
+    queue->magic = kDeleted;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item,
+                            TickType_t wait) {
+    return send(queue, item, wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item,
+                             TickType_t wait) {
+    return send(queue, item, wait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+    return receive(queue, item, wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait) {
+    return receive(queue, item, wait, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    if (!usable(queue)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock{queue->mutex};
+    return static_cast<UBaseType_t>(queue->count);
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    if (!usable(queue)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock{queue->mutex};
+    return static_cast<UBaseType_t>(queue->capacity - queue->count);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    if (!usable(queue)) {
+        return pdFAIL;
+    }
+    {
+        std::lock_guard<std::mutex> lock{queue->mutex};
+        queue->head = 0;
+        queue->count = 0;
+    }
+    queue->notFull.notify_all();
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return createQueue(1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return createQueue(1, 0, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount,
+                                           UBaseType_t initialCount) {
+    return createQueue(maxCount, 0, initialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+    return receive(semaphore, nullptr, wait, true);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return send(semaphore, nullptr, 0, false);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+    return uxQueueMessagesWaiting(semaphore);
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new EventGroupDef_t;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    if (!usable(group)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{group->mutex};
+    group->magic = kDeleted;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    if (!usable(group)) {
+        return 0;
+    }
+    EventBits_t result;
+    {
+        std::lock_guard<std::mutex> lock{group->mutex};
+        group->bits |= bits;
+        result = group->bits;
+    }
+    group->changed.notify_all();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    if (!usable(group)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock{group->mutex};
+    const EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    if (!usable(group)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock{group->mutex};
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clearOnExit,
+                                BaseType_t waitForAllBits, TickType_t wait) {
+    if (!usable(group)) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock{group->mutex};
+    const auto satisfied = [group, bits, waitForAllBits]() {
+        return waitForAllBits ? (group->bits & bits) == bits
+                              : (group->bits & bits) != 0;
+    };
+    const bool set = waitFor(group->changed, lock, wait, satisfied);
+    const EventBits_t result = group->bits;
+    if (set && clearOnExit) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+namespace mock {
+
+size_t abandonedTaskCount() {
+    return gAbandonedTasks.load();
+}
+
+size_t runningTaskCount() {
+    return gRunningTasks.load();
+}
+
+size_t useAfterDeleteCount() {
+    return gUseAfterDelete.load();
+}
+
+}  // namespace mock
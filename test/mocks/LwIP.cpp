@@ -0,0 +1,104 @@
+#include "MockSupport.h"
+#include <WiFi.h>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+
+// A thread running jobs in order, joined at exit
+class Worker {
+  public:
+    Worker() : mThread{&Worker::loop, this} {
+    }
+
+    ~Worker() {
+        {
+            std::lock_guard<std::mutex> lock{mMutex};
+            mExiting = true;
+        }
+        mChanged.notify_all();
+        mThread.join();
+    }
+
+    void post(std::function<void()> job) {
+        mock::ScopedIgnoreAllocations ignore;
+        {
+            std::lock_guard<std::mutex> lock{mMutex};
+            mJobs.push_back(std::move(job));
+        }
+        mChanged.notify_all();
+    }
+
+  private:
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+    std::deque<std::function<void()>> mJobs;
+    bool mExiting = false;
+    std::thread mThread;
+
+    void loop() {
+        mock::ignoreAllocationsOfThisThread(true);
+        std::unique_lock<std::mutex> lock{mMutex};
+        while (!mExiting || !mJobs.empty()) {
+            if (mJobs.empty()) {
+                mChanged.wait(lock);
+                continue;
+            }
+            std::function<void()> job = std::move(mJobs.front());
+            mJobs.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+};
+
+// Constructed on first use, after WiFi, so destroyed before it
+Worker& tcpipThread() {
+    static Worker worker;
+    return worker;
+}
+
+// The DNS server, answering without blocking the tcpip thread
+Worker& dnsServer() {
+    static Worker worker;
+    return worker;
+}
+
+}  // namespace
+
+char* ipaddr_ntoa_r(const ip_addr_t* addr, char* buf, int buflen) {
+    const std::string text = IPAddress{addr->addr}.toString();
+    if (buflen <= 0 || text.size() >= static_cast<size_t>(buflen)) {
+        return nullptr;
+    }
+    std::snprintf(buf, static_cast<size_t>(buflen), "%s", text.c_str());
+    return buf;
+}
+
+err_t tcpip_callback(tcpip_callback_fn function, void* ctx) {
+    tcpipThread().post([function, ctx]() { function(ctx); });
+    return ERR_OK;
+}
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t*,
+                        dns_found_callback found, void* callback_arg) {
+    mock::ScopedIgnoreAllocations ignore;
+    dnsServer().post([name = std::string{hostname}, found, callback_arg]() {
+        IPAddress address;
+        // Counted and delayed like WiFi.hostByName
+        const bool known = WiFi.hostByName(name.c_str(), address) == 1;
+        const ip_addr_t result{static_cast<uint32_t>(address), IPADDR_TYPE_V4};
+        tcpipThread().post([name, found, callback_arg, known, result]() {
+            found(name.c_str(), known ? &result : nullptr, callback_arg);
+        });
+    });
+    return ERR_INPROGRESS;
+}
@@ -0,0 +1,159 @@
+/**
+ * In-process MQTT broker of the mocked ESP MQTT client. A client connects to
+ * the broker registered for the host of its URI, if the Wi-Fi is connected.
+ *
+ * The broker stores the retained messages, forwards the messages to the
+ * subscribed clients and acknowledges the QoS 1/2 messages after a
+ * configurable latency. It can refuse connections, stall (hold the messages
+ * and their acknowledgements) and drop all connections, to run the failure
+ * scenarios of the tests and benchmarks.
+ */
+#ifndef UPT_MQTT_MOCK_BROKER_H
+#define UPT_MQTT_MOCK_BROKER_H
+
+#include <mqtt_client.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mock {
+
+struct BrokerMessage {
+    std::string topic;
+    std::string payload;
+    int qos;
+    bool retain;
+    // Resent by the client after a reconnection
+    bool duplicate;
+    // esp_timer_get_time() when the broker received it
+    int64_t receivedUs;
+};
+
+class MockBroker {
+  public:
+    /**
+     * @brief Registers the broker for host names or addresses, e.g.
+     *        {"broker.local", "10.0.0.5"}
+     */
+    MockBroker(std::initializer_list<std::string> hosts);
+    ~MockBroker();
+
+    MockBroker(const MockBroker&) = delete;
+    MockBroker& operator=(const MockBroker&) = delete;
+
+    /**
+     * @brief returns the broker registered for host, nullptr if none
+     */
+    static MockBroker* find(const std::string& host);
+
+    // Connection attempts fail while refused
+    void setAcceptConnections(bool accept);
+    // Latency of the acknowledgement of QoS 1/2 messages
+    void setAckDelayUs(uint32_t delayUs);
+    // Time a publish blocks the client, e.g. writing to the socket
+    void setPublishDelayUs(uint32_t delayUs);
+    // While stalled, the published messages and their acknowledgements are
+    // held, they are processed once the stall ends
+    void setStalled(bool stalled);
+    // Drops all connections, like a restart of the broker
+    void disconnectAll();
+    // Keep the received messages, see messages()
+    void setRecordMessages(bool record);
+    // Called for every received message, in the publishing thread or, for
+    // the messages held by a stall, in the thread ending it
+    void setObserver(std::function<void(const BrokerMessage&)> observer);
+
+    std::vector<BrokerMessage> messages();
+    size_t messageCount() const {
+        return mMessageCount;
+    }
+    size_t duplicateCount() const {
+        return mDuplicateCount;
+    }
+    size_t connectCount() const {
+        return mConnectCount;
+    }
+    size_t connectedClientCount();
+    size_t retainedCount();
+    // Payload of the retained message of topic, empty if none
+    std::string retained(const std::string& topic);
+    // Number of subscriptions of all connected clients
+    size_t subscriptionCount();
+    // Publishes a message from the broker itself, e.g. a command
+    void inject(const std::string& topic, const std::string& payload,
+                int qos = 0, bool retain = false);
+
+    /*
+     * Used by the mocked client
+     */
+    bool connect(esp_mqtt_client_handle_t client);
+    void disconnect(esp_mqtt_client_handle_t client);
+    void publish(esp_mqtt_client_handle_t client, int msgId,
+                 const BrokerMessage& message);
+    void subscribe(esp_mqtt_client_handle_t client, const std::string& filter,
+                   int qos);
+    void unsubscribe(esp_mqtt_client_handle_t client,
+                     const std::string& filter);
+    uint32_t publishDelayUs() const {
+        return mPublishDelayUs;
+    }
+
+    static bool matches(const std::string& filter, const std::string& topic);
+
+  private:
+    struct Held {
+        esp_mqtt_client_handle_t client;
+        int msgId;
+        BrokerMessage message;
+    };
+
+    void process(esp_mqtt_client_handle_t client, int msgId,
+                 BrokerMessage message);
+    // Called with mMutex taken
+    void unsubscribeLocked(esp_mqtt_client_handle_t client,
+                           const std::string& filter);
+
+    std::vector<std::string> mHosts;
+    std::mutex mMutex;
+    std::vector<esp_mqtt_client_handle_t> mClients;
+    std::multimap<esp_mqtt_client_handle_t, std::pair<std::string, int>>
+        mSubscriptions;
+    std::map<std::string, std::string> mRetained;
+    std::vector<BrokerMessage> mMessages;
+    std::vector<Held> mHeld;
+    std::function<void(const BrokerMessage&)> mObserver;
+    std::atomic<bool> mAccept{true};
+    std::atomic<bool> mStalled{false};
+    std::atomic<bool> mRecord{true};
+    std::atomic<uint32_t> mAckDelayUs{0};
+    std::atomic<uint32_t> mPublishDelayUs{0};
+    std::atomic<size_t> mMessageCount{0};
+    std::atomic<size_t> mDuplicateCount{0};
+    std::atomic<size_t> mConnectCount{0};
+};
+
+/**
+ * URI the mocked client currently connects to, see esp_mqtt_client_set_uri
+ */
+std::string clientUri(esp_mqtt_client_handle_t client);
+
+/**
+ * Number of mocked clients created and not destroyed
+ */
+size_t liveClientCount();
+
+/**
+ * Buffer size of the mocked clients created from now on, unless configured
+ * (1024 bytes like the ESP MQTT client). Larger received messages are
+ * delivered in several MQTT_EVENT_DATA events.
+ */
+void setDefaultClientBufferSize(size_t size);
+
+}  // namespace mock
+
+#endif /* UPT_MQTT_MOCK_BROKER_H */
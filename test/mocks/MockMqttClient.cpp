@@ -0,0 +1,742 @@
+#include "MockBroker.h"
+#include "MockSupport.h"
+#include <WiFi.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <thread>
+
+namespace {
+
+std::mutex gRegistryMutex;
+std::map<std::string, mock::MockBroker*> gBrokers;
+std::atomic<size_t> gLiveClients{0};
+std::atomic<size_t> gDefaultBufferSize{1024};
+
+/**
+ * Host of an URI such as mqtt://broker.local:1883/path
+ */
+std::string hostOf(const std::string& uri) {
+    size_t start = uri.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    const size_t end = uri.find_first_of(":/", start);
+    return uri.substr(start, end == std::string::npos ? std::string::npos
+                                                      : end - start);
+}
+
+}  // namespace
+
+struct esp_mqtt_client {
+    enum class State {
+        STOPPED,
+        CONNECTING,
+        CONNECTED,
+        WAIT_RECONNECT,
+    };
+
+    enum class Kind {
+        CONNECT,
+        ACK,
+        DATA,
+        LOST,
+    };
+
+    struct Pending {
+        uint64_t dueUs;
+        Kind kind;
+        int msgId;
+        std::string topic;
+        std::string payload;
+        int qos;
+        bool retain;
+    };
+
+    struct OutboxEntry {
+        int msgId;
+        mock::BrokerMessage message;
+    };
+
+    std::string uri;
+    bool autoReconnect = true;
+    uint32_t reconnectTimeoutMs = 10000;
+    size_t bufferSize = gDefaultBufferSize;
+    esp_event_handler_t handler = nullptr;
+    void* handlerArg = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    State state = State::STOPPED;
+    bool running = false;
+    bool exiting = false;
+    bool dispatching = false;
+    std::thread thread;
+    std::deque<Pending> pending;
+    std::vector<OutboxEntry> outbox;
+    int nextMsgId = 0;
+    mock::MockBroker* broker = nullptr;
+
+    int takeMsgId() {
+        nextMsgId = nextMsgId % 65535 + 1;
+        return nextMsgId;
+    }
+
+    // Called with mutex taken
+    void schedule(Pending p) {
+        auto it = std::find_if(
+            pending.begin(), pending.end(),
+            [&p](const Pending& other) { return other.dueUs > p.dueUs; });
+        pending.insert(it, std::move(p));
+        changed.notify_all();
+    }
+
+    void dispatch(esp_mqtt_event_t& event) {
+        event.client = this;
+        // The allocations of the handler are those of the library
+        mock::ignoreAllocationsOfThisThread(false);
+        handler(handlerArg, "MQTT_EVENTS", event.event_id, &event);
+        mock::ignoreAllocationsOfThisThread(true);
+    }
+
+    void dispatch(esp_mqtt_event_id_t id, int msgId = 0) {
+        esp_mqtt_event_t event{};
+        event.event_id = id;
+        event.msg_id = msgId;
+        dispatch(event);
+    }
+
+    void loop();
+    void attemptConnection();
+    void acknowledge(int msgId);
+    void deliver(Pending& p);
+    void lose();
+};
+
+void esp_mqtt_client::loop() {
+    mock::ignoreAllocationsOfThisThread(true);
+    std::unique_lock<std::mutex> lock{mutex};
+    while (!exiting) {
+        if (pending.empty()) {
+            changed.wait(lock);
+            continue;
+        }
+        const uint64_t now = mock::nowUs();
+        if (pending.front().dueUs > now) {
+            changed.wait_for(lock, std::chrono::microseconds(
+                                       pending.front().dueUs - now));
+            continue;
+        }
+        Pending p = std::move(pending.front());
+        pending.pop_front();
+        dispatching = true;
+        lock.unlock();
+        switch (p.kind) {
+            case Kind::CONNECT:
+                attemptConnection();
+                break;
+            case Kind::ACK:
+                acknowledge(p.msgId);
+                break;
+            case Kind::DATA:
+                deliver(p);
+                break;
+            case Kind::LOST:
+                lose();
+                break;
+        }
+        lock.lock();
+        dispatching = false;
+        changed.notify_all();
+    }
+}
+
+void esp_mqtt_client::attemptConnection() {
+    dispatch(MQTT_EVENT_BEFORE_CONNECT);
+    std::string host;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        host = hostOf(uri);
+    }
+    mock::MockBroker* target = mock::MockBroker::find(host);
+    if (WiFi.isConnected() && target != nullptr && target->connect(this)) {
+        std::vector<OutboxEntry> resend;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (!running) {
+                // stopped meanwhile
+                target->disconnect(this);
+                return;
+            }
+            state = State::CONNECTED;
+            broker = target;
+            resend = outbox;
+        }
+        dispatch(MQTT_EVENT_CONNECTED);
+        for (auto& entry : resend) {
+            entry.message.duplicate = true;
+            target->publish(this, entry.msgId, entry.message);
+        }
+        return;
+    }
+    esp_mqtt_error_codes_t error{};
+    error.error_type = MQTT_ERROR_TYPE_TCP_TRANSPORT;
+    esp_mqtt_event_t event{};
+    event.event_id = MQTT_EVENT_ERROR;
+    event.error_handle = &error;
+    dispatch(event);
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!running) {
+            return;
+        }
+        state = State::WAIT_RECONNECT;
+        if (autoReconnect) {
+            schedule(Pending{mock::nowUs() + reconnectTimeoutMs * 1000ull,
+                             Kind::CONNECT, 0, {}, {}, 0, false});
+        }
+    }
+    dispatch(MQTT_EVENT_DISCONNECTED);
+}
+
+void esp_mqtt_client::acknowledge(int msgId) {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto it = std::find_if(
+            outbox.begin(), outbox.end(),
+            [msgId](const OutboxEntry& entry) { return entry.msgId == msgId; });
+        if (it == outbox.end() || state != State::CONNECTED) {
+            return;
+        }
+        outbox.erase(it);
+    }
+    dispatch(MQTT_EVENT_PUBLISHED, msgId);
+}
+
+void esp_mqtt_client::deliver(Pending& p) {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (state != State::CONNECTED) {
+            return;
+        }
+    }
+    // Payloads larger than the buffer come in several events, only the
+    // first one carries the topic
+    const size_t total = p.payload.size();
+    size_t offset = 0;
+    do {
+        const size_t length = std::min(bufferSize, total - offset);
+        esp_mqtt_event_t event{};
+        event.event_id = MQTT_EVENT_DATA;
+        event.topic = offset == 0 ? &p.topic[0] : nullptr;
+        event.topic_len = offset == 0 ? static_cast<int>(p.topic.size()) : 0;
+        event.data = &p.payload[0] + offset;
+        event.data_len = static_cast<int>(length);
+        event.total_data_len = static_cast<int>(total);
+        event.current_data_offset = static_cast<int>(offset);
+        event.qos = p.qos;
+        event.retain = p.retain;
+        dispatch(event);
+        offset += length;
+    } while (offset < total);
+}
+
+void esp_mqtt_client::lose() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (state != State::CONNECTED) {
+            return;
+        }
+        state = State::WAIT_RECONNECT;
+        broker = nullptr;
+        // The acknowledgements and messages in transit are lost, the outbox
+        // is sent again after reconnecting
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [](const Pending& p) {
+                                         return p.kind != Kind::CONNECT;
+                                     }),
+                      pending.end());
+        if (autoReconnect) {
+            schedule(Pending{mock::nowUs() + reconnectTimeoutMs * 1000ull,
+                             Kind::CONNECT, 0, {}, {}, 0, false});
+        }
+    }
+    dispatch(MQTT_EVENT_DISCONNECTED);
+}
+
+esp_mqtt_client_handle_t
+esp_mqtt_client_init(const esp_mqtt_client_config_t* config) {
+    mock::ScopedIgnoreAllocations ignore;
+    auto* client = new esp_mqtt_client;
+    client->uri = config->uri != nullptr ? config->uri : "";
+    client->autoReconnect = !config->disable_auto_reconnect;
+    if (config->reconnect_timeout_ms > 0) {
+        client->reconnectTimeoutMs = config->reconnect_timeout_ms;
+    }
+    if (config->buffer_size > 0) {
+        client->bufferSize = config->buffer_size;
+    }
+    gLiveClients++;
+    return client;
+}
+
+esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client,
+                                  const char* uri) {
+    mock::ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{client->mutex};
+    client->uri = uri;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    mock::ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{client->mutex};
+    if (client->running) {
+        return ESP_FAIL;
+    }
+    client->running = true;
+    client->state = esp_mqtt_client::State::CONNECTING;
+    if (!client->thread.joinable()) {
+        client->thread = std::thread{&esp_mqtt_client::loop, client};
+    }
+    client->schedule(esp_mqtt_client::Pending{
+        mock::nowUs(), esp_mqtt_client::Kind::CONNECT, 0, {}, {}, 0, false});
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client) {
+    mock::ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{client->mutex};
+    if (!client->running ||
+        client->state != esp_mqtt_client::State::WAIT_RECONNECT) {
+        return ESP_FAIL;
+    }
+    auto& pending = client->pending;
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                 [](const esp_mqtt_client::Pending& p) {
+                                     return p.kind ==
+                                            esp_mqtt_client::Kind::CONNECT;
+                                 }),
+                  pending.end());
+    client->state = esp_mqtt_client::State::CONNECTING;
+    client->schedule(esp_mqtt_client::Pending{
+        mock::nowUs(), esp_mqtt_client::Kind::CONNECT, 0, {}, {}, 0, false});
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client) {
+    mock::MockBroker* broker;
+    {
+        std::lock_guard<std::mutex> lock{client->mutex};
+        broker = client->broker;
+    }
+    if (broker == nullptr) {
+        return ESP_FAIL;
+    }
+    broker->disconnect(client);
+    mock::ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{client->mutex};
+    client->schedule(esp_mqtt_client::Pending{
+        mock::nowUs(), esp_mqtt_client::Kind::LOST, 0, {}, {}, 0, false});
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+    mock::MockBroker* broker;
+    {
+        std::unique_lock<std::mutex> lock{client->mutex};
+        if (!client->running ||
+            std::this_thread::get_id() == client->thread.get_id()) {
+            // Like ESP-IDF, the client cannot be stopped from its own task
+            return ESP_FAIL;
+        }
+        client->running = false;
+        client->state = esp_mqtt_client::State::STOPPED;
+        client->pending.clear();
+        broker = client->broker;
+        client->broker = nullptr;
+        // No event is dispatched once stopped
+        client->changed.wait(lock, [client]() { return !client->dispatching; });
+    }
+    if (broker != nullptr) {
+        broker->disconnect(client);
+    }
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client,
+                              const char* topic, int qos) {
+    mock::ScopedIgnoreAllocations ignore;
+    mock::MockBroker* broker;
+    int msgId;
+    {
+        std::lock_guard<std::mutex> lock{client->mutex};
+        if (client->state != esp_mqtt_client::State::CONNECTED) {
+            return -1;
+        }
+        broker = client->broker;
+        msgId = client->takeMsgId();
+    }
+    broker->subscribe(client, topic, qos);
+    return msgId;
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client,
+                                const char* topic) {
+    mock::ScopedIgnoreAllocations ignore;
+    mock::MockBroker* broker;
+    int msgId;
+    {
+        std::lock_guard<std::mutex> lock{client->mutex};
+        if (client->state != esp_mqtt_client::State::CONNECTED) {
+            return -1;
+        }
+        broker = client->broker;
+        msgId = client->takeMsgId();
+    }
+    broker->unsubscribe(client, topic);
+    return msgId;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client,
+                            const char* topic, const char* data, int len,
+                            int qos, int retain) {
+    mock::ScopedIgnoreAllocations ignore;
+    if (len <= 0 && data != nullptr) {
+        len = static_cast<int>(strlen(data));
+    }
+    mock::BrokerMessage message{topic,          std::string(data, len),
+                                qos,            retain != 0,
+                                false,          0};
+    mock::MockBroker* broker;
+    int msgId = 0;
+    {
+        std::lock_guard<std::mutex> lock{client->mutex};
+        if (!client->running) {
+            return -1;
+        }
+        if (qos > 0) {
+            msgId = client->takeMsgId();
+            // Sent again after a reconnection until acknowledged
+            client->outbox.push_back({msgId, message});
+        }
+        if (client->state != esp_mqtt_client::State::CONNECTED) {
+            return qos > 0 ? msgId : -1;
+        }
+        broker = client->broker;
+    }
+    broker->publish(client, msgId, message);
+    if (broker->publishDelayUs() > 0) {
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(broker->publishDelayUs()));
+    }
+    return msgId;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client) {
+    if (client == nullptr) {
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_stop(client);
+    {
+        std::lock_guard<std::mutex> lock{client->mutex};
+        client->exiting = true;
+        client->changed.notify_all();
+    }
+    if (client->thread.joinable()) {
+        if (std::this_thread::get_id() == client->thread.get_id()) {
+            client->thread.detach();
+        } else {
+            client->thread.join();
+        }
+    }
+    mock::ScopedIgnoreAllocations ignore;
+    delete client;
+    gLiveClients--;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(
+    esp_mqtt_client_handle_t client, [[maybe_unused]] esp_mqtt_event_id_t event,
+    esp_event_handler_t event_handler, void* event_handler_arg) {
+    std::lock_guard<std::mutex> lock{client->mutex};
+    client->handler = event_handler;
+    client->handlerArg = event_handler_arg;
+    return ESP_OK;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client) {
+    std::lock_guard<std::mutex> lock{client->mutex};
+    size_t size = 0;
+    for (const auto& entry : client->outbox) {
+        size += entry.message.topic.size() + entry.message.payload.size();
+    }
+    return static_cast<int>(size);
+}
+
+namespace mock {
+
+MockBroker::MockBroker(std::initializer_list<std::string> hosts)
+    : mHosts{hosts} {
+    std::lock_guard<std::mutex> lock{gRegistryMutex};
+    for (const auto& host : mHosts) {
+        gBrokers[host] = this;
+    }
+}
+
+MockBroker::~MockBroker() {
+    {
+        std::lock_guard<std::mutex> lock{gRegistryMutex};
+        for (const auto& host : mHosts) {
+            gBrokers.erase(host);
+        }
+    }
+    disconnectAll();
+}
+
+MockBroker* MockBroker::find(const std::string& host) {
+    std::lock_guard<std::mutex> lock{gRegistryMutex};
+    const auto it = gBrokers.find(host);
+    return it == gBrokers.end() ? nullptr : it->second;
+}
+
+void MockBroker::setAcceptConnections(bool accept) {
+    mAccept = accept;
+}
+
+void MockBroker::setAckDelayUs(uint32_t delayUs) {
+    mAckDelayUs = delayUs;
+}
+
+void MockBroker::setPublishDelayUs(uint32_t delayUs) {
+    mPublishDelayUs = delayUs;
+}
+
+void MockBroker::setStalled(bool stalled) {
+    mStalled = stalled;
+    if (stalled) {
+        return;
+    }
+    std::vector<Held> held;
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        held.swap(mHeld);
+    }
+    for (auto& h : held) {
+        process(h.client, h.msgId, std::move(h.message));
+    }
+}
+
+void MockBroker::disconnectAll() {
+    ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{mMutex};
+    for (esp_mqtt_client_handle_t client : mClients) {
+        std::lock_guard<std::mutex> clientLock{client->mutex};
+        client->schedule(esp_mqtt_client::Pending{
+            nowUs(), esp_mqtt_client::Kind::LOST, 0, {}, {}, 0, false});
+    }
+    mClients.clear();
+    mSubscriptions.clear();
+    mHeld.clear();
+}
+
+void MockBroker::setRecordMessages(bool record) {
+    mRecord = record;
+}
+
+void MockBroker::setObserver(
+    std::function<void(const BrokerMessage&)> observer) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    mObserver = std::move(observer);
+}
+
+std::vector<BrokerMessage> MockBroker::messages() {
+    std::lock_guard<std::mutex> lock{mMutex};
+    return mMessages;
+}
+
+size_t MockBroker::connectedClientCount() {
+    std::lock_guard<std::mutex> lock{mMutex};
+    return mClients.size();
+}
+
+size_t MockBroker::retainedCount() {
+    std::lock_guard<std::mutex> lock{mMutex};
+    return mRetained.size();
+}
+
+std::string MockBroker::retained(const std::string& topic) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    const auto it = mRetained.find(topic);
+    return it == mRetained.end() ? std::string{} : it->second;
+}
+
+size_t MockBroker::subscriptionCount() {
+    std::lock_guard<std::mutex> lock{mMutex};
+    return mSubscriptions.size();
+}
+
+void MockBroker::inject(const std::string& topic, const std::string& payload,
+                        int qos, bool retain) {
+    ScopedIgnoreAllocations ignore;
+    process(nullptr, 0, BrokerMessage{topic, payload, qos, retain, false, 0});
+}
+
+bool MockBroker::connect(esp_mqtt_client_handle_t client) {
+    if (!mAccept) {
+        return false;
+    }
+    ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{mMutex};
+    mClients.push_back(client);
+    mConnectCount++;
+    return true;
+}
+
+void MockBroker::disconnect(esp_mqtt_client_handle_t client) {
+    ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{mMutex};
+    mClients.erase(std::remove(mClients.begin(), mClients.end(), client),
+                   mClients.end());
+    // Clean session: the subscriptions end with the connection
+    mSubscriptions.erase(client);
+    for (auto& held : mHeld) {
+        if (held.client == client) {
+            held.client = nullptr;
+        }
+    }
+}
+
+void MockBroker::publish(esp_mqtt_client_handle_t client, int msgId,
+                         const BrokerMessage& message) {
+    ScopedIgnoreAllocations ignore;
+    if (mStalled) {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mHeld.push_back(Held{client, msgId, message});
+        return;
+    }
+    process(client, msgId, message);
+}
+
+void MockBroker::subscribe(esp_mqtt_client_handle_t client,
+                           const std::string& filter, int qos) {
+    ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{mMutex};
+    unsubscribeLocked(client, filter);
+    mSubscriptions.emplace(client, std::make_pair(filter, qos));
+    for (const auto& retained : mRetained) {
+        if (matches(filter, retained.first)) {
+            std::lock_guard<std::mutex> clientLock{client->mutex};
+            client->schedule(esp_mqtt_client::Pending{
+                nowUs(), esp_mqtt_client::Kind::DATA, 0, retained.first,
+                retained.second, qos, true});
+        }
+    }
+}
+
+void MockBroker::unsubscribe(esp_mqtt_client_handle_t client,
+                             const std::string& filter) {
+    ScopedIgnoreAllocations ignore;
+    std::lock_guard<std::mutex> lock{mMutex};
+    unsubscribeLocked(client, filter);
+}
+
+void MockBroker::unsubscribeLocked(esp_mqtt_client_handle_t client,
+                                   const std::string& filter) {
+    auto range = mSubscriptions.equal_range(client);
+    for (auto it = range.first; it != range.second;) {
+        it = it->second.first == filter ? mSubscriptions.erase(it) : ++it;
+    }
+}
+
+void MockBroker::process(esp_mqtt_client_handle_t client, int msgId,
+                         BrokerMessage message) {
+    message.receivedUs = esp_timer_get_time();
+    std::function<void(const BrokerMessage&)> observer;
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mMessageCount++;
+        if (message.duplicate) {
+            mDuplicateCount++;
+        }
+        if (mRecord) {
+            mMessages.push_back(message);
+        }
+        if (message.retain) {
+            if (message.payload.empty()) {
+                mRetained.erase(message.topic);
+            } else {
+                mRetained[message.topic] = message.payload;
+            }
+        }
+        // One copy per subscribed client, with the highest matching QoS
+        std::map<esp_mqtt_client_handle_t, int> receivers;
+        for (const auto& subscription : mSubscriptions) {
+            if (matches(subscription.second.first, message.topic)) {
+                const int qos = std::min(message.qos, subscription.second.second);
+                auto it = receivers.find(subscription.first);
+                if (it == receivers.end()) {
+                    receivers[subscription.first] = qos;
+                } else {
+                    it->second = std::max(it->second, qos);
+                }
+            }
+        }
+        const uint64_t now = nowUs();
+        for (const auto& receiver : receivers) {
+            std::lock_guard<std::mutex> clientLock{receiver.first->mutex};
+            receiver.first->schedule(esp_mqtt_client::Pending{
+                now, esp_mqtt_client::Kind::DATA, 0, message.topic,
+                message.payload, receiver.second, false});
+        }
+        const bool connected =
+            std::find(mClients.begin(), mClients.end(), client) !=
+            mClients.end();
+        if (msgId > 0 && connected) {
+            std::lock_guard<std::mutex> clientLock{client->mutex};
+            client->schedule(esp_mqtt_client::Pending{
+                now + mAckDelayUs, esp_mqtt_client::Kind::ACK, msgId, {}, {},
+                0, false});
+        }
+        observer = mObserver;
+    }
+    if (observer) {
+        observer(message);
+    }
+}
+
+bool MockBroker::matches(const std::string& filter, const std::string& topic) {
+    size_t f = 0;
+    size_t t = 0;
+    while (f < filter.size()) {
+        const size_t fEnd = std::min(filter.find('/', f), filter.size());
+        const std::string level = filter.substr(f, fEnd - f);
+        if (level == "#") {
+            return true;
+        }
+        if (t > topic.size()) {
+            return false;
+        }
+        const size_t tEnd = std::min(topic.find('/', t), topic.size());
+        if (level != "+" && level != topic.substr(t, tEnd - t)) {
+            return false;
+        }
+        f = fEnd + 1;
+        t = tEnd + 1;
+    }
+    return t > topic.size();
+}
+
+std::string clientUri(esp_mqtt_client_handle_t client) {
+    std::lock_guard<std::mutex> lock{client->mutex};
+    return client->uri;
+}
+
+size_t liveClientCount() {
+    return gLiveClients.load();
+}
+
+void setDefaultClientBufferSize(size_t size) {
+    gDefaultBufferSize = size;
+}
+
+}  // namespace mock
@@ -0,0 +1,97 @@
+#include "MockSupport.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+namespace {
+
+std::atomic<uint64_t> gAllocations{0};
+thread_local bool tIgnoreAllocations = false;
+
+void* allocate(size_t size) {
+    if (!tIgnoreAllocations) {
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return p;
+}
+
+}  // namespace
+
+// Replaced for the whole test binary, see mock::allocationCount
+void* operator new(size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace mock {
+
+uint64_t allocationCount() {
+    return gAllocations.load();
+}
+
+void ignoreAllocationsOfThisThread(bool ignore) {
+    tIgnoreAllocations = ignore;
+}
+
+ScopedIgnoreAllocations::ScopedIgnoreAllocations()
+    : mWasIgnored{tIgnoreAllocations} {
+    tIgnoreAllocations = true;
+}
+
+ScopedIgnoreAllocations::~ScopedIgnoreAllocations() {
+    tIgnoreAllocations = mWasIgnored;
+}
+
+void sleepMs(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+uint64_t nowUs() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+}  // namespace mock
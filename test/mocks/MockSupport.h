@@ -0,0 +1,83 @@
+/**
+ * Instrumentation of the host mocks, used by the tests to check what the
+ * library did on the mocked ESP32 layers.
+ */
+#ifndef UPT_MQTT_MOCK_SUPPORT_H
+#define UPT_MQTT_MOCK_SUPPORT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mock {
+
+/**
+ * Number of heap allocations (operator new) made so far by the threads that
+ * are not ignored, see ScopedIgnoreAllocations
+ */
+uint64_t allocationCount();
+
+/**
+ * Excludes or includes the allocations of the calling thread, e.g. those of
+ * the mocked broker running in the test thread
+ */
+void ignoreAllocationsOfThisThread(bool ignore);
+
+/**
+ * Excludes the allocations of the calling thread for its lifetime, used by
+ * the mocks so that the counted allocations are those of the library
+ */
+class ScopedIgnoreAllocations {
+  public:
+    ScopedIgnoreAllocations();
+    ~ScopedIgnoreAllocations();
+
+    ScopedIgnoreAllocations(const ScopedIgnoreAllocations&) = delete;
+    ScopedIgnoreAllocations& operator=(const ScopedIgnoreAllocations&) =
+        delete;
+
+  private:
+    bool mWasIgnored;
+};
+
+/**
+ * Number of queues, semaphores, event groups or tasks used after they were
+ * deleted, or through a null handle. These objects are never freed by the
+ * mock.
+ */
+size_t useAfterDeleteCount();
+
+/**
+ * Number of tasks deleted while running, i.e. that did not stop in time
+ */
+size_t abandonedTaskCount();
+
+/**
+ * Number of tasks created and not yet deleted
+ */
+size_t runningTaskCount();
+
+/**
+ * Polls condition every millisecond until it holds or timeoutMs elapsed,
+ * returns its last value
+ */
+template <typename Condition>
+bool waitUntil(Condition condition, uint32_t timeoutMs);
+
+void sleepMs(uint32_t ms);
+uint64_t nowUs();
+
+template <typename Condition>
+bool waitUntil(Condition condition, uint32_t timeoutMs) {
+    const uint64_t deadline = nowUs() + uint64_t{timeoutMs} * 1000;
+    while (!condition()) {
+        if (nowUs() >= deadline) {
+            return condition();
+        }
+        sleepMs(1);
+    }
+    return true;
+}
+
+}  // namespace mock
+
+#endif /* UPT_MQTT_MOCK_SUPPORT_H */
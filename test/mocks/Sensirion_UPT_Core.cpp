@@ -0,0 +1,68 @@
+#include <Sensirion_UPT_Core.h>
+
+namespace sensirion::upt::core {
+
+DeviceType SCD4X() {
+    return DeviceType{1, 4};
+}
+
+DeviceType SEN5X() {
+    return DeviceType{1, 5};
+}
+
+DeviceType SHT4X() {
+    return DeviceType{1, 6};
+}
+
+const char* deviceLabel(DeviceType deviceType) {
+    if (deviceType == SCD4X()) {
+        return "SCD4X";
+    }
+    if (deviceType == SEN5X()) {
+        return "SEN5X";
+    }
+    if (deviceType == SHT4X()) {
+        return "SHT4X";
+    }
+    return "UNDEFINED";
+}
+
+std::ostream& operator<<(std::ostream& os, DeviceType deviceType) {
+    return os << deviceLabel(deviceType);
+}
+
+const char* quantityOf(SignalType signalType) {
+    switch (signalType) {
+        case SignalType::TEMPERATURE_DEGREES_CELSIUS:
+            return "Temperature";
+        case SignalType::RELATIVE_HUMIDITY_PERCENTAGE:
+            return "Relative humidity";
+        case SignalType::CO2_PARTS_PER_MILLION:
+            return "CO2";
+        case SignalType::VOC_INDEX:
+            return "VOC index";
+        case SignalType::NOX_INDEX:
+            return "NOx index";
+        case SignalType::PM2P5_MICRO_GRAMM_PER_CUBIC_METER:
+            return "PM2.5";
+        default:
+            return "Undefined";
+    }
+}
+
+const char* unitOf(SignalType signalType) {
+    switch (signalType) {
+        case SignalType::TEMPERATURE_DEGREES_CELSIUS:
+            return "degC";
+        case SignalType::RELATIVE_HUMIDITY_PERCENTAGE:
+            return "%";
+        case SignalType::CO2_PARTS_PER_MILLION:
+            return "ppm";
+        case SignalType::PM2P5_MICRO_GRAMM_PER_CUBIC_METER:
+            return "ug/m3";
+        default:
+            return "";
+    }
+}
+
+}  // namespace sensirion::upt::core
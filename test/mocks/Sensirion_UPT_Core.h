@@ -0,0 +1,63 @@
+/**
+ * Host stub of the parts of the Sensirion UPT Core library used by the
+ * library: measurements, device types and the labels of the signal types
+ */
+#ifndef UPT_MQTT_MOCK_SENSIRION_UPT_CORE_H
+#define UPT_MQTT_MOCK_SENSIRION_UPT_CORE_H
+
+#include <cstdint>
+#include <ostream>
+
+namespace sensirion::upt::core {
+
+enum class SignalType {
+    UNDEFINED = 0,
+    TEMPERATURE_DEGREES_CELSIUS,
+    RELATIVE_HUMIDITY_PERCENTAGE,
+    CO2_PARTS_PER_MILLION,
+    VOC_INDEX,
+    NOX_INDEX,
+    PM2P5_MICRO_GRAMM_PER_CUBIC_METER,
+};
+
+struct DeviceType {
+    uint16_t category;
+    uint16_t id;
+
+    bool operator==(const DeviceType& other) const {
+        return category == other.category && id == other.id;
+    }
+};
+
+DeviceType SCD4X();
+DeviceType SEN5X();
+DeviceType SHT4X();
+
+const char* deviceLabel(DeviceType deviceType);
+std::ostream& operator<<(std::ostream& os, DeviceType deviceType);
+const char* quantityOf(SignalType signalType);
+const char* unitOf(SignalType signalType);
+
+struct DataPoint {
+    uint32_t t_offset = 0;
+    float value = 0.0f;
+};
+
+struct MetaData {
+    MetaData() = default;
+    explicit MetaData(DeviceType type) : deviceType{type} {
+    }
+
+    DeviceType deviceType{};
+    uint64_t deviceID = 0;
+};
+
+struct Measurement {
+    MetaData metaData{};
+    SignalType signalType = SignalType::UNDEFINED;
+    DataPoint dataPoint{};
+};
+
+}  // namespace sensirion::upt::core
+
+#endif /* UPT_MQTT_MOCK_SENSIRION_UPT_CORE_H */
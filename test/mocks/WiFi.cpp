@@ -0,0 +1,233 @@
+#include "MockSupport.h"
+#include <WiFi.h>
+#include <algorithm>
+
+WiFiClass WiFi;
+
+std::string IPAddress::toString() const {
+    return std::to_string(mAddress & 0xff) + "." +
+           std::to_string((mAddress >> 8) & 0xff) + "." +
+           std::to_string((mAddress >> 16) & 0xff) + "." +
+           std::to_string((mAddress >> 24) & 0xff);
+}
+
+WiFiClass::~WiFiClass() {
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mStopping = true;
+    }
+    mChanged.notify_all();
+    if (mEventThread.joinable()) {
+        mEventThread.join();
+    }
+}
+
+int WiFiClass::begin([[maybe_unused]] const char* ssid,
+                     [[maybe_unused]] const char* passphrase) {
+    mBeginCount++;
+    if (!mConnected) {
+        schedule(ARDUINO_EVENT_WIFI_STA_GOT_IP, mConnectDelayMs, true);
+    }
+    return 1;
+}
+
+bool WiFiClass::isConnected() {
+    return mConnected;
+}
+
+bool WiFiClass::reconnect() {
+    mReconnectCount++;
+    if (!mConnected) {
+        schedule(ARDUINO_EVENT_WIFI_STA_GOT_IP, mConnectDelayMs, true);
+    }
+    return true;
+}
+
+bool WiFiClass::disconnect([[maybe_unused]] bool wifiOff,
+                           [[maybe_unused]] bool eraseAp) {
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        // Aborts the pending connection attempts
+        mPending.erase(std::remove_if(mPending.begin(), mPending.end(),
+                                      [](const PendingEvent& pending) {
+                                          return pending.attempt;
+                                      }),
+                       mPending.end());
+    }
+    if (mConnected.exchange(false)) {
+        schedule(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, 0, false);
+    }
+    return true;
+}
+
+bool WiFiClass::setAutoReconnect(bool autoReconnect) {
+    mAutoReconnect = autoReconnect;
+    return true;
+}
+
+bool WiFiClass::getAutoReconnect() {
+    return mAutoReconnect;
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb callback,
+                                   [[maybe_unused]] arduino_event_id_t event) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    const wifi_event_id_t id = mNextHandlerId++;
+    mHandlers[id] = std::move(callback);
+    return id;
+}
+
+void WiFiClass::removeEvent(wifi_event_id_t id) {
+    // Like the Arduino core, does not wait for the event being delivered
+    std::lock_guard<std::mutex> lock{mMutex};
+    mHandlers.erase(id);
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+    mResolveCount++;
+    if (mResolveDelayMs > 0) {
+        delay(mResolveDelayMs);
+    }
+    std::lock_guard<std::mutex> lock{mMutex};
+    const auto it = mHosts.find(host);
+    if (it == mHosts.end()) {
+        return 0;
+    }
+    result = it->second;
+    return 1;
+}
+
+void WiFiClass::mockSetAccessPointAvailable(bool available) {
+    mAccessPointAvailable = available;
+}
+
+void WiFiClass::mockSetConnectDelayMs(uint32_t delayMs) {
+    mConnectDelayMs = delayMs;
+}
+
+void WiFiClass::mockConnect() {
+    if (!mConnected.exchange(true)) {
+        schedule(ARDUINO_EVENT_WIFI_STA_GOT_IP, 0, false);
+    }
+}
+
+void WiFiClass::mockLoseConnection() {
+    if (mConnected.exchange(false)) {
+        schedule(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, 0, false);
+        if (mAutoReconnect) {
+            schedule(ARDUINO_EVENT_WIFI_STA_GOT_IP, mConnectDelayMs, true);
+        }
+    }
+}
+
+void WiFiClass::mockEmit(arduino_event_id_t event) {
+    schedule(event, 0, false);
+}
+
+void WiFiClass::mockSetDeliveryDelayMs(uint32_t delayMs) {
+    mDeliveryDelayMs = delayMs;
+}
+
+void WiFiClass::mockAddHost(const std::string& host, IPAddress address) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    mHosts[host] = address;
+}
+
+void WiFiClass::mockSetResolveDelayMs(uint32_t delayMs) {
+    mResolveDelayMs = delayMs;
+}
+
+void WiFiClass::mockReset() {
+    mockFlushEvents();
+    std::lock_guard<std::mutex> lock{mMutex};
+    mPending.clear();
+    mHandlers.clear();
+    mHosts.clear();
+    mConnected = false;
+    mAccessPointAvailable = true;
+    mAutoReconnect = true;
+    mConnectDelayMs = 5;
+    mResolveDelayMs = 0;
+    mDeliveryDelayMs = 0;
+    mBeginCount = 0;
+    mReconnectCount = 0;
+    mResolveCount = 0;
+}
+
+void WiFiClass::mockFlushEvents() {
+    std::unique_lock<std::mutex> lock{mMutex};
+    mChanged.wait(lock, [this]() {
+        return (mPending.empty() && !mDelivering) || mStopping;
+    });
+}
+
+size_t WiFiClass::mockHandlerCount() {
+    std::lock_guard<std::mutex> lock{mMutex};
+    return mHandlers.size();
+}
+
+void WiFiClass::schedule(arduino_event_id_t event, uint32_t delayMs,
+                         bool attempt) {
+    mock::ScopedIgnoreAllocations ignore;
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        const uint64_t dueUs = mock::nowUs() + uint64_t{delayMs} * 1000;
+        // Ordered by due time, events due at the same time keep their order
+        auto it = std::find_if(
+            mPending.begin(), mPending.end(),
+            [dueUs](const PendingEvent& p) { return p.dueUs > dueUs; });
+        mPending.insert(it, PendingEvent{dueUs, event, attempt});
+        if (!mEventThread.joinable()) {
+            mEventThread = std::thread{&WiFiClass::eventLoop, this};
+        }
+    }
+    mChanged.notify_all();
+}
+
+void WiFiClass::eventLoop() {
+    mock::ignoreAllocationsOfThisThread(true);
+    std::unique_lock<std::mutex> lock{mMutex};
+    while (!mStopping) {
+        if (mPending.empty()) {
+            mChanged.wait(lock);
+            continue;
+        }
+        const uint64_t now = mock::nowUs();
+        if (mPending.front().dueUs > now) {
+            mChanged.wait_for(lock, std::chrono::microseconds(
+                                        mPending.front().dueUs - now));
+            continue;
+        }
+        PendingEvent pending = mPending.front();
+        mPending.pop_front();
+        mDelivering = true;
+        lock.unlock();
+        if (pending.attempt) {
+            if (mAccessPointAvailable) {
+                mConnected = true;
+            } else {
+                pending.event = ARDUINO_EVENT_WIFI_STA_DISCONNECTED;
+            }
+        }
+        deliver(pending.event);
+        lock.lock();
+        mDelivering = false;
+        mChanged.notify_all();
+    }
+}
+
+void WiFiClass::deliver(arduino_event_id_t event) {
+    std::vector<WiFiEventFuncCb> handlers;
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        for (const auto& entry : mHandlers) {
+            handlers.push_back(entry.second);
+        }
+    }
+    if (mDeliveryDelayMs > 0) {
+        delay(mDeliveryDelayMs);
+    }
+    for (const auto& handler : handlers) {
+        handler(event, arduino_event_info_t{});
+    }
+}
@@ -0,0 +1,155 @@
+/**
+ * Host mock of the Arduino ESP32 Wi-Fi station. Connections succeed after
+ * a short delay if the access point is available, the events are delivered
+ * to the handlers by an event thread, like the Arduino event task.
+ */
+#ifndef UPT_MQTT_MOCK_WIFI_H
+#define UPT_MQTT_MOCK_WIFI_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_READY = 0,
+    ARDUINO_EVENT_WIFI_STA_START = 2,
+    ARDUINO_EVENT_WIFI_STA_STOP,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_AUTHMODE_CHANGE,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP6,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP,
+    ARDUINO_EVENT_MAX = 48,
+} arduino_event_id_t;
+
+typedef struct {
+    int unused;
+} arduino_event_info_t;
+
+typedef size_t wifi_event_id_t;
+typedef std::function<void(arduino_event_id_t event, arduino_event_info_t info)>
+    WiFiEventFuncCb;
+
+class IPAddress {
+  public:
+    IPAddress() = default;
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : mAddress{static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 |
+                   static_cast<uint32_t>(c) << 16 |
+                   static_cast<uint32_t>(d) << 24} {
+    }
+    explicit IPAddress(uint32_t address) : mAddress{address} {
+    }
+
+    operator uint32_t() const {
+        return mAddress;
+    }
+
+    std::string toString() const;
+
+  private:
+    uint32_t mAddress = 0;
+};
+
+class WiFiClass {
+  public:
+    WiFiClass() = default;
+    ~WiFiClass();
+
+    int begin(const char* ssid, const char* passphrase);
+    bool isConnected();
+    bool reconnect();
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    bool setAutoReconnect(bool autoReconnect);
+    bool getAutoReconnect();
+
+    wifi_event_id_t onEvent(WiFiEventFuncCb callback,
+                            arduino_event_id_t event = ARDUINO_EVENT_MAX);
+    void removeEvent(wifi_event_id_t id);
+
+    /**
+     * Resolves the host names registered with mockAddHost, blocking the
+     * caller for the configured resolution delay
+     *
+     * @return 1 on success, 0 if the name is unknown
+     */
+    int hostByName(const char* host, IPAddress& result);
+
+    /*
+     * Mock controls
+     */
+
+    // Connection attempts fail while the access point is unavailable
+    void mockSetAccessPointAvailable(bool available);
+    void mockSetConnectDelayMs(uint32_t delayMs);
+    // Connected at once, e.g. by an application managing the Wi-Fi itself
+    void mockConnect();
+    // The access point went away, the station is disconnected
+    void mockLoseConnection();
+    // Delivers an event to the handlers, without changing the state
+    void mockEmit(arduino_event_id_t event);
+    // The handlers are called this long after being looked up, also when
+    // removed meanwhile
+    void mockSetDeliveryDelayMs(uint32_t delayMs);
+    void mockAddHost(const std::string& host, IPAddress address);
+    void mockSetResolveDelayMs(uint32_t delayMs);
+    // Back to a disconnected station without handlers nor hosts
+    void mockReset();
+    // Waits until the pending events are delivered
+    void mockFlushEvents();
+
+    size_t mockBeginCount() const {
+        return mBeginCount;
+    }
+    size_t mockReconnectCount() const {
+        return mReconnectCount;
+    }
+    size_t mockResolveCount() const {
+        return mResolveCount;
+    }
+    size_t mockHandlerCount();
+
+  private:
+    struct PendingEvent {
+        uint64_t dueUs;
+        arduino_event_id_t event;
+        // Connection attempt, the outcome is decided when due
+        bool attempt;
+    };
+
+    void schedule(arduino_event_id_t event, uint32_t delayMs, bool attempt);
+    void eventLoop();
+    void deliver(arduino_event_id_t event);
+
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+    std::deque<PendingEvent> mPending;
+    bool mDelivering = false;
+    std::thread mEventThread;
+    bool mStopping = false;
+
+    std::map<wifi_event_id_t, WiFiEventFuncCb> mHandlers;
+    wifi_event_id_t mNextHandlerId = 1;
+    std::map<std::string, IPAddress> mHosts;
+
+    std::atomic<bool> mConnected{false};
+    std::atomic<bool> mAccessPointAvailable{true};
+    std::atomic<bool> mAutoReconnect{true};
+    std::atomic<uint32_t> mConnectDelayMs{5};
+    std::atomic<uint32_t> mResolveDelayMs{0};
+    std::atomic<uint32_t> mDeliveryDelayMs{0};
+    std::atomic<size_t> mBeginCount{0};
+    std::atomic<size_t> mReconnectCount{0};
+    std::atomic<size_t> mResolveCount{0};
+};
+
+extern WiFiClass WiFi;
+
+#endif /* UPT_MQTT_MOCK_WIFI_H */
@@ -0,0 +1,33 @@
+/**
+ * Log macros of ESP-IDF, printed to stderr if the environment variable
+ * UPT_MQTT_LOG is set to the maximum level: E, W, I, D or V
+ */
+#ifndef UPT_MQTT_MOCK_ESP_LOG_H
+#define UPT_MQTT_MOCK_ESP_LOG_H
+
+#include <cstdio>
+
+namespace mock {
+bool logEnabled(char level);
+}
+
+#define UPT_MQTT_MOCK_LOG(level, tag, format, ...)                             \
+    do {                                                                       \
+        if (mock::logEnabled(level)) {                                         \
+            fprintf(stderr, "%c (%s) " format "\n", level, tag,                \
+                    ##__VA_ARGS__);                                            \
+        }                                                                      \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...)                                             \
+    UPT_MQTT_MOCK_LOG('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)                                             \
+    UPT_MQTT_MOCK_LOG('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)                                             \
+    UPT_MQTT_MOCK_LOG('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)                                             \
+    UPT_MQTT_MOCK_LOG('D', tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)                                             \
+    UPT_MQTT_MOCK_LOG('V', tag, format, ##__VA_ARGS__)
+
+#endif /* UPT_MQTT_MOCK_ESP_LOG_H */
@@ -0,0 +1,11 @@
+#ifndef UPT_MQTT_MOCK_ESP_TIMER_H
+#define UPT_MQTT_MOCK_ESP_TIMER_H
+
+#include <cstdint>
+
+/**
+ * Microseconds since the start of the process
+ */
+int64_t esp_timer_get_time();
+
+#endif /* UPT_MQTT_MOCK_ESP_TIMER_H */
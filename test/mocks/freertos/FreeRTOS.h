@@ -0,0 +1,42 @@
+/**
+ * Host mock of the FreeRTOS kernel of the ESP32, see FreeRTOS.cpp. Tasks are
+ * threads, queues, semaphores and event groups are built on std::mutex and
+ * std::condition_variable. One tick is one millisecond.
+ */
+#ifndef UPT_MQTT_MOCK_FREERTOS_H
+#define UPT_MQTT_MOCK_FREERTOS_H
+
+#include <cstddef>
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY 0
+#define configMAX_PRIORITIES 25
+
+// Spinlock of the ESP32 port, recursive for the owning thread
+typedef struct {
+    volatile uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+
+TickType_t xTaskGetTickCount();
+
+#endif /* UPT_MQTT_MOCK_FREERTOS_H */
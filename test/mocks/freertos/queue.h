@@ -0,0 +1,24 @@
+#ifndef UPT_MQTT_MOCK_FREERTOS_QUEUE_H
+#define UPT_MQTT_MOCK_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef struct QueueDefinition* QueueHandle_t;
+
+// The storage is allocated by xQueueCreate, sending and receiving do not
+// allocate
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item,
+                            TickType_t wait);
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item,
+                             TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#define xQueueSend(queue, item, wait) xQueueSendToBack(queue, item, wait)
+
+#endif /* UPT_MQTT_MOCK_FREERTOS_QUEUE_H */
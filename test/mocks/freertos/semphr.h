@@ -0,0 +1,19 @@
+#ifndef UPT_MQTT_MOCK_FREERTOS_SEMPHR_H
+#define UPT_MQTT_MOCK_FREERTOS_SEMPHR_H
+
+#include "queue.h"
+
+// Like in FreeRTOS, semaphores are queues of items without data
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount,
+                                           UBaseType_t initialCount);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore);
+
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+#endif /* UPT_MQTT_MOCK_FREERTOS_SEMPHR_H */
@@ -0,0 +1,29 @@
+#ifndef UPT_MQTT_MOCK_FREERTOS_TASK_H
+#define UPT_MQTT_MOCK_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name,
+                       uint32_t stackDepth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* createdTask);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name,
+                                   uint32_t stackDepth, void* parameters,
+                                   UBaseType_t priority,
+                                   TaskHandle_t* createdTask, BaseType_t core);
+
+/**
+ * Deleting the calling task (nullptr) must be its last statement: the thread
+ * returns from the task function afterwards. Another task cannot be stopped,
+ * its thread is abandoned and reported by mock::abandonedTaskCount().
+ */
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t wait);
+
+#endif /* UPT_MQTT_MOCK_FREERTOS_TASK_H */
@@ -0,0 +1,23 @@
+/**
+ * Host mock of the DNS client of lwIP: names registered with
+ * WiFi.mockAddHost resolve after the delay of WiFi.mockSetResolveDelayMs,
+ * the answer comes from a thread of the mock like from the tcpip thread.
+ */
+#ifndef UPT_MQTT_MOCK_LWIP_DNS_H
+#define UPT_MQTT_MOCK_LWIP_DNS_H
+
+#include "err.h"
+#include "ip_addr.h"
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr,
+                                   void* callback_arg);
+
+/**
+ * Always answers later through found, with nullptr if the name is unknown
+ *
+ * @return ERR_INPROGRESS
+ */
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr,
+                        dns_found_callback found, void* callback_arg);
+
+#endif /* UPT_MQTT_MOCK_LWIP_DNS_H */
@@ -0,0 +1,16 @@
+/**
+ * Host mock of the error codes of lwIP
+ */
+#ifndef UPT_MQTT_MOCK_LWIP_ERR_H
+#define UPT_MQTT_MOCK_LWIP_ERR_H
+
+#include <cstdint>
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_MEM -1
+#define ERR_INPROGRESS -5
+#define ERR_VAL -6
+#define ERR_ARG -16
+
+#endif /* UPT_MQTT_MOCK_LWIP_ERR_H */
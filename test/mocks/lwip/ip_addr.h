@@ -0,0 +1,23 @@
+/**
+ * Host mock of the IP addresses of lwIP, IPv4 only
+ */
+#ifndef UPT_MQTT_MOCK_LWIP_IP_ADDR_H
+#define UPT_MQTT_MOCK_LWIP_IP_ADDR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define IPADDR_TYPE_V4 0U
+#define IPADDR_TYPE_V6 6U
+
+typedef struct ip_addr {
+    // In network byte order, like IPAddress
+    uint32_t addr;
+    uint8_t type;
+} ip_addr_t;
+
+#define IP_IS_V4(ipaddr) ((ipaddr)->type == IPADDR_TYPE_V4)
+
+char* ipaddr_ntoa_r(const ip_addr_t* addr, char* buf, int buflen);
+
+#endif /* UPT_MQTT_MOCK_LWIP_IP_ADDR_H */
@@ -0,0 +1,16 @@
+/**
+ * Host mock of the tcpip thread of lwIP
+ */
+#ifndef UPT_MQTT_MOCK_LWIP_TCPIP_H
+#define UPT_MQTT_MOCK_LWIP_TCPIP_H
+
+#include "err.h"
+
+typedef void (*tcpip_callback_fn)(void* ctx);
+
+/**
+ * Runs function in the thread of the mock standing for the tcpip thread
+ */
+err_t tcpip_callback(tcpip_callback_fn function, void* ctx);
+
+#endif /* UPT_MQTT_MOCK_LWIP_TCPIP_H */
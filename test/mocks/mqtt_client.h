@@ -0,0 +1,159 @@
+/**
+ * Host mock of the ESP-IDF 4.4 MQTT client (MQTT 3.1.1), connected to the
+ * in-process brokers of MockBroker.h. Like the ESP MQTT task, a thread per
+ * client connects and dispatches the events to the registered handler.
+ */
+#ifndef UPT_MQTT_MOCK_MQTT_CLIENT_H
+#define UPT_MQTT_MOCK_MQTT_CLIENT_H
+
+#include <cstddef>
+#include <cstdint>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef const char* esp_event_base_t;
+#define ESP_EVENT_ANY_ID -1
+typedef void (*esp_event_handler_t)(void* event_handler_arg,
+                                    esp_event_base_t event_base,
+                                    int32_t event_id, void* event_data);
+
+typedef struct esp_mqtt_client* esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef enum {
+    MQTT_ERROR_TYPE_NONE = 0,
+    MQTT_ERROR_TYPE_TCP_TRANSPORT,
+    MQTT_ERROR_TYPE_CONNECTION_REFUSED,
+} esp_mqtt_error_type_t;
+
+typedef struct esp_mqtt_error_codes {
+    esp_err_t esp_tls_last_esp_err;
+    int esp_tls_stack_err;
+    int esp_tls_cert_verify_flags;
+    esp_mqtt_error_type_t error_type;
+    int connect_return_code;
+    int esp_transport_sock_errno;
+} esp_mqtt_error_codes_t;
+
+typedef struct esp_mqtt_event_t {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    void* user_context;
+    char* data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    char* topic;
+    int topic_len;
+    int msg_id;
+    int session_present;
+    esp_mqtt_error_codes_t* error_handle;
+    bool retain;
+    int qos;
+    bool dup;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
+
+typedef enum {
+    MQTT_TRANSPORT_UNKNOWN = 0,
+    MQTT_TRANSPORT_OVER_TCP,
+    MQTT_TRANSPORT_OVER_SSL,
+    MQTT_TRANSPORT_OVER_WS,
+    MQTT_TRANSPORT_OVER_WSS,
+} esp_mqtt_transport_t;
+
+typedef enum {
+    MQTT_PROTOCOL_UNDEFINED = 0,
+    MQTT_PROTOCOL_V_3_1,
+    MQTT_PROTOCOL_V_3_1_1,
+} esp_mqtt_protocol_ver_t;
+
+// Same members in the same order as ESP-IDF 4.4, the mock only reads uri,
+// lwt_topic, lwt_msg, lwt_qos, lwt_retain, disable_auto_reconnect,
+// buffer_size, cert_pem and reconnect_timeout_ms
+typedef struct {
+    void* event_handle;
+    void* event_loop_handle;
+    const char* host;
+    const char* uri;
+    uint32_t port;
+    bool set_null_client_id;
+    const char* client_id;
+    const char* username;
+    const char* password;
+    const char* lwt_topic;
+    const char* lwt_msg;
+    int lwt_qos;
+    int lwt_retain;
+    int lwt_msg_len;
+    int disable_clean_session;
+    int keepalive;
+    bool disable_auto_reconnect;
+    void* user_context;
+    int task_prio;
+    int task_stack;
+    int buffer_size;
+    const char* cert_pem;
+    size_t cert_len;
+    const char* client_cert_pem;
+    size_t client_cert_len;
+    const char* client_key_pem;
+    size_t client_key_len;
+    esp_mqtt_transport_t transport;
+    int refresh_connection_after_ms;
+    const void* psk_hint_key;
+    bool use_global_ca_store;
+    void* crt_bundle_attach;
+    int reconnect_timeout_ms;
+    const char** alpn_protos;
+    const char* clientkey_password;
+    int clientkey_password_len;
+    esp_mqtt_protocol_ver_t protocol_ver;
+    int out_buffer_size;
+    bool skip_cert_common_name_check;
+    bool use_secure_element;
+    void* ds_data;
+    int network_timeout_ms;
+    bool disable_keepalive;
+    const char* path;
+    int message_retransmit_timeout;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t
+esp_mqtt_client_init(const esp_mqtt_client_config_t* config);
+esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client,
+                                  const char* uri);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client,
+                              const char* topic, int qos);
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client,
+                                const char* topic);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client,
+                            const char* topic, const char* data, int len,
+                            int qos, int retain);
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler,
+                                         void* event_handler_arg);
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
+
+#endif /* UPT_MQTT_MOCK_MQTT_CLIENT_H */
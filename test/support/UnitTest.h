@@ -0,0 +1,139 @@
+/**
+ * Minimal subset of the CppUTest API used by the host tests, so that they
+ * build without dependencies. A test file defines its groups and tests and
+ * is linked with UnitTestMain.cpp:
+ *
+ *     TEST_GROUP(TopicFilterTrie) {
+ *         void setup() {}
+ *         void teardown() {}
+ *     };
+ *
+ *     TEST(TopicFilterTrie, matchesWildcards) {
+ *         CHECK(...);
+ *     }
+ */
+#ifndef UPT_MQTT_UNIT_TEST_H
+#define UPT_MQTT_UNIT_TEST_H
+
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace unittest {
+
+class Test {
+  public:
+    virtual ~Test() = default;
+    virtual void setup() {
+    }
+    virtual void teardown() {
+    }
+    virtual void testBody() = 0;
+};
+
+struct TestRegistration {
+    TestRegistration(const char* group, const char* name,
+                     Test* (*factory)());
+};
+
+/**
+ * Records a failure of the running test and ends it
+ */
+[[noreturn]] void fail(const char* file, int line, const std::string& message);
+
+template <typename T> std::string describe(const T& value) {
+    std::ostringstream stream;
+    stream << value;
+    return stream.str();
+}
+
+inline std::string describe(const char* value) {
+    return value == nullptr ? "(null)" : std::string{"\""} + value + "\"";
+}
+
+inline std::string describe(const std::string& value) {
+    return "\"" + value + "\"";
+}
+
+inline std::string describe(bool value) {
+    return value ? "true" : "false";
+}
+
+inline std::string describe(std::nullptr_t) {
+    return "nullptr";
+}
+
+template <typename Expected, typename Actual>
+void checkEqual(const Expected& expected, const Actual& actual,
+                const char* text, const char* file, int line) {
+    if (!(expected == actual)) {
+        fail(file, line,
+             std::string{text} + "\n\texpected <" + describe(expected) +
+                 ">\n\tbut was  <" + describe(actual) + ">");
+    }
+}
+
+}  // namespace unittest
+
+#define TEST_GROUP(group) struct TEST_GROUP_##group : public unittest::Test
+
+#define TEST(group, name)                                                      \
+    struct TEST_##group##_##name : public TEST_GROUP_##group {                 \
+        void testBody() override;                                              \
+    };                                                                         \
+    static unittest::TestRegistration TEST_REGISTRATION_##group##_##name{      \
+        #group, #name,                                                         \
+        []() -> unittest::Test* { return new TEST_##group##_##name; }};        \
+    void TEST_##group##_##name::testBody()
+
+#define FAIL(text) unittest::fail(__FILE__, __LINE__, text)
+
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            unittest::fail(__FILE__, __LINE__, "CHECK(" #condition ")");       \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_TEXT(condition, text)                                            \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            unittest::fail(__FILE__, __LINE__,                                 \
+                           std::string{"CHECK(" #condition ") "} + (text));    \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_TRUE(condition) CHECK(condition)
+#define CHECK_FALSE(condition) CHECK(!(condition))
+
+#define CHECK_EQUAL(expected, actual)                                          \
+    unittest::checkEqual((expected), (actual),                                 \
+                         "CHECK_EQUAL(" #expected ", " #actual ")", __FILE__,  \
+                         __LINE__)
+
+#define LONGS_EQUAL(expected, actual)                                          \
+    unittest::checkEqual(static_cast<long long>(expected),                     \
+                         static_cast<long long>(actual),                       \
+                         "LONGS_EQUAL(" #expected ", " #actual ")", __FILE__,  \
+                         __LINE__)
+
+#define STRCMP_EQUAL(expected, actual)                                         \
+    unittest::checkEqual(std::string{expected}, std::string{actual},           \
+                         "STRCMP_EQUAL(" #expected ", " #actual ")", __FILE__, \
+                         __LINE__)
+
+#define DOUBLES_EQUAL(expected, actual, tolerance)                             \
+    do {                                                                       \
+        const double e_ = (expected);                                          \
+        const double a_ = (actual);                                            \
+        if (!(std::fabs(e_ - a_) <= (tolerance))) {                            \
+            unittest::fail(__FILE__, __LINE__,                                 \
+                           "DOUBLES_EQUAL(" #expected ", " #actual             \
+                           ")\n\texpected <" +                                 \
+                               unittest::describe(e_) + ">\n\tbut was  <" +    \
+                               unittest::describe(a_) + ">");                  \
+        }                                                                      \
+    } while (0)
+
+#endif /* UPT_MQTT_UNIT_TEST_H */
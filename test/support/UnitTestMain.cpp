@@ -0,0 +1,74 @@
+/**
+ * Runs the tests registered by a test file, in registration order. A test
+ * ends at its first failed check, its teardown() still runs. The optional
+ * argument selects the tests whose "group.name" contains it.
+ *
+ * @return the number of failed tests
+ */
+#include "UnitTest.h"
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace unittest {
+
+namespace {
+
+struct Failure {};
+
+struct Entry {
+    const char* group;
+    const char* name;
+    Test* (*factory)();
+};
+
+std::vector<Entry>& registry() {
+    static std::vector<Entry> entries;
+    return entries;
+}
+
+}  // namespace
+
+TestRegistration::TestRegistration(const char* group, const char* name,
+                                   Test* (*factory)()) {
+    registry().push_back(Entry{group, name, factory});
+}
+
+void fail(const char* file, int line, const std::string& message) {
+    std::fprintf(stderr, "%s:%d: error: %s\n", file, line, message.c_str());
+    throw Failure{};
+}
+
+}  // namespace unittest
+
+int main(int argc, char** argv) {
+    const std::string filter = argc > 1 ? argv[1] : "";
+    int run = 0;
+    int failed = 0;
+    for (const auto& entry : unittest::registry()) {
+        const std::string fullName =
+            std::string{entry.group} + "." + entry.name;
+        if (fullName.find(filter) == std::string::npos) {
+            continue;
+        }
+        run++;
+        std::unique_ptr<unittest::Test> test{entry.factory()};
+        bool passed = true;
+        try {
+            test->setup();
+            test->testBody();
+        } catch (const unittest::Failure&) {
+            passed = false;
+        }
+        try {
+            test->teardown();
+        } catch (const unittest::Failure&) {
+            passed = false;
+        }
+        std::printf("%s %s\n", passed ? "PASS" : "FAIL", fullName.c_str());
+        std::fflush(stdout);
+        failed += passed ? 0 : 1;
+    }
+    std::printf("\n%d tests, %d failures\n", run, failed);
+    return failed;
+}